@@ -157,3 +157,13 @@ void DateBuffer::InexactUpdate()
         this->Update(0);
     }
 }
+
+void DateBuffer::SecondUpdate()
+{
+    SInt64 theCurTime = OS::CachedMilliseconds();
+    if ((fLastDateUpdate == 0) || ((fLastDateUpdate / 1000) != (theCurTime / 1000)))
+    {
+        fLastDateUpdate = theCurTime;
+        this->Update(theCurTime);
+    }
+}
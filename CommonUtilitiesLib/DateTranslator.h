@@ -89,6 +89,10 @@ public:
     // Updates this date buffer to reflect the current time, with a certain degree
     // of inexactitude (the range of error is defined by the kUpdateInterval value)
     void InexactUpdate();
+
+    // Same as above, but the date is rebuilt whenever the second changes, so it is
+    // never more than a second old. Meant for Date headers in responses.
+    void SecondUpdate();
     
     //returns a NULL terminated C-string always of kHTTPDateLen length.
     char *GetDateBuffer()   { return fDateBuffer; }
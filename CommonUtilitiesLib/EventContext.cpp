@@ -94,7 +94,11 @@ void EventContext::Cleanup()
  //           select_removeevent(fFileDesc);//The eventqueue / select shim requires this
         
         #if defined(__linux__)
-            deleteEpollEvent(fFileDesc);
+            //The fd is owned by this thread's epoll instance. Once it has been
+            //removed from there (and from the ref table above) nothing can
+            //hand it out again, so it is safe to close it right away.
+            deleteEpollEvent(fEventThread->fEpollFD, fFileDesc);
+            err = ::close(fFileDesc);
         #else
             select_removeevent(fFileDesc);//The eventqueue / select shim requires this
         #endif           
@@ -144,6 +148,9 @@ void EventContext::SnarfEventContext( EventContext &fromContext )
     
     fromContext.fFileDesc = kInvalidFileDesc;
     
+    // the fd stays registered with the event thread (and epoll instance) it was
+    // first armed on, so take over that thread along with the registration
+    fEventThread = fromContext.fEventThread;
     fWatchEventCalled = fromContext.fWatchEventCalled; 
     fUniqueID = fromContext.fUniqueID;
     fUniqueIDStr.Set((char*)&fUniqueID, sizeof(fUniqueID)),
@@ -173,7 +180,7 @@ void EventContext::RequestEvent(int theMask)
         if (modwatch(&fEventReq, theMask) != 0)
 #else
         #if defined(__linux__)
-           if (addEpollEvent(&fEventReq, theMask) != 0)
+           if (addEpollEvent(fEventThread->fEpollFD, &fEventReq, theMask, true) != 0)
         #else
            if(select_modwatch(&fEventReq, theMask) != 0)
         #endif
@@ -216,7 +223,7 @@ void EventContext::RequestEvent(int theMask)
         if (watchevent(&fEventReq, theMask) != 0)
 #else
         #if defined(__linux__)
-           if (addEpollEvent(&fEventReq, theMask) != 0)
+           if (addEpollEvent(fEventThread->fEpollFD, &fEventReq, theMask, false) != 0)
         #else
            if(select_modwatch(&fEventReq, theMask) != 0)
         #endif
@@ -227,6 +234,54 @@ void EventContext::RequestEvent(int theMask)
     }
 }
 
+EventThread::EventThread()
+:   OSThread()
+{
+#if defined(__linux__) && !MACOSXEVENTQUEUE
+    fEpollFD = epollCreate();
+#endif
+}
+
+EventThread::~EventThread()
+{
+#if defined(__linux__) && !MACOSXEVENTQUEUE
+    epollDestory(fEpollFD);
+#endif
+}
+
+#if defined(__linux__) && !MACOSXEVENTQUEUE
+void EventThread::Entry()
+{
+    while (true)
+    {
+        int theNumEvents = epollWaitEvents(fEpollFD, fEpollEvents, kMaxEventsPerWait, kWaitTimeoutInMilSecs);
+        AssertV(theNumEvents >= 0, OSThread::GetErrno());
+
+        for (int theIndex = 0; theIndex < theNumEvents; theIndex++)
+        {
+            //The cookie in this event is an ObjectID. Resolve it through our own
+            //ref table: the context may be torn down by a task thread while its
+            //event is still sitting in this batch, and Resolve / UnRegister are
+            //what keep that safe.
+            void* theCookie = fEpollEvents[theIndex].data.ptr;
+            if (theCookie == NULL)
+                continue;
+                
+            StrPtrLen idStr((char*)&theCookie, sizeof(theCookie));
+            OSRef* ref = fRefTable.Resolve(&idStr);
+            if (ref != NULL)
+            {
+                EventContext* theContext = (EventContext*)ref->GetObject();
+#if DEBUG
+                theContext->fModwatched = false;
+#endif
+                theContext->ProcessEvent(epollEventBits(fEpollEvents[theIndex]));
+                fRefTable.Release(ref);   
+            }
+        }
+    }
+}
+#else
 void EventThread::Entry()
 {
     struct eventreq theCurrentEvent;
@@ -241,11 +296,7 @@ void EventThread::Entry()
             int theReturnValue = waitevent(&theCurrentEvent, NULL);
 #else
             
-            #if defined(__linux__)
-            int theReturnValue = epoll_waitevent(&theCurrentEvent, NULL);
-            #else
             int theReturnValue = select_waitevent(&theCurrentEvent, NULL);            
-            #endif
 #endif  
             //Sort of a hack. In the POSIX version of the server, waitevent can return
             //an actual POSIX errorcode.
@@ -279,11 +330,7 @@ void EventThread::Entry()
         SInt64  yieldStart = OS::Milliseconds();
 #endif
 
-    #if 0//defined(__linux__)
-
-    #else
         this->ThreadYield();
-    #endif
     
 #if EVENT_CONTEXT_DEBUG
         SInt64  yieldDur = OS::Milliseconds() - yieldStart;
@@ -299,3 +346,4 @@ void EventThread::Entry()
 #endif
     }
 }
+#endif
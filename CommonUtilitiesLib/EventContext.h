@@ -167,13 +167,26 @@ class EventThread : public OSThread
 {
     public:
     
-        EventThread() : OSThread() {}
-        virtual ~EventThread() {}
+        EventThread();
+        virtual ~EventThread();
     
     private:
     
         virtual void Entry();
         OSRefTable      fRefTable;
+
+#if defined(__linux__) && !MACOSXEVENTQUEUE
+        enum
+        {
+            kMaxEventsPerWait = 1024,   //UInt32
+            kWaitTimeoutInMilSecs = 15000 //UInt32
+        };
+
+        // Each event thread has its own epoll instance, and a whole batch
+        // of ready events is dispatched per epoll_wait.
+        int                 fEpollFD;
+        struct epoll_event  fEpollEvents[kMaxEventsPerWait];
+#endif
         
         friend class EventContext;
 };
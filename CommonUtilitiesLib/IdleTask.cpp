@@ -44,56 +44,57 @@ IdleTaskThread*     IdleTask::sIdleThread = NULL;
 
 void IdleTaskThread::SetIdleTimer(IdleTask *activeObj, SInt64 msec)
 {
-    //note: OSHeap doesn't support a random remove, so this function
-    //won't change the timeout value if there is already one set
-    if (activeObj->fIdleElem.IsMemberOfAnyHeap())
+    //note: this function won't change the timeout value if there is already
+    //one set, callers rely on the first timeout winning
+    if (activeObj->fIdleElem.IsMemberOfAnyWheel())
         return;
     activeObj->fIdleElem.SetValue(OS::Milliseconds() + msec);
     
     {
-        OSMutexLocker locker(&fHeapMutex);
-        fIdleHeap.Insert(&activeObj->fIdleElem);
+        OSMutexLocker locker(&fWheelMutex);
+        fIdleWheel.Insert(&activeObj->fIdleElem);
     }
-    fHeapCond.Signal();
+    fWheelCond.Signal();
 }
 
 void IdleTaskThread::CancelTimeout(IdleTask* idleObj)
 {
     Assert(idleObj != NULL);
-    OSMutexLocker locker(&fHeapMutex);
-    fIdleHeap.Remove(&idleObj->fIdleElem);  
+    OSMutexLocker locker(&fWheelMutex);
+    fIdleWheel.Remove(&idleObj->fIdleElem);  
 }
 
 void
 IdleTaskThread::Entry()
 {
-    OSMutexLocker locker(&fHeapMutex);
+    OSMutexLocker locker(&fWheelMutex);
     
     while (true)
     {
         //if there are no events to process, block.
-        if (fIdleHeap.CurrentHeapSize() == 0)
-            fHeapCond.Wait(&fHeapMutex);
+        if (fIdleWheel.GetNumElems() == 0)
+            fWheelCond.Wait(&fWheelMutex);
         SInt64 msec = OS::Milliseconds();
         
-        //pop elements out of the heap as long as their timeout time has arrived
-        while ((fIdleHeap.CurrentHeapSize() > 0) && (fIdleHeap.PeekMin()->GetValue() <= msec))
+        //pop elements out of the wheel as long as their timeout time has arrived
+        OSTimerWheelElem* theTimerElem = NULL;
+        while ((theTimerElem = fIdleWheel.ExtractExpired(msec)) != NULL)
         {
-            IdleTask* elem = (IdleTask*)fIdleHeap.ExtractMin()->GetEnclosingObject();
+            IdleTask* elem = (IdleTask*)theTimerElem->GetEnclosingObject();
             Assert(elem != NULL);
             elem->Signal(Task::kIdleEvent);
         }
                         
-        //we are done sending idle events. If there is a lowest tick count, then
+        //we are done sending idle events. If there is a next expiration, then
         //we need to sleep until that time.
-        if (fIdleHeap.CurrentHeapSize() > 0)
+        if (fIdleWheel.GetNumElems() > 0)
         {
-            SInt64 timeoutTime = fIdleHeap.PeekMin()->GetValue();
+            SInt64 timeoutTime = fIdleWheel.GetNextExpiration();
             //because sleep takes a 32 bit number
             timeoutTime -= msec;
             Assert(timeoutTime > 0);
             UInt32 smallTime = (UInt32)timeoutTime;
-            fHeapCond.Wait(&fHeapMutex, smallTime);
+            fWheelCond.Wait(&fWheelMutex, smallTime);
         }
     }   
 }
@@ -112,11 +113,11 @@ IdleTask::~IdleTask()
     //clean up stuff used by idle thread routines
     Assert(sIdleThread != NULL);
     
-    OSMutexLocker locker(&sIdleThread->fHeapMutex);
+    OSMutexLocker locker(&sIdleThread->fWheelMutex);
 
     //Check to see if there is a pending timeout. If so, get this object
-    //out of the heap
-    if (fIdleElem.IsMemberOfAnyHeap())
+    //out of the wheel
+    if (fIdleElem.IsMemberOfAnyWheel())
         sIdleThread->CancelTimeout(this);
 }
 
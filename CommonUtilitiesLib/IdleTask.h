@@ -42,7 +42,7 @@
 #include "Task.h"
 
 #include "OSThread.h"
-#include "OSHeap.h"
+#include "OSTimerWheel.h"
 #include "OSMutex.h"
 #include "OSCond.h"
 
@@ -53,16 +53,16 @@ class IdleTaskThread : private OSThread
 {
 private:
 
-    IdleTaskThread() : OSThread(), fHeapMutex() {}
-    virtual ~IdleTaskThread() { Assert(fIdleHeap.CurrentHeapSize() == 0); }
+    IdleTaskThread() : OSThread(), fWheelMutex() {}
+    virtual ~IdleTaskThread() { Assert(fIdleWheel.GetNumElems() == 0); }
 
     void SetIdleTimer(IdleTask *idleObj, SInt64 msec);
     void CancelTimeout(IdleTask *idleObj);
     
     virtual void Entry();
-    OSHeap  fIdleHeap;
-    OSMutex fHeapMutex;
-    OSCond  fHeapCond;
+    OSTimerWheel    fIdleWheel;
+    OSMutex         fWheelMutex;
+    OSCond          fWheelCond;
     friend class IdleTask;
 };
 
@@ -93,12 +93,11 @@ public:
     //CancelTimeout
     //If there is a pending timeout for this object, this function cancels it.
     //If there is no pending timeout, this function does nothing.
-    //Currently not supported because OSHeap doesn't support random remove
     void CancelTimeout() { sIdleThread->CancelTimeout(this); }
 
 private:
 
-    OSHeapElem fIdleElem;
+    OSTimerWheelElem fIdleElem;
 
     //there is only one idle thread shared by all idle tasks.
     static IdleTaskThread*  sIdleThread;    
@@ -46,6 +46,10 @@
 #include <sys/time.h>
 #endif
 
+#if __linux__
+#include <time.h>
+#endif
+
 #ifdef __sgi__ 
 #include <unistd.h>
 #endif
@@ -77,6 +81,10 @@
 	#include <sys/systeminfo.h>
 #endif
 
+#if OS_VECTOR_CODE && defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
 
 double  OS::sDivisor = 0;
 double  OS::sMicroDivisor = 0;
@@ -86,6 +94,7 @@ SInt64  OS::sInitialMsec = 0;
 SInt64  OS::sWrapTime = 0;
 SInt64  OS::sCompareWrap = 0;
 SInt64  OS::sLastTimeMilli = 0;
+Bool16  OS::sUseCoarseClock = false;
 OSMutex OS::sStdLibOSMutex;
 
 #if DEBUG || __Win32__
@@ -115,6 +124,14 @@ void OS::Initialize()
     sMsecSince1970 = ::time(NULL);  // POSIX time always returns seconds since 1970
     sMsecSince1970 *= 1000;         // Convert to msec
     
+#if __linux__ && defined(CLOCK_REALTIME_COARSE)
+    //The coarse clock ticks once per jiffy. On kernels built with a low HZ
+    //that is too stale to stand in for Milliseconds, so don't use it there.
+    struct timespec theRes;
+    if ((::clock_getres(CLOCK_REALTIME_COARSE, &theRes) == 0) && (theRes.tv_sec == 0) && (theRes.tv_nsec <= kMaxCoarseClockResInNanoSecs))
+        sUseCoarseClock = true;
+#endif
+
 
 #if DEBUG || __Win32__ 
     sLastMillisMutex = NEW OSMutex();
@@ -179,6 +196,27 @@ SInt64 OS::Milliseconds()
 
 }
 
+SInt64 OS::CachedMilliseconds()
+{
+#if __linux__ && defined(CLOCK_REALTIME_COARSE)
+    //CLOCK_REALTIME_COARSE is served from the vDSO without reading the TSC,
+    //it only returns the time of the last timer tick.
+    if (sUseCoarseClock)
+    {
+        struct timespec t;
+        (void)::clock_gettime(CLOCK_REALTIME_COARSE, &t);
+
+        SInt64 curTime;
+        curTime = t.tv_sec;
+        curTime *= 1000;                        // sec -> msec
+        curTime += t.tv_nsec / 1000000;         // nsec -> msec
+
+        return (curTime - sInitialMsec) + sMsecSince1970;
+    }
+#endif
+    return OS::Milliseconds();
+}
+
 SInt64 OS::Microseconds()
 {
 /*
@@ -454,6 +492,34 @@ UInt32  OS::GetNumProcessors()
     return 1;
 }
 
+UInt32  OS::GetVectorLevel()
+{
+#if OS_VECTOR_CODE && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return kVectorAVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return kVectorSSE2;
+#elif OS_VECTOR_CODE
+    int theInfo[4];
+    __cpuid(theInfo, 0);
+    int theMaxLeaf = theInfo[0];
+    __cpuid(theInfo, 1);
+    Bool16 hasSSE2 = (theInfo[3] & (1 << 26)) != 0;
+    // AVX2 also needs the OS to save the YMM registers
+    Bool16 hasOSAVX = ((theInfo[2] & (1 << 27)) != 0) && ((theInfo[2] & (1 << 28)) != 0) && ((_xgetbv(0) & 6) == 6);
+    if (hasOSAVX && (theMaxLeaf >= 7))
+    {
+        __cpuidex(theInfo, 7, 0);
+        if (theInfo[1] & (1 << 5))
+            return kVectorAVX2;
+    }
+    if (hasSSE2)
+        return kVectorSSE2;
+#endif
+    return kVectorNone;
+}
+
 
 //CISCO provided fix for integer + fractional fixed64.
 SInt64 OS::TimeMilli_To_Fixed64Secs(SInt64 inMilliseconds)
@@ -468,3 +534,42 @@ SInt64 OS::TimeMilli_To_Fixed64Secs(SInt64 inMilliseconds)
        result |= frac;
        return result;
 }
+
+#if OSTESTING
+
+void OS::Benchmark(UInt32 inNumCalls)
+{
+    if (inNumCalls == 0)
+        return;
+        
+    SInt64 theStart = OS::Microseconds();
+    for (UInt32 x = 0; x < inNumCalls; x++)
+        (void)OS::Milliseconds();
+    SInt64 thePreciseTime = OS::Microseconds() - theStart;
+    
+    theStart = OS::Microseconds();
+    for (UInt32 x = 0; x < inNumCalls; x++)
+        (void)OS::CachedMilliseconds();
+    SInt64 theCachedTime = OS::Microseconds() - theStart;
+    
+    // The lag, sampled every 1000 calls so that the precise clock doesn't dominate
+    SInt64 theMinLag = 0;
+    SInt64 theMaxLag = 0;
+    for (UInt32 y = 0; y < inNumCalls; y += 1000)
+    {
+        SInt64 theCached = OS::CachedMilliseconds();
+        SInt64 theLag = OS::Milliseconds() - theCached;
+        if ((y == 0) || (theLag < theMinLag))
+            theMinLag = theLag;
+        if (theLag > theMaxLag)
+            theMaxLag = theLag;
+        for (UInt32 z = 0; z < 1000; z++)
+            (void)OS::CachedMilliseconds();
+    }
+    
+    qtss_printf("OS::Benchmark %"_U32BITARG_" calls: Milliseconds %.1f nsec/call, CachedMilliseconds %.1f nsec/call (coarse clock %s), lag %"_64BITARG_"d..%"_64BITARG_"d msec\n",
+                inNumCalls, (Float64)thePreciseTime * 1000 / inNumCalls, (Float64)theCachedTime * 1000 / inNumCalls,
+                sUseCoarseClock ? "on" : "off", theMinLag, theMaxLag);
+}
+
+#endif
@@ -39,6 +39,22 @@
 #include "OSMutex.h"
 #include <string.h>
 
+#define OSTESTING 0
+
+// Where OS_VECTOR_CODE is 1, a function can be built for SSE2 or AVX2 with
+// OS_VECTOR_TARGET, while the rest of the file is built for the baseline CPU.
+// Only call such a function if OS::GetVectorLevel says the CPU can run it.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))
+    #define OS_VECTOR_CODE 1
+    #define OS_VECTOR_TARGET(inTarget) __attribute__((target(inTarget)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #define OS_VECTOR_CODE 1
+    #define OS_VECTOR_TARGET(inTarget)
+#else
+    #define OS_VECTOR_CODE 0
+    #define OS_VECTOR_TARGET(inTarget)
+#endif
+
 class OS
 {
     public:
@@ -54,6 +70,12 @@ class OS
         // in msec, not seconds. To convert to a time_t, divide by 1000.
         static SInt64   Milliseconds();
 
+        //
+        // CachedMilliseconds returns the same clock as Milliseconds, but may lag
+        // it by a few msec (about one kernel timer tick). It is a lot cheaper, so
+        // use it on per-packet paths that don't need better than that.
+        static SInt64   CachedMilliseconds();
+
         static SInt64   Microseconds();
         
         // Some processors (MIPS, Sparc) cannot handle non word aligned memory
@@ -77,6 +99,11 @@ class OS
 		static SInt64	TimeMilli_To_UnixTimeMilli(SInt64 inMilliseconds)
 						{ return inMilliseconds; }
 
+		//This converts a wall clock time in msec since 1970 (gettimeofday, kernel packet
+		//timestamps) to the local time base of OS::Milliseconds.
+		static SInt64	UnixTimeMilli_To_TimeMilli(SInt64 inUnixMilliseconds)
+						{ return (inUnixMilliseconds - sInitialMsec) + sMsecSince1970; }
+
 		static time_t	TimeMilli_To_UnixTimeSecs(SInt64 inMilliseconds)
 						{ return (time_t)  ( (SInt64) TimeMilli_To_UnixTimeMilli(inMilliseconds) / (SInt64) 1000); }
 		
@@ -101,6 +128,16 @@ class OS
         // Discovery of how many processors are on this machine
         static UInt32   GetNumProcessors();
         
+        // The best vector instruction set that both the CPU and the OS support,
+        // kVectorNone where OS_VECTOR_CODE is 0
+        enum
+        {
+            kVectorNone = 0,    //UInt32
+            kVectorSSE2 = 1,    //UInt32
+            kVectorAVX2 = 2     //UInt32
+        };
+        static UInt32   GetVectorLevel();
+        
         // CPU Load
         static Float32  GetCurrentCPULoadPercent();
         
@@ -113,8 +150,19 @@ class OS
 
 		static Bool16 	ThreadSafe();
 
+#if OSTESTING
+        //prints the cost per call of Milliseconds and CachedMilliseconds over
+        //inNumCalls calls each, and how far CachedMilliseconds lagged
+        static void     Benchmark(UInt32 inNumCalls);
+#endif
+
    private:
     
+        enum
+        {
+            kMaxCoarseClockResInNanoSecs = 4000000  //SInt32, HZ=250
+        };
+
         static double sDivisor;
         static double sMicroDivisor;
         static SInt64 sMsecSince1900;
@@ -125,6 +173,7 @@ class OS
         static SInt64 sWrapTime;
         static SInt64 sCompareWrap;
         static SInt64 sLastTimeMilli;
+        static Bool16 sUseCoarseClock;
         static OSMutex sStdLibOSMutex;
 };
 
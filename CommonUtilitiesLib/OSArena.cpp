@@ -0,0 +1,143 @@
+/*
+	Copyright (c) 2013-2016 EasyDarwin.ORG.  All rights reserved.
+	Github: https://github.com/EasyDarwin
+	WEChat: EasyDarwin
+	Website: http://www.easydarwin.org
+*/
+/*
+    File:       OSArena.cpp
+
+    Contains:   Implements a bump pointer allocator
+*/
+
+#include <string.h>
+
+#include "OSArena.h"
+#include "OSMemory.h"
+#include "MyAssert.h"
+
+OSArena::OSArena(UInt32 inBlockSize)
+:   fBlockSize(inBlockSize),
+    fFirstBlock(NULL),
+    fCurBlock(NULL),
+    fCurOffset(0),
+    fNumAllocs(0),
+    fBytesAllocated(0)
+{
+    Assert(fBlockSize > 0);
+}
+
+OSArena::~OSArena()
+{
+    this->Reset();
+    delete [] (char*)fFirstBlock;
+}
+
+OSArena::Block* OSArena::AddBlock(UInt32 inSize)
+{
+    Block* theBlock = (Block*)NEW char[GetHeaderSize() + inSize];
+    theBlock->fNext = NULL;
+    theBlock->fSize = inSize;
+    return theBlock;
+}
+
+void* OSArena::Alloc(UInt32 inSize)
+{
+    UInt32 theSize = (inSize + kAlignment - 1) & ~(UInt32)(kAlignment - 1);
+    fNumAllocs++;
+    fBytesAllocated += theSize;
+
+    if ((fCurBlock != NULL) && (fCurOffset + theSize <= fCurBlock->fSize))
+    {
+        char* theData = GetData(fCurBlock) + fCurOffset;
+        fCurOffset += theSize;
+        return theData;
+    }
+
+    if (theSize > fBlockSize / 2)
+    {
+        // Big allocations get a block of their own. It goes behind the current
+        // block, which can still be used for the small ones that follow.
+        Block* theBlock = this->AddBlock(theSize);
+        if (fCurBlock == NULL)
+        {
+            fFirstBlock = fCurBlock = theBlock;
+            fCurOffset = theSize;
+        }
+        else
+        {
+            theBlock->fNext = fCurBlock->fNext;
+            fCurBlock->fNext = theBlock;
+        }
+        return GetData(theBlock);
+    }
+
+    Block* theBlock = this->AddBlock(fBlockSize);
+    theBlock->fNext = fCurBlock;
+    fCurBlock = theBlock;
+    if (fFirstBlock == NULL)
+        fFirstBlock = theBlock;
+
+    fCurOffset = theSize;
+    return GetData(theBlock);
+}
+
+char* OSArena::GetAsCString(StrPtrLen* inString)
+{
+    UInt32 theLen = (inString != NULL) ? inString->Len : 0;
+    char* theString = (char*)this->Alloc(theLen + 1);
+    if (theLen > 0)
+        ::memcpy(theString, inString->Ptr, theLen);
+    theString[theLen] = '\0';
+    return theString;
+}
+
+void OSArena::Reset()
+{
+    Block* theBlock = fCurBlock;
+    while (theBlock != NULL)
+    {
+        Block* theNext = theBlock->fNext;
+        if (theBlock != fFirstBlock)
+            delete [] (char*)theBlock;
+        theBlock = theNext;
+    }
+
+    if (fFirstBlock != NULL)
+        fFirstBlock->fNext = NULL;
+    fCurBlock = fFirstBlock;
+    fCurOffset = 0;
+    fNumAllocs = 0;
+    fBytesAllocated = 0;
+}
+
+#if OSARENATESTING
+Bool16 OSArena::Test()
+{
+    OSArena theArena(256);
+    
+    // Odd sizes, and sizes big enough to get a block of their own
+    for (UInt32 theRound = 0; theRound < 2; theRound++)
+    {
+        for (UInt32 x = 1; x < 400; x += 7)
+        {
+            char* theData = (char*)theArena.Alloc(x);
+            if (((PointerSizedInt)theData % kAlignment) != 0)
+                return false;
+            ::memset(theData, (int)x, x);
+        }
+        if (theArena.GetNumAllocs() != 57)
+            return false;
+        theArena.Reset();
+        if ((theArena.GetNumAllocs() != 0) || (theArena.GetBytesAllocated() != 0))
+            return false;
+    }
+    
+    StrPtrLen theString("arena");
+    char* theCopy = theArena.GetAsCString(&theString);
+    if ((((PointerSizedInt)theCopy % kAlignment) != 0) || (::strcmp(theCopy, "arena") != 0))
+        return false;
+    
+    return true;
+}
+#endif
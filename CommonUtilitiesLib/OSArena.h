@@ -0,0 +1,88 @@
+/*
+	Copyright (c) 2013-2016 EasyDarwin.ORG.  All rights reserved.
+	Github: https://github.com/EasyDarwin
+	WEChat: EasyDarwin
+	Website: http://www.easydarwin.org
+*/
+/*
+    File:       OSArena.h
+
+    Contains:   Bump pointer allocator for memory that all goes away at the same
+                time, such as everything allocated while handling one request.
+                Alloc just moves a pointer forward in the current block, there is
+                no per allocation free, and Reset makes the whole arena available
+                again at once.
+
+                The first block is kept across Resets, so once an arena has warmed
+                up, allocating from it never calls into the heap. Blocks added when
+                the first one runs out are freed by Reset.
+
+                This object is not thread-safe.
+*/
+
+#ifndef _OSARENA_H_
+#define _OSARENA_H_
+
+#include "OSHeaders.h"
+#include "StrPtrLen.h"
+
+#define OSARENATESTING 0
+
+class OSArena
+{
+    public:
+
+        enum
+        {
+            kDefaultBlockSize   = 4096, //UInt32
+            kAlignment          = 8     //UInt32
+        };
+
+        OSArena(UInt32 inBlockSize = kDefaultBlockSize);
+        ~OSArena();
+
+        // Returns inSize bytes aligned to kAlignment. Never returns NULL.
+        // The memory is valid until the next Reset.
+        void*   Alloc(UInt32 inSize);
+
+        // Returns a NUL terminated copy of inString, allocated in the arena
+        char*   GetAsCString(StrPtrLen* inString);
+
+        // Makes everything allocated so far available again
+        void    Reset();
+
+        //ACCESSORS
+        // Statistics since the last Reset
+        UInt32  GetNumAllocs()      { return fNumAllocs; }
+        UInt32  GetBytesAllocated() { return fBytesAllocated; }
+
+#if OSARENATESTING
+        //returns true if it passed the test, false otherwise
+        static Bool16   Test();
+#endif
+
+    private:
+
+        struct Block
+        {
+            Block*  fNext;
+            UInt32  fSize;  // usable bytes after the header
+        };
+
+        // The data starts after the header rounded up to kAlignment. The header
+        // is 12 bytes with 32 bit pointers, so it can't be used as it is.
+        static UInt32   GetHeaderSize() { return (sizeof(Block) + kAlignment - 1) & ~(UInt32)(kAlignment - 1); }
+        static char*    GetData(Block* inBlock) { return (char*)inBlock + GetHeaderSize(); }
+
+        Block*  AddBlock(UInt32 inSize);
+
+        UInt32  fBlockSize;
+        Block*  fFirstBlock;    // kept across Resets
+        Block*  fCurBlock;      // the block being allocated from, head of the list
+        UInt32  fCurOffset;     // offset of the free space in fCurBlock
+
+        UInt32  fNumAllocs;
+        UInt32  fBytesAllocated;
+};
+
+#endif //_OSARENA_H_
@@ -80,6 +80,10 @@ class OSMemory
         static void*    New(size_t inSize);
         static void     Delete(void* inMemory);
         
+        // Number of allocations the calling thread has made through New. Only
+        // counted where the compiler has thread local storage, always 0 elsewhere.
+        static UInt32   GetThreadNumAllocs();
+        
         //When memory allocation fails, the server just exits. This sets the code
         //the server exits with
         static void SetMemoryError(SInt32 inErr);
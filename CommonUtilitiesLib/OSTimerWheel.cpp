@@ -0,0 +1,376 @@
+/*
+	Copyright (c) 2013-2016 EasyDarwin.ORG.  All rights reserved.
+	Github: https://github.com/EasyDarwin
+	WEChat: EasyDarwin
+	Website: http://www.easydarwin.org
+*/
+/*
+    File:       OSTimerWheel.cpp
+
+    Contains:   Implements a hierarchical timing wheel
+*/
+
+#include <string.h>
+
+#include "OSTimerWheel.h"
+#include "OS.h"
+#include "MyAssert.h"
+
+#if _OSTIMERWHEEL_TESTING_
+#include "OSHeap.h"
+#include "OSMemory.h"
+#endif
+
+OSTimerWheel::OSTimerWheel()
+:   fCurrentTick(0),
+    fExpired(NULL),
+    fNumElems(0)
+{
+    ::memset(fSlots, 0, sizeof(fSlots));
+    ::memset(fLevelCount, 0, sizeof(fLevelCount));
+}
+
+void OSTimerWheel::AddToList(OSTimerWheelElem** ioHead, OSTimerWheelElem* inElem)
+{
+    inElem->fList = ioHead;
+    inElem->fPrev = NULL;
+    inElem->fNext = *ioHead;
+    if (*ioHead != NULL)
+        (*ioHead)->fPrev = inElem;
+    *ioHead = inElem;
+
+    if (ioHead != &fExpired)
+        fLevelCount[(ioHead - &fSlots[0][0]) / kNumSlots]++;
+}
+
+void OSTimerWheel::RemoveFromList(OSTimerWheelElem* inElem)
+{
+    OSTimerWheelElem** theHead = inElem->fList;
+    if (inElem->fPrev != NULL)
+        inElem->fPrev->fNext = inElem->fNext;
+    else
+        *theHead = inElem->fNext;
+    if (inElem->fNext != NULL)
+        inElem->fNext->fPrev = inElem->fPrev;
+
+    if (theHead != &fExpired)
+        fLevelCount[(theHead - &fSlots[0][0]) / kNumSlots]--;
+
+    inElem->fList = NULL;
+    inElem->fNext = NULL;
+    inElem->fPrev = NULL;
+}
+
+void OSTimerWheel::Insert(OSTimerWheelElem* inElem)
+{
+    Assert(inElem != NULL);
+    Assert(inElem->fCurrentWheel == NULL);
+
+    // The wheel starts turning the first time something is put on it
+    if (fCurrentTick == 0)
+        fCurrentTick = OS::Milliseconds();
+
+    inElem->fCurrentWheel = this;
+    fNumElems++;
+
+    SInt64 theExpires = inElem->fValue;
+    SInt64 theDelta = theExpires - fCurrentTick;
+    if (theDelta < 0)
+    {
+        this->AddToList(&fExpired, inElem);
+        return;
+    }
+
+    // Pick the lowest level whose range covers the delta. Anything further
+    // out than the top level can reach is parked in the top level's last
+    // slot, and moves down the wheel once its slot is cascaded.
+    UInt32 theLevel = 0;
+    while ((theLevel < kNumLevels - 1) && (theDelta >= ((SInt64)1 << (kSlotBits * (theLevel + 1)))))
+        theLevel++;
+
+    if (theDelta >= ((SInt64)1 << (kSlotBits * kNumLevels)))
+        theExpires = fCurrentTick + ((SInt64)1 << (kSlotBits * kNumLevels)) - 1;
+
+    UInt32 theSlot = (UInt32)(theExpires >> (kSlotBits * theLevel)) & kSlotMask;
+    this->AddToList(&fSlots[theLevel][theSlot], inElem);
+}
+
+OSTimerWheelElem* OSTimerWheel::Remove(OSTimerWheelElem* inElem)
+{
+    Assert(inElem != NULL);
+    if (inElem->fCurrentWheel != this)
+        return NULL;
+
+    this->RemoveFromList(inElem);
+    inElem->fCurrentWheel = NULL;
+    fNumElems--;
+    return inElem;
+}
+
+void OSTimerWheel::Cascade(UInt32 inLevel, UInt32 inSlot)
+{
+    // Take the whole list off the slot, then re-insert every element; they
+    // all land in lower levels because the wheel has moved on since.
+    OSTimerWheelElem* theElem = fSlots[inLevel][inSlot];
+    while (theElem != NULL)
+    {
+        OSTimerWheelElem* theNext = theElem->fNext;
+        this->RemoveFromList(theElem);
+        theElem->fCurrentWheel = NULL;
+        fNumElems--;
+        this->Insert(theElem);
+        theElem = theNext;
+    }
+}
+
+void OSTimerWheel::Advance(SInt64 inCurrentTime)
+{
+    while (fCurrentTick <= inCurrentTime)
+    {
+        // Nothing left to turn the wheel for
+        if (fNumElems == 0)
+        {
+            fCurrentTick = inCurrentTime + 1;
+            return;
+        }
+
+        UInt32 theSlot = (UInt32)fCurrentTick & kSlotMask;
+        if (theSlot == 0)
+        {
+            // Level 0 wrapped around: refill it from level 1, and level 1 from
+            // level 2 if that wrapped as well, and so on up.
+            for (UInt32 theLevel = 1; theLevel < kNumLevels; theLevel++)
+            {
+                UInt32 theLevelSlot = (UInt32)(fCurrentTick >> (kSlotBits * theLevel)) & kSlotMask;
+                this->Cascade(theLevel, theLevelSlot);
+                if (theLevelSlot != 0)
+                    break;
+            }
+        }
+
+        if (fLevelCount[0] == 0)
+        {
+            // Skip straight to the next cascade, there is nothing to fire before it
+            SInt64 theNextWrap = (fCurrentTick | kSlotMask) + 1;
+            fCurrentTick = (theNextWrap <= inCurrentTime) ? theNextWrap : inCurrentTime + 1;
+            continue;
+        }
+
+        OSTimerWheelElem* theElem = fSlots[0][theSlot];
+        while (theElem != NULL)
+        {
+            OSTimerWheelElem* theNext = theElem->fNext;
+            this->RemoveFromList(theElem);
+            this->AddToList(&fExpired, theElem);
+            theElem = theNext;
+        }
+        fCurrentTick++;
+    }
+}
+
+void OSTimerWheel::Rebase(SInt64 inCurrentTime)
+{
+    // Take every element off the wheel, expired ones included, and insert them
+    // again against the new time. Elements armed after the clock stepped back
+    // were placed (or found overdue) against the old fCurrentTick.
+    OSTimerWheelElem* theElems = NULL;
+    for (UInt32 theList = 0; theList <= kNumLevels * kNumSlots; theList++)
+    {
+        OSTimerWheelElem** theHead = (theList < kNumLevels * kNumSlots) ? &fSlots[0][0] + theList : &fExpired;
+        while (*theHead != NULL)
+        {
+            OSTimerWheelElem* theElem = *theHead;
+            this->RemoveFromList(theElem);
+            theElem->fCurrentWheel = NULL;
+            fNumElems--;
+            theElem->fNext = theElems;
+            theElems = theElem;
+        }
+    }
+    
+    fCurrentTick = inCurrentTime;
+    while (theElems != NULL)
+    {
+        OSTimerWheelElem* theNext = theElems->fNext;
+        theElems->fNext = NULL;
+        this->Insert(theElems);
+        theElems = theNext;
+    }
+}
+
+OSTimerWheelElem* OSTimerWheel::ExtractExpired(SInt64 inCurrentTime)
+{
+    // OS::Milliseconds can step backwards when the system clock is set
+    if (inCurrentTime < fCurrentTick - 1)
+        this->Rebase(inCurrentTime);
+        
+    if (fExpired == NULL)
+        this->Advance(inCurrentTime);
+
+    if (fExpired == NULL)
+        return NULL;
+
+    return this->Remove(fExpired);
+}
+
+SInt64 OSTimerWheel::GetNextExpiration()
+{
+    if (fNumElems == 0)
+        return -1;
+    if (fExpired != NULL)
+        return fCurrentTick - 1;
+
+    SInt64 theNextExpiration = -1;
+    for (UInt32 theLevel = 0; theLevel < kNumLevels; theLevel++)
+    {
+        UInt32 theShift = kSlotBits * theLevel;
+        if (fLevelCount[theLevel] > 0)
+        {
+            // In the upper levels the current slot was cascaded when this
+            // range started, so anything in it now is one full turn away,
+            // unless the wheel stopped right at the start of the range.
+            SInt64 theIndex = fCurrentTick >> theShift;
+            UInt32 theFirst = ((fCurrentTick & (((SInt64)1 << theShift) - 1)) == 0) ? 0 : 1;
+            for (UInt32 theOffset = theFirst; theOffset < kNumSlots + theFirst; theOffset++)
+            {
+                if (fSlots[theLevel][(UInt32)(theIndex + theOffset) & kSlotMask] != NULL)
+                {
+                    SInt64 theSlotStart = (theLevel == 0) ? fCurrentTick + theOffset : (theIndex + theOffset) << theShift;
+                    if ((theNextExpiration < 0) || (theSlotStart < theNextExpiration))
+                        theNextExpiration = theSlotStart;
+                    break;
+                }
+            }
+        }
+
+        // Everything in the levels above is due after this level wraps around
+        // (or right now, if the wheel is waiting to cascade at this tick)
+        SInt64 theWrapMask = ((SInt64)1 << (theShift + kSlotBits)) - 1;
+        SInt64 theNextWrap = ((fCurrentTick & theWrapMask) == 0) ? fCurrentTick : (fCurrentTick | theWrapMask) + 1;
+        if ((theNextExpiration >= 0) && (theNextExpiration <= theNextWrap))
+            break;
+    }
+
+    return theNextExpiration;
+}
+
+#if _OSTIMERWHEEL_TESTING_
+
+Bool16 OSTimerWheel::Test()
+{
+    enum { kNumElems = 10000 };
+
+    OSTimerWheel theWheel;
+    OSTimerWheelElem* theElems = NEW OSTimerWheelElem[kNumElems];
+    SInt64 theStart = OS::Milliseconds();
+
+    // spread timers out over every level, then cancel every third one
+    for (UInt32 x = 0; x < kNumElems; x++)
+    {
+        theElems[x].SetEnclosingObject(&theElems[x]);
+        theElems[x].SetValue(theStart + ((SInt64)x * x * 37) % 20000000);
+        theWheel.Insert(&theElems[x]);
+    }
+    for (UInt32 y = 0; y < kNumElems; y += 3)
+    {
+        if (theWheel.Remove(&theElems[y]) == NULL)
+            return false;
+    }
+
+    UInt32 theNumFired = 0;
+    SInt64 theLastValue = 0;
+    for (SInt64 theTime = theStart; theWheel.GetNumElems() > 0; theTime += 100)
+    {
+        OSTimerWheelElem* theElem = NULL;
+        while ((theElem = theWheel.ExtractExpired(theTime)) != NULL)
+        {
+            // nothing may fire early, and nothing may be late by more than the step
+            if ((theElem->GetValue() > theTime) || (theElem->GetValue() < theTime - 100))
+                return false;
+            if (theElem->GetValue() < theLastValue - 100)
+                return false;
+            theLastValue = theElem->GetValue();
+            theNumFired++;
+        }
+    }
+
+    delete [] theElems;
+    if (theNumFired != kNumElems - ((kNumElems + 2) / 3))
+        return false;
+
+    // the clock steps back 10 seconds: a timer armed after the step must not fire
+    // before its time, and one armed before it keeps its absolute time
+    OSTimerWheel theStepWheel;
+    OSTimerWheelElem theOldElem;
+    OSTimerWheelElem theNewElem;
+    SInt64 theNow = OS::Milliseconds();
+    theOldElem.SetValue(theNow + 1000);
+    theStepWheel.Insert(&theOldElem);
+    if (theStepWheel.ExtractExpired(theNow + 500) != NULL)
+        return false;
+
+    SInt64 theStepped = theNow - 10000;
+    theNewElem.SetValue(theStepped + 50);
+    theStepWheel.Insert(&theNewElem);
+    for (SInt64 theTime = theStepped; theTime < theStepped + 50; theTime++)
+    {
+        if (theStepWheel.ExtractExpired(theTime) != NULL)
+            return false;
+    }
+    if (theStepWheel.ExtractExpired(theStepped + 50) != &theNewElem)
+        return false;
+    if ((theStepWheel.ExtractExpired(theNow + 999) != NULL) || (theStepWheel.ExtractExpired(theNow + 1000) != &theOldElem))
+        return false;
+
+    return (theStepWheel.GetNumElems() == 0);
+}
+
+void OSTimerWheel::Benchmark(UInt32 inNumTimers)
+{
+    OSTimerWheelElem* theWheelElems = NEW OSTimerWheelElem[inNumTimers];
+    OSHeapElem* theHeapElems = NEW OSHeapElem[inNumTimers];
+    OSTimerWheel theWheel;
+    OSHeap theHeap;
+    SInt64 theNow = OS::Milliseconds();
+
+    // Timers are armed for up to 30 seconds out, then kNumRearms of them are
+    // re-armed (the RTCP / keepalive pattern), then all of them are run down.
+    // OSHeap::Remove is a linear search, so only a fixed number is re-armed.
+    enum { kNumRearms = 1000 };
+    SInt64 theWheelStart = OS::Microseconds();
+    for (UInt32 x = 0; x < inNumTimers; x++)
+    {
+        theWheelElems[x].SetValue(theNow + (x * 7919) % 30000);
+        theWheel.Insert(&theWheelElems[x]);
+    }
+    for (UInt32 y = 0; (y < inNumTimers) && (y < kNumRearms); y++)
+        theWheel.Reschedule(&theWheelElems[y], theNow + (y * 104729) % 30000);
+    for (SInt64 theTime = theNow; theWheel.GetNumElems() > 0; theTime++)
+        while (theWheel.ExtractExpired(theTime) != NULL) {}
+    SInt64 theWheelTime = OS::Microseconds() - theWheelStart;
+
+    SInt64 theHeapStart = OS::Microseconds();
+    for (UInt32 x = 0; x < inNumTimers; x++)
+    {
+        theHeapElems[x].SetValue(theNow + (x * 7919) % 30000);
+        theHeap.Insert(&theHeapElems[x]);
+    }
+    for (UInt32 y = 0; (y < inNumTimers) && (y < kNumRearms); y++)
+    {
+        (void)theHeap.Remove(&theHeapElems[y]);
+        theHeapElems[y].SetValue(theNow + (y * 104729) % 30000);
+        theHeap.Insert(&theHeapElems[y]);
+    }
+    for (SInt64 theTime = theNow; theHeap.CurrentHeapSize() > 0; theTime++)
+        while ((theHeap.PeekMin() != NULL) && (theHeap.PeekMin()->GetValue() <= theTime))
+            (void)theHeap.ExtractMin();
+    SInt64 theHeapTime = OS::Microseconds() - theHeapStart;
+
+    qtss_printf("OSTimerWheel::Benchmark %"_U32BITARG_" timers: wheel %"_64BITARG_"d usec, heap %"_64BITARG_"d usec\n",
+                inNumTimers, theWheelTime, theHeapTime);
+
+    delete [] theWheelElems;
+    delete [] theHeapElems;
+}
+
+#endif
@@ -0,0 +1,126 @@
+/*
+	Copyright (c) 2013-2016 EasyDarwin.ORG.  All rights reserved.
+	Github: https://github.com/EasyDarwin
+	WEChat: EasyDarwin
+	Website: http://www.easydarwin.org
+*/
+/*
+    File:       OSTimerWheel.h
+
+    Contains:   Hierarchical timing wheel with millisecond resolution. Used
+                instead of OSHeap wherever timers are armed and cancelled at
+                a high rate: insert, remove and re-arm are all O(1).
+
+                The wheel has kNumLevels levels of kNumSlots slots each. Level 0
+                holds timers due in the next kNumSlots milliseconds, one slot per
+                millisecond, and every higher level covers kNumSlots times the
+                range of the level below. Each time level 0 wraps around, one slot
+                of the next level is cascaded down.
+*/
+
+#ifndef _OSTIMERWHEEL_H_
+#define _OSTIMERWHEEL_H_
+
+#define _OSTIMERWHEEL_TESTING_ 0
+
+#include "MyAssert.h"
+#include "OSHeaders.h"
+
+class OSTimerWheel;
+
+class OSTimerWheelElem
+{
+    public:
+        OSTimerWheelElem(void* enclosingObject = NULL)
+            : fValue(0), fEnclosingObject(enclosingObject), fCurrentWheel(NULL), fList(NULL), fNext(NULL), fPrev(NULL) {}
+        ~OSTimerWheelElem() {}
+
+        // The value is the absolute time (in OS::Milliseconds) the timer fires at.
+        // Don't change it while the element is in a wheel.
+        void    SetValue(SInt64 newValue) { fValue = newValue; }
+        SInt64  GetValue()              { return fValue; }
+        void*   GetEnclosingObject()    { return fEnclosingObject; }
+        void    SetEnclosingObject(void* obj) { fEnclosingObject = obj; }
+        Bool16  IsMemberOfAnyWheel()    { return fCurrentWheel != NULL; }
+
+    private:
+
+        SInt64              fValue;
+        void*               fEnclosingObject;
+        OSTimerWheel*       fCurrentWheel;
+        OSTimerWheelElem**  fList;  // head of the slot list this element is on
+        OSTimerWheelElem*   fNext;
+        OSTimerWheelElem*   fPrev;
+
+        friend class OSTimerWheel;
+};
+
+class OSTimerWheel
+{
+    public:
+
+        enum
+        {
+            kSlotBits   = 8,                //UInt32
+            kNumSlots   = 1 << kSlotBits,   //UInt32
+            kSlotMask   = kNumSlots - 1,    //UInt32
+            kNumLevels  = 4                 //UInt32, covers 2^32 msec (~49 days)
+        };
+
+        OSTimerWheel();
+        ~OSTimerWheel() {}
+
+        //ACCESSORS
+        UInt32      GetNumElems()   { return fNumElems; }
+
+        // Returns the time the next timer may be due at, or -1 if the wheel is empty.
+        // Timers in the upper levels are reported at the start of their slot, so
+        // this is never later than the real expiration, but can be earlier.
+        SInt64      GetNextExpiration();
+
+        //MODIFIERS
+
+        // Arms the element for the time in its value. Elements whose time
+        // has already passed are returned by the next ExtractExpired.
+        void                Insert(OSTimerWheelElem* inElem);
+
+        // Removes the element from the wheel, returns NULL if it wasn't in it
+        OSTimerWheelElem*   Remove(OSTimerWheelElem* inElem);
+
+        // Changes the expiration time of an element, whether or not it is armed
+        void                Reschedule(OSTimerWheelElem* inElem, SInt64 inNewValue)
+                                { (void)this->Remove(inElem); inElem->SetValue(inNewValue); this->Insert(inElem); }
+
+        // Moves the wheel forward to inCurrentTime, and returns one element that
+        // has expired (removed from the wheel), or NULL if none have. If the time
+        // has gone backwards, the wheel starts over at inCurrentTime.
+        OSTimerWheelElem*   ExtractExpired(SInt64 inCurrentTime);
+
+#if _OSTIMERWHEEL_TESTING_
+        //returns true if it passed the test, false otherwise
+        static Bool16       Test();
+
+        //prints the cost of arming, re-arming and expiring inNumTimers timers,
+        //compared to OSHeap
+        static void         Benchmark(UInt32 inNumTimers);
+#endif
+
+    private:
+
+        void                Advance(SInt64 inCurrentTime);
+        void                Rebase(SInt64 inCurrentTime);
+        void                Cascade(UInt32 inLevel, UInt32 inSlot);
+        void                AddToList(OSTimerWheelElem** ioHead, OSTimerWheelElem* inElem);
+        void                RemoveFromList(OSTimerWheelElem* inElem);
+
+        // fCurrentTick is the next millisecond that hasn't been processed yet
+        SInt64              fCurrentTick;
+        OSTimerWheelElem*   fSlots[kNumLevels][kNumSlots];
+        UInt32              fLevelCount[kNumLevels];
+
+        // Elements whose time has come, waiting for ExtractExpired
+        OSTimerWheelElem*   fExpired;
+        UInt32              fNumElems;
+};
+
+#endif //_OSTIMERWHEEL_H_
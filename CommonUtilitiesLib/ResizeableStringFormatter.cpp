@@ -40,11 +40,15 @@ Bool16 ResizeableStringFormatter::BufferIsFull(char* inBuffer, UInt32 inBufferLe
     if (theNewBufferSize == 0)
         theNewBufferSize = 64;
         
-    char* theNewBuffer = NEW char[theNewBufferSize];
+    char* theNewBuffer = NULL;
+    if (fArena != NULL)
+        theNewBuffer = (char*)fArena->Alloc(theNewBufferSize);
+    else
+        theNewBuffer = NEW char[theNewBufferSize];
     ::memcpy(theNewBuffer, inBuffer, inBufferLen);
 
     //if the old buffer was dynamically allocated also, we'd better delete it.
-    if (inBuffer != fOriginalBuffer)
+    if ((inBuffer != fOriginalBuffer) && (fArena == NULL))
         delete [] inBuffer;
     
     fStartPut = theNewBuffer;
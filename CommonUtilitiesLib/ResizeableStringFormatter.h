@@ -37,17 +37,20 @@
 #define __RESIZEABLE_STRING_FORMATTER_H__
 
 #include "StringFormatter.h"
+#include "OSArena.h"
 
 class ResizeableStringFormatter : public StringFormatter
 {
     public:
         // Pass in inBuffer=NULL and inBufSize=0 to dynamically allocate the initial buffer.
-        ResizeableStringFormatter(char* inBuffer = NULL, UInt32 inBufSize = 0)
-            : StringFormatter(inBuffer, inBufSize), fOriginalBuffer(inBuffer) {}
+        // If inArena is set, bigger buffers are allocated in it instead of on the heap,
+        // so the arena must not be Reset while this object is in use.
+        ResizeableStringFormatter(char* inBuffer = NULL, UInt32 inBufSize = 0, OSArena* inArena = NULL)
+            : StringFormatter(inBuffer, inBufSize), fOriginalBuffer(inBuffer), fArena(inArena) {}
         
         //If we've been forced to increase the buffer size, fStartPut WILL be a dynamically allocated
         //buffer, and it WON'T be equal to fOriginalBuffer (obviously).
-        virtual ~ResizeableStringFormatter() {  if (fStartPut != fOriginalBuffer) delete [] fStartPut; }
+        virtual ~ResizeableStringFormatter() {  if ((fStartPut != fOriginalBuffer) && (fArena == NULL)) delete [] fStartPut; }
 
     private:
         
@@ -57,6 +60,7 @@ class ResizeableStringFormatter : public StringFormatter
         virtual Bool16    BufferIsFull(char* inBuffer, UInt32 inBufferLen);
         
         char*           fOriginalBuffer;
+        OSArena*        fArena;
         
 };
 
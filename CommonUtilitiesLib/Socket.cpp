@@ -45,9 +45,17 @@
 
 #include <errno.h>
 
+#if __linux__ && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#include <linux/errqueue.h>
+#define SOCKET_ZEROCOPY 1
+#else
+#define SOCKET_ZEROCOPY 0
+#endif
+
 #include "Socket.h"
 #include "SocketUtils.h"
 #include "OSMemory.h"
+#include "atomic.h"
 
 #ifdef USE_NETLOG
 	#include <netlog.h>
@@ -59,13 +67,52 @@
 
 
 EventThread* Socket::sEventThread = NULL;
+EventThread** Socket::sEventThreadArray = NULL;
+UInt32 Socket::sNumEventThreads = 0;
+unsigned int Socket::sEventThreadPicker = 0;
+
+void Socket::AddEventThreads(UInt32 inNumToAdd)
+{
+    Assert(sEventThread != NULL);
+    if (inNumToAdd == 0)
+        return;
+        
+    EventThread** theNewArray = NEW EventThread*[sNumEventThreads + inNumToAdd];
+    for (UInt32 x = 0; x < sNumEventThreads; x++)
+        theNewArray[x] = sEventThreadArray[x];
+    for (UInt32 y = sNumEventThreads; y < sNumEventThreads + inNumToAdd; y++)
+        theNewArray[y] = NEW EventThread();
+
+    if (sEventThreadArray != &sEventThread)
+        delete [] sEventThreadArray;
+    sEventThreadArray = theNewArray;
+    sNumEventThreads += inNumToAdd;
+}
+
+void Socket::StartThread()
+{
+    for (UInt32 x = 0; x < sNumEventThreads; x++)
+        sEventThreadArray[x]->Start();
+}
+
+EventThread* Socket::GetEventThread()
+{
+    if (sNumEventThreads <= 1)
+        return sEventThread;
+        
+    unsigned int theIndex = atomic_add(&sEventThreadPicker, 1);
+    return sEventThreadArray[theIndex % sNumEventThreads];
+}
 
 Socket::Socket(Task *notifytask, UInt32 inSocketType)
-:   EventContext(EventContext::kInvalidFileDesc, sEventThread),
+:   EventContext(EventContext::kInvalidFileDesc, Socket::GetEventThread()),
     fState(inSocketType),
     fLocalAddrStrPtr(NULL),
     fLocalDNSStrPtr(NULL),
-    fPortStr(fPortBuffer, kPortBufSizeInBytes)
+    fPortStr(fPortBuffer, kPortBufSizeInBytes),
+    fZeroCopyNextSendID(0),
+    fZeroCopyCompletedID(0),
+    fZeroCopyReaping(0)
 {
     fLocalAddr.sin_addr.s_addr = 0;
     fLocalAddr.sin_port = 0;
@@ -103,6 +150,19 @@ void Socket::ReuseAddr()
     Assert(err == 0);   
 }
 
+OS_Error Socket::ReusePort()
+{
+#if defined(SO_REUSEPORT)
+    int one = 1;
+    int err = ::setsockopt(fFileDesc, SOL_SOCKET, SO_REUSEPORT, (char*)&one, sizeof(int));
+    if (err != 0)
+        return (OS_Error)OSThread::GetErrno();
+    return OS_NoErr;
+#else
+    return EOPNOTSUPP;
+#endif
+}
+
 void Socket::NoDelay()
 {
     int one = 1;
@@ -355,6 +415,104 @@ OS_Error Socket::WriteV(const struct iovec* iov, const UInt32 numIOvecs, UInt32*
     return OS_NoErr;
 }
 
+OS_Error Socket::EnableZeroCopy()
+{
+#if SOCKET_ZEROCOPY
+    int one = 1;
+    if (::setsockopt(fFileDesc, SOL_SOCKET, SO_ZEROCOPY, (char*)&one, sizeof(int)) != 0)
+        return (OS_Error)OSThread::GetErrno();
+
+    fState |= kZeroCopy;
+    return OS_NoErr;
+#else
+    return (OS_Error)EOPNOTSUPP;
+#endif
+}
+
+OS_Error Socket::WriteVZeroCopy(const struct iovec* iov, const UInt32 numIOvecs, UInt32* outLenSent, UInt32* outSendID)
+{
+    Assert(iov != NULL);
+    Assert(outSendID != NULL);
+
+    if (!(fState & kConnected))
+        return (OS_Error)ENOTCONN;
+    if (!(fState & kZeroCopy))
+        return (OS_Error)EOPNOTSUPP;
+
+#if SOCKET_ZEROCOPY
+    struct msghdr theMsg;
+    ::memset(&theMsg, 0, sizeof(theMsg));
+    theMsg.msg_iov = (struct iovec*)iov;
+    theMsg.msg_iovlen = numIOvecs;
+
+    int err;
+    do {
+       err = ::sendmsg(fFileDesc, &theMsg, MSG_ZEROCOPY);
+    } while((err == -1) && (OSThread::GetErrno() == EINTR));
+    if (err == -1)
+    {
+        // ENOBUFS means the socket is over its pinned memory limit (optmem_max),
+        // the connection is still fine
+        int theErr = OSThread::GetErrno();
+        if ((theErr != EAGAIN) && (theErr != ENOBUFS) && (this->IsConnected()))
+            fState ^= kConnected;//turn off connected state flag
+        return (OS_Error)theErr;
+    }
+
+    // The kernel numbers every successful MSG_ZEROCOPY send on the socket, starting at 0
+    *outSendID = fZeroCopyNextSendID++;
+    if (outLenSent != NULL)
+        *outLenSent = (UInt32)err;
+
+    return OS_NoErr;
+#else
+    return (OS_Error)EOPNOTSUPP;
+#endif
+}
+
+Bool16 Socket::ZeroCopySendDone(UInt32 inSendID)
+{
+    if ((SInt32)(fZeroCopyCompletedID - inSendID) <= 0)
+        this->ReapZeroCopyCompletions();
+
+    return (Bool16) ((SInt32)(fZeroCopyCompletedID - inSendID) > 0);
+}
+
+void Socket::ReapZeroCopyCompletions()
+{
+#if SOCKET_ZEROCOPY
+    // Another thread is already at it
+    if (compare_and_store(0, 1, &fZeroCopyReaping) == 0)
+        return;
+
+    while (true)
+    {
+        char theControl[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in))];
+        struct msghdr theMsg;
+        ::memset(&theMsg, 0, sizeof(theMsg));
+        theMsg.msg_control = theControl;
+        theMsg.msg_controllen = sizeof(theControl);
+
+        if (::recvmsg(fFileDesc, &theMsg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+            break;
+
+        for (struct cmsghdr* theCmsg = CMSG_FIRSTHDR(&theMsg); theCmsg != NULL; theCmsg = CMSG_NXTHDR(&theMsg, theCmsg))
+        {
+            struct sock_extended_err* theErr = (struct sock_extended_err*)CMSG_DATA(theCmsg);
+            if ((theErr->ee_errno != 0) || (theErr->ee_origin != SO_EE_ORIGIN_ZEROCOPY))
+                continue;
+
+            // Each notification covers the send IDs ee_info through ee_data. TCP
+            // completes its sends in order, so only the end of the range matters.
+            if ((SInt32)(theErr->ee_data + 1 - fZeroCopyCompletedID) > 0)
+                fZeroCopyCompletedID = theErr->ee_data + 1;
+        }
+    }
+
+    fZeroCopyReaping = 0;
+#endif
+}
+
 OS_Error Socket::Read(void *buffer, const UInt32 length, UInt32 *outRecvLenP)
 {
     Assert(outRecvLenP != NULL);
@@ -376,6 +534,8 @@ OS_Error Socket::Read(void *buffer, const UInt32 length, UInt32 *outRecvLenP)
         int theErr = OSThread::GetErrno();
         if ((theErr != EAGAIN) && (this->IsConnected()))
             fState ^= kConnected;//turn off connected state flag
+        if ((theErr == EAGAIN) && (fState & kZeroCopy))
+            this->ReapZeroCopyCompletions();
         return (OS_Error)theErr;
     }
     //if we get 0 bytes back from read, that means the client has disconnected.
@@ -56,10 +56,14 @@ class Socket : public EventContext
             kNonBlockingSocketType = 1
         };
 
-        // This class provides a global event thread.
-        static void Initialize() { sEventThread = new EventThread(); }
-        static void StartThread() { sEventThread->Start(); }
-        static EventThread* GetEventThread() { return sEventThread; }
+        // This class provides a global event thread. More event threads may be
+        // added before StartThread is called; new sockets are then spread across
+        // all of them round-robin, each thread running its own event loop.
+        static void Initialize() { sEventThread = new EventThread(); sEventThreadArray = &sEventThread; sNumEventThreads = 1; }
+        static void AddEventThreads(UInt32 inNumToAdd);
+        static void StartThread();
+        static EventThread* GetEventThread();
+        static UInt32 GetNumEventThreads() { return sNumEventThreads; }
         
         //Binds the socket to the following address.
         //Returns: QTSS_FileNotOpen, QTSS_NoErr, or POSIX errorcode.
@@ -70,6 +74,10 @@ class Socket : public EventContext
         void            ReuseAddr();
         void            NoDelay();
         void            KeepAlive();
+        
+        // Lets several sockets bind the same address and port, and have the kernel
+        // spread incoming connections over them. Returns an error where unsupported.
+        OS_Error        ReusePort();
         void            SetSocketBufSize(UInt32 inNewSize);
 
         //
@@ -88,6 +96,23 @@ class Socket : public EventContext
         //WriteV: same as send, but takes an iovec
         //Returns: QTSS_FileNotOpen, QTSS_NoErr, or POSIX errorcode.
         OS_Error        WriteV(const struct iovec* iov, const UInt32 numIOvecs, UInt32* outLengthSent);
+
+        //Zero copy sends (Linux MSG_ZEROCOPY). EnableZeroCopy returns an error if
+        //the platform or kernel doesn't support them.
+        OS_Error        EnableZeroCopy();
+        Bool16          IsZeroCopyEnabled() { return (Bool16) ((fState & kZeroCopy) != 0); }
+
+        //WriteVZeroCopy: same as WriteV, but the kernel sends the data straight from
+        //the caller's memory. Each successful call is given the next send ID, and the
+        //data must be left untouched until ZeroCopySendDone returns true for that ID.
+        //Returns ENOBUFS if the kernel can't pin any more memory for this socket,
+        //the data has to be sent with WriteV then.
+        OS_Error        WriteVZeroCopy(const struct iovec* iov, const UInt32 numIOvecs, UInt32* outLengthSent, UInt32* outSendID);
+        Bool16          ZeroCopySendDone(UInt32 inSendID);
+
+        //Reads the send completions off the socket's error queue. Until they are read
+        //the socket keeps polling readable, so Read does this whenever it gets EAGAIN.
+        void            ReapZeroCopyCompletions();
         
         //You can query for the socket's state
         Bool16  IsConnected()   { return (Bool16) (fState & kConnected); }
@@ -148,10 +173,19 @@ class Socket : public EventContext
         enum
         {
             kBound      = 0x0004,
-            kConnected  = 0x0008
+            kConnected  = 0x0008,
+            kZeroCopy   = 0x0010
         };
+
+        //zero copy send IDs, in the order the kernel hands them out
+        UInt32          fZeroCopyNextSendID;
+        UInt32          fZeroCopyCompletedID;   // all IDs before this one are completed
+        unsigned int    fZeroCopyReaping;       // only one thread reads the error queue at a time
         
         static EventThread* sEventThread;
+        static EventThread** sEventThreadArray;
+        static UInt32 sNumEventThreads;
+        static unsigned int sEventThreadPicker;
         
 };
 
@@ -162,8 +162,8 @@ Bool16 StrPtrLen::EqualIgnoreCase(const char* compare, const UInt32 len) const
 
 char *StrPtrLen::FindStringCase(char *queryCharStr, StrPtrLen *resultStr, Bool16 caseSensitive) const
 {
-    // Be careful about exiting this method from the middle. This routine deletes allocated memory at the end.
-    // 
+    // Searches Ptr/Len in place, without copying or terminating the source.
+    // Like strstr on a terminated copy, a NUL in the source ends the search.
 
     if (resultStr)
         resultStr->Set(NULL,0);
@@ -173,55 +173,30 @@ char *StrPtrLen::FindStringCase(char *queryCharStr, StrPtrLen *resultStr, Bool16
     if (NULL == Ptr) return NULL;
     if (0 == Len) return NULL;
     
-
-    StrPtrLen queryStr(queryCharStr);
-    char *editSource = NULL;
-    char *resultChar = NULL;
-    char lastSourceChar = Ptr[Len -1];
-    
-    if (lastSourceChar != 0) // need to modify for termination. 
-    {   editSource = NEW char[Len + 1]; // Ptr could be a static string so make a copy
-        ::memcpy( editSource, Ptr, Len );
-        editSource[Len] = 0; // this won't work on static strings so we are modifing a new string here
-    }
-
-    char *queryString = queryCharStr;       
-    char *dupSourceString = NULL;
-    char *dupQueryString = NULL;
-    char *sourceString = Ptr;
-    UInt32 foundLen = 0;
-    
-    if (editSource != NULL) // a copy of the source ptr and len 0 terminated
-        sourceString = editSource;
+    UInt32 queryLen = ::strlen(queryCharStr);
+    UInt32 sourceLen = 0;
+    while ((sourceLen < Len) && (Ptr[sourceLen] != 0))
+        sourceLen++;
     
-    if (!caseSensitive)
-    {   dupSourceString = ::strdup(sourceString);
-        dupQueryString = ::strdup(queryCharStr);                
-        if (dupSourceString && dupQueryString) 
-        {   sourceString = StrPtrLen(dupSourceString).ToUpper();
-            queryString = StrPtrLen(dupQueryString).ToUpper();
-            resultChar = ::strstr(sourceString,queryString);
-			
-			::free(dupSourceString);
-			::free(dupQueryString);
+    char *resultChar = NULL;
+    for (UInt32 start = 0; (resultChar == NULL) && (start + queryLen <= sourceLen); start++)
+    {
+        UInt32 x = 0;
+        if (caseSensitive)
+        {   while ((x < queryLen) && (Ptr[start + x] == queryCharStr[x]))
+                x++;
         }
+        else
+        {   while ((x < queryLen) && (sCaseInsensitiveMask[(UInt8) Ptr[start + x]] == sCaseInsensitiveMask[(UInt8) queryCharStr[x]]))
+                x++;
+        }
+        
+        if (x == queryLen)
+            resultChar = Ptr + start; // return a pointer in the source buffer
     }
-    else
-    {   resultChar = ::strstr(sourceString,queryString);        
-    }
-    
-    if (resultChar != NULL) // get the start offset
-    {   foundLen = resultChar - sourceString;
-        resultChar = Ptr + foundLen;  // return a pointer in the source buffer
-        if (resultChar > (Ptr + Len)) // make sure it is in the buffer
-            resultChar = NULL;
-    }
-    
-    if (editSource != NULL)  
-        delete [] editSource;
     
     if (resultStr != NULL && resultChar != NULL)
-        resultStr->Set(resultChar,queryStr.Len);
+        resultStr->Set(resultChar,queryLen);
     
 #if STRPTRLENTESTING    
     qtss_printf("StrPtrLen::FindStringCase found string=%s\n",resultChar);
@@ -32,6 +32,12 @@
 */
 
 #include "StringParser.h"
+#include "OS.h"
+
+#if STRINGPARSERTESTING
+#include <string.h>
+#include "OSMemory.h"
+#endif
 
 UInt8 StringParser::sNonWordMask[] =
 {
@@ -245,6 +251,208 @@ UInt8 StringParser::sEOLWhitespaceQueryMask[] =
     0, 0, 0, 0, 0, 0             //250-255
 };
 
+//
+// VECTOR SCANNING
+//
+// The stop conditions ConsumeUntil sees most often are described here in a
+// form that can be tested on a whole vector of bytes at once: a byte stops
+// the scan if it is equal to one of fEq, or lies in [fLo, fHi] (after
+// folding upper case to lower case if fFoldCase is set). fInvert stops on
+// every byte that does neither. Unused fEq slots repeat a used one, and a
+// class without a range repeats fEq[0] as its range.
+
+struct StringParserStopClass
+{
+    UInt8   fEq[3];
+    UInt8   fLo;
+    UInt8   fHi;
+    Bool16  fFoldCase;
+    Bool16  fInvert;
+    Bool16  fCountLines;    // the bytes before a stop can be '\r' or '\n'
+};
+
+static StringParserStopClass sEOLStopClass =            { { '\r', '\n', '\n' }, '\r', '\r', false, false, false };
+static StringParserStopClass sEOLWhitespaceStopClass =  { { ' ', ' ', ' ' },    '\t', '\r', false, false, false };
+static StringParserStopClass sEOLWhitespaceQueryStopClass = { { ' ', '?', '?' }, '\t', '\r', false, false, false };
+static StringParserStopClass sWhitespaceStopClass =     { { ' ', ' ', ' ' },    '\t', '\r', false, true,  true };
+static StringParserStopClass sNonWordStopClass =        { { '-', '_', '_' },    'a',  'z',  true,  true,  false };
+static StringParserStopClass sWordStopClass =           { { '-', '_', '_' },    'a',  'z',  true,  false, true };
+static StringParserStopClass sDigitStopClass =          { { '0', '0', '0' },    '0',  '9',  false, false, true };
+
+static const StringParserStopClass* GetStopClass(UInt8* inMask)
+{
+    if (inMask == StringParser::sEOLMask)
+        return &sEOLStopClass;
+    if (inMask == StringParser::sEOLWhitespaceMask)
+        return &sEOLWhitespaceStopClass;
+    if (inMask == StringParser::sWhitespaceMask)
+        return &sWhitespaceStopClass;
+    if (inMask == StringParser::sEOLWhitespaceQueryMask)
+        return &sEOLWhitespaceQueryStopClass;
+    if (inMask == StringParser::sWordMask)
+        return &sWordStopClass;
+    if (inMask == StringParser::sDigitMask)
+        return &sDigitStopClass;
+    return NULL; // sNonWordMask is private, ConsumeUntil checks for it itself
+}
+
+// Scans from inStart for the first byte that stops inClass, adding the lines
+// it moves past to ioLineNumber. Returns the stop byte, or the point near
+// inEnd where vectors no longer fit, from which the caller scans bytewise.
+typedef char* (*StringParserScanFunctionPtr)(char* inStart, char* inEnd, const StringParserStopClass& inClass, int* ioLineNumber);
+
+#if OS_VECTOR_CODE && defined(__GNUC__)
+    #include <immintrin.h>
+    static inline UInt32 StringParserFirstBit(UInt32 inBits)  { return __builtin_ctz(inBits); }
+    static inline UInt32 StringParserCountBits(UInt32 inBits) { return __builtin_popcount(inBits); }
+#elif OS_VECTOR_CODE
+    #include <immintrin.h>
+    #include <intrin.h>
+    static inline UInt32 StringParserFirstBit(UInt32 inBits)  { unsigned long theIndex; _BitScanForward(&theIndex, inBits); return theIndex; }
+    static inline UInt32 StringParserCountBits(UInt32 inBits)
+    {   UInt32 theCount = 0;
+        for (; inBits != 0; inBits &= inBits - 1)
+            theCount++;
+        return theCount;
+    }
+#endif
+
+#if OS_VECTOR_CODE
+
+// Lines moved past in one vector, counted the way AdvanceMark does: every
+// '\n', and every '\r' not followed by a '\n'.
+static inline UInt32 CountLines(UInt32 inCRBits, UInt32 inLFBits, UInt32 inNextLFBits, UInt32 inConsumedBits)
+{
+    return StringParserCountBits(inLFBits & inConsumedBits) + StringParserCountBits(inCRBits & ~inNextLFBits & inConsumedBits);
+}
+
+OS_VECTOR_TARGET("sse2")
+static char* ScanSSE2(char* inStart, char* inEnd, const StringParserStopClass& inClass, int* ioLineNumber)
+{
+    const __m128i theEq0 = _mm_set1_epi8((char)inClass.fEq[0]);
+    const __m128i theEq1 = _mm_set1_epi8((char)inClass.fEq[1]);
+    const __m128i theEq2 = _mm_set1_epi8((char)inClass.fEq[2]);
+    const __m128i theLo = _mm_set1_epi8((char)inClass.fLo);
+    const __m128i theRange = _mm_set1_epi8((char)(inClass.fHi - inClass.fLo));
+    const __m128i theFold = _mm_set1_epi8(inClass.fFoldCase ? 0x20 : 0);
+    const __m128i theZero = _mm_setzero_si128();
+    const __m128i theCR = _mm_set1_epi8('\r');
+    const __m128i theLF = _mm_set1_epi8('\n');
+    const UInt32 theInvert = inClass.fInvert ? 0xFFFF : 0;
+
+    char* theNext = inStart;
+    while (inEnd - theNext > 16) // line counting looks one byte past the vector
+    {
+        __m128i theBytes = _mm_loadu_si128((const __m128i*)theNext);
+        __m128i theHits = _mm_or_si128(_mm_cmpeq_epi8(theBytes, theEq0),
+                            _mm_or_si128(_mm_cmpeq_epi8(theBytes, theEq1), _mm_cmpeq_epi8(theBytes, theEq2)));
+        // x is in [lo, hi] exactly when (x - lo) mod 256 <= hi - lo
+        __m128i theOffset = _mm_sub_epi8(_mm_or_si128(theBytes, theFold), theLo);
+        theHits = _mm_or_si128(theHits, _mm_cmpeq_epi8(_mm_subs_epu8(theOffset, theRange), theZero));
+
+        UInt32 theStops = ((UInt32)_mm_movemask_epi8(theHits)) ^ theInvert;
+        if (inClass.fCountLines)
+        {
+            UInt32 theConsumed = (theStops != 0) ? ((1U << StringParserFirstBit(theStops)) - 1) : 0xFFFF;
+            UInt32 theCRBits = (UInt32)_mm_movemask_epi8(_mm_cmpeq_epi8(theBytes, theCR));
+            UInt32 theLFBits = (UInt32)_mm_movemask_epi8(_mm_cmpeq_epi8(theBytes, theLF));
+            if ((theCRBits | theLFBits) & theConsumed)
+            {
+                __m128i theNextBytes = _mm_loadu_si128((const __m128i*)(theNext + 1));
+                UInt32 theNextLFBits = (UInt32)_mm_movemask_epi8(_mm_cmpeq_epi8(theNextBytes, theLF));
+                *ioLineNumber += CountLines(theCRBits, theLFBits, theNextLFBits, theConsumed);
+            }
+        }
+        if (theStops != 0)
+            return theNext + StringParserFirstBit(theStops);
+        theNext += 16;
+    }
+    return theNext;
+}
+
+OS_VECTOR_TARGET("avx2")
+static char* ScanAVX2(char* inStart, char* inEnd, const StringParserStopClass& inClass, int* ioLineNumber)
+{
+    const __m256i theEq0 = _mm256_set1_epi8((char)inClass.fEq[0]);
+    const __m256i theEq1 = _mm256_set1_epi8((char)inClass.fEq[1]);
+    const __m256i theEq2 = _mm256_set1_epi8((char)inClass.fEq[2]);
+    const __m256i theLo = _mm256_set1_epi8((char)inClass.fLo);
+    const __m256i theRange = _mm256_set1_epi8((char)(inClass.fHi - inClass.fLo));
+    const __m256i theFold = _mm256_set1_epi8(inClass.fFoldCase ? 0x20 : 0);
+    const __m256i theZero = _mm256_setzero_si256();
+    const __m256i theCR = _mm256_set1_epi8('\r');
+    const __m256i theLF = _mm256_set1_epi8('\n');
+    const UInt32 theInvert = inClass.fInvert ? 0xFFFFFFFF : 0;
+
+    char* theNext = inStart;
+    while (inEnd - theNext > 32)
+    {
+        __m256i theBytes = _mm256_loadu_si256((const __m256i*)theNext);
+        __m256i theHits = _mm256_or_si256(_mm256_cmpeq_epi8(theBytes, theEq0),
+                            _mm256_or_si256(_mm256_cmpeq_epi8(theBytes, theEq1), _mm256_cmpeq_epi8(theBytes, theEq2)));
+        __m256i theOffset = _mm256_sub_epi8(_mm256_or_si256(theBytes, theFold), theLo);
+        theHits = _mm256_or_si256(theHits, _mm256_cmpeq_epi8(_mm256_subs_epu8(theOffset, theRange), theZero));
+
+        UInt32 theStops = ((UInt32)_mm256_movemask_epi8(theHits)) ^ theInvert;
+        if (inClass.fCountLines)
+        {
+            UInt32 theConsumed = (theStops != 0) ? ((1U << StringParserFirstBit(theStops)) - 1) : 0xFFFFFFFF;
+            UInt32 theCRBits = (UInt32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(theBytes, theCR));
+            UInt32 theLFBits = (UInt32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(theBytes, theLF));
+            if ((theCRBits | theLFBits) & theConsumed)
+            {
+                __m256i theNextBytes = _mm256_loadu_si256((const __m256i*)(theNext + 1));
+                UInt32 theNextLFBits = (UInt32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(theNextBytes, theLF));
+                *ioLineNumber += CountLines(theCRBits, theLFBits, theNextLFBits, theConsumed);
+            }
+        }
+        if (theStops != 0)
+            return theNext + StringParserFirstBit(theStops);
+        theNext += 32;
+    }
+    return theNext;
+}
+
+#endif //OS_VECTOR_CODE
+
+static UInt32 GetSupportedScanLevel()
+{
+    UInt32 theVectorLevel = OS::GetVectorLevel();
+    if (theVectorLevel == OS::kVectorAVX2)
+        return StringParser::kScanAVX2;
+    if (theVectorLevel == OS::kVectorSSE2)
+        return StringParser::kScanSSE2;
+    return StringParser::kScanScalar;
+}
+
+static StringParserScanFunctionPtr GetScanFunction(UInt32 inLevel)
+{
+#if OS_VECTOR_CODE
+    if (inLevel == StringParser::kScanAVX2)
+        return ScanAVX2;
+    if (inLevel == StringParser::kScanSSE2)
+        return ScanSSE2;
+#endif
+    return NULL;
+}
+
+static UInt32                       sSupportedScanLevel = GetSupportedScanLevel();
+static UInt32                       sScanLevel = sSupportedScanLevel;
+static StringParserScanFunctionPtr  sScanFunction = GetScanFunction(sSupportedScanLevel);
+
+UInt32 StringParser::GetScanLevel()
+{
+    return sScanLevel;
+}
+
+void StringParser::SetScanLevel(UInt32 inLevel)
+{
+    if (inLevel > sSupportedScanLevel)
+        inLevel = sSupportedScanLevel;
+    sScanLevel = inLevel;
+    sScanFunction = GetScanFunction(inLevel);
+}
+
 void StringParser::ConsumeUntil(StrPtrLen* outString, char inStop)
 {
     if (this->ParserIsEmpty(outString))
@@ -252,6 +460,12 @@ void StringParser::ConsumeUntil(StrPtrLen* outString, char inStop)
 
     char *originalStartGet = fStartGet;
 
+    if (sScanFunction != NULL)
+    {
+        StringParserStopClass theClass = { { (UInt8)inStop, (UInt8)inStop, (UInt8)inStop }, (UInt8)inStop, (UInt8)inStop, false, false, true };
+        fStartGet = sScanFunction(fStartGet, fEndGet, theClass, &fCurLineNumber);
+    }
+
     while ((fStartGet < fEndGet) && (*fStartGet != inStop))
         AdvanceMark();
         
@@ -269,6 +483,13 @@ void StringParser::ConsumeUntil(StrPtrLen* outString, UInt8 *inMask)
         
     char *originalStartGet = fStartGet;
 
+    if (sScanFunction != NULL)
+    {
+        const StringParserStopClass* theClass = (inMask == sNonWordMask) ? &sNonWordStopClass : GetStopClass(inMask);
+        if (theClass != NULL)
+            fStartGet = sScanFunction(fStartGet, fEndGet, *theClass, &fCurLineNumber);
+    }
+
     while ((fStartGet < fEndGet) && (!inMask[(unsigned char) (*fStartGet)]))//make sure inMask is indexed with an unsigned char
         AdvanceMark();
 
@@ -484,6 +705,13 @@ void StringParser::AdvanceMark()
 }
 
 #if STRINGPARSERTESTING
+
+static UInt8* sTestMasks[] =
+{
+    StringParser::sEOLMask, StringParser::sEOLWhitespaceMask, StringParser::sEOLWhitespaceQueryMask,
+    StringParser::sWhitespaceMask, StringParser::sWordMask, StringParser::sDigitMask
+};
+
 Bool16 StringParser::Test()
 {
     static char* string1 = "RTSP 200 OK\r\nContent-Type: MeowMix\r\n\t   \n3450";
@@ -497,14 +725,133 @@ Bool16 StringParser::Test()
     if (theInt != 0)
         return false;
     victim.ConsumeWord(&rtsp);
-    if ((rtsp.len != 4) && (strncmp(rtsp.Ptr, "RTSP", 4) != 0))
+    if ((rtsp.Len != 4) && (strncmp(rtsp.Ptr, "RTSP", 4) != 0))
         return false;
         
-    victim.ConsumeWhiteSpace();
+    victim.ConsumeWhitespace();
     theInt = victim.ConsumeInteger();
     if (theInt != 200)
         return false;
-        
+    
+    // Every scan level must stop where the bytewise scan stops, and count the same lines
+    // Runs of up to 80 bytes of one kind, so the vector code gets to skip,
+    // separated by bytes that stop some of the masks
+    static char* sRunChars = "aZ09 \t\r\n-";
+    static char* sTestChars = "aZ09 \t\r\n\r\r\n\n?:;=-_/.zA@[`{\x0b\x80\xff";
+    char theBuffer[2048];
+    UInt32 theRandom = 1;
+    for (UInt32 x = 0; x < sizeof(theBuffer); )
+    {
+        theRandom = theRandom * 1103515245 + 12345;
+        UInt32 theRunLen = (theRandom >> 16) % 80;
+        theRandom = theRandom * 1103515245 + 12345;
+        char theRunChar = sRunChars[(theRandom >> 16) % ::strlen(sRunChars)];
+        for (; (theRunLen > 0) && (x < sizeof(theBuffer)); theRunLen--, x++)
+            theBuffer[x] = theRunChar;
+        theRandom = theRandom * 1103515245 + 12345;
+        if (x < sizeof(theBuffer))
+            theBuffer[x++] = sTestChars[(theRandom >> 16) % ::strlen(sTestChars)];
+    }
+    StrPtrLen theTestString(theBuffer, sizeof(theBuffer));
+    
+    UInt32 theLevel = GetScanLevel();
+    for (UInt32 theStart = 0; theStart < sizeof(theBuffer); theStart++)
+    {
+        for (UInt32 theMask = 0; theMask < (sizeof(sTestMasks) / sizeof(UInt8*)) + 3; theMask++)
+        {
+            char* theStop[kScanAVX2 + 1];
+            int theLines[kScanAVX2 + 1];
+            for (UInt32 theTestLevel = kScanScalar; theTestLevel <= theLevel; theTestLevel++)
+            {
+                SetScanLevel(theTestLevel);
+                StringParser theParser(&theTestString);
+                theParser.ConsumeLength(NULL, theStart);
+                if (theMask < sizeof(sTestMasks) / sizeof(UInt8*))
+                    theParser.ConsumeUntil(NULL, sTestMasks[theMask]);
+                else if (theMask == sizeof(sTestMasks) / sizeof(UInt8*))
+                    theParser.ConsumeWord();
+                else
+                    theParser.ConsumeUntil(NULL, (theMask & 1) ? ';' : '\n');
+                theStop[theTestLevel] = theParser.GetCurrentPosition();
+                theLines[theTestLevel] = theParser.GetCurrentLineNumber();
+                if ((theStop[theTestLevel] != theStop[kScanScalar]) || (theLines[theTestLevel] != theLines[kScanScalar]))
+                {
+                    SetScanLevel(theLevel);
+                    return false;
+                }
+            }
+        }
+    }
+    SetScanLevel(theLevel);
     return true;
 }
+
+void StringParser::Benchmark(UInt32 inIterations)
+{
+    static char* sRequest = "SETUP rtsp://192.168.1.10:554/live/stream1.sdp/trackID=1 RTSP/1.0\r\n"
+                            "CSeq: 3\r\n"
+                            "Transport: RTP/AVP;unicast;client_port=6970-6971;mode=play\r\n"
+                            "Session: 1590074451605982931\r\n"
+                            "User-Agent: LibVLC/3.0.16 (LIVE555 Streaming Media v2021.08.24)\r\n"
+                            "Accept-Language: en-US,en;q=0.9\r\n"
+                            "Authorization: Digest username=\"admin\", realm=\"EasyDarwin\", nonce=\"0123456789abcdef\", uri=\"rtsp://192.168.1.10:554/live/stream1.sdp\", response=\"fedcba9876543210fedcba9876543210\"\r\n"
+                            "\r\n";
+    static char* sSDPLine = "a=fmtp:96 packetization-mode=1;profile-level-id=42C01E;sprop-parameter-sets=Z0LAHtkDxWhAAAADAEAAAAwDxYuS,aMuMsg==\r\n";
+    
+    // A big SDP, like a multi program source or one with many fmtp lines
+    UInt32 theSDPLineLen = ::strlen(sSDPLine);
+    UInt32 theSDPLen = 256 * theSDPLineLen;
+    char* theSDP = NEW char[theSDPLen];
+    for (UInt32 x = 0; x < 256; x++)
+        ::memcpy(theSDP + (x * theSDPLineLen), sSDPLine, theSDPLineLen);
+    
+    StrPtrLen theRequest(sRequest, ::strlen(sRequest));
+    StrPtrLen theSDPString(theSDP, theSDPLen);
+    
+    UInt32 theLevel = GetScanLevel();
+    for (UInt32 theTestLevel = kScanScalar; theTestLevel <= theLevel; theTestLevel++)
+    {
+        SetScanLevel(theTestLevel);
+        
+        // Headers the way RTSPRequest::Parse reads them
+        SInt64 theStartTime = OS::Microseconds();
+        for (UInt32 x = 0; x < inIterations; x++)
+        {
+            StringParser theParser(&theRequest);
+            theParser.ConsumeWord();
+            theParser.ConsumeWhitespace();
+            theParser.ConsumeUntil(NULL, sEOLWhitespaceMask);
+            theParser.ConsumeWhitespace();
+            theParser.GetThruEOL(NULL);
+            while (theParser.GetDataRemaining() > 2)
+            {
+                theParser.ConsumeUntil(NULL, ':');
+                theParser.Expect(':');
+                theParser.ConsumeWhitespace();
+                theParser.GetThruEOL(NULL);
+            }
+        }
+        SInt64 theHeaderTime = OS::Microseconds() - theStartTime;
+        
+        // SDP lines the way SDPSourceInfo reads them
+        theStartTime = OS::Microseconds();
+        for (UInt32 x = 0; x < inIterations / 64; x++)
+        {
+            StringParser theParser(&theSDPString);
+            while (theParser.GetDataRemaining() > 0)
+            {
+                theParser.ConsumeUntil(NULL, '=');
+                theParser.Expect('=');
+                theParser.GetThruEOL(NULL);
+            }
+        }
+        SInt64 theSDPTime = OS::Microseconds() - theStartTime;
+        
+        qtss_printf("StringParser::Benchmark level %"_U32BITARG_": headers %"_64BITARG_"d usec (%.1f MB/s), SDP %"_64BITARG_"d usec (%.1f MB/s)\n",
+            theTestLevel, theHeaderTime, (Float32)theRequest.Len * inIterations / (theHeaderTime + 1),
+            theSDPTime, (Float32)theSDPLen * (inIterations / 64) / (theSDPTime + 1));
+    }
+    SetScanLevel(theLevel);
+    delete [] theSDP;
+}
 #endif
@@ -61,6 +61,19 @@ class StringParser
        
         static UInt8 sWhitespaceMask[]; // skip over whitespace
         
+        // ConsumeUntil scans for the built-in masks and for single stop
+        // characters 16 or 32 bytes at a time when the CPU can. The level is
+        // picked at startup. SetScanLevel is for benchmarks and tests, it clamps
+        // to what the CPU supports and must not be called while parsing.
+        enum
+        {
+            kScanScalar = 0,
+            kScanSSE2   = 1,
+            kScanAVX2   = 2
+        };
+        static UInt32   GetScanLevel();
+        static void     SetScanLevel(UInt32 inLevel);
+
 
         //GetBuffer:
         //Returns a pointer to the string object
@@ -139,6 +152,7 @@ class StringParser
 
 #if STRINGPARSERTESTING
         static Bool16       Test();
+        static void         Benchmark(UInt32 inIterations);
 #endif
 
     private:
@@ -47,6 +47,14 @@
 #include "TCPListenerSocket.h"
 #include "Task.h"
 
+#if _TCPLISTENERSOCKET_TESTING_
+#include <poll.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include "OS.h"
+#include "OSMemory.h"
+#endif
+
 
 
 OS_Error TCPListenerSocket::Listen(UInt32 queueLength)
@@ -60,7 +68,7 @@ OS_Error TCPListenerSocket::Listen(UInt32 queueLength)
     return OS_NoErr;
 }
 
-OS_Error TCPListenerSocket::Initialize(UInt32 addr, UInt16 port)
+OS_Error TCPListenerSocket::Initialize(UInt32 addr, UInt16 port, Bool16 reusePort)
 {
     OS_Error err = this->TCPSocket::Open();
     if (0 == err) do
@@ -71,6 +79,12 @@ OS_Error TCPListenerSocket::Initialize(UInt32 addr, UInt16 port)
         // so don't do it on NT.
         this->ReuseAddr();
 #endif
+        if (reusePort)
+        {
+            err = this->ReusePort();
+            if (err != 0) break;
+        }
+
         err = this->Bind(addr, port);
         if (err != 0) break; // don't assert this is just a port already in use.
 
@@ -79,6 +93,15 @@ OS_Error TCPListenerSocket::Initialize(UInt32 addr, UInt16 port)
         // can be used for incoming broadcast data. This could force the server
         // to run out of memory faster if it gets bogged down, but it is unavoidable.
         this->SetSocketRcvBufSize(96 * 1024);       
+
+#if __linux__
+        // Accepted sockets inherit these from the listener on Linux, so they
+        // are set once here instead of on every new connection
+        this->NoDelay();
+        this->KeepAlive();
+        this->SetSocketBufSize(96 * 1024);
+#endif
+
         err = this->Listen(kListenQueueLength);
         AssertV(err == 0, OSThread::GetErrno()); 
         if (err != 0) break;
@@ -102,96 +125,113 @@ void TCPListenerSocket::ProcessEvent(int /*eventBits*/)
     Task* theTask = NULL;
     TCPSocket* theSocket = NULL;
     
-    //fSocket data member of TCPSocket.
-	int osSocket = accept(fFileDesc, (struct sockaddr*)&addr, &size);
+    // Drain the listen queue, up to kMaxAcceptsPerEvent connections per wakeup,
+    // so a burst of connects doesn't take one event per connection.
+    for (UInt32 theNumAccepted = 0; theNumAccepted < kMaxAcceptsPerEvent; theNumAccepted++)
+    {
+        size = sizeof(addr);
+        
+        //fSocket data member of TCPSocket.
+#if __linux__ && defined(SOCK_NONBLOCK)
+        int osSocket = accept4(fFileDesc, (struct sockaddr*)&addr, &size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+        int osSocket = accept(fFileDesc, (struct sockaddr*)&addr, &size);
+#endif
 
 //test osSocket = -1;
-	if (osSocket == -1)
-	{
-        //take a look at what this error is.
-        int acceptError = OSThread::GetErrno();
-        if (acceptError == EAGAIN)
-        { 
-            //If it's EAGAIN, there's nothing on the listen queue right now,
-            //so modwatch and return
-            this->RequestEvent(EV_RE);
-            return;
-        }
+        if (osSocket == -1)
+        {
+            //take a look at what this error is.
+            int acceptError = OSThread::GetErrno();
+            if (acceptError == EAGAIN)
+            { 
+                //If it's EAGAIN, there's nothing on the listen queue right now,
+                //so modwatch and return
+                this->RequestEvent(EV_RE);
+                return;
+            }
 		
 //test acceptError = ENFILE;
 //test acceptError = EINTR;
 //test acceptError = ENOENT;
 		 
-        //if these error gets returned, we're out of file desciptors, 
-        //the server is going to be failing on sockets, logs, qtgroups and qtuser auth file accesses and movie files. The server is not functional.
-		if (acceptError == EMFILE || acceptError == ENFILE)
-        {           
+            //if these error gets returned, we're out of file desciptors, 
+            //the server is going to be failing on sockets, logs, qtgroups and qtuser auth file accesses and movie files. The server is not functional.
+            if (acceptError == EMFILE || acceptError == ENFILE)
+            {           
 #ifndef __Win32__
 
-			QTSSModuleUtils::LogErrorStr(qtssFatalVerbosity,  "Out of File Descriptors. Set max connections lower and check for competing usage from other processes. Exiting.");
+                QTSSModuleUtils::LogErrorStr(qtssFatalVerbosity,  "Out of File Descriptors. Set max connections lower and check for competing usage from other processes. Exiting.");
 #endif
 
-			exit (EXIT_FAILURE);	
-        }
-        else
-        {   
-            char errStr[256];
-            errStr[sizeof(errStr) -1] = 0;
-            qtss_snprintf(errStr, sizeof(errStr) -1, "accept error = %d '%s' on socket. Clean up and continue.", acceptError, strerror(acceptError)); 
-            WarnV( (acceptError == 0), errStr);
-            
-            theTask = this->GetSessionTask(&theSocket);
-            if (theTask == NULL)
-            {   
-                close(osSocket);
+                exit (EXIT_FAILURE);	
             }
             else
-            {  
-                theTask->Signal(Task::kKillEvent); // just clean up the task
+            {   
+                char errStr[256];
+                errStr[sizeof(errStr) -1] = 0;
+                qtss_snprintf(errStr, sizeof(errStr) -1, "accept error = %d '%s' on socket. Clean up and continue.", acceptError, strerror(acceptError)); 
+                WarnV( (acceptError == 0), errStr);
+                
+                theTask = this->GetSessionTask(&theSocket);
+                if (theTask == NULL)
+                {   
+                    close(osSocket);
+                }
+                else
+                {  
+                    theTask->Signal(Task::kKillEvent); // just clean up the task
+                }
+                
+                if (theSocket)
+                    theSocket->fState &= ~kConnected; // turn off connected state
+                
+                return;
             }
-            
+        }
+        
+        theTask = this->GetSessionTask(&theSocket);
+        if (theTask == NULL)
+        {    //this should be a disconnect. do an ioctl call?
+            close(osSocket);
             if (theSocket)
                 theSocket->fState &= ~kConnected; // turn off connected state
-            
-            return;
         }
-	}
-	
-    theTask = this->GetSessionTask(&theSocket);
-    if (theTask == NULL)
-    {    //this should be a disconnect. do an ioctl call?
-        close(osSocket);
-        if (theSocket)
-            theSocket->fState &= ~kConnected; // turn off connected state
-    }
-    else
-    {   
-        Assert(osSocket != EventContext::kInvalidFileDesc);
+        else
+        {   
+            Assert(osSocket != EventContext::kInvalidFileDesc);
+            
+#if !__linux__
+            //set options on the socket
+            //we are a server, always disable nagle algorithm
+            int one = 1;
+            int err = ::setsockopt(osSocket, IPPROTO_TCP, TCP_NODELAY, (char*)&one, sizeof(int));
+            AssertV(err == 0, OSThread::GetErrno());
+            
+            err = ::setsockopt(osSocket, SOL_SOCKET, SO_KEEPALIVE, (char*)&one, sizeof(int));
+            AssertV(err == 0, OSThread::GetErrno());
         
-        //set options on the socket
-        //we are a server, always disable nagle algorithm
-        int one = 1;
-        int err = ::setsockopt(osSocket, IPPROTO_TCP, TCP_NODELAY, (char*)&one, sizeof(int));
-        AssertV(err == 0, OSThread::GetErrno());
+            int sndBufSize = 96L * 1024L;
+            err = ::setsockopt(osSocket, SOL_SOCKET, SO_SNDBUF, (char*)&sndBufSize, sizeof(int));
+            AssertV(err == 0, OSThread::GetErrno());
+#endif
         
-        err = ::setsockopt(osSocket, SOL_SOCKET, SO_KEEPALIVE, (char*)&one, sizeof(int));
-        AssertV(err == 0, OSThread::GetErrno());
-    
-        int sndBufSize = 96L * 1024L;
-        err = ::setsockopt(osSocket, SOL_SOCKET, SO_SNDBUF, (char*)&sndBufSize, sizeof(int));
-        AssertV(err == 0, OSThread::GetErrno());
-    
-        //setup the socket. When there is data on the socket,
-        //theTask will get an kReadEvent event
-        theSocket->Set(osSocket, &addr);
-        theSocket->InitNonBlocking(osSocket);
-        theSocket->SetTask(theTask);
-        theSocket->RequestEvent(EV_RE);
+            //setup the socket. When there is data on the socket,
+            //theTask will get an kReadEvent event
+            theSocket->Set(osSocket, &addr);
+#if !(__linux__ && defined(SOCK_NONBLOCK))
+            theSocket->InitNonBlocking(osSocket); // accept4 already made it non-blocking
+#endif
+            theSocket->SetTask(theTask);
+            theSocket->RequestEvent(EV_RE);
+            
+            theTask->SetThreadPicker(Task::GetBlockingTaskThreadPicker()); //The Message Task processing threads
+        }
         
-        theTask->SetThreadPicker(Task::GetBlockingTaskThreadPicker()); //The Message Task processing threads
+        // At our maximum supported sockets, leave the rest on the listen queue
+        if (fSleepBetweenAccepts)
+            break;
     }
-    
-
 
     if (fSleepBetweenAccepts)
     { 	
@@ -204,6 +244,7 @@ void TCPListenerSocket::ProcessEvent(int /*eventBits*/)
     else
     { 	
         // sleep until there is a read event outstanding (another client wants to connect)
+        // or, if the batch ran out, go around again for the rest of the listen queue
         //qtss_printf("TCPListenerSocket normal speed\n");
         this->RequestEvent(EV_RE);
     }
@@ -230,3 +271,131 @@ SInt64 TCPListenerSocket::Run()
     this->ProcessEvent(Task::kReadEvent);
     return 0;
 }
+
+#if _TCPLISTENERSOCKET_TESTING_
+
+static int CompareLatencies(const void* inA, const void* inB)
+{
+    SInt64 theA = *(const SInt64*)inA;
+    SInt64 theB = *(const SInt64*)inB;
+    return (theA < theB) ? -1 : ((theA > theB) ? 1 : 0);
+}
+
+void TCPListenerSocket::BenchmarkAccept(UInt32 inRemoteAddr, UInt16 inRemotePort, UInt32 inNumConnections)
+{
+    enum { kMaxConnectsInFlight = 1024 };
+    static const char sRequest[] = "OPTIONS * RTSP/1.0\r\nCSeq: 1\r\n\r\n";
+
+    int* theFDs = NEW int[inNumConnections];
+    SInt64* theStartTimes = NEW SInt64[inNumConnections];
+    SInt64* theLatencies = NEW SInt64[inNumConnections];
+    struct pollfd* thePolls = NEW struct pollfd[kMaxConnectsInFlight];
+    UInt32* thePollIndexes = NEW UInt32[kMaxConnectsInFlight];
+
+    struct sockaddr_in theAddr;
+    ::memset(&theAddr, 0, sizeof(theAddr));
+    theAddr.sin_family = AF_INET;
+    theAddr.sin_port = htons(inRemotePort);
+    theAddr.sin_addr.s_addr = htonl(inRemoteAddr);
+
+    UInt32 theNumStarted = 0;
+    UInt32 theNumDone = 0;
+    UInt32 theNumFailed = 0;
+    UInt32 theNumInFlight = 0;
+    SInt64 theBenchStart = OS::Microseconds();
+    while (theNumDone + theNumFailed < inNumConnections)
+    {
+        // Top up the connects in flight
+        while ((theNumInFlight < kMaxConnectsInFlight) && (theNumStarted < inNumConnections))
+        {
+            UInt32 theIndex = theNumStarted++;
+            theStartTimes[theIndex] = OS::Microseconds();
+            theFDs[theIndex] = ::socket(PF_INET, SOCK_STREAM, 0);
+            if (theFDs[theIndex] == -1)
+            {
+                theNumFailed++;
+                continue;
+            }
+            (void)::fcntl(theFDs[theIndex], F_SETFL, ::fcntl(theFDs[theIndex], F_GETFL, 0) | O_NONBLOCK);
+            if ((::connect(theFDs[theIndex], (struct sockaddr*)&theAddr, sizeof(theAddr)) == -1) && (OSThread::GetErrno() != EINPROGRESS))
+            {
+                ::close(theFDs[theIndex]);
+                theFDs[theIndex] = -1;
+                theNumFailed++;
+                continue;
+            }
+            thePolls[theNumInFlight].fd = theFDs[theIndex];
+            thePolls[theNumInFlight].events = POLLOUT;
+            thePolls[theNumInFlight].revents = 0;
+            thePollIndexes[theNumInFlight] = theIndex;
+            theNumInFlight++;
+        }
+
+        if (::poll(thePolls, theNumInFlight, 1000) <= 0)
+            continue;
+
+        // Once connected, send the request and wait for the first byte of the
+        // response. Finished connections stay open until the end.
+        for (UInt32 x = 0; x < theNumInFlight; )
+        {
+            UInt32 theIndex = thePollIndexes[x];
+            Bool16 isFinished = false;
+            if (thePolls[x].revents & POLLIN)
+            {
+                char theBuffer[512];
+                if (::recv(theFDs[theIndex], theBuffer, sizeof(theBuffer), 0) > 0)
+                    theLatencies[theNumDone++] = OS::Microseconds() - theStartTimes[theIndex];
+                else
+                    theNumFailed++;
+                isFinished = true;
+            }
+            else if (thePolls[x].revents & (POLLERR | POLLHUP))
+            {
+                theNumFailed++;
+                isFinished = true;
+            }
+            else if (thePolls[x].revents & POLLOUT)
+            {
+                if (::send(theFDs[theIndex], sRequest, sizeof(sRequest) - 1, 0) != sizeof(sRequest) - 1)
+                {
+                    theNumFailed++;
+                    isFinished = true;
+                }
+                else
+                    thePolls[x].events = POLLIN;
+            }
+
+            if (isFinished)
+            {
+                theNumInFlight--;
+                thePolls[x] = thePolls[theNumInFlight];
+                thePollIndexes[x] = thePollIndexes[theNumInFlight];
+            }
+            else
+                x++;
+        }
+    }
+    SInt64 theBenchTime = OS::Microseconds() - theBenchStart;
+
+    ::qsort(theLatencies, theNumDone, sizeof(SInt64), CompareLatencies);
+    if (theNumDone > 0)
+        qtss_printf("TCPListenerSocket::BenchmarkAccept %"_U32BITARG_" connections (%"_U32BITARG_" failed) in %"_64BITARG_"d usec: "
+                    "p50 %"_64BITARG_"d p90 %"_64BITARG_"d p99 %"_64BITARG_"d max %"_64BITARG_"d usec\n",
+                    theNumDone, theNumFailed, theBenchTime, theLatencies[(theNumDone * 50) / 100],
+                    theLatencies[(theNumDone * 90) / 100], theLatencies[(theNumDone * 99) / 100], theLatencies[theNumDone - 1]);
+    else
+        qtss_printf("TCPListenerSocket::BenchmarkAccept all %"_U32BITARG_" connections failed\n", theNumFailed);
+
+    for (UInt32 y = 0; y < theNumStarted; y++)
+    {
+        if (theFDs[y] != -1)
+            ::close(theFDs[y]);
+    }
+    delete [] theFDs;
+    delete [] theStartTimes;
+    delete [] theLatencies;
+    delete [] thePolls;
+    delete [] thePollIndexes;
+}
+
+#endif
@@ -40,6 +40,8 @@
 #include "TCPSocket.h"
 #include "IdleTask.h"
 
+#define _TCPLISTENERSOCKET_TESTING_ 0
+
 class TCPListenerSocket : public TCPSocket, public IdleTask
 {
     public:
@@ -52,8 +54,9 @@ class TCPListenerSocket : public TCPSocket, public IdleTask
         // Send a TCPListenerObject a Kill event to delete it.
                 
         //addr = listening address. port = listening port. Automatically
-        //starts listening
-        OS_Error        Initialize(UInt32 addr, UInt16 port);
+        //starts listening. With reusePort, the socket is opened with SO_REUSEPORT
+        //so several listeners can share the port, each on its own event thread.
+        OS_Error        Initialize(UInt32 addr, UInt16 port, Bool16 reusePort = false);
 
         //You can query the listener to see if it is failing to accept
         //connections because the OS is out of descriptors.
@@ -65,13 +68,22 @@ class TCPListenerSocket : public TCPSocket, public IdleTask
         virtual Task*   GetSessionTask(TCPSocket** outSocket) = 0;
         
         virtual SInt64  Run();
+
+#if _TCPLISTENERSOCKET_TESTING_
+        //Opens inNumConnections connections to a listener at the address, at most
+        //kMaxConnectsInFlight at a time, and keeps them all open until the end. Each one
+        //sends an RTSP OPTIONS request, and the time from connect() to the first byte
+        //of the response is reported as p50 / p90 / p99 / max. Raise the fd limit first.
+        static void     BenchmarkAccept(UInt32 inRemoteAddr, UInt16 inRemotePort, UInt32 inNumConnections);
+#endif
             
     private:
     
         enum
         {
             kTimeBetweenAcceptsInMsec = 1000,   //UInt32
-            kListenQueueLength = 128            //UInt32
+            kListenQueueLength = 1024,          //UInt32
+            kMaxAcceptsPerEvent = 64            //UInt32
         };
 
         virtual void ProcessEvent(int eventBits);
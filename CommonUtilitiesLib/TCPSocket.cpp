@@ -47,6 +47,12 @@
 #include <netlog.h>
 #endif
 
+#if _TCPSOCKET_TESTING_
+#include <sys/resource.h>
+#include <poll.h>
+#include "OSMemory.h"
+#endif
+
 void TCPSocket::SnarfSocket( TCPSocket & fromSocket )
 {
     // take the connection away from the other socket
@@ -118,3 +124,90 @@ OS_Error  TCPSocket::Connect(UInt32 inRemoteAddr, UInt16 inRemotePort)
 
 }
 
+#if _TCPSOCKET_TESTING_
+
+static SInt64 GetProcessCPUMicroseconds()
+{
+    struct rusage theUsage;
+    (void)::getrusage(RUSAGE_SELF, &theUsage);
+    return ((SInt64)theUsage.ru_utime.tv_sec + theUsage.ru_stime.tv_sec) * 1000000
+            + theUsage.ru_utime.tv_usec + theUsage.ru_stime.tv_usec;
+}
+
+void TCPSocket::BenchmarkZeroCopy(UInt32 inRemoteAddr, UInt16 inRemotePort, UInt32 inNumMBytes)
+{
+    // Same sized writes as a full RTSP coalesce buffer
+    enum { kBufferSize = 65536, kNumBuffers = 16 };
+    char* theBuffers = NEW char[kBufferSize * kNumBuffers];
+    ::memset(theBuffers, 'x', kBufferSize * kNumBuffers);
+
+    for (UInt32 theMode = 0; theMode < 2; theMode++)
+    {
+        Bool16 isZeroCopy = (theMode == 1);
+        TCPSocket theSocket(NULL, 0);
+        if ((theSocket.Open() != OS_NoErr) || (theSocket.Connect(inRemoteAddr, inRemotePort) != OS_NoErr))
+        {
+            qtss_printf("TCPSocket::BenchmarkZeroCopy can't connect to the sink\n");
+            break;
+        }
+        if (isZeroCopy && (theSocket.EnableZeroCopy() != OS_NoErr))
+        {
+            qtss_printf("TCPSocket::BenchmarkZeroCopy zero copy isn't supported\n");
+            break;
+        }
+
+        UInt32 theSendIDs[kNumBuffers];
+        Bool16 theInFlight[kNumBuffers];
+        ::memset(theInFlight, 0, sizeof(theInFlight));
+        UInt32 theNumCopied = 0;
+
+        UInt64 theTotal = (UInt64)inNumMBytes * 1024 * 1024;
+        UInt64 theSent = 0;
+        SInt64 theCPUStart = GetProcessCPUMicroseconds();
+        SInt64 theStart = OS::Microseconds();
+        OS_Error theErr = OS_NoErr;
+        for (UInt32 x = 0; (theSent < theTotal) && (theErr == OS_NoErr); x = (x + 1) % kNumBuffers)
+        {
+            struct iovec theVec;
+            theVec.iov_base = theBuffers + (x * kBufferSize);
+            theVec.iov_len = kBufferSize;
+            UInt32 theLen = 0;
+
+            if (isZeroCopy)
+            {
+                // Wait for the kernel to let go of the buffer. The completions make
+                // the socket poll with POLLERR
+                while (theInFlight[x] && !theSocket.ZeroCopySendDone(theSendIDs[x]))
+                {
+                    struct pollfd thePoll;
+                    thePoll.fd = theSocket.GetSocketFD();
+                    thePoll.events = 0;
+                    (void)::poll(&thePoll, 1, 100);
+                }
+                theErr = theSocket.WriteVZeroCopy(&theVec, 1, &theLen, &theSendIDs[x]);
+                theInFlight[x] = (theErr == OS_NoErr);
+                if (theErr == ENOBUFS)
+                {
+                    theNumCopied++;
+                    theErr = theSocket.WriteV(&theVec, 1, &theLen);
+                }
+            }
+            else
+                theErr = theSocket.WriteV(&theVec, 1, &theLen);
+
+            theSent += theLen;
+        }
+        SInt64 theCPUTime = GetProcessCPUMicroseconds() - theCPUStart;
+        SInt64 theTime = OS::Microseconds() - theStart;
+
+        Float64 theGbits = (Float64)theSent * 8 / 1000000000;
+        qtss_printf("TCPSocket::BenchmarkZeroCopy %s: %"_64BITARG_"u bytes in %"_64BITARG_"d usec, %"_64BITARG_"d usec CPU, %.0f msec CPU per Gbit, %"_U32BITARG_" copied sends\n",
+                    isZeroCopy ? "MSG_ZEROCOPY" : "writev", theSent, theTime, theCPUTime,
+                    (theGbits > 0) ? ((Float64)theCPUTime / 1000 / theGbits) : 0.0, theNumCopied);
+    }
+
+    delete [] theBuffers;
+}
+
+#endif
+
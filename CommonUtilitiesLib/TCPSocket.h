@@ -47,6 +47,8 @@
 #include "Task.h"
 #include "StrPtrLen.h"
 
+#define _TCPSOCKET_TESTING_ 0
+
 class TCPSocket : public Socket
 {
     public:
@@ -86,6 +88,14 @@ class TCPSocket : public Socket
         //This function is NOT thread safe!
         StrPtrLen*  GetRemoteAddrStr();
 
+#if _TCPSOCKET_TESTING_
+        //Sends inNumMBytes to a sink listening at the address (nc -l > /dev/null will do),
+        //once with WriteV and once with WriteVZeroCopy, and prints the CPU time each took
+        //per Gbit sent. The kernel copies anyway on loopback, where MSG_ZEROCOPY only
+        //adds the cost of the completions, so use a remote sink.
+        static void BenchmarkZeroCopy(UInt32 inRemoteAddr, UInt16 inRemotePort, UInt32 inNumMBytes);
+#endif
+
     protected:
 
         void        Set(int inSocket, struct sockaddr_in* remoteaddr);
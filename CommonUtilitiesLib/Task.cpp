@@ -36,6 +36,13 @@
 #include "atomic.h"
 #include "OSMutexRW.h"
 
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <time.h>
+#endif
+
 
 unsigned int    Task::sShortTaskThreadPicker = 0;
 unsigned int    Task::sBlockingTaskThreadPicker = 0;
@@ -44,7 +51,7 @@ OSMutexRW       TaskThreadPool::sMutexRW;
 static char* sTaskStateStr="live_"; //Alive
 
 Task::Task()
-:   fEvents(0), fUseThisThread(NULL),fDefaultThread(NULL), fWriteLock(false), fTimerHeapElem(), fTaskQueueElem(), pickerToUse(&Task::sShortTaskThreadPicker)
+:   fEvents(0), fUseThisThread(NULL),fDefaultThread(NULL), fWriteLock(false), fTimerWheelElem(), fTaskQueueElem(), pickerToUse(&Task::sShortTaskThreadPicker)
 {
 #if DEBUG
     fInRunCount = 0;
@@ -52,7 +59,7 @@ Task::Task()
     this->SetTaskName("unknown");
 
 	fTaskQueueElem.SetEnclosingObject(this);
-	fTimerHeapElem.SetEnclosingObject(this);
+	fTimerWheelElem.SetEnclosingObject(this);
 
 }
 
@@ -114,6 +121,8 @@ void Task::Signal(EventFlags events)
             }
             
 			fUseThisThread->fTaskQueue.EnQueue(&fTaskQueueElem);
+            if (TaskThreadPool::sWorkStealing)
+                (void)fUseThisThread->Unpark();
         }
         else
         {
@@ -144,7 +153,18 @@ void Task::Signal(EventFlags events)
             if (TASK_DEBUG) if (fTaskName[0] == 0) ::strcpy(fTaskName, " _Corrupt_Task");
 
 			if (TASK_DEBUG) qtss_printf("Task::Signal EnQueue B TaskName=%s theThreadIndex=%u thread=%p fTaskQueue.GetLength(%"_U32BITARG_") q_elem=%p enclosing=%p\n", fTaskName,theThreadIndex,  (void *)TaskThreadPool::sTaskThreadArray[theThreadIndex],TaskThreadPool::sTaskThreadArray[theThreadIndex]->fTaskQueue.GetQueue()->GetLength(), (void *) &fTaskQueueElem,(void *) this);
-            TaskThreadPool::sTaskThreadArray[theThreadIndex]->fTaskQueue.EnQueue(&fTaskQueueElem);
+            TaskThread* theThread = TaskThreadPool::sTaskThreadArray[theThreadIndex];
+            if (TaskThreadPool::sWorkStealing)
+            {
+                // If the picked thread is busy, wake an idle one so it can steal this task.
+                // A full run queue falls back to the thread's ordinary task queue.
+                if (!theThread->fRunQueue.Push(this))
+                    theThread->fTaskQueue.EnQueue(&fTaskQueueElem);
+                if (!theThread->Unpark())
+                    TaskThreadPool::WakeIdleThread(theThread);
+            }
+            else
+                theThread->fTaskQueue.EnQueue(&fTaskQueueElem);
             if (TASK_DEBUG) qtss_printf("Task::Signal EnQueue A TaskName=%s theThreadIndex=%u thread=%p fTaskQueue.GetLength(%"_U32BITARG_") q_elem=%p enclosing=%p\n", fTaskName,theThreadIndex,  (void *)TaskThreadPool::sTaskThreadArray[theThreadIndex],TaskThreadPool::sTaskThreadArray[theThreadIndex]->fTaskQueue.GetQueue()->GetLength(), (void *) &fTaskQueueElem,(void *) this);
 
         }
@@ -215,6 +235,7 @@ void TaskThread::Entry()
             theTask->fUseThisThread = NULL; // Each invocation of Run must independently
                                             // request a specific thread.
             SInt64 theTimeout = 0;
+            fNumRuns++;
             
             if (theTask->fWriteLock)
             {   
@@ -245,8 +266,8 @@ void TaskThread::Entry()
                      
                     theTask->fUseThisThread = NULL;
                     
-                    if (NULL != fHeap.Remove(&theTask->fTimerHeapElem)) 
-                        qtss_printf("TaskThread::Entry task still in heap before delete\n");
+                    if (theTask->fTimerWheelElem.IsMemberOfAnyWheel()) 
+                        qtss_printf("TaskThread::Entry task still in timer wheel before delete\n");
                     
                     if (NULL != theTask->fTaskQueueElem.InQueue())
                         qtss_printf("TaskThread::Entry task still in queue before delete\n");
@@ -260,6 +281,7 @@ void TaskThread::Entry()
                      
                     ::strncat (theTask->fTaskName, " deleted", sizeof(theTask->fTaskName) -1);
                 }
+                Assert(!theTask->fTimerWheelElem.IsMemberOfAnyWheel());
                 theTask->fTaskName[0] = 'D'; //mark as dead
                 delete theTask;
                 theTask = NULL;
@@ -280,9 +302,13 @@ void TaskThread::Entry()
             {
                 //note that if we get here, we don't reset theTask, so it will get passed into
                 //WaitForTask
-                if (TASK_DEBUG) qtss_printf("TaskThread::Entry insert TaskName=%s in timer heap thread=%p elem=%p task=%p timeout=%.2f\n", theTask->fTaskName,  (void *) this, (void *) &theTask->fTimerHeapElem,(void *) theTask, (float)theTimeout / (float) 1000);
-                theTask->fTimerHeapElem.SetValue(OS::Milliseconds() + theTimeout);
-                fHeap.Insert(&theTask->fTimerHeapElem);
+                if (TASK_DEBUG) qtss_printf("TaskThread::Entry insert TaskName=%s in timer wheel thread=%p elem=%p task=%p timeout=%.2f\n", theTask->fTaskName,  (void *) this, (void *) &theTask->fTimerWheelElem,(void *) theTask, (float)theTimeout / (float) 1000);
+                
+                //The task can't be in any wheel here: while its timeout is armed it keeps
+                //kAlive set, so Signal doesn't queue it, and it only runs again once
+                //the timeout has fired and ExtractExpired has taken it out of the wheel.
+                theTask->fTimerWheelElem.SetValue(OS::Milliseconds() + theTimeout);
+                fTimerWheel.Insert(&theTask->fTimerWheelElem);
                 (void)atomic_or(&theTask->fEvents, Task::kIdleEvent);
                 doneProcessingEvent = true;
             }
@@ -312,20 +338,24 @@ void TaskThread::Entry()
 
 Task* TaskThread::WaitForTask()
 {
+    if (TaskThreadPool::sWorkStealing)
+        return this->WaitForTaskWorkStealing();
+        
     while (true)
     {
         SInt64 theCurrentTime = OS::Milliseconds();
         
-        if ((fHeap.PeekMin() != NULL) && (fHeap.PeekMin()->GetValue() <= theCurrentTime))
+        OSTimerWheelElem* theTimerElem = fTimerWheel.ExtractExpired(theCurrentTime);
+        if (theTimerElem != NULL)
         {    
-            if (TASK_DEBUG) qtss_printf("TaskThread::WaitForTask found timer-task=%s thread %p fHeap.CurrentHeapSize(%"_U32BITARG_") taskElem = %p enclose=%p\n",((Task*)fHeap.PeekMin()->GetEnclosingObject())->fTaskName, (void *) this, fHeap.CurrentHeapSize(), (void *) fHeap.PeekMin(), (void *) fHeap.PeekMin()->GetEnclosingObject());
-            return (Task*)fHeap.ExtractMin()->GetEnclosingObject();
+            if (TASK_DEBUG) qtss_printf("TaskThread::WaitForTask found timer-task=%s thread %p fTimerWheel.GetNumElems(%"_U32BITARG_") taskElem = %p enclose=%p\n",((Task*)theTimerElem->GetEnclosingObject())->fTaskName, (void *) this, fTimerWheel.GetNumElems(), (void *) theTimerElem, (void *) theTimerElem->GetEnclosingObject());
+            return (Task*)theTimerElem->GetEnclosingObject();
         }
     
         //if there is an element waiting for a timeout, figure out how long we should wait.
         SInt64 theTimeout = 0;
-        if (fHeap.PeekMin() != NULL)
-            theTimeout = fHeap.PeekMin()->GetValue() - theCurrentTime;
+        if (fTimerWheel.GetNumElems() > 0)
+            theTimeout = fTimerWheel.GetNextExpiration() - theCurrentTime;
         Assert(theTimeout >= 0);
         
         //
@@ -351,10 +381,175 @@ Task* TaskThread::WaitForTask()
     }   
 }
 
+Task* TaskThread::WaitForTaskWorkStealing()
+{
+    while (true)
+    {
+        SInt64 theCurrentTime = OS::Milliseconds();
+        
+        OSTimerWheelElem* theTimerElem = fTimerWheel.ExtractExpired(theCurrentTime);
+        if (theTimerElem != NULL)
+            return (Task*)theTimerElem->GetEnclosingObject();
+    
+        SInt64 theTimeout = 0;
+        if (fTimerWheel.GetNumElems() > 0)
+            theTimeout = fTimerWheel.GetNextExpiration() - theCurrentTime;
+        Assert(theTimeout >= 0);
+        
+        // Same floor as WaitForTask, see the comment there
+	    if (theTimeout < kMinWaitTimeInMilSecs) 
+           theTimeout = kMinWaitTimeInMilSecs;
+        
+        // Pinned tasks first, then our own run queue, then other threads' run queues
+        OSQueueElem* theElem = fTaskQueue.DeQueue();
+        if (theElem != NULL)
+            return (Task*)theElem->GetEnclosingObject();
+            
+        Task* theTask = fRunQueue.Pop();
+        if (theTask != NULL)
+            return theTask;
+            
+        theTask = this->StealTask();
+        if (theTask != NULL)
+        {
+            fNumSteals++;
+            return theTask;
+        }
+
+        if (OSThread::GetCurrent()->IsStopRequested())
+            return NULL;
+            
+        // Announce that we are going to sleep, then look once more so that a
+        // Signal racing with us either sees kParked or its task is seen here.
+        (void)compare_and_store(kRunning, kParked, (unsigned int*)&fParkState);
+        if ((fTaskQueue.GetQueue()->GetLength() > 0) || (fRunQueue.GetDepth() > 0))
+        {
+            (void)compare_and_store(kParked, kRunning, (unsigned int*)&fParkState);
+            continue;
+        }
+        
+        this->Park((SInt32) theTimeout);
+        (void)compare_and_store(kParked, kRunning, (unsigned int*)&fParkState);
+    }   
+}
+
+Task* TaskThread::StealTask()
+{
+    UInt32 theFirst = 0;
+    UInt32 theLast = 0;
+    TaskThreadPool::GetThreadGroup(fIndex, &theFirst, &theLast);
+    
+    UInt32 theGroupSize = theLast - theFirst + 1;
+    for (UInt32 x = 1; x < theGroupSize; x++)
+    {
+        // Start with our neighbour so that idle threads don't all gang up on thread 0
+        UInt32 theVictim = theFirst + (fIndex - theFirst + x) % theGroupSize;
+        TaskThread* theThread = TaskThreadPool::sTaskThreadArray[theVictim];
+        if (theThread->fRunQueue.GetDepth() == 0)
+            continue;
+            
+        Task* theTask = theThread->fRunQueue.Pop();
+        if (theTask != NULL)
+            return theTask;
+    }
+    return NULL;
+}
+
+void TaskThread::Park(SInt32 inTimeoutInMilSecs)
+{
+#if defined(__linux__)
+    struct timespec theTimeout;
+    theTimeout.tv_sec = inTimeoutInMilSecs / 1000;
+    theTimeout.tv_nsec = (inTimeoutInMilSecs % 1000) * 1000000;
+    // Returns right away if fParkState is no longer kParked
+    (void)::syscall(SYS_futex, &fParkState, FUTEX_WAIT_PRIVATE, kParked, &theTimeout, NULL, 0);
+#else
+    OSMutexLocker theLocker(&fParkMutex);
+    if (fParkState == kParked)
+        fParkCond.Wait(&fParkMutex, inTimeoutInMilSecs);
+#endif
+}
+
+Bool16 TaskThread::Unpark()
+{
+    if (!compare_and_store(kParked, kRunning, (unsigned int*)&fParkState))
+        return false;
+        
+#if defined(__linux__)
+    (void)::syscall(SYS_futex, &fParkState, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+    OSMutexLocker theLocker(&fParkMutex);
+    fParkCond.Signal();
+#endif
+    return true;
+}
+
+TaskRunQueue::TaskRunQueue()
+:   fEnqueuePos(0),
+    fDequeuePos(0)
+{
+    for (UInt32 x = 0; x < kCapacity; x++)
+    {
+        fSlots[x].fSequence = x;
+        fSlots[x].fTask = NULL;
+    }
+}
+
+Bool16 TaskRunQueue::Push(Task* inTask)
+{
+    unsigned int thePos = fEnqueuePos;
+    Slot* theSlot = NULL;
+    while (true)
+    {
+        theSlot = &fSlots[thePos & (kCapacity - 1)];
+        SInt32 theDiff = (SInt32)(theSlot->fSequence - thePos);
+        if (theDiff == 0)
+        {
+            if (compare_and_store(thePos, thePos + 1, (unsigned int*)&fEnqueuePos))
+                break;
+        }
+        else if (theDiff < 0)
+            return false; // full
+            
+        thePos = fEnqueuePos;
+    }
+    
+    theSlot->fTask = inTask;
+    atomic_barrier();
+    theSlot->fSequence = thePos + 1;
+    return true;
+}
+
+Task* TaskRunQueue::Pop()
+{
+    unsigned int thePos = fDequeuePos;
+    Slot* theSlot = NULL;
+    while (true)
+    {
+        theSlot = &fSlots[thePos & (kCapacity - 1)];
+        SInt32 theDiff = (SInt32)(theSlot->fSequence - (thePos + 1));
+        if (theDiff == 0)
+        {
+            if (compare_and_store(thePos, thePos + 1, (unsigned int*)&fDequeuePos))
+                break;
+        }
+        else if (theDiff < 0)
+            return NULL; // empty
+            
+        thePos = fDequeuePos;
+    }
+    
+    Task* theTask = theSlot->fTask;
+    atomic_barrier();
+    theSlot->fSequence = thePos + kCapacity;
+    return theTask;
+}
+
 TaskThread** TaskThreadPool::sTaskThreadArray = NULL;
 UInt32       TaskThreadPool::sNumTaskThreads = 0;
 UInt32       TaskThreadPool::sNumShortTaskThreads = 0;
 UInt32       TaskThreadPool::sNumBlockingTaskThreads = 0;
+Bool16       TaskThreadPool::sWorkStealing = false;
 
 Bool16 TaskThreadPool::AddThreads(UInt32 numToAdd)
 {
@@ -364,6 +559,7 @@ Bool16 TaskThreadPool::AddThreads(UInt32 numToAdd)
     for (UInt32 x = 0; x < numToAdd; x++)
     {
         sTaskThreadArray[x] = NEW TaskThread();
+        sTaskThreadArray[x]->fIndex = x;
         sTaskThreadArray[x]->Start();
         if (TASK_DEBUG)  qtss_printf("TaskThreadPool::AddThreads sTaskThreadArray[%"_U32BITARG_"]=%p\n",x, sTaskThreadArray[x]); 
     }
@@ -377,6 +573,34 @@ Bool16 TaskThreadPool::AddThreads(UInt32 numToAdd)
 
 
 
+void TaskThreadPool::GetThreadGroup(UInt32 inIndex, UInt32* outFirst, UInt32* outLast)
+{
+    // Short task threads come first in sTaskThreadArray, blocking threads after them
+    if ((inIndex < sNumShortTaskThreads) || (sNumShortTaskThreads >= sNumTaskThreads))
+    {
+        *outFirst = 0;
+        *outLast = OS::Min(sNumShortTaskThreads, sNumTaskThreads) - 1;
+    }
+    else
+    {
+        *outFirst = sNumShortTaskThreads;
+        *outLast = sNumTaskThreads - 1;
+    }
+}
+
+void TaskThreadPool::WakeIdleThread(TaskThread* inThread)
+{
+    UInt32 theFirst = 0;
+    UInt32 theLast = 0;
+    GetThreadGroup(inThread->fIndex, &theFirst, &theLast);
+    
+    for (UInt32 x = theFirst; x <= theLast; x++)
+    {
+        if ((sTaskThreadArray[x] != inThread) && sTaskThreadArray[x]->Unpark())
+            return;
+    }
+}
+
 TaskThread* TaskThreadPool::GetThread(UInt32 index)
 {
 
@@ -400,7 +624,10 @@ void TaskThreadPool::RemoveThreads()
     //Because any (or all) threads may be blocked on the queue, cycle through
     //all the threads, signalling each one
     for (UInt32 y = 0; y < sNumTaskThreads; y++)
+    {
         sTaskThreadArray[y]->fTaskQueue.GetCond()->Signal();
+        (void)sTaskThreadArray[y]->Unpark();
+    }
     
     //Ok, now wait for the selected threads to terminate, deleting them and removing
     //them from the queue.
@@ -46,9 +46,10 @@
 #define __TASK_H__
 
 #include "OSQueue.h"
-#include "OSHeap.h"
+#include "OSTimerWheel.h"
 #include "OSThread.h"
 #include "OSMutexRW.h"
+#include "OSCond.h"
 
 #define TASK_DEBUG 0
 
@@ -148,9 +149,8 @@ class Task
         volatile UInt32 fInRunCount;
 #endif
 
-        //This could later be optimized by using a timing wheel instead of a heap,
-        //and that way we wouldn't need both a heap elem and a queue elem here (just queue elem)
-        OSHeapElem      fTimerHeapElem;
+        //Arms the idle timeout in the timer wheel of the TaskThread that ran us last
+        OSTimerWheelElem    fTimerWheelElem;
         OSQueueElem     fTaskQueueElem;
         
         unsigned int *pickerToUse;
@@ -161,15 +161,60 @@ class Task
         friend class    TaskThread; 
 };
 
+//
+// TaskRunQueue
+//
+// Bounded, lock-free run queue used by the work stealing scheduler. Any thread
+// may push (Task::Signal) and any thread may pop (the owner, or an idle thread
+// stealing work). Each slot carries a sequence number so that pushers and
+// poppers only ever contend on a single compare_and_store.
+class TaskRunQueue
+{
+    public:
+    
+        enum
+        {
+            kCapacity = 1024    //UInt32, must be a power of 2
+        };
+        
+                        TaskRunQueue();
+        
+        // Returns false if the queue is full
+        Bool16          Push(Task* inTask);
+        
+        // Returns NULL if the queue is empty
+        Task*           Pop();
+        
+        UInt32          GetDepth()  { return fEnqueuePos - fDequeuePos; }
+        
+    private:
+    
+        struct Slot
+        {
+            volatile unsigned int   fSequence;
+            Task*                   fTask;
+        };
+        
+        Slot                    fSlots[kCapacity];
+        volatile unsigned int   fEnqueuePos;
+        volatile unsigned int   fDequeuePos;
+};
+
 class TaskThread : public OSThread
 {
     public:
     
         //Implementation detail: all tasks get run on TaskThreads.
         
-                        TaskThread() :  OSThread(), fTaskThreadPoolElem()
+                        TaskThread() :  OSThread(), fTaskThreadPoolElem(), fParkState(kRunning),
+                                        fIndex(0), fNumRuns(0), fNumSteals(0)
                                         {fTaskThreadPoolElem.SetEnclosingObject(this);}
 						virtual         ~TaskThread() { this->StopAndWaitForThread(); }
+        
+        // Scheduler statistics
+        UInt64          GetNumRuns()        { return fNumRuns; }
+        UInt64          GetNumSteals()      { return fNumSteals; }
+        UInt32          GetQueueDepth()     { return fRunQueue.GetDepth() + fTaskQueue.GetQueue()->GetLength(); }
            
     private:
     
@@ -177,15 +222,36 @@ class TaskThread : public OSThread
         {
             kMinWaitTimeInMilSecs = 10  //UInt32
         };
+        
+        enum // fParkState
+        {
+            kRunning    = 0,
+            kParked     = 1
+        };
 
         virtual void    Entry();
         Task*           WaitForTask();
         
+        // Work stealing scheduler
+        Task*           WaitForTaskWorkStealing();
+        Task*           StealTask();
+        void            Park(SInt32 inTimeoutInMilSecs);
+        Bool16          Unpark();
+        
         OSQueueElem     fTaskThreadPoolElem;
         
-        OSHeap              fHeap;
-        OSQueue_Blocking    fTaskQueue;
+        OSTimerWheel        fTimerWheel;
+        OSQueue_Blocking    fTaskQueue; // holds tasks pinned to this thread
+        TaskRunQueue        fRunQueue;  // holds tasks any thread in the group may run
         
+        volatile unsigned int fParkState;
+#if !defined(__linux__)
+        OSMutex             fParkMutex;
+        OSCond              fParkCond;
+#endif
+        UInt32              fIndex;
+        UInt64              fNumRuns;
+        UInt64              fNumSteals;
         
         friend class Task;
         friend class TaskThreadPool;
@@ -206,12 +272,24 @@ public:
     static void SetNumShortTaskThreads(UInt32 numToAdd) { sNumShortTaskThreads = numToAdd; }
     static void SetNumBlockingTaskThreads(UInt32 numToAdd) { sNumBlockingTaskThreads = numToAdd; }
     
+    // Work stealing: each thread gets a lock-free run queue and idle threads
+    // take work from busy ones in the same group (short task or blocking).
+    // Tasks pinned with ForceSameThread or SetDefaultThread are never stolen.
+    // Must be set before AddThreads.
+    static void SetWorkStealing(Bool16 inEnabled) { sWorkStealing = inEnabled; }
+    static Bool16 IsWorkStealing() { return sWorkStealing; }
+    
 private:
 
+    // Wakes a parked thread in the same group as inThread, so it can steal
+    static void     WakeIdleThread(TaskThread* inThread);
+    static void     GetThreadGroup(UInt32 inIndex, UInt32* outFirst, UInt32* outLast);
+
     static TaskThread**     sTaskThreadArray;
     static UInt32           sNumTaskThreads;
     static UInt32           sNumShortTaskThreads;
     static UInt32           sNumBlockingTaskThreads;
+    static Bool16           sWorkStealing;
     
     static OSMutexRW        sMutexRW;// __attribute__((visibility("hidden")));
     
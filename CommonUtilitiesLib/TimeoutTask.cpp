@@ -47,63 +47,82 @@ void TimeoutTask::Initialize()
 
 
 TimeoutTask::TimeoutTask(Task* inTask, SInt64 inTimeoutInMilSecs)
-: fTask(inTask), fQueueElem()
+: fTask(inTask), fTimeoutAtThisTime(0), fTimeoutInMilSecs(0), fTimerElem()
 {
-	fQueueElem.SetEnclosingObject(this);
-    this->SetTimeout(inTimeoutInMilSecs);
+	fTimerElem.SetEnclosingObject(this);
     if (NULL == inTask)
 		fTask = (Task *) this;
     Assert(sThread != NULL); // this can happen if RunServer intializes tasks in the wrong order
 
-    OSMutexLocker locker(&sThread->fMutex); 
-    sThread->fQueue.EnQueue(&fQueueElem);
+    this->SetTimeout(inTimeoutInMilSecs);
 }
 
 TimeoutTask::~TimeoutTask()
 {
     OSMutexLocker locker(&sThread->fMutex);
-    sThread->fQueue.Remove(&fQueueElem);
+    (void)sThread->fWheel.Remove(&fTimerElem);
 }
 
 void TimeoutTask::SetTimeout(SInt64 inTimeoutInMilSecs)
 {
+    OSMutexLocker locker(&sThread->fMutex);
     fTimeoutInMilSecs = inTimeoutInMilSecs;
     if (inTimeoutInMilSecs == 0)
         fTimeoutAtThisTime = 0;
     else
         fTimeoutAtThisTime = OS::Milliseconds() + fTimeoutInMilSecs;
+
+    //the timeout may have become shorter, so re-arm right away
+    (void)sThread->fWheel.Remove(&fTimerElem);
+    if (fTimeoutAtThisTime > 0)
+    {
+        fTimerElem.SetValue(fTimeoutAtThisTime);
+        sThread->fWheel.Insert(&fTimerElem);
+    }
 }
 
 SInt64 TimeoutTaskThread::Run()
 {
-    //ok, check for timeouts now. Go through the whole queue
+    //ok, check for timeouts now. Only the timers that have fired are looked at
     OSMutexLocker locker(&fMutex);
     SInt64 curTime = OS::Milliseconds();
-	SInt64 intervalMilli = kIntervalSeconds * 1000;//always default to 60 seconds but adjust to smallest interval > 0
-	SInt64 taskInterval = intervalMilli;
+	SInt64 intervalMilli = kIntervalSeconds * 1000;
 	
-    for (OSQueueIter iter(&fQueue); !iter.IsDone(); iter.Next())
+    OSTimerWheelElem* theTimerElem = NULL;
+    while ((theTimerElem = fWheel.ExtractExpired(curTime)) != NULL)
     {
-        TimeoutTask* theTimeoutTask = (TimeoutTask*)iter.GetCurrent()->GetEnclosingObject();
+        TimeoutTask* theTimeoutTask = (TimeoutTask*)theTimerElem->GetEnclosingObject();
+        SInt64 theTimeoutAtThisTime = theTimeoutTask->fTimeoutAtThisTime;
+        if (theTimeoutAtThisTime == 0)
+            continue; // never times out, SetTimeout arms it again if that changes
         
-        //if it's time to time this task out, signal it
-        if ((theTimeoutTask->fTimeoutAtThisTime > 0) && (curTime >= theTimeoutTask->fTimeoutAtThisTime))
+        //if it's time to time this task out, signal it, and keep signalling it
+        //every interval until it goes away or refreshes its timeout
+        if (curTime >= theTimeoutAtThisTime)
         {
 #if TIMEOUT_DEBUGGING
-            qtss_printf("TimeoutTask %"_S32BITARG_" timed out. Curtime = %"_64BITARG_"d, timeout time = %"_64BITARG_"d\n",(SInt32)theTimeoutTask, curTime, theTimeoutTask->fTimeoutAtThisTime);
+            qtss_printf("TimeoutTask %"_S32BITARG_" timed out. Curtime = %"_64BITARG_"d, timeout time = %"_64BITARG_"d\n",(SInt32)theTimeoutTask, curTime, theTimeoutAtThisTime);
 #endif
 			theTimeoutTask->fTask->Signal(Task::kTimeoutEvent);
+			theTimerElem->SetValue(curTime + (kIntervalSeconds * 1000));
 		}
 		else
 		{
-			taskInterval = theTimeoutTask->fTimeoutAtThisTime - curTime;
-			if ( (taskInterval > 0) && (theTimeoutTask->fTimeoutInMilSecs > 0) && (intervalMilli > taskInterval) )
-				intervalMilli = taskInterval + 1000; // set timeout to 1 second past this task's timeout
+			//RefreshTimeout was called since the timer was armed
 #if TIMEOUT_DEBUGGING
-			qtss_printf("TimeoutTask %"_S32BITARG_" not being timed out. Curtime = %"_64BITARG_"d. timeout time = %"_64BITARG_"d\n", (SInt32)theTimeoutTask, curTime, theTimeoutTask->fTimeoutAtThisTime);
+			qtss_printf("TimeoutTask %"_S32BITARG_" not being timed out. Curtime = %"_64BITARG_"d. timeout time = %"_64BITARG_"d\n", (SInt32)theTimeoutTask, curTime, theTimeoutAtThisTime);
 #endif
+			theTimerElem->SetValue(theTimeoutAtThisTime);
 		}
+		fWheel.Insert(theTimerElem);
 	}
+	
+	SInt64 theNextExpiration = fWheel.GetNextExpiration();
+	if ((theNextExpiration > 0) && (theNextExpiration - curTime < intervalMilli))
+		intervalMilli = theNextExpiration - curTime;
+	if (intervalMilli < kMinIntervalMilSecs)
+		intervalMilli = kMinIntervalMilSecs;
+	
 	(void)this->GetEvents();//we must clear the event mask!
 	
 	OSThread::ThreadYield();
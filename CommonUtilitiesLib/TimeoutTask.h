@@ -44,7 +44,7 @@
 #include "IdleTask.h"
 
 #include "OSThread.h"
-#include "OSQueue.h"
+#include "OSTimerWheel.h"
 #include "OSMutex.h"
 #include "OS.h"
 
@@ -60,15 +60,16 @@ class TimeoutTaskThread : public IdleTask
 
     private:
         
-        //this thread runs every minute and checks for timeouts
+        //this thread runs when the next timeout is due, and at least every kIntervalSeconds
         enum
         {
-            kIntervalSeconds = 15   //UInt32
+            kIntervalSeconds = 15,      //UInt32
+            kMinIntervalMilSecs = 1000  //UInt32, timeouts due within this are handled together
         };
 
         virtual SInt64          Run();
         OSMutex                 fMutex;
-        OSQueue                 fQueue;
+        OSTimerWheel            fWheel;
         
         friend class TimeoutTask;
 };
@@ -93,7 +94,9 @@ class TimeoutTask
         void        SetTimeout(SInt64 inTimeoutInMilSecs);
         
         // Specified task will get a Task::kTimeoutEvent if this
-        // function isn't called within the timeout period
+        // function isn't called within the timeout period. This is called for
+        // every packet, so it doesn't touch the wheel: the timer stays armed at
+        // the old time, and is moved forward when it fires.
         void        RefreshTimeout() { fTimeoutAtThisTime = OS::Milliseconds() + fTimeoutInMilSecs; Assert(fTimeoutAtThisTime > 0); }
         
         void        SetTask(Task* inTask) { fTask = inTask; }
@@ -102,8 +105,8 @@ class TimeoutTask
         Task*       fTask;
         SInt64      fTimeoutAtThisTime;
         SInt64      fTimeoutInMilSecs;
-        //for putting on our global queue of timeout tasks
-        OSQueueElem fQueueElem;
+        //for arming in the timeout thread's wheel
+        OSTimerWheelElem fTimerElem;
         
         static TimeoutTaskThread*   sThread;
         
@@ -32,19 +32,101 @@
 */
 
 #include "UDPDemuxer.h"
+#include "OSMemory.h"
+#include "OSThread.h"
 
 #include <errno.h>
+#include <string.h>
 
+#if _UDPDEMUXER_TESTING_
+#include "OS.h"
+#endif
+
+UDPDemuxer::UDPDemuxer()
+:   fTable(NewTable(kMinTableSize)),
+    fRetiredTable(NULL),
+    fNumTasks(0),
+    fEpoch(0),
+    fMutex()
+{
+    fNumReaders[0] = fNumReaders[1] = 0;
+}
+
+UDPDemuxer::~UDPDemuxer()
+{
+    delete [] (char*)fTable;
+    delete [] (char*)fRetiredTable;
+}
+
+UInt32 UDPDemuxer::ComputeHashValue(UInt32 inRemoteAddr, UInt16 inRemotePort)
+{
+    // Mixes the 48 bits of address and port so that consecutive client ports,
+    // the common case, spread over the table instead of clustering.
+    UInt32 theHash = inRemoteAddr ^ ((UInt32)inRemotePort * 0x9E3779B1);
+    theHash ^= theHash >> 16;
+    theHash *= 0x85EBCA6B;
+    theHash ^= theHash >> 13;
+    return theHash;
+}
+
+UDPDemuxer::Table* UDPDemuxer::NewTable(UInt32 inSize)
+{
+    UInt32 theBytes = sizeof(Table) + ((inSize - 1) * sizeof(Slot));
+    Table* theTable = (Table*)NEW char[theBytes];
+    ::memset(theTable, 0, theBytes);
+    theTable->fSize = inSize;
+    return theTable;
+}
+
+UDPDemuxer::Slot* UDPDemuxer::FindSlot(Table* inTable, UInt32 inRemoteAddr, UInt16 inRemotePort)
+{
+    //Returns the slot with this key, or the empty slot that ends its probe sequence.
+    UInt32 theMask = inTable->fSize - 1;
+    UInt32 thePortAndUsed = (UInt32)inRemotePort | 0x10000;
+    for (UInt32 theIndex = ComputeHashValue(inRemoteAddr, inRemotePort) & theMask; ; theIndex = (theIndex + 1) & theMask)
+    {
+        Slot* theSlot = &inTable->fSlots[theIndex];
+        UInt32 theSlotPort = theSlot->fRemotePortAndUsed;
+        if (theSlotPort == 0)
+            return theSlot;
+        if (theSlotPort != thePortAndUsed)
+            continue;
+            
+        // fRemoteAddr was written before fRemotePortAndUsed, make sure we don't see it older
+        atomic_barrier();
+        if (theSlot->fRemoteAddr == inRemoteAddr)
+            return theSlot;
+    }
+}
 
 OS_Error UDPDemuxer::RegisterTask(UInt32 inRemoteAddr, UInt16 inRemotePort,
                                         UDPDemuxerTask *inTaskP)
 {
     Assert(NULL != inTaskP);
     OSMutexLocker locker(&fMutex);
-    if (this->GetTask(inRemoteAddr, inRemotePort) != NULL)
+    Slot* theSlot = this->FindSlot(fTable, inRemoteAddr, inRemotePort);
+    if (theSlot->fTask != NULL)
         return EPERM;
-    inTaskP->Set(inRemoteAddr, inRemotePort);
-    fHashTable.Add(inTaskP);
+        
+    if (theSlot->fRemotePortAndUsed == 0)
+    {
+        // Keep at least half of the slots empty so probe sequences stay short
+        if ((fTable->fNumUsed + 1) * 2 > fTable->fSize)
+        {
+            this->Rebuild();
+            theSlot = this->FindSlot(fTable, inRemoteAddr, inRemotePort);
+        }
+        theSlot->fRemoteAddr = inRemoteAddr;
+        atomic_barrier();
+        theSlot->fRemotePortAndUsed = (UInt32)inRemotePort | 0x10000;
+        fTable->fNumUsed++;
+    }
+    
+    inTaskP->fRemoteAddr = inRemoteAddr;
+    inTaskP->fRemotePort = inRemotePort;
+    atomic_barrier();
+    theSlot->fTask = inTaskP;
+    fNumTasks++;
     return OS_NoErr;
 }
 
@@ -53,11 +135,17 @@ OS_Error UDPDemuxer::UnregisterTask(UInt32 inRemoteAddr, UInt16 inRemotePort,
 {
     OSMutexLocker locker(&fMutex);
     //remove by executing a lookup based on key information
-    UDPDemuxerTask* theTask = this->GetTask(inRemoteAddr, inRemotePort);
+    Slot* theSlot = this->FindSlot(fTable, inRemoteAddr, inRemotePort);
 
-    if ((NULL != theTask) && (theTask == inTaskP))
+    if ((NULL != theSlot->fTask) && (theSlot->fTask == inTaskP))
     {
-        fHashTable.Remove(theTask);
+        theSlot->fTask = NULL;
+        fNumTasks--;
+        
+        // Readers that found the task before it was cleared may still be using it
+        this->WaitForReaders();
+        delete [] (char*)fRetiredTable;
+        fRetiredTable = NULL;
         return OS_NoErr;
     }
     else
@@ -66,6 +154,211 @@ OS_Error UDPDemuxer::UnregisterTask(UInt32 inRemoteAddr, UInt16 inRemotePort,
 
 UDPDemuxerTask* UDPDemuxer::GetTask(UInt32 inRemoteAddr, UInt16 inRemotePort)
 {
-    UDPDemuxerKey theKey(inRemoteAddr, inRemotePort);
-    return fHashTable.Map(&theKey);
+    Slot* theSlot = this->FindSlot(fTable, inRemoteAddr, inRemotePort);
+    return theSlot->fTask;
+}
+
+void UDPDemuxer::Rebuild()
+{
+    // Copies the registered tasks into a new table, leaving out the keys nobody
+    // uses anymore, sized so it is at most a quarter full.
+    UInt32 theNewSize = kMinTableSize;
+    while (theNewSize < (fNumTasks + 1) * 4)
+        theNewSize <<= 1;
+        
+    Table* theOldTable = fTable;
+    Table* theNewTable = NewTable(theNewSize);
+    for (UInt32 x = 0; x < theOldTable->fSize; x++)
+    {
+        Slot* theOldSlot = &theOldTable->fSlots[x];
+        if (theOldSlot->fTask == NULL)
+            continue;
+            
+        Slot* theNewSlot = this->FindSlot(theNewTable, theOldSlot->fRemoteAddr, (UInt16)theOldSlot->fRemotePortAndUsed);
+        theNewSlot->fRemoteAddr = theOldSlot->fRemoteAddr;
+        theNewSlot->fRemotePortAndUsed = theOldSlot->fRemotePortAndUsed;
+        theNewSlot->fTask = theOldSlot->fTask;
+        theNewTable->fNumUsed++;
+    }
+    
+    // Publish the new table only once it is complete
+    atomic_barrier();
+    fTable = theNewTable;
+    
+    // Readers may still be probing the old table. It is freed once they are gone,
+    // which the next UnregisterTask waits for anyway. Only wait here if there
+    // already is a table waiting to be freed.
+    if (fRetiredTable != NULL)
+    {
+        this->WaitForReaders();
+        delete [] (char*)fRetiredTable;
+    }
+    fRetiredTable = theOldTable;
+}
+
+UInt32 UDPDemuxer::EnterRead()
+{
+    while (true)
+    {
+        // atomic_add is a full barrier. If the epoch is still the same after we
+        // counted ourselves, any WaitForReaders that flips it later will see us.
+        UInt32 theEpoch = fEpoch & 1;
+        (void)atomic_add(&fNumReaders[theEpoch], 1);
+        if ((fEpoch & 1) == theEpoch)
+            return theEpoch;
+        (void)atomic_sub(&fNumReaders[theEpoch], 1);
+    }
 }
+
+void UDPDemuxer::WaitForReaders()
+{
+    //Called with the mutex held, after unlinking whatever is to be freed.
+    //Readers that come in after the flip can't find what was unlinked, so only
+    //the ones counted in the old epoch need to be waited for.
+    UInt32 theOldEpoch = fEpoch & 1;
+    atomic_barrier();
+    fEpoch = fEpoch + 1;
+    atomic_barrier();
+    
+    while (*(volatile unsigned int*)&fNumReaders[theOldEpoch] != 0)
+        OSThread::ThreadYield();
+    atomic_barrier();
+}
+
+#if _UDPDEMUXER_TESTING_
+
+Bool16 UDPDemuxer::Test()
+{
+    enum { kNumTasks = 5000 };
+    
+    UDPDemuxer theDemuxer;
+    UDPDemuxerTask* theTasks = NEW UDPDemuxerTask[kNumTasks];
+    
+    // enough tasks to rebuild the table several times, all on the same address
+    for (UInt32 x = 0; x < kNumTasks; x++)
+    {
+        if (theDemuxer.RegisterTask(0x0A000001, (UInt16)(6970 + (x * 2)), &theTasks[x]) != OS_NoErr)
+            return false;
+    }
+    if (theDemuxer.RegisterTask(0x0A000001, 6970, &theTasks[1]) != EPERM)
+        return false;
+        
+    // unregister every other one, then check what is left
+    for (UInt32 y = 0; y < kNumTasks; y += 2)
+    {
+        if (theDemuxer.UnregisterTask(0x0A000001, (UInt16)(6970 + (y * 2)), &theTasks[y]) != OS_NoErr)
+            return false;
+    }
+    if (theDemuxer.UnregisterTask(0x0A000001, 6970, &theTasks[0]) != EPERM)
+        return false;
+    for (UInt32 z = 0; z < kNumTasks; z++)
+    {
+        UDPDemuxerTask* theTask = theDemuxer.GetTask(0x0A000001, (UInt16)(6970 + (z * 2)));
+        if (theTask != (((z & 1) != 0) ? &theTasks[z] : NULL))
+            return false;
+    }
+    if (theDemuxer.GetTask(0x0A000002, 6972) != NULL)
+        return false;
+        
+    // a freed key can be registered again
+    if (theDemuxer.RegisterTask(0x0A000001, 6970, &theTasks[0]) != OS_NoErr)
+        return false;
+    if (theDemuxer.RegisterTask(0x0A000001, 6970, &theTasks[0]) != EPERM)
+        return false;
+        
+    Bool16 thePassed = (theDemuxer.GetTask(0x0A000001, 6970) == &theTasks[0]) &&
+                        (theDemuxer.GetNumTasks() == (kNumTasks / 2) + 1);
+    delete [] theTasks;
+    return thePassed;
+}
+
+class UDPDemuxerBenchmarkThread : public OSThread
+{
+    public:
+        UDPDemuxerBenchmarkThread(UDPDemuxer* inDemuxer, UInt32 inNumTasks, Bool16 inLockFree)
+            : fDemuxer(inDemuxer), fNumTasks(inNumTasks), fLockFree(inLockFree), fNumLookups(0), fNumFound(0) {}
+        virtual ~UDPDemuxerBenchmarkThread() {}
+        
+        virtual void Entry()
+        {
+            // Looks up in batches of 16, the way RTCPTask reads its sockets
+            UInt32 theKey = 0;
+            while (!this->IsStopRequested())
+            {
+                if (fLockFree)
+                {
+                    UDPDemuxerReadLocker theReadLocker(fDemuxer);
+                    this->LookupBatch(&theKey);
+                }
+                else
+                {
+                    OSMutexLocker theLocker(fDemuxer->GetMutex());
+                    this->LookupBatch(&theKey);
+                }
+            }
+        }
+        
+        void LookupBatch(UInt32* ioKey)
+        {
+            for (UInt32 x = 0; x < 16; x++, (*ioKey)++)
+            {
+                if (fDemuxer->GetTask(0x0A000001, (UInt16)(*ioKey % (fNumTasks * 2))) != NULL)
+                    fNumFound++;
+            }
+            fNumLookups += 16;
+        }
+        
+        UDPDemuxer* fDemuxer;
+        UInt32      fNumTasks;
+        Bool16      fLockFree;
+        UInt64      fNumLookups;
+        UInt64      fNumFound;
+};
+
+void UDPDemuxer::Benchmark(UInt32 inNumReaders, UInt32 inNumTasks, UInt32 inMsec)
+{
+    for (UInt32 theMode = 0; theMode < 2; theMode++)
+    {
+        Bool16 isLockFree = (theMode == 0);
+        UDPDemuxer theDemuxer;
+        UDPDemuxerTask* theTasks = NEW UDPDemuxerTask[inNumTasks * 2];
+        for (UInt32 x = 0; x < inNumTasks; x++)
+            (void)theDemuxer.RegisterTask(0x0A000001, (UInt16)x, &theTasks[x]);
+            
+        UDPDemuxerBenchmarkThread** theReaders = NEW UDPDemuxerBenchmarkThread*[inNumReaders];
+        for (UInt32 y = 0; y < inNumReaders; y++)
+        {
+            theReaders[y] = NEW UDPDemuxerBenchmarkThread(&theDemuxer, inNumTasks, isLockFree);
+            theReaders[y]->Start();
+        }
+        
+        // Session churn: move the registered window forward one port at a time
+        UInt64 theNumChurns = 0;
+        SInt64 theStart = OS::Milliseconds();
+        while (OS::Milliseconds() - theStart < (SInt64)inMsec)
+        {
+            UInt32 theOld = (UInt32)(theNumChurns % (inNumTasks * 2));
+            UInt32 theNew = (UInt32)((theNumChurns + inNumTasks) % (inNumTasks * 2));
+            (void)theDemuxer.UnregisterTask(0x0A000001, (UInt16)theOld, &theTasks[theOld]);
+            (void)theDemuxer.RegisterTask(0x0A000001, (UInt16)theNew, &theTasks[theNew]);
+            theNumChurns++;
+        }
+        SInt64 theElapsed = OS::Milliseconds() - theStart;
+        
+        UInt64 theNumLookups = 0;
+        for (UInt32 z = 0; z < inNumReaders; z++)
+        {
+            theReaders[z]->StopAndWaitForThread();
+            theNumLookups += theReaders[z]->fNumLookups;
+            delete theReaders[z];
+        }
+        qtss_printf("UDPDemuxer %s: %"_U32BITARG_" readers, %"_U32BITARG_" tasks: %.1fM lookups/sec, %.0f register+unregister/sec\n",
+            isLockFree ? "lock free" : "mutex", inNumReaders, inNumTasks,
+            (Float64)theNumLookups / theElapsed / 1000, (Float64)theNumChurns * 1000 / theElapsed);
+            
+        delete [] theReaders;
+        delete [] theTasks;
+    }
+}
+
+#endif
@@ -29,116 +29,50 @@
                 waiting for data. When it gets data, it passes it off to a UDPDemuxerTask
                 object depending on where it came from.
 
+                The tasks are kept in an open addressing hash table keyed on the remote
+                address and port. Lookups take no lock: a reader marks itself with a
+                UDPDemuxerReadLocker, and writers, which are serialized by the demuxer
+                mutex, never free anything a reader may still see until every reader
+                that was active when it was unlinked has left (epoch based reclamation).
+
     
 */
 
 #ifndef __UDPDEMUXER_H__
 #define __UDPDEMUXER_H__
 
-#include "OSHashTable.h"
+#include "OSHeaders.h"
 #include "OSMutex.h"
 #include "StrPtrLen.h"
+#include "atomic.h"
 
-class Task;
-class UDPDemuxerKey;
-
-//IMPLEMENTATION ONLY:
-//HASH TABLE CLASSES USED ONLY IN IMPLEMENTATION
-
-
-class UDPDemuxerUtils
-{
-    private:
-    
-        static UInt32 ComputeHashValue(UInt32 inRemoteAddr, UInt16 inRemotePort)
-            { return ((inRemoteAddr << 16) + inRemotePort); }
-            
-    friend class UDPDemuxerTask;
-    friend class UDPDemuxerKey;
-};
+#define _UDPDEMUXER_TESTING_ 0
 
 class UDPDemuxerTask
 {
     public:
     
         UDPDemuxerTask()
-            :   fRemoteAddr(0), fRemotePort(0),
-                fHashValue(0), fNextHashEntry(NULL) {}
+            :   fRemoteAddr(0), fRemotePort(0) {}
         virtual ~UDPDemuxerTask() {}
         
         UInt32  GetRemoteAddr() { return fRemoteAddr; }
         
     private:
 
-        void Set(UInt32 inRemoteAddr, UInt16 inRemotePort)
-            {   fRemoteAddr = inRemoteAddr; fRemotePort = inRemotePort;
-                fHashValue = UDPDemuxerUtils::ComputeHashValue(fRemoteAddr, fRemotePort);
-            }
-        
         //key values
         UInt32 fRemoteAddr;
         UInt16 fRemotePort;
-        
-        //precomputed for performance
-        UInt32 fHashValue;
-        
-        UDPDemuxerTask  *fNextHashEntry;
-
-        friend class UDPDemuxerKey;
-        friend class UDPDemuxer;
-        friend class OSHashTable<UDPDemuxerTask,UDPDemuxerKey>;
-};
-
-
-
-class UDPDemuxerKey
-{
-    private:
-
-        //CONSTRUCTOR / DESTRUCTOR:
-        UDPDemuxerKey(UInt32 inRemoteAddr, UInt16 inRemotePort)
-            :   fRemoteAddr(inRemoteAddr), fRemotePort(inRemotePort)
-                { fHashValue = UDPDemuxerUtils::ComputeHashValue(inRemoteAddr, inRemotePort); }
-                
-        ~UDPDemuxerKey() {}
-        
-        
-    private:
-
-        //PRIVATE ACCESSORS:    
-        UInt32      GetHashKey()        { return fHashValue; }
-
-        //these functions are only used by the hash table itself. This constructor
-        //will break the "Set" functions.
-        UDPDemuxerKey(UDPDemuxerTask *elem) :   fRemoteAddr(elem->fRemoteAddr),
-                                                fRemotePort(elem->fRemotePort), 
-                                                fHashValue(elem->fHashValue) {}
-                                            
-        friend int operator ==(const UDPDemuxerKey &key1, const UDPDemuxerKey &key2) {
-            if ((key1.fRemoteAddr == key2.fRemoteAddr) &&
-                (key1.fRemotePort == key2.fRemotePort))
-                return true;
-            return false;
-        }
-        
-        //data:
-        UInt32 fRemoteAddr;
-        UInt16 fRemotePort;
-        UInt32  fHashValue;
 
-        friend class OSHashTable<UDPDemuxerTask,UDPDemuxerKey>;
         friend class UDPDemuxer;
 };
 
-//CLASSES USED ONLY IN IMPLEMENTATION
-typedef OSHashTable<UDPDemuxerTask, UDPDemuxerKey> UDPDemuxerHashTable;
-
 class UDPDemuxer
 {
     public:
 
-        UDPDemuxer() : fHashTable(kMaxHashTableSize), fMutex() {}
-        ~UDPDemuxer() {}
+        UDPDemuxer();
+        ~UDPDemuxer();
 
         //These functions grab the mutex and are therefore premptive safe
         
@@ -149,26 +83,96 @@ class UDPDemuxer
 
         // Return values: OS_NoErr, or EPERM if this task / address combination
         // is not registered
+        // When this returns, no reader can still be using inTaskP, so the caller may
+        // delete it. It waits for the readers to leave, so it must not be called
+        // from inside a UDPDemuxerReadLocker.
         OS_Error UnregisterTask(UInt32 inRemoteAddr, UInt16 inRemotePort,
                                         UDPDemuxerTask *inTaskP);
         
-        //Assumes that parent has grabbed the mutex!
+        //Never blocks. Assumes that the caller either has grabbed the mutex or is
+        //inside a UDPDemuxerReadLocker on this demuxer. The task returned stays
+        //valid until the caller lets go of either.
         UDPDemuxerTask* GetTask(UInt32 inRemoteAddr, UInt16 inRemotePort);
 
         Bool16  AddrInMap(UInt32 inRemoteAddr, UInt16 inRemotePort)
                     { return (this->GetTask(inRemoteAddr, inRemotePort) != NULL); }
                     
         OSMutex*                GetMutex()      { return &fMutex; }
-        UDPDemuxerHashTable*    GetHashTable()  { return &fHashTable; }
+        UInt32                  GetNumTasks()   { return fNumTasks; }
+
+#if _UDPDEMUXER_TESTING_
+        //returns true if it passed the test, false otherwise
+        static Bool16           Test();
+        
+        //prints GetTask throughput for inNumReaders threads while another thread
+        //registers and unregisters tasks, lock free and with the mutex held
+        static void             Benchmark(UInt32 inNumReaders, UInt32 inNumTasks, UInt32 inMsec);
+#endif
         
     private:
     
         enum
         {
-            kMaxHashTableSize = 2747//is this prime? it should be... //UInt32
+            kMinTableSize = 64  //UInt32, must be a power of 2
+        };
+        
+        // A slot is claimed for one address and port the first time a task registers
+        // with them, and keeps that key until the table is rebuilt. Unregistering
+        // just clears fTask, so a reader never sees a slot change keys under it.
+        struct Slot
+        {
+            volatile UInt32             fRemoteAddr;
+            volatile UInt32             fRemotePortAndUsed; // 0 if the slot is empty
+            UDPDemuxerTask* volatile    fTask;              // NULL if not registered
         };
-        UDPDemuxerHashTable fHashTable;
+        
+        struct Table
+        {
+            UInt32  fSize;
+            UInt32  fNumUsed;   // slots that have a key, registered or not
+            Slot    fSlots[1];
+        };
+        
+        static UInt32   ComputeHashValue(UInt32 inRemoteAddr, UInt16 inRemotePort);
+        static Table*   NewTable(UInt32 inSize);
+        
+        Slot*   FindSlot(Table* inTable, UInt32 inRemoteAddr, UInt16 inRemotePort);
+        void    Rebuild();
+        
+        // Read side of the epoch scheme: readers count themselves in the counter
+        // of the current epoch. WaitForReaders moves to the other epoch and waits
+        // for the previous one's counter to drain.
+        UInt32  EnterRead();
+        void    ExitRead(UInt32 inEpoch)    { (void)atomic_sub(&fNumReaders[inEpoch], 1); }
+        void    WaitForReaders();
+        
+        Table* volatile     fTable;
+        Table*              fRetiredTable;  // replaced, freed after the next WaitForReaders
+        UInt32              fNumTasks;
+        
+        volatile unsigned int   fEpoch;
+        unsigned int            fNumReaders[2];
+        
         OSMutex             fMutex;//this data structure is shared!
+        
+        friend class UDPDemuxerReadLocker;
+};
+
+// While one of these is alive, GetTask can be called on the demuxer without
+// the mutex, and the tasks it returns won't be unregistered out from under it.
+// Keep these short, UnregisterTask waits for them.
+class UDPDemuxerReadLocker
+{
+    public:
+    
+        UDPDemuxerReadLocker(UDPDemuxer* inDemuxer)
+            :   fDemuxer(inDemuxer), fEpoch(inDemuxer->EnterRead()) {}
+        ~UDPDemuxerReadLocker() { fDemuxer->ExitRead(fEpoch); }
+        
+    private:
+    
+        UDPDemuxer* fDemuxer;
+        UInt32      fEpoch;
 };
 
 #endif // __UDPDEMUXER_H__
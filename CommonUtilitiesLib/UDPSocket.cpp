@@ -51,13 +51,33 @@
 #include <errno.h>
 #include "UDPSocket.h"
 #include "OSMemory.h"
+#include "atomic.h"
+#include "OS.h"
 
 #ifdef USE_NETLOG
 #include <netlog.h>
 #endif
 
+#if __linux__
+struct UDPSendBatch
+{
+    UInt32              fNumMsgs;
+    struct mmsghdr      fMsgs[UDPSocket::kMaxBatchSize];
+    struct iovec        fIOVecs[UDPSocket::kMaxBatchSize];
+    struct sockaddr_in  fAddrs[UDPSocket::kMaxBatchSize];
+};
+#else
+struct UDPSendBatch
+{
+    UInt32              fNumMsgs;
+};
+#endif
+
+unsigned int UDPSocket::sNumBatches = 0;
+unsigned int UDPSocket::sNumBatchedPackets = 0;
+
 UDPSocket::UDPSocket(Task* inTask, UInt32 inSocketType)
-: Socket(inTask, inSocketType), fDemuxer(NULL)
+: Socket(inTask, inSocketType), fDemuxer(NULL), fBatch(NULL), fReceiveTimestamps(false)
 {
     if (inSocketType & kWantsDemuxer)
         fDemuxer = NEW UDPDemuxer();
@@ -66,6 +86,13 @@ UDPSocket::UDPSocket(Task* inTask, UInt32 inSocketType)
     ::memset(&fMsgAddr, 0, sizeof(fMsgAddr));
 }
 
+UDPSocket::~UDPSocket()
+{
+    if (fDemuxer != NULL)
+        delete fDemuxer;
+    delete fBatch;
+}
+
 
 OS_Error
 UDPSocket::SendTo(UInt32 inRemoteAddr, UInt16 inRemotePort, void* inBuffer, UInt32 inLength)
@@ -89,6 +116,97 @@ UDPSocket::SendTo(UInt32 inRemoteAddr, UInt16 inRemotePort, void* inBuffer, UInt
     return OS_NoErr;
 }
 
+OS_Error
+UDPSocket::SendToBatch(UInt32 inRemoteAddr, UInt16 inRemotePort, void* inBuffer, UInt32 inLength)
+{
+#if __linux__
+    Assert(inBuffer != NULL);
+    
+    OSMutexLocker locker(&fBatchMutex);
+    if (fBatch == NULL)
+    {
+        fBatch = NEW UDPSendBatch;
+        ::memset(fBatch, 0, sizeof(UDPSendBatch));
+    }
+    
+    UInt32 theIndex = fBatch->fNumMsgs;
+    struct sockaddr_in* theRemoteAddr = &fBatch->fAddrs[theIndex];
+    theRemoteAddr->sin_family = AF_INET;
+    theRemoteAddr->sin_port = htons(inRemotePort);
+    theRemoteAddr->sin_addr.s_addr = htonl(inRemoteAddr);
+    
+    fBatch->fIOVecs[theIndex].iov_base = inBuffer;
+    fBatch->fIOVecs[theIndex].iov_len = inLength;
+    
+    struct msghdr* theMsg = &fBatch->fMsgs[theIndex].msg_hdr;
+    theMsg->msg_name = theRemoteAddr;
+    theMsg->msg_namelen = sizeof(struct sockaddr_in);
+    theMsg->msg_iov = &fBatch->fIOVecs[theIndex];
+    theMsg->msg_iovlen = 1;
+    
+    fBatch->fNumMsgs++;
+    if (fBatch->fNumMsgs == kMaxBatchSize)
+        return this->SendBatch();
+    return OS_NoErr;
+#else
+    return this->SendTo(inRemoteAddr, inRemotePort, inBuffer, inLength);
+#endif
+}
+
+OS_Error UDPSocket::FlushBatch()
+{
+    OSMutexLocker locker(&fBatchMutex);
+    if (fBatch == NULL)
+        return OS_NoErr;
+    return this->SendBatch();
+}
+
+OS_Error UDPSocket::SendBatch()
+{
+    // fBatchMutex must be held
+    OS_Error theErr = OS_NoErr;
+#if __linux__
+    UInt32 theNumSent = 0;
+    while (theNumSent < fBatch->fNumMsgs)
+    {
+        int theResult = ::sendmmsg(fFileDesc, &fBatch->fMsgs[theNumSent], fBatch->fNumMsgs - theNumSent, 0);
+        if (theResult > 0)
+        {
+            theNumSent += theResult;
+            continue;
+        }
+        
+        theErr = (OS_Error)OSThread::GetErrno();
+        if (theErr == EINTR)
+            continue;
+        if ((theErr == EAGAIN) || (theErr == EWOULDBLOCK))
+            break; // the socket buffer is full, the rest would fail as well
+            
+        // This datagram couldn't be sent. Drop it, as SendTo callers do, and go on with the rest
+        theNumSent++;
+    }
+    
+    if (fBatch->fNumMsgs > 0)
+    {
+        (void)atomic_add(&sNumBatches, 1);
+        (void)atomic_add(&sNumBatchedPackets, fBatch->fNumMsgs);
+    }
+    fBatch->fNumMsgs = 0;
+#endif
+    return theErr;
+}
+
+void UDPSocket::GetBatchStats(UInt32* outNumBatches, UInt32* outNumPackets)
+{
+    unsigned int theNumBatches = sNumBatches;
+    (void)atomic_sub(&sNumBatches, theNumBatches);
+    unsigned int theNumPackets = sNumBatchedPackets;
+    (void)atomic_sub(&sNumBatchedPackets, theNumPackets);
+    
+    *outNumBatches = theNumBatches;
+    *outNumPackets = theNumPackets;
+}
+
 OS_Error UDPSocket::RecvFrom(UInt32* outRemoteAddr, UInt16* outRemotePort,
                             void* ioBuffer, UInt32 inBufLen, UInt32* outRecvLen)
 {
@@ -119,6 +237,91 @@ OS_Error UDPSocket::RecvFrom(UInt32* outRemoteAddr, UInt16* outRemotePort,
     return OS_NoErr;        
 }
 
+OS_Error UDPSocket::RecvMultiple(UDPRecvBuf* ioBufs, UInt32 inNumBufs, UInt32* outNumReceived)
+{
+    Assert(ioBufs != NULL);
+    Assert(outNumReceived != NULL);
+    
+    *outNumReceived = 0;
+    if (inNumBufs > kMaxBatchSize)
+        inNumBufs = kMaxBatchSize;
+
+#if __linux__
+    struct mmsghdr      theMsgs[kMaxBatchSize];
+    struct iovec        theIOVecs[kMaxBatchSize];
+    struct sockaddr_in  theAddrs[kMaxBatchSize];
+    char                theControl[kMaxBatchSize][CMSG_SPACE(sizeof(struct timespec))];
+    
+    for (UInt32 x = 0; x < inNumBufs; x++)
+    {
+        theIOVecs[x].iov_base = ioBufs[x].fBuffer;
+        theIOVecs[x].iov_len = ioBufs[x].fBufLen;
+        
+        struct msghdr* theMsg = &theMsgs[x].msg_hdr;
+        theMsg->msg_name = &theAddrs[x];
+        theMsg->msg_namelen = sizeof(struct sockaddr_in);
+        theMsg->msg_iov = &theIOVecs[x];
+        theMsg->msg_iovlen = 1;
+        theMsg->msg_control = fReceiveTimestamps ? theControl[x] : NULL;
+        theMsg->msg_controllen = fReceiveTimestamps ? sizeof(theControl[x]) : 0;
+        theMsg->msg_flags = 0;
+    }
+    
+    int theNumReceived = ::recvmmsg(fFileDesc, theMsgs, inNumBufs, 0, NULL);
+    if (theNumReceived == -1)
+        return (OS_Error)OSThread::GetErrno();
+    
+    for (int y = 0; y < theNumReceived; y++)
+    {
+        ioBufs[y].fRecvLen = theMsgs[y].msg_len;
+        ioBufs[y].fRemoteAddr = ntohl(theAddrs[y].sin_addr.s_addr);
+        ioBufs[y].fRemotePort = ntohs(theAddrs[y].sin_port);
+        ioBufs[y].fArrivalTime = -1;
+        
+        if (!fReceiveTimestamps)
+            continue;
+        for (struct cmsghdr* theCmsg = CMSG_FIRSTHDR(&theMsgs[y].msg_hdr); theCmsg != NULL; theCmsg = CMSG_NXTHDR(&theMsgs[y].msg_hdr, theCmsg))
+        {
+            if ((theCmsg->cmsg_level == SOL_SOCKET) && (theCmsg->cmsg_type == SCM_TIMESTAMPNS))
+            {
+                // The kernel stamps with CLOCK_REALTIME, the clock OS::Milliseconds is based on
+                struct timespec* theStamp = (struct timespec*)CMSG_DATA(theCmsg);
+                ioBufs[y].fArrivalTime = OS::UnixTimeMilli_To_TimeMilli(((SInt64)theStamp->tv_sec * 1000) + (theStamp->tv_nsec / 1000000));
+                break;
+            }
+        }
+    }
+    *outNumReceived = (UInt32)theNumReceived;
+    return OS_NoErr;
+#else
+    OS_Error theErr = OS_NoErr;
+    while (*outNumReceived < inNumBufs)
+    {
+        UDPRecvBuf* theBuf = &ioBufs[*outNumReceived];
+        theErr = this->RecvFrom(&theBuf->fRemoteAddr, &theBuf->fRemotePort, theBuf->fBuffer, theBuf->fBufLen, &theBuf->fRecvLen);
+        if (theErr != OS_NoErr)
+            break;
+        theBuf->fArrivalTime = -1;
+        (*outNumReceived)++;
+    }
+    return (*outNumReceived > 0) ? OS_NoErr : theErr;
+#endif
+}
+
+OS_Error UDPSocket::SetReceiveTimestamps(Bool16 inEnable)
+{
+#if __linux__ && defined(SO_TIMESTAMPNS)
+    int theOption = inEnable ? 1 : 0;
+    int err = setsockopt(fFileDesc, SOL_SOCKET, SO_TIMESTAMPNS, (char*)&theOption, sizeof(theOption));
+    if (err == -1)
+        return (OS_Error)OSThread::GetErrno();
+    fReceiveTimestamps = inEnable;
+    return OS_NoErr;
+#else
+    return inEnable ? (OS_Error)ENOPROTOOPT : OS_NoErr;
+#endif
+}
+
 OS_Error UDPSocket::JoinMulticast(UInt32 inRemoteAddr)
 {
     struct ip_mreq  theMulti;
@@ -174,3 +377,139 @@ OS_Error UDPSocket::LeaveMulticast(UInt32 inRemoteAddr)
     else
         return OS_NoErr;    
 }
+
+#if _UDPSOCKET_TESTING_
+
+void UDPSocket::BenchmarkSendBatch(UInt32 inNumPackets)
+{
+    // RTP sized datagrams. The receiver is drained between rounds, outside the
+    // timed part, so that loopback doesn't drop any.
+    enum { kPacketSize = 1200, kRoundSize = kMaxBatchSize };
+    UDPSocket theReceiver(NULL, Socket::kNonBlockingSocketType);
+    UDPSocket theSender(NULL, Socket::kNonBlockingSocketType);
+    if ((theReceiver.Open() != OS_NoErr) || (theReceiver.Bind(INADDR_LOOPBACK, 0) != OS_NoErr) || (theSender.Open() != OS_NoErr))
+    {
+        qtss_printf("UDPSocket::BenchmarkSendBatch can't open the sockets\n");
+        return;
+    }
+    (void)theReceiver.SetSocketRcvBufSize(kRoundSize * 4096);
+    
+    char thePacket[kPacketSize];
+    ::memset(thePacket, 'x', kPacketSize);
+    
+    for (UInt32 theMode = 0; theMode < 2; theMode++)
+    {
+        Bool16 isBatched = (theMode == 1);
+        UInt32 theNumBatches = 0;
+        UInt32 theNumBatchedPackets = 0;
+        UDPSocket::GetBatchStats(&theNumBatches, &theNumBatchedPackets);
+        
+        SInt64 theTime = 0;
+        UInt32 theNumReceived = 0;
+        for (UInt32 theSent = 0; theSent < inNumPackets; )
+        {
+            UInt32 theRoundSize = inNumPackets - theSent;
+            if (theRoundSize > kRoundSize)
+                theRoundSize = kRoundSize;
+                
+            SInt64 theStart = OS::Microseconds();
+            for (UInt32 x = 0; x < theRoundSize; x++)
+            {
+                if (isBatched)
+                    (void)theSender.SendToBatch(INADDR_LOOPBACK, theReceiver.GetLocalPort(), thePacket, kPacketSize);
+                else
+                    (void)theSender.SendTo(INADDR_LOOPBACK, theReceiver.GetLocalPort(), thePacket, kPacketSize);
+            }
+            if (isBatched)
+                (void)theSender.FlushBatch();
+            theTime += OS::Microseconds() - theStart;
+            theSent += theRoundSize;
+            
+            UInt32 theRemoteAddr = 0;
+            UInt16 theRemotePort = 0;
+            UInt32 theRecvLen = 0;
+            char theBuffer[kPacketSize];
+            while (theReceiver.RecvFrom(&theRemoteAddr, &theRemotePort, theBuffer, kPacketSize, &theRecvLen) == OS_NoErr)
+                theNumReceived++;
+        }
+        
+        UDPSocket::GetBatchStats(&theNumBatches, &theNumBatchedPackets);
+        qtss_printf("UDPSocket::BenchmarkSendBatch %s: %"_U32BITARG_" packets in %"_64BITARG_"d usec, %"_U32BITARG_" received, %"_U32BITARG_" calls\n",
+                    isBatched ? "sendmmsg" : "sendto", inNumPackets, theTime, theNumReceived,
+                    isBatched ? theNumBatches : inNumPackets);
+    }
+}
+
+void UDPSocket::BenchmarkRecvMultiple(UInt32 inNumPackets)
+{
+    // Rounds of datagrams are queued outside the timed part, then drained the
+    // way ReflectorSocket::GetIncomingData does, until EAGAIN or a short read
+    enum { kPacketSize = 1200, kRoundSize = 2 * kMaxBatchSize };
+    UDPSocket theReceiver(NULL, Socket::kNonBlockingSocketType);
+    UDPSocket theSender(NULL, Socket::kNonBlockingSocketType);
+    if ((theReceiver.Open() != OS_NoErr) || (theReceiver.Bind(INADDR_LOOPBACK, 0) != OS_NoErr) || (theSender.Open() != OS_NoErr))
+    {
+        qtss_printf("UDPSocket::BenchmarkRecvMultiple can't open the sockets\n");
+        return;
+    }
+    (void)theReceiver.SetSocketRcvBufSize(kRoundSize * 4096);
+    
+    char thePacket[kPacketSize];
+    ::memset(thePacket, 'x', kPacketSize);
+    char* theBuffers = NEW char[kMaxBatchSize * kPacketSize];
+    UDPRecvBuf theRecvBufs[kMaxBatchSize];
+    for (UInt32 x = 0; x < kMaxBatchSize; x++)
+    {
+        theRecvBufs[x].fBuffer = theBuffers + (x * kPacketSize);
+        theRecvBufs[x].fBufLen = kPacketSize;
+    }
+    
+    for (UInt32 theMode = 0; theMode < 2; theMode++)
+    {
+        Bool16 isBatched = (theMode == 1);
+        SInt64 theTime = 0;
+        UInt32 theNumReceived = 0;
+        UInt32 theNumCalls = 0;
+        for (UInt32 theSent = 0; theSent < inNumPackets; )
+        {
+            UInt32 theRoundSize = inNumPackets - theSent;
+            if (theRoundSize > kRoundSize)
+                theRoundSize = kRoundSize;
+            for (UInt32 x = 0; x < theRoundSize; x++)
+                (void)theSender.SendTo(INADDR_LOOPBACK, theReceiver.GetLocalPort(), thePacket, kPacketSize);
+            theSent += theRoundSize;
+            
+            SInt64 theStart = OS::Microseconds();
+            while (true)
+            {
+                theNumCalls++;
+                if (isBatched)
+                {
+                    UInt32 theNumInCall = 0;
+                    if (theReceiver.RecvMultiple(theRecvBufs, kMaxBatchSize, &theNumInCall) != OS_NoErr)
+                        break;
+                    theNumReceived += theNumInCall;
+                    if (theNumInCall < kMaxBatchSize)
+                        break;
+                }
+                else
+                {
+                    UInt32 theRemoteAddr = 0;
+                    UInt16 theRemotePort = 0;
+                    UInt32 theRecvLen = 0;
+                    if (theReceiver.RecvFrom(&theRemoteAddr, &theRemotePort, theBuffers, kPacketSize, &theRecvLen) != OS_NoErr)
+                        break;
+                    theNumReceived++;
+                }
+            }
+            theTime += OS::Microseconds() - theStart;
+        }
+        
+        qtss_printf("UDPSocket::BenchmarkRecvMultiple %s: %"_U32BITARG_" packets in %"_64BITARG_"d usec, %"_U32BITARG_" received, %"_U32BITARG_" calls\n",
+                    isBatched ? "recvmmsg" : "recvfrom", inNumPackets, theTime, theNumReceived, theNumCalls);
+    }
+    
+    delete [] theBuffers;
+}
+
+#endif
@@ -43,6 +43,23 @@
 
 #include "Socket.h"
 #include "UDPDemuxer.h"
+#include "OSMutex.h"
+
+#define _UDPSOCKET_TESTING_ 0
+
+struct UDPSendBatch;
+
+//One datagram for UDPSocket::RecvMultiple. The caller fills in fBuffer and fBufLen.
+struct UDPRecvBuf
+{
+    void*   fBuffer;
+    UInt32  fBufLen;
+    
+    UInt32  fRecvLen;
+    UInt32  fRemoteAddr;
+    UInt16  fRemotePort;
+    SInt64  fArrivalTime;   //in OS::Milliseconds, -1 unless receive timestamps are on
+};
 
 
 class   UDPSocket : public Socket
@@ -56,8 +73,13 @@ class   UDPSocket : public Socket
             kWantsDemuxer = 0x0100 //UInt32
         };
     
+        enum
+        {
+            kMaxBatchSize = 64 //UInt32, datagrams per sendmmsg call
+        };
+    
         UDPSocket(Task* inTask, UInt32 inSocketType);
-        virtual ~UDPSocket() { if (fDemuxer != NULL) delete fDemuxer; }
+        virtual ~UDPSocket();
 
         //Open
         OS_Error    Open() { return Socket::Open(SOCK_DGRAM); }
@@ -70,19 +92,59 @@ class   UDPSocket : public Socket
         //returns an ERRNO
         OS_Error        SendTo(UInt32 inRemoteAddr, UInt16 inRemotePort,
                                     void* inBuffer, UInt32 inLength);
+        
+        //Same as SendTo, but the datagram is only queued. Queued datagrams go out
+        //together (one sendmmsg call on Linux) when FlushBatch is called or the batch
+        //fills up, so the buffer must stay valid until then. Several threads may batch
+        //on the same socket at once. Returns an ERRNO if an earlier datagram failed.
+        OS_Error        SendToBatch(UInt32 inRemoteAddr, UInt16 inRemotePort,
+                                    void* inBuffer, UInt32 inLength);
+        OS_Error        FlushBatch();
+        
+        //Number of batches sent, and datagrams in them, since the last call
+        static void     GetBatchStats(UInt32* outNumBatches, UInt32* outNumPackets);
                         
         OS_Error        RecvFrom(UInt32* outRemoteAddr, UInt16* outRemotePort,
                                         void* ioBuffer, UInt32 inBufLen, UInt32* outRecvLen);
         
+        //Reads up to inNumBufs (at most kMaxBatchSize) waiting datagrams with one call
+        //(recvmmsg on Linux). Returns an ERRNO, EAGAIN if nothing was waiting.
+        OS_Error        RecvMultiple(UDPRecvBuf* ioBufs, UInt32 inNumBufs, UInt32* outNumReceived);
+        
+        //Asks the kernel to stamp each datagram with its arrival time (SO_TIMESTAMPNS),
+        //which RecvMultiple then returns in fArrivalTime.
+        OS_Error        SetReceiveTimestamps(Bool16 inEnable);
+        
         //A UDP socket may or may not have a demuxer associated with it. The demuxer
         //is a data structure so the socket can associate incoming data with the proper
         //task to process that data (based on source IP addr & port)
         UDPDemuxer*         GetDemuxer()    { return fDemuxer; }
         
+#if _UDPSOCKET_TESTING_
+        //Sends inNumPackets datagrams to a loopback socket, once with SendTo and once
+        //with SendToBatch, and prints the time spent sending and the number of calls
+        static void         BenchmarkSendBatch(UInt32 inNumPackets);
+        
+        //Queues inNumPackets datagrams on a loopback socket and drains them, once with
+        //RecvFrom and once with RecvMultiple, and prints the time spent receiving
+        static void         BenchmarkRecvMultiple(UInt32 inNumPackets);
+#endif
+
     private:
     
+        OS_Error    SendBatch();
+    
         UDPDemuxer* fDemuxer;
         struct sockaddr_in  fMsgAddr;
+        
+        //allocated the first time SendToBatch is called
+        OSMutex         fBatchMutex;
+        UDPSendBatch*   fBatch;
+        
+        Bool16          fReceiveTimestamps;
+        
+        static unsigned int sNumBatches;
+        static unsigned int sNumBatchedPackets;
 };
 #endif // __UDPSOCKET_H__
 
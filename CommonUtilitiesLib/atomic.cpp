@@ -26,6 +26,73 @@
 #include "atomic.h"
 #include "OSMutex.h"
 
+#if defined(__GNUC__)
+
+//
+// The compiler builtins are full barriers, so these never need the global mutex.
+
+unsigned int atomic_add(unsigned int *area, int val)
+{
+    return __sync_add_and_fetch(area, val);
+}
+
+unsigned int atomic_sub(unsigned int *area,int val)
+{
+    return __sync_sub_and_fetch(area, val);
+}
+
+unsigned int atomic_or(unsigned int *area, unsigned int val)
+{
+    return __sync_fetch_and_or(area, val);
+}
+
+unsigned int compare_and_store(unsigned int oval, unsigned int nval, unsigned int *area)
+{
+    return __sync_bool_compare_and_swap(area, oval, nval) ? 1 : 0;
+}
+
+void atomic_barrier()
+{
+    __sync_synchronize();
+}
+
+#if defined(__LP64__)
+
+// Aligned 64 bit accesses are atomic here, only the ordering needs help
+
+unsigned long long atomic_load64(unsigned long long *area)
+{
+    unsigned long long val = *(volatile unsigned long long *)area;
+    __sync_synchronize();
+    return val;
+}
+
+void atomic_store64(unsigned long long *area, unsigned long long val)
+{
+    __sync_synchronize();
+    *(volatile unsigned long long *)area = val;
+    __sync_synchronize();
+}
+
+#else
+
+unsigned long long atomic_load64(unsigned long long *area)
+{
+    return __sync_val_compare_and_swap(area, 0, 0);
+}
+
+void atomic_store64(unsigned long long *area, unsigned long long val)
+{
+    unsigned long long oldval = *area;
+    unsigned long long curval;
+    while ((curval = __sync_val_compare_and_swap(area, oldval, val)) != oldval)
+        oldval = curval;
+}
+
+#endif
+
+#else
+
 static OSMutex sAtomicMutex;
 
 
@@ -64,3 +131,22 @@ unsigned int compare_and_store(unsigned int oval, unsigned int nval, unsigned in
     rv=0;
     return rv;
 }
+
+void atomic_barrier()
+{
+    OSMutexLocker locker(&sAtomicMutex);
+}
+
+unsigned long long atomic_load64(unsigned long long *area)
+{
+    OSMutexLocker locker(&sAtomicMutex);
+    return *area;
+}
+
+void atomic_store64(unsigned long long *area, unsigned long long val)
+{
+    OSMutexLocker locker(&sAtomicMutex);
+    *area = val;
+}
+
+#endif
@@ -81,6 +81,14 @@ extern unsigned int atomic_or(unsigned int *area, unsigned int mask);
 
 extern unsigned int atomic_sub(unsigned int *area, int val);
 
+extern void atomic_barrier(void);
+
+/* A 64 bit load or store is not atomic on 32 bit targets. These are, and are
+   full barriers like atomic_barrier(). */
+extern unsigned long long atomic_load64(unsigned long long *area);
+
+extern void atomic_store64(unsigned long long *area, unsigned long long val);
+
 extern void queue_atomic(unsigned int *anchor,
                     unsigned int *elem, unsigned int disp);
 
@@ -16,17 +16,22 @@
 #include <string.h>
 #include "common.h"
 
-int epollInit();
+//
+// Every EventThread owns one epoll instance. Registrations are one-shot:
+// once an event fires the fd is disarmed inside the kernel, and the next
+// RequestEvent re-arms it with a single EPOLL_CTL_MOD.
 
-int addEpollEvent(struct eventreq *req,int event);//event {EV_RD,EV_RM}
+int epollCreate();
 
-int deleteEpollEvent(int& fd);
+int addEpollEvent(int inEpollFD, struct eventreq *req, int event, bool inRearm);//event {EV_RE,EV_WR,EV_RM}
 
-int epollwaitevent();
+int deleteEpollEvent(int inEpollFD, int& fd);
 
-int epoll_waitevent(struct eventreq *req, void* onlyForMOSX);//stay the same with old event
+int epollWaitEvents(int inEpollFD, struct epoll_event* outEvents, int inMaxEvents, int inTimeoutMilSecs);
 
-int epollDestory();
+int epollEventBits(const struct epoll_event& inEvent);//maps epoll bits back to EV_RE / EV_WR
+
+int epollDestory(int inEpollFD);
 #endif
 
 #endif
@@ -44,6 +44,7 @@ OBJECTFILES= \
 	${OBJECTDIR}/IdleTask.o \
 	${OBJECTDIR}/MyAssert.o \
 	${OBJECTDIR}/OS.o \
+	${OBJECTDIR}/OSArena.o \
 	${OBJECTDIR}/OSBufferPool.o \
 	${OBJECTDIR}/OSCodeFragment.o \
 	${OBJECTDIR}/OSCond.o \
@@ -54,6 +55,7 @@ OBJECTFILES= \
 	${OBJECTDIR}/OSQueue.o \
 	${OBJECTDIR}/OSRef.o \
 	${OBJECTDIR}/OSThread.o \
+	${OBJECTDIR}/OSTimerWheel.o \
 	${OBJECTDIR}/QueryParamList.o \
 	${OBJECTDIR}/ResizeableStringFormatter.o \
 	${OBJECTDIR}/SDPUtils.o \
@@ -154,6 +156,11 @@ ${OBJECTDIR}/OS.o: OS.cpp
 	${RM} "$@.d"
 	$(COMPILE.cc) -O2 -DCOMMON_UTILITIES_LIB -D_REENTRANT -D__USE_POSIX -D__linux__ -I. -I../Include -I../EasyDarwin/APICommonCode -I../EasyDarwin/APIStubLib -I../EasyDarwin/RTPMetaInfoLib -include ../Include/PlatformHeader.h -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/OS.o OS.cpp
 
+${OBJECTDIR}/OSArena.o: OSArena.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -DCOMMON_UTILITIES_LIB -D_REENTRANT -D__USE_POSIX -D__linux__ -I. -I../Include -I../EasyDarwin/APICommonCode -I../EasyDarwin/APIStubLib -I../EasyDarwin/RTPMetaInfoLib -include ../Include/PlatformHeader.h -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/OSArena.o OSArena.cpp
+
 ${OBJECTDIR}/OSBufferPool.o: OSBufferPool.cpp 
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
@@ -204,6 +211,11 @@ ${OBJECTDIR}/OSThread.o: OSThread.cpp
 	${RM} "$@.d"
 	$(COMPILE.cc) -O2 -DCOMMON_UTILITIES_LIB -D_REENTRANT -D__USE_POSIX -D__linux__ -I. -I../Include -I../EasyDarwin/APICommonCode -I../EasyDarwin/APIStubLib -I../EasyDarwin/RTPMetaInfoLib -include ../Include/PlatformHeader.h -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/OSThread.o OSThread.cpp
 
+${OBJECTDIR}/OSTimerWheel.o: OSTimerWheel.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -DCOMMON_UTILITIES_LIB -D_REENTRANT -D__USE_POSIX -D__linux__ -I. -I../Include -I../EasyDarwin/APICommonCode -I../EasyDarwin/APIStubLib -I../EasyDarwin/RTPMetaInfoLib -include ../Include/PlatformHeader.h -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/OSTimerWheel.o OSTimerWheel.cpp
+
 ${OBJECTDIR}/QueryParamList.o: QueryParamList.cpp 
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
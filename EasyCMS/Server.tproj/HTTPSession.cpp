@@ -38,7 +38,8 @@ HTTPSession::HTTPSession( )
 	fRequest(NULL),
 	fReadMutex(),
 	fCurrentModule(0),
-	fState(kReadingFirstRequest)
+	fState(kReadingFirstRequest),
+	fCloseAfterResponse(false)
 {
 	this->SetTaskName("HTTPSession");
 
@@ -175,7 +176,7 @@ SInt64 HTTPSession::Run()
 
 				Assert(fRequest == NULL);
 				//ݾĹHTTPRequest
-				fRequest = NEW HTTPRequest(&QTSServerInterface::GetServerHeader(), fInputStream.GetRequestBuffer());
+				fRequest = new (fRequestArena.Alloc(sizeof(HTTPRequest))) HTTPRequest(&QTSServerInterface::GetServerHeader(), fInputStream.GetRequestBuffer());
 
 				//ѾȡһRequest׼ĴֱӦķ
 				//ڴ˹УSessionSocketκݵĶ/д
@@ -242,7 +243,6 @@ SInt64 HTTPSession::Run()
 				ProcessRequest();//
 				if (fOutputStream.GetBytesWritten() > 0)//ÿһӦǷɣֱӽлظӦ
 				{
-					delete[] fRequestBody;//ͷݲ
 					fRequestBody=NULL;
 					fState = kSendingResponse;
 					break;
@@ -257,7 +257,6 @@ SInt64 HTTPSession::Run()
 					fInfo.uWaitingTime=0;//´εȴʱҪ±ֵ
 					return iTemp;//ȴһڱ
 				}
-				delete[] fRequestBody;//ͷݲ,עڴ˿ָΪ
 				fRequestBody=NULL;
 				fState = kCleaningUp;
 				break;
@@ -324,6 +323,10 @@ SInt64 HTTPSession::Run()
 				//һĶȡӦȴһ籨ģ
 				this->CleanupRequest();
 				fState = kReadingRequest;
+
+				// The response told the client this connection ends here
+				if (fCloseAfterResponse)
+					fLiveSession = false;
 			}
 		}
 	} 
@@ -439,7 +442,7 @@ QTSS_Error HTTPSession::SetupRequest()
 
 			// жǷҪرյǰSession
 			//if(connectionClose)
-			httpAck.AppendConnectionCloseHeader();
+			this->AppendConnectionHeader(&httpAck);
 
 			//Push HTTP Header to OutputBuffer
 			char respHeader[2048] = { 0 };
@@ -490,7 +493,7 @@ QTSS_Error HTTPSession::SetupRequest()
 	{
 		// First time we've been here for this request. Create a buffer for the content body and
 		// shove it in the request.
-		theRequestBody = NEW char[content_length + 1];
+		theRequestBody = (char*)fRequestArena.Alloc(content_length + 1);
 		memset(theRequestBody,0,content_length + 1);
 		theLen = sizeof(theRequestBody);
 		theErr = QTSS_SetValue(this, qtssEasySesContentBody, 0, &theRequestBody, theLen);// SetValue creates an internal copy.
@@ -512,7 +515,6 @@ QTSS_Error HTTPSession::SetupRequest()
 
 	if (theErr == QTSS_RequestFailed)
 	{
-		OSCharArrayDeleter charArrayPathDeleter(theRequestBody);
 		//
 		// NEED TO RETURN HTTP ERROR RESPONSE
 		return QTSS_RequestFailed;
@@ -550,15 +552,40 @@ void HTTPSession::CleanupRequest()
 	if (fRequest != NULL)
 	{
 		// NULL out any references to the current request
-		delete fRequest;
+		fRequest->~HTTPRequest();
 		fRequest = NULL;
 	}
+	fRequestBody = NULL;
 
 	fSessionMutex.Unlock();
 	fReadMutex.Unlock();
 
 	// Clear out our last value for request body length before moving onto the next request
 	this->SetRequestBodyLength(-1);
+
+	// Everything allocated for this request goes away at once
+	fRequestArena.Reset();
+}
+
+/*
+	Persistent connections: an HTTP/1.1 client keeps the connection unless it sends
+	Connection: close, an HTTP/1.0 client only if it sends Connection: keep-alive.
+	Requests the client pipelined are already in fInputStream and are handled before
+	Run waits on the socket again. A connection that isn't kept gets Connection: close
+	in the response, and Run ends the session once the response is out.
+*/
+void HTTPSession::AppendConnectionHeader(HTTPRequest* inResponse)
+{
+	if ((fRequest != NULL) && fRequest->IsRequestKeepAlive())
+	{
+		// An HTTP/1.0 client only keeps the connection if the response agrees
+		if (fRequest->GetVersion() == http10Version)
+			inResponse->AppendConnectionKeepAliveHeader();
+		return;
+	}
+
+	inResponse->AppendConnectionCloseHeader();
+	fCloseAfterResponse = true;
 }
 
 Bool16 HTTPSession::OverMaxConnections(UInt32 buffer)
@@ -707,8 +734,8 @@ QTSS_Error HTTPSession::ExecNetMsgGetDeviceListReq(char *queryString)
 	if (!msg.empty())
 		httpAck.AppendContentLengthHeader((UInt32)msg.length());
 
-	//ӦɺϿ
-	httpAck.AppendConnectionCloseHeader();
+	//ǳ־ӦɺϿ
+	this->AppendConnectionHeader(&httpAck);
 
 	//Push MSG to OutputBuffer
 	char respHeader[2048] = { 0 };
@@ -767,8 +794,8 @@ QTSS_Error HTTPSession::ExecNetMsgGetCameraListReq(const string& device_serial,
 	if (!msg.empty())
 		httpAck.AppendContentLengthHeader((UInt32)msg.length());
 
-	//ӦɺϿ
-	httpAck.AppendConnectionCloseHeader();
+	//ǳ־ӦɺϿ
+	this->AppendConnectionHeader(&httpAck);
 
 	//Push MSG to OutputBuffer
 	char respHeader[2048] = { 0 };
@@ -905,8 +932,8 @@ QTSS_Error HTTPSession::ExecNetMsgStartStreamReq(const string& device_serial, ch
 	if (!msg.empty())
 		httpAck.AppendContentLengthHeader((UInt32)msg.length());
 
-	//ӦɺϿ
-	httpAck.AppendConnectionCloseHeader();
+	//ǳ־ӦɺϿ
+	this->AppendConnectionHeader(&httpAck);
 
 	//Push MSG to OutputBuffer
 	char respHeader[2048] = { 0 };
@@ -1055,8 +1082,8 @@ QTSS_Error HTTPSession::ExecNetMsgStopStreamReq(const string& device_serial, cha
 	if (!msg.empty())
 		httpAck.AppendContentLengthHeader((UInt32)msg.length());
 
-	//ӦɺϿ
-	httpAck.AppendConnectionCloseHeader();
+	//ǳ־ӦɺϿ
+	this->AppendConnectionHeader(&httpAck);
 
 	//Push MSG to OutputBuffer
 	char respHeader[2048] = { 0 };
@@ -1303,8 +1330,8 @@ QTSS_Error HTTPSession::ExecNetMsgStreamStopReqRestful(char *queryString)//
 	req.SetBody(body);
 
 	string buffer=req.GetMsg();
-	fRequestBody =new char[buffer.size()+1];
-	strcpy(fRequestBody,buffer.c_str());
+	StrPtrLen theMsg((char*)buffer.c_str(), buffer.size());
+	fRequestBody = fRequestArena.GetAsCString(&theMsg);
 	return QTSS_NoErr;
 }
 QTSS_Error HTTPSession::ExecNetMsgStreamStopReq(const char* json)//ͻ˵ֱֹͣ
@@ -1415,8 +1442,8 @@ QTSS_Error HTTPSession::ExecNetMsgStreamStartReqRestful(char *queryString)//
 	req.SetBody(body);
 
 	string buffer=req.GetMsg();
-	fRequestBody =new char[buffer.size()+1];
-	strcpy(fRequestBody,buffer.c_str());
+	StrPtrLen theMsg((char*)buffer.c_str(), buffer.size());
+	fRequestBody = fRequestArena.GetAsCString(&theMsg);
 	return QTSS_NoErr;
 
 }
@@ -1740,8 +1767,8 @@ QTSS_Error HTTPSession::ExecNetMsgGetDeviceListReqEx(char *queryString)//
 	if (!msg.empty())
 		httpAck.AppendContentLengthHeader((UInt32)msg.length());
 
-	//ӦɺϿ
-	httpAck.AppendConnectionCloseHeader();
+	//ǳ־ӦɺϿ
+	this->AppendConnectionHeader(&httpAck);
 
 	//Push MSG to OutputBuffer
 	char respHeader[2048] = { 0 };
@@ -1881,8 +1908,8 @@ QTSS_Error HTTPSession::ExecNetMsgGetCameraListReqEx(char* queryString)
 	if (!msg.empty())
 		httpAck.AppendContentLengthHeader((UInt32)msg.length());
 
-	//ӦɺϿ
-	httpAck.AppendConnectionCloseHeader();
+	//ǳ־ӦɺϿ
+	this->AppendConnectionHeader(&httpAck);
 
 	//Push MSG to OutputBuffer
 	char respHeader[2048] = { 0 };
@@ -1961,8 +1988,8 @@ QTSS_Error HTTPSession::ExecNetMsgGetCameraListReqJsonEx(const char* json)
 	if (!msg.empty())
 		httpAck.AppendContentLengthHeader((UInt32)msg.length());
 
-	//ӦɺϿ
-	httpAck.AppendConnectionCloseHeader();
+	//ǳ־ӦɺϿ
+	this->AppendConnectionHeader(&httpAck);
 
 	//Push MSG to OutputBuffer
 	char respHeader[2048] = { 0 };
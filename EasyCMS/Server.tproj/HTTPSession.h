@@ -54,6 +54,8 @@ class HTTPSession : public HTTPSessionInterface
         QTSS_Error SetupRequest();
         void CleanupRequest();
 		
+		// Adds Connection: close to a response unless the request asked to keep the connection
+		void AppendConnectionHeader(HTTPRequest* inResponse);
 		//begin
 		QTSS_Error ExecNetMsgDevRegisterReq(const char* json);
 		QTSS_Error ExecNetMsgGetDeviceListReq(char *queryString);
@@ -103,6 +105,7 @@ class HTTPSession : public HTTPSessionInterface
         
         UInt32 fCurrentModule;
         UInt32 fState;
+        Bool16 fCloseAfterResponse; // the response says Connection: close
 
         QTSS_RoleParams     fRoleParams;//module param blocks for roles.
         QTSS_ModuleState    fModuleState;
@@ -44,6 +44,7 @@
 #include "QTSS.h"
 #include "QTSSDictionary.h"
 #include "atomic.h"
+#include "OSArena.h"
 #include "base64.h"
 #include <string>
 #include <boost/thread/condition.hpp>
@@ -222,6 +223,8 @@ protected:
 		int iMsgType;//Ϣ
 	};
 	typedef map<UInt32,strMessage> MsgMap;
+	// The request, its body and the messages built from it live here until CleanupRequest
+	OSArena fRequestArena;
 	char *fRequestBody;//洢ݲ
 
 	OSMutex fMutexCSeq;//fCSeqʵ֣Ϊܶ߳ͬʱfCSeq++,MsgMapͬʹһ
@@ -133,6 +133,10 @@ static UInt32   sDefaultTimeoutSSRCSecs = 30;
 static UInt32   sBroadcasterSessionTimeoutSecs = 20;
 static UInt32   sDefaultBroadcasterSessionTimeoutSecs = 20;
 static UInt32   sBroadcasterSessionTimeoutMilliSecs = sBroadcasterSessionTimeoutSecs * 1000;
+
+// Room for the lines Do*AddRequiredSDPLines add, so the edited SDP
+// normally fits in the buffer it starts with
+static UInt32   sEditedSDPHeadroom = 512;
                                 
 static UInt16 sLastMax = 0;
 static UInt16 sLastMin = 0;
@@ -191,6 +195,10 @@ static StrPtrLen    sSDPSuffix(".sdp");
 static StrPtrLen    sMOVSuffix(".mov");
 static StrPtrLen    sSDPTooLongMessage("Announced SDP is too long");
 static StrPtrLen    sSDPNotValidMessage("Announced SDP is not a valid SDP");
+
+// Added to every media section when the server answers RTCP generic NACKs
+static StrPtrLen    sRTCPNackSDPLine("a=rtcp-fb:* nack\r\n");
+static StrPtrLen    sFECXorScheme("xor");
 static StrPtrLen    sKILLNotValidMessage("Announced .kill is not a valid SDP");
 static StrPtrLen    sSDPTimeNotValidMessage("SDP time is not valid or movie not available at this time.");
 static StrPtrLen    sBroadcastNotAllowed("Broadcast is not allowed.");
@@ -403,6 +411,7 @@ QTSS_Error Initialize(QTSS_Initialize_Params* inParams)
 
     // Call helper class initializers
     ReflectorStream::Initialize(sPrefs);
+    ReflectorStream::InitializeStats(inParams->inServer);
     ReflectorSession::Initialize();
     
     // Report to the server that this module handles DESCRIBE, SETUP, PLAY, PAUSE, and TEARDOWN
@@ -811,6 +820,25 @@ ReflectorSession* DoSessionSetup(QTSS_StandardRTSP_Params* inParams, QTSS_Attrib
 	return NULL;
 }
 
+// State kept while the ANNOUNCE body is read in, see DoAnnounce
+struct AnnounceBody
+{
+    char*   fBuffer;
+    UInt32  fLen;       // Content-Length
+    UInt32  fOffset;    // how much of the body is in fBuffer
+};
+
+static QTSS_Error AppendAnnounceBody(void* inUserData, char* inChunk, UInt32 inChunkLen)
+{
+    AnnounceBody* theBody = (AnnounceBody*)inUserData;
+    if (inChunkLen > theBody->fLen - theBody->fOffset)
+        return QTSS_RequestFailed;
+
+    ::memcpy(theBody->fBuffer + theBody->fOffset, inChunk, inChunkLen);
+    theBody->fOffset += inChunkLen;
+    return QTSS_NoErr;
+}
+
 void DoAnnounceAddRequiredSDPLines(QTSS_StandardRTSP_Params* inParams, ResizeableStringFormatter *editedSDP, char* theSDPPtr)
 {
     SDPContainer checkedSDPContainer;
@@ -953,56 +981,46 @@ QTSS_Error DoAnnounce(QTSS_StandardRTSP_Params* inParams)
         return QTSSModuleUtils::SendErrorResponseWithMessage( inParams->inRTSPRequest, qtssPreconditionFailed, &sSDPTooLongMessage );
     
     //
-    // Check for the existence of 2 attributes in the request: a pointer to our buffer for
-    // the request body, and the current offset in that buffer. If these attributes exist,
+    // The body is collected in memory that belongs to the request and is freed by the
+    // server once the response has gone out, so nothing is left behind if the client
+    // goes away half way through. Check for the existence of 2 attributes in the request:
+    // a pointer to that buffer, and the current offset in it. If these attributes exist,
     // then we've already been here for this request. If they don't exist, add them.
-    UInt32 theBufferOffset = 0;
-    char* theRequestBody = NULL;
+    AnnounceBody theBody;
+    theBody.fBuffer = NULL;
+    theBody.fLen = *theContentLenP;
+    theBody.fOffset = 0;
 
-    theLen = sizeof(theRequestBody);
-    theErr = QTSS_GetValue(inParams->inRTSPRequest, sRequestBodyAttr, 0, &theRequestBody, &theLen);
+    theLen = sizeof(theBody.fBuffer);
+    theErr = QTSS_GetValue(inParams->inRTSPRequest, sRequestBodyAttr, 0, &theBody.fBuffer, &theLen);
 
-    //qtss_printf("QTSSReflectorModule:DoAnnounce theRequestBody =%s\n",theRequestBody);
     if (theErr != QTSS_NoErr)
     {
         //
         // First time we've been here for this request. Create a buffer for the content body and
         // shove it in the request.
-        theRequestBody = NEW char[*theContentLenP + 1];
-        memset(theRequestBody,0,*theContentLenP + 1);
-        theLen = sizeof(theRequestBody);
-        theErr = QTSS_SetValue(inParams->inRTSPRequest, sRequestBodyAttr, 0, &theRequestBody, theLen);// SetValue creates an internal copy.
+        theErr = QTSS_AllocRequestMemory(inParams->inRTSPRequest, theBody.fLen + 1, (void**)&theBody.fBuffer);
         Assert(theErr == QTSS_NoErr);
-        
-        //
-        // Also store the offset in the buffer
-        theLen = sizeof(theBufferOffset);
-        theErr = QTSS_SetValue(inParams->inRTSPRequest, sBufferOffsetAttr, 0, &theBufferOffset, theLen);
+        theLen = sizeof(theBody.fBuffer);
+        theErr = QTSS_SetValue(inParams->inRTSPRequest, sRequestBodyAttr, 0, &theBody.fBuffer, theLen);// SetValue creates an internal copy.
         Assert(theErr == QTSS_NoErr);
     }
-    
-    theLen = sizeof(theBufferOffset);
-    theErr = QTSS_GetValue(inParams->inRTSPRequest, sBufferOffsetAttr, 0, &theBufferOffset, &theLen);
+    else
+    {
+        theLen = sizeof(theBody.fOffset);
+        theErr = QTSS_GetValue(inParams->inRTSPRequest, sBufferOffsetAttr, 0, &theBody.fOffset, &theLen);
+    }
 
     //
-    // We have our buffer and offset. Read the data.
-    theErr = QTSS_Read(inParams->inRTSPRequest, theRequestBody + theBufferOffset, *theContentLenP - theBufferOffset, &theLen);
+    // We have our buffer and offset. Take whatever part of the body has arrived.
+    theErr = QTSS_ReadBody(inParams->inRTSPRequest, AppendAnnounceBody, &theBody);
     Assert(theErr != QTSS_BadArgument);
 
-    if (theErr == QTSS_RequestFailed)
-    {
-        OSCharArrayDeleter charArrayPathDeleter(theRequestBody);
-        //
-        // NEED TO RETURN RTSP ERROR RESPONSE
-        return QTSSModuleUtils::SendErrorResponse(inParams->inRTSPRequest, qtssClientBadRequest,0);
-    }
-    
-    if ((theErr == QTSS_WouldBlock) || (theLen < (*theContentLenP - theBufferOffset)))
+    if (theErr == QTSS_WouldBlock)
     {
 		//
         // Update our offset in the buffer
-        theBufferOffset += theLen;
-        (void)QTSS_SetValue(inParams->inRTSPRequest, sBufferOffsetAttr, 0, &theBufferOffset, sizeof(theBufferOffset));
+        (void)QTSS_SetValue(inParams->inRTSPRequest, sBufferOffsetAttr, 0, &theBody.fOffset, sizeof(theBody.fOffset));
         //qtss_printf("QTSSReflectorModule:DoAnnounce Request some more data \n");
         //
         // The entire content body hasn't arrived yet. Request a read event and wait for it.
@@ -1012,7 +1030,15 @@ QTSS_Error DoAnnounce(QTSS_StandardRTSP_Params* inParams)
         return QTSS_NoErr;
     }
 
-    Assert(theErr == QTSS_NoErr);
+    if ((theErr != QTSS_NoErr) || (theBody.fOffset != theBody.fLen))
+    {
+        //
+        // NEED TO RETURN RTSP ERROR RESPONSE
+        return QTSSModuleUtils::SendErrorResponse(inParams->inRTSPRequest, qtssClientBadRequest,0);
+    }
+
+    char* theRequestBody = theBody.fBuffer;
+    theRequestBody[theBody.fLen] = '\0';
     
 
 //
@@ -1030,7 +1056,11 @@ QTSS_Error DoAnnounce(QTSS_StandardRTSP_Params* inParams)
 
 // ------------  Clean up missing required SDP lines
 
-    ResizeableStringFormatter editedSDP(NULL,0);
+    UInt32 theEditedSDPSize = theBody.fLen + sEditedSDPHeadroom;
+    char* theEditedSDPBuffer = NULL;
+    if (QTSS_AllocRequestMemory(inParams->inRTSPRequest, theEditedSDPSize, (void**)&theEditedSDPBuffer) != QTSS_NoErr)
+        theEditedSDPSize = 0;
+    ResizeableStringFormatter editedSDP(theEditedSDPBuffer, theEditedSDPSize);
     DoAnnounceAddRequiredSDPLines(inParams, &editedSDP, theRequestBody);
     StrPtrLen editedSDPSPL(editedSDP.GetBufPtr(),editedSDP.GetBytesWritten());
 
@@ -1044,7 +1074,6 @@ QTSS_Error DoAnnounce(QTSS_StandardRTSP_Params* inParams)
     }
 
     SDPSourceInfo theSDPSourceInfo(editedSDPSPL.Ptr, editedSDPSPL.Len );
-    OSCharArrayDeleter charArrayPathDeleter(theRequestBody);
                         
     if (!InfoPortsOK(inParams,&theSDPSourceInfo,&theFullPath)) // All validity checks like this check should be done before touching the file.
     {   return QTSS_NoErr; // InfoPortsOK is sending back the error.
@@ -1079,7 +1108,8 @@ QTSS_Error DoAnnounce(QTSS_StandardRTSP_Params* inParams)
 	   {   return QTSSModuleUtils::SendErrorResponse(inParams->inRTSPRequest, qtssClientForbidden,0);
 	   }
 #endif 
-	   char sdpContext[1024] = {0};
+	   char* sdpContext = NULL;
+	   (void)QTSS_AllocRequestMemory(inParams->inRTSPRequest, ::strlen(sessionHeaders) + ::strlen(mediaHeaders) + 1, (void**)&sdpContext);
 	   sprintf(sdpContext,"%s%s",sessionHeaders,mediaHeaders);
 	   CSdpCache::GetInstance()->setSdpMap(theFullPath.Ptr,sdpContext);
 	   
@@ -1192,7 +1222,11 @@ QTSS_Error DoDescribe(QTSS_StandardRTSP_Params* inParams)
 
 // ------------  Clean up missing required SDP lines
 
-    ResizeableStringFormatter editedSDP(NULL,0);
+    UInt32 theEditedSDPSize = theSDPData.Len + sEditedSDPHeadroom;
+    char* theEditedSDPBuffer = NULL;
+    if (QTSS_AllocRequestMemory(inParams->inRTSPRequest, theEditedSDPSize, (void**)&theEditedSDPBuffer) != QTSS_NoErr)
+        theEditedSDPSize = 0;
+    ResizeableStringFormatter editedSDP(theEditedSDPBuffer, theEditedSDPSize);
     DoDescribeAddRequiredSDPLines(inParams, theSession, outModDate, &editedSDP, &theSDPData);
     StrPtrLen editedSDPSPL(editedSDP.GetBufPtr(),editedSDP.GetBytesWritten());
 
@@ -1218,6 +1252,13 @@ QTSS_Error DoDescribe(QTSS_StandardRTSP_Params* inParams)
 
     ResizeableStringFormatter buffer;
     SDPContainer* insertMediaLines = QTSS3GPPModuleUtils::Get3GPPSDPFeatureListCopy(buffer);
+
+    Bool16 nackEnabled = false;
+    UInt32 nackEnabledLen = sizeof(nackEnabled);
+    (void)QTSS_GetValue(sServerPrefs, easyPrefsRTCPNackEnabled, 0, &nackEnabled, &nackEnabledLen);
+    if (nackEnabled)
+        insertMediaLines->AddHeaderLine(&sRTCPNackSDPLine);
+
     SDPLineSorter sortedSDP(&checkedSDPContainer,adjustMediaBandwidthPercent,insertMediaLines);
     delete insertMediaLines;
  
@@ -1470,11 +1511,15 @@ QTSS_Error AddRTPStream(ReflectorSession* theSession,QTSS_StandardRTSP_Params* i
     // stream queue, we need to make sure that each ReflectorStream is not reflecting to this
     // session while we call QTSS_AddRTPStream. One brutal way to do this is to grab each
     // ReflectorStream's mutex, which will stop every reflector stream from running.
+    // The bucket tasks only hold the bucket task lock, so that gets write locked too.
     Assert(newStreamPtr != NULL);
     
     if (theSession != NULL)
         for (UInt32 x = 0; x < theSession->GetNumStreams(); x++)
+        {
             theSession->GetStreamByIndex(x)->GetMutex()->Lock();
+            theSession->GetStreamByIndex(x)->GetBucketTaskLock()->LockWrite();
+        }
     
     //
     // Turn off reliable UDP transport, because we are not yet equipped to
@@ -1483,7 +1528,10 @@ QTSS_Error AddRTPStream(ReflectorSession* theSession,QTSS_StandardRTSP_Params* i
 
     if (theSession != NULL)
         for (UInt32 y = 0; y < theSession->GetNumStreams(); y++)
+        {
+            theSession->GetStreamByIndex(y)->GetBucketTaskLock()->Unlock();
             theSession->GetStreamByIndex(y)->GetMutex()->Unlock();
+        }
 
     return theErr;
 }
@@ -1646,14 +1694,21 @@ QTSS_Error DoSetup(QTSS_StandardRTSP_Params* inParams)
         // stream queue, we need to make sure that each ReflectorStream is not reflecting to this
         // session while we call QTSS_AddRTPStream. One brutal way to do this is to grab each
         // ReflectorStream's mutex, which will stop every reflector stream from running.
+        // The bucket tasks only hold the bucket task lock, so that gets write locked too.
         
         for (UInt32 x = 0; x < theSession->GetNumStreams(); x++)
+        {
             theSession->GetStreamByIndex(x)->GetMutex()->Lock();
+            theSession->GetStreamByIndex(x)->GetBucketTaskLock()->LockWrite();
+        }
             
         theErr = QTSS_AddRTPStream(inParams->inClientSession, inParams->inRTSPRequest, &newStream, 0);
 
         for (UInt32 y = 0; y < theSession->GetNumStreams(); y++)
+        {
+            theSession->GetStreamByIndex(y)->GetBucketTaskLock()->Unlock();
             theSession->GetStreamByIndex(y)->GetMutex()->Unlock();
+        }
             
         if (theErr != QTSS_NoErr)
             return theErr;
@@ -1687,6 +1742,38 @@ QTSS_Error DoSetup(QTSS_StandardRTSP_Params* inParams)
     theErr = QTSS_SetValue(newStream, qtssRTPStrNumQualityLevels, 0, &sNumQualityLevels, sizeof(sNumQualityLevels));
     Assert(theErr == QTSS_NoErr);
     
+    // RTP over UDP viewers can ask for XOR FEC packets with "x-FEC: xor". The response
+    // tells them the payload type of the FEC packets and how many packets each protects.
+    StrPtrLen theFECHeader;
+    (void)QTSS_GetValuePtr(inParams->inRTSPHeaders, qtssXFECHeader, 0, (void**)&theFECHeader.Ptr, &theFECHeader.Len);
+    if ((theFECHeader.Len >= sFECXorScheme.Len) && theFECHeader.NumEqualIgnoreCase(sFECXorScheme.Ptr, sFECXorScheme.Len)
+        && (ReflectorStream::GetFECGroupSize() > 0))
+    {
+        QTSS_RTPTransportType theTransportType = qtssRTPTransportTypeTCP;
+        theLen = sizeof(theTransportType);
+        (void)QTSS_GetValue(newStream, qtssRTPStrTransportType, 0, &theTransportType, &theLen);
+        
+        for (UInt32 x = 0; (theTransportType == qtssRTPTransportTypeUDP) && (x < theSession->GetNumStreams()); x++)
+        {
+            ReflectorStream* theReflectorStream = theSession->GetStreamByIndex(x);
+            if (theReflectorStream->GetStreamCookie() != theStreamCookie)
+                continue;
+                
+            // the output was added to the stream on the first SETUP, so count it in here
+            theReflectorStream->GetMutex()->Lock();
+            if (RTPSessionOutput::EnableFEC(newStream))
+                theReflectorStream->AddFECOutput();
+            theReflectorStream->GetMutex()->Unlock();
+            
+            char theFECResponse[64];
+            qtss_snprintf(theFECResponse, sizeof(theFECResponse) - 1, "xor;pt=%"_U32BITARG_";group=%"_U32BITARG_,
+                            (UInt32)ReflectorStream::GetFECPayloadType(), ReflectorStream::GetFECGroupSize());
+            theFECResponse[sizeof(theFECResponse) - 1] = 0;
+            (void)QTSS_AppendRTSPHeader(inParams->inRTSPRequest, qtssXFECHeader, theFECResponse, ::strlen(theFECResponse));
+            break;
+        }
+    }
+    
     //send the setup response
     (void)QTSS_AppendRTSPHeader(inParams->inRTSPRequest, qtssCacheControlHeader,
                                 kCacheControlHeader.Ptr, kCacheControlHeader.Len);
@@ -72,6 +72,12 @@ static QTSS_AttributeID     sLastRTPTimeStampAttr           = qtssIllegalAttrID;
 
 static QTSS_AttributeID     sLastRTCPTransmitAttr           = qtssIllegalAttrID;
 
+static QTSS_AttributeID     sStreamFECEnabledAttr           = qtssIllegalAttrID;
+
+// Let the RTP stream hold on to a packet's buffer (see qtssWriteFlagsSharedPacket)
+static void RetainPacketBuffer(void* inBufferRef)   { ((ReflectorPacketBuffer*)inBufferRef)->Retain(); }
+static void ReleasePacketBuffer(void* inBufferRef)  { ((ReflectorPacketBuffer*)inBufferRef)->Release(); }
+
 RTPSessionOutput::RTPSessionOutput(QTSS_ClientSessionObject inClientSession, ReflectorSession* inReflectorSession,
                                     QTSS_Object serverPrefs, QTSS_AttributeID inCookieAddrID)
 :   fClientSession(inClientSession),
@@ -82,7 +88,8 @@ RTPSessionOutput::RTPSessionOutput(QTSS_ClientSessionObject inClientSession, Ref
     fIsUDP(false),
     fTransportInitialized(false),
     fMustSynch(true),
-    fPreFilter(true)
+    fPreFilter(true),
+    fNeedsFlush(false)
 {
     // create a bookmark for each stream we'll reflect
     this->InititializeBookmarks( inReflectorSession->GetNumStreams() );
@@ -117,6 +124,7 @@ void RTPSessionOutput::Register()
     static char*        sStreamSSRC             = "qtssReflectorStreamSSRC";
     static char*        sStreamPacketCount      = "qtssReflectorStreamPacketCount";
     static char*        sStreamByteCount        = "qtssReflectorStreamByteCount";
+    static char*        sStreamFECEnabled       = "qtssReflectorStreamFECEnabled";
 
 
  
@@ -178,6 +186,9 @@ void RTPSessionOutput::Register()
     (void)QTSS_AddStaticAttribute(qtssRTPStreamObjectType, sStreamByteCount, NULL, qtssAttrDataTypeUInt32);
     (void)QTSS_IDForAttr(qtssRTPStreamObjectType, sStreamByteCount, &sStreamByteCountAttr);
 
+    (void)QTSS_AddStaticAttribute(qtssRTPStreamObjectType, sStreamFECEnabled, NULL, qtssAttrDataTypeBool16);
+    (void)QTSS_IDForAttr(qtssRTPStreamObjectType, sStreamFECEnabled, &sStreamFECEnabledAttr);
+
 }
 
 Bool16 RTPSessionOutput::IsPlaying()
@@ -484,8 +495,9 @@ QTSS_Error  RTPSessionOutput::TrackRTPPackets(QTSS_RTPStreamObject *theStreamPtr
     if (!(inFlags & qtssWriteFlagsIsRTP))
         return QTSS_NoErr;
     
+    // only used to parse the header, so point it at the data instead of copying it
     ReflectorPacket packetContainer;
-    packetContainer.SetPacketData(inPacketStrPtr->Ptr, inPacketStrPtr->Len);
+    packetContainer.fPacketPtr.Set(inPacketStrPtr->Ptr, inPacketStrPtr->Len);
     packetContainer.fIsRTCP = false;
     SInt64 *theTimePtr = NULL;
     UInt32 theLen = 0;
@@ -562,12 +574,12 @@ QTSS_Error  RTPSessionOutput::TrackPackets(QTSS_RTPStreamObject *theStreamPtr, S
 }
 
 
-QTSS_Error  RTPSessionOutput::WritePacket(StrPtrLen* inPacket, void* inStreamCookie, UInt32 inFlags, SInt64 packetLatenessInMSec, SInt64* timeToSendThisPacketAgain, UInt64* packetIDPtr, SInt64* arrivalTimeMSecPtr, Bool16 firstPacket)
+QTSS_Error  RTPSessionOutput::WritePacket(StrPtrLen* inPacket, void* inStreamCookie, UInt32 inFlags, SInt64 packetLatenessInMSec, SInt64* timeToSendThisPacketAgain, UInt64* packetIDPtr, SInt64* arrivalTimeMSecPtr, Bool16 firstPacket, ReflectorPacketBuffer* inBuffer)
 {
     QTSS_RTPSessionState*   theState = NULL;
     UInt32                  theLen = 0;
     QTSS_Error              writeErr = QTSS_NoErr;
-    SInt64                  currentTime = OS::Milliseconds();
+    SInt64                  currentTime = OS::CachedMilliseconds();
     
  	if (inPacket == NULL || inPacket->Len == 0)
 		return QTSS_NoErr;
@@ -601,14 +613,30 @@ QTSS_Error  RTPSessionOutput::WritePacket(StrPtrLen* inPacket, void* inStreamCoo
        // TrackPackets below is for re-writing the rtcps we don't use it right now-- shouldn't need to    
        // (void) this->TrackPackets(theStreamPtr, inPacket, &currentTime,inFlags,  &packetLatenessInMSec, timeToSendThisPacketAgain, packetIDPtr,arrivalTimeMSecPtr);
 
-            QTSS_PacketStruct thePacket;
+            QTSS_SharedPacketStruct theSharedPacket;
+            QTSS_PacketStruct& thePacket = theSharedPacket.packet;
             thePacket.packetData = inPacket->Ptr;
             SInt64 delayMSecs = fBufferDelayMSecs - (currentTime - *arrivalTimeMSecPtr);
             thePacket.packetTransmitTime = (currentTime - packetLatenessInMSec);
             if (fBufferDelayMSecs > 0 ) 
                 thePacket.packetTransmitTime += delayMSecs; // add buffer time where oldest buffered packet as now == 0 and newest is entire buffer time in the future.
  
-            writeErr = QTSS_Write(*theStreamPtr, &thePacket, inPacket->Len, NULL, inFlags | qtssWriteFlagsWriteBurstBegin); 
+            // RTP over UDP is only queued on the stream's socket (the reflector packet stays put until
+            // the sender calls Flush), so the sends to every output of a bucket go out together.
+            UInt32 theWriteFlags = inFlags | qtssWriteFlagsWriteBurstBegin;
+            if (inFlags & qtssWriteFlagsIsRTP)
+                theWriteFlags |= qtssWriteFlagsBufferData;
+            
+            // Streams that answer NACKs keep a reference on the packet instead of a copy
+            if ((inFlags & qtssWriteFlagsIsRTP) && (inBuffer != NULL))
+            {
+                theSharedPacket.bufferRef = inBuffer;
+                theSharedPacket.retainProc = RetainPacketBuffer;
+                theSharedPacket.releaseProc = ReleasePacketBuffer;
+                theWriteFlags |= qtssWriteFlagsSharedPacket;
+            }
+            
+            writeErr = QTSS_Write(*theStreamPtr, &theSharedPacket, inPacket->Len, NULL, theWriteFlags); 
             if (writeErr == QTSS_WouldBlock)
             {  
                  //qtss_printf("QTSS_Write == QTSS_WouldBlock\n");
@@ -631,6 +659,7 @@ QTSS_Error  RTPSessionOutput::WritePacket(StrPtrLen* inPacket, void* inStreamCoo
                 if (inFlags & qtssWriteFlagsIsRTP)
                 {
                     (void) QTSS_SetValue (*theStreamPtr, sLastRTPPacketIDAttr, 0, packetIDPtr, sizeof(UInt64));
+                    fNeedsFlush = true;
                 }
                 else if (inFlags & qtssWriteFlagsIsRTCP)
                 {
@@ -660,6 +689,79 @@ QTSS_Error  RTPSessionOutput::WritePacket(StrPtrLen* inPacket, void* inStreamCoo
     return writeErr;
 }
 
+Bool16 RTPSessionOutput::EnableFEC(QTSS_RTPStreamObject inStream)
+{
+    Bool16* theEnabledPtr = NULL;
+    UInt32 theLen = 0;
+    if ((QTSS_GetValuePtr(inStream, sStreamFECEnabledAttr, 0, (void**)&theEnabledPtr, &theLen) == QTSS_NoErr) && (theLen > 0) && *theEnabledPtr)
+        return false;
+    
+    Bool16 isEnabled = true;
+    (void) QTSS_SetValue(inStream, sStreamFECEnabledAttr, 0, &isEnabled, sizeof(isEnabled));
+    return true;
+}
+
+Bool16 RTPSessionOutput::WantsFEC(void* inStreamCookie)
+{
+    QTSS_RTPStreamObject *theStreamPtr = NULL;
+    Bool16* theEnabledPtr = NULL;
+    UInt32 theLen = 0;
+    for (UInt32 z = 0; QTSS_GetValuePtr(fClientSession, qtssCliSesStreamObjects, z, (void**)&theStreamPtr, &theLen) == QTSS_NoErr; z++)
+    {
+        if (this->PacketMatchesStream(inStreamCookie, theStreamPtr))
+            return (QTSS_GetValuePtr(*theStreamPtr, sStreamFECEnabledAttr, 0, (void**)&theEnabledPtr, &theLen) == QTSS_NoErr) && (theLen > 0) && *theEnabledPtr;
+    }
+    return false;
+}
+
+QTSS_Error RTPSessionOutput::WriteFECPacket(StrPtrLen* inPacket, void* inStreamCookie, SInt64 packetLatenessInMSec, SInt64* timeToSendThisPacketAgain, SInt64* arrivalTimeMSecPtr)
+{
+    QTSS_Error  writeErr = QTSS_NoErr;
+    SInt64      currentTime = OS::CachedMilliseconds();
+    
+    QTSS_RTPStreamObject *theStreamPtr = NULL;
+    UInt32 theLen = 0;
+    for (UInt32 z = 0; QTSS_GetValuePtr(fClientSession, qtssCliSesStreamObjects, z, (void**)&theStreamPtr, &theLen) == QTSS_NoErr; z++)
+    {
+        if (!this->PacketMatchesStream(inStreamCookie, theStreamPtr))
+            continue;
+        
+        Bool16* theEnabledPtr = NULL;
+        if ((QTSS_GetValuePtr(*theStreamPtr, sStreamFECEnabledAttr, 0, (void**)&theEnabledPtr, &theLen) != QTSS_NoErr) || (theLen == 0) || !*theEnabledPtr)
+            break;
+        
+        // Same timing as the packet it follows. It's buffered like the RTP packets (the
+        // packet it hangs off isn't reused before the Flush), but it isn't pooled data:
+        // FEC packets never answer a NACK.
+        QTSS_PacketStruct thePacket;
+        thePacket.packetData = inPacket->Ptr;
+        thePacket.packetTransmitTime = (currentTime - packetLatenessInMSec);
+        if (fBufferDelayMSecs > 0)
+            thePacket.packetTransmitTime += fBufferDelayMSecs - (currentTime - *arrivalTimeMSecPtr);
+        
+        writeErr = QTSS_Write(*theStreamPtr, &thePacket, inPacket->Len, NULL, qtssWriteFlagsIsRTP | qtssWriteFlagsBufferData);
+        if (writeErr == QTSS_WouldBlock)
+            *timeToSendThisPacketAgain = thePacket.suggestedWakeupTime;
+        else if (writeErr == QTSS_NoErr)
+            fNeedsFlush = true;
+        break;
+    }
+    
+    return writeErr;
+}
+
+void RTPSessionOutput::Flush()
+{
+    if (!fNeedsFlush)
+        return;
+    fNeedsFlush = false;
+
+    QTSS_RTPStreamObject *theStreamPtr = NULL;
+    UInt32 theLen = 0;
+    for (UInt32 z = 0; QTSS_GetValuePtr(fClientSession, qtssCliSesStreamObjects, z, (void**)&theStreamPtr, &theLen) == QTSS_NoErr; z++)
+        (void) QTSS_Flush(*theStreamPtr);
+}
+
 UInt16 RTPSessionOutput::GetPacketSeqNumber(StrPtrLen* inPacket)
 {
     if (inPacket->Len < 4)
@@ -723,7 +825,7 @@ Bool16 RTPSessionOutput::PacketShouldBeThinned(QTSS_RTPStreamObject inStream, St
         (void)QTSS_SetValue(inStream, sLastQualityChangeAttr, 0, lastChangeTime, sizeof(SInt64));
     }
     
-    SInt64 timeNow = OS::Milliseconds();
+    SInt64 timeNow = OS::CachedMilliseconds();
     if (*lastChangeTime == 0 || *curQualityLevel == 0) 
         *lastChangeTime =timeNow;
     
@@ -57,7 +57,8 @@ class RTPSessionOutput : public ReflectorOutput
         // This writes the packet out to the proper QTSS_RTPStreamObject.
         // If this function returns QTSS_WouldBlock, timeToSendThisPacketAgain will
         // be set to # of msec in which the packet can be sent, or -1 if unknown
-        virtual QTSS_Error  WritePacket(StrPtrLen* inPacketData, void* inStreamCookie, UInt32 inFlags, SInt64 packetLatenessInMSec, SInt64* timeToSendThisPacketAgain, UInt64* packetIDPtr, SInt64* arrivalTimeMSec,Bool16 firstPacket );
+        virtual QTSS_Error  WritePacket(StrPtrLen* inPacketData, void* inStreamCookie, UInt32 inFlags, SInt64 packetLatenessInMSec, SInt64* timeToSendThisPacketAgain, UInt64* packetIDPtr, SInt64* arrivalTimeMSec,Bool16 firstPacket, ReflectorPacketBuffer* inBuffer );
+        virtual void Flush();
         virtual void TearDown();
         
         SInt64                  GetReflectorSessionInitTime()                    { return fReflectorSession->GetInitTimeMS(); }
@@ -66,6 +67,12 @@ class RTPSessionOutput : public ReflectorOutput
         
         virtual Bool16  IsPlaying();
         
+        // FEC packets only go to the streams they were turned on for with EnableFEC.
+        // EnableFEC returns false if the stream already had them.
+        static Bool16       EnableFEC(QTSS_RTPStreamObject inStream);
+        virtual Bool16      WantsFEC(void* inStreamCookie);
+        virtual QTSS_Error  WriteFECPacket(StrPtrLen* inPacket, void* inStreamCookie, SInt64 packetLatenessInMSec, SInt64* timeToSendThisPacketAgain, SInt64* arrivalTimeMSec);
+        
         void SetBufferDelay (UInt32 delay) { fBufferDelayMSecs = delay; }
 
     private:
@@ -79,6 +86,7 @@ class RTPSessionOutput : public ReflectorOutput
         Bool16                  fTransportInitialized;
         Bool16                  fMustSynch;
         Bool16                  fPreFilter;
+        Bool16                  fNeedsFlush;    // RTP packets were buffered since the last Flush
         
         UInt16 GetPacketSeqNumber(StrPtrLen* inPacket);
         void SetPacketSeqNumber(StrPtrLen* inPacket, UInt16 inSeqNumber);
@@ -44,30 +44,41 @@
 #include "OS.h"
 #include "OSQueue.h"
 
+class ReflectorPacketRing;
+class ReflectorPacketBuffer;
 
 class ReflectorOutput
 {
 	public:
     
-		ReflectorOutput() : fBookmarkedPacketsElemsArray(NULL), fNumBookmarks(0), fAvailPosition(0), fLastIntervalMilliSec(5), fLastPacketTransmitTime(0) {}   
+		ReflectorOutput() : fBookmarksArray(NULL), fNumBookmarks(0), fLastIntervalMilliSec(5), fLastPacketTransmitTime(0),
+                            fFirstFrameWaitStart(0), fFirstFrameWaitSeq(0) {}   
 
         virtual ~ReflectorOutput() 
         {
-            if ( fBookmarkedPacketsElemsArray )
-            {   ::memset( fBookmarkedPacketsElemsArray, 0, sizeof ( OSQueueElem* ) * fNumBookmarks );
-
-                delete [] fBookmarkedPacketsElemsArray;
-            }
+            if ( fBookmarksArray )
+                delete [] fBookmarksArray;
         }
         
-        // an array of packet elements ( from fPacketQueue in ReflectorSender )
-        // possibly one for each ReflectorSender that sends data to this ReflectorOutput        
-        OSQueueElem         **fBookmarkedPacketsElemsArray;
+        // This output's read position in the packet ring of a ReflectorSender:
+        // the sequence number of the next packet to write to it
+        struct Bookmark
+        {
+            ReflectorPacketRing*    fRing;
+            UInt64                  fSeq;
+        };
+        
+        // one for each ReflectorSender that sends data to this ReflectorOutput        
+        Bookmark            *fBookmarksArray;
         UInt32              fNumBookmarks;
-        SInt32              fAvailPosition;
         QTSS_TimeVal        fLastIntervalMilliSec;
         QTSS_TimeVal        fLastPacketTransmitTime;
 		OSMutex             fMutex;
+        
+        // Set while a new output is waiting for its first video key frame (for the
+        // time-to-first-frame counter): when it started, and the packet it started at
+        SInt64              fFirstFrameWaitStart;
+        UInt64              fFirstFrameWaitSeq;
 
 	//add by fantasy		
 	private:
@@ -101,8 +112,9 @@ class ReflectorOutput
 //end add
 
 
-inline  OSQueueElem*    GetBookMarkedPacket(OSQueue *thePacketQueue);
-inline  Bool16          SetBookMarkPacket(OSQueueElem* thePacketElemPtr);
+        // Returns false if nothing has been written to this output from that ring yet
+inline  Bool16          GetBookMarkedPacket(ReflectorPacketRing* inRing, UInt64* outSeq);
+inline  Bool16          SetBookMarkPacket(ReflectorPacketRing* inRing, UInt64 inSeq);
         
         // WritePacket
         //
@@ -111,7 +123,19 @@ inline  Bool16          SetBookMarkPacket(OSQueueElem* thePacketElemPtr);
         // packetLateness is how many MSec's late this packet is in being delivered ( will be < 0 if its early )
         // If this function returns QTSS_WouldBlock, timeToSendThisPacketAgain will
         // be set to # of msec in which the packet can be sent, or -1 if unknown
-        virtual QTSS_Error  WritePacket(StrPtrLen* inPacket, void* inStreamCookie, UInt32 inFlags, SInt64 packetLatenessInMSec, SInt64* timeToSendThisPacketAgain, UInt64* packetIDPtr, SInt64* arrivalTimeMSec, Bool16 firstPacket ) = 0;
+        // inBuffer is the reference counted buffer inPacket points into, or NULL. An output
+        // that keeps the data after it returns must Retain the buffer.
+        virtual QTSS_Error  WritePacket(StrPtrLen* inPacket, void* inStreamCookie, UInt32 inFlags, SInt64 packetLatenessInMSec, SInt64* timeToSendThisPacketAgain, UInt64* packetIDPtr, SInt64* arrivalTimeMSec, Bool16 firstPacket, ReflectorPacketBuffer* inBuffer ) = 0;
+    
+        // Sends out any packets WritePacket has buffered instead of sending right away.
+        // The sender calls this at the end of each bucket, before any of the packets can be reused.
+        virtual void        Flush() {}
+        
+        // Forward error correction. WantsFEC returns true if the output asked for the
+        // parity packets of that stream (see ReflectorFECGenerator), WriteFECPacket then
+        // writes them the way WritePacket writes RTP packets.
+        virtual Bool16      WantsFEC(void* inStreamCookie) { return false; }
+        virtual QTSS_Error  WriteFECPacket(StrPtrLen* inPacket, void* inStreamCookie, SInt64 packetLatenessInMSec, SInt64* timeToSendThisPacketAgain, SInt64* arrivalTimeMSec) { return QTSS_NoErr; }
     
         virtual void        TearDown() = 0;
         virtual Bool16      IsUDP() = 0;
@@ -125,74 +149,54 @@ inline  Bool16          SetBookMarkPacket(OSQueueElem* thePacketElemPtr);
             // need 2 bookmarks for each stream ( include RTCPs )
             UInt32  numBookmarks = numStreams * 2;
 
-            fBookmarkedPacketsElemsArray = new OSQueueElem*[numBookmarks]; 
-            ::memset( fBookmarkedPacketsElemsArray, 0, sizeof ( OSQueueElem* ) * (numBookmarks) );
+            fBookmarksArray = new Bookmark[numBookmarks]; 
+            ::memset( fBookmarksArray, 0, sizeof ( Bookmark ) * (numBookmarks) );
             
-			//DT("fBookmarkedPacketsElemsArray[-1] %p= %p", &fBookmarkedPacketsElemsArray[-1], fBookmarkedPacketsElemsArray[-1]);
             fNumBookmarks = numBookmarks;
         }
 
 };
 
-Bool16  ReflectorOutput::SetBookMarkPacket(OSQueueElem* thePacketElemPtr)
+Bool16  ReflectorOutput::SetBookMarkPacket(ReflectorPacketRing* inRing, UInt64 inSeq)
 {
-	//OSMutexLocker locker(&fMutex);
-    if (fAvailPosition != -1 && thePacketElemPtr)
-    {    
-        fBookmarkedPacketsElemsArray[fAvailPosition] = thePacketElemPtr; 
-        
-        for (UInt32 i = 0; i < fNumBookmarks; i++)
-        {                   
-            if (fBookmarkedPacketsElemsArray[i] == NULL)
-            {   
-                fAvailPosition = i;
-                return true;
-            }
+    Assert(inRing != NULL);
+    
+    // update this ring's bookmark, or take the first free one
+    Bookmark* theFree = NULL;
+    for (UInt32 i = 0; i < fNumBookmarks; i++)
+    {
+        if (fBookmarksArray[i].fRing == inRing)
+        {
+            fBookmarksArray[i].fSeq = inSeq;
+            return true;
         }
+        if ((fBookmarksArray[i].fRing == NULL) && (theFree == NULL))
+            theFree = &fBookmarksArray[i];
     }
     
-    return false;
-
+    if (theFree == NULL)
+        return false;
+    
+    theFree->fRing = inRing;
+    theFree->fSeq = inSeq;
+    return true;
 }
 
-OSQueueElem*    ReflectorOutput::GetBookMarkedPacket(OSQueue *thePacketQueue)
+Bool16  ReflectorOutput::GetBookMarkedPacket(ReflectorPacketRing* inRing, UInt64* outSeq)
 {
-	//OSMutexLocker locker(&fMutex);
-    Assert(thePacketQueue != NULL);    
-        
-    OSQueueElem*        packetElem = NULL;              
-    UInt32              curBookmark = 0;
-
-    fAvailPosition = -1;       
+    Assert(inRing != NULL);
+    Assert(outSeq != NULL);
     
-    // see if we've bookmarked a held packet for this Sender in this Output
-    while ( curBookmark < fNumBookmarks )
-    {                   
-        OSQueueElem*    bookmarkedElem = fBookmarkedPacketsElemsArray[curBookmark]; 
-        
-        if ( bookmarkedElem )   // there may be holes in this array
-        {                           
-            if ( bookmarkedElem->IsMember( *thePacketQueue ) ) 
-            {   
-                // this packet was previously bookmarked for this specific queue
-                // remove if from the bookmark list and use it
-                // to jump ahead into the Sender's over all packet queue                        
-                fBookmarkedPacketsElemsArray[curBookmark] = NULL;  
-                fAvailPosition = curBookmark;
-                packetElem = bookmarkedElem;
-                break;
-            }                        
-        }
-        else
+    for (UInt32 i = 0; i < fNumBookmarks; i++)
+    {
+        if (fBookmarksArray[i].fRing == inRing)
         {
-            fAvailPosition = curBookmark;
+            *outSeq = fBookmarksArray[i].fSeq;
+            return true;
         }
-        
-        curBookmark++;
-            
     }
     
-    return packetElem;
+    return false;
 }                
 
 
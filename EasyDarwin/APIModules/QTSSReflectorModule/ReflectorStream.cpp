@@ -33,11 +33,13 @@
 
 #include "ReflectorStream.h"
 #include "QTSSModuleUtils.h"
+#include "OS.h"
 #include "OSMemory.h"
 #include "SocketUtils.h"
 #include "atomic.h"
 #include "RTCPPacket.h"
 #include "ReflectorSession.h"
+#include "OSBufferPool.h"
 
 
 #if DEBUG
@@ -49,6 +51,19 @@
 
 static ReflectorSocketPool  sSocketPool;
 
+// Packet buffer slabs, one pool per size class. Audio and RTCP packets fit the small
+// classes, full video packets the 1536 byte one. UDP input always reads into the
+// largest class because the length isn't known until the datagram is in.
+UInt32 ReflectorPacketBuffer::sSizeClasses[ReflectorPacketBuffer::kNumSizeClasses] = { 256, 512, 1024, 1536, ReflectorPacket::kMaxReflectorPacketSize };
+
+static OSBufferPool sPacketBufferPool0(sizeof(ReflectorPacketBuffer) + 256);
+static OSBufferPool sPacketBufferPool1(sizeof(ReflectorPacketBuffer) + 512);
+static OSBufferPool sPacketBufferPool2(sizeof(ReflectorPacketBuffer) + 1024);
+static OSBufferPool sPacketBufferPool3(sizeof(ReflectorPacketBuffer) + 1536);
+static OSBufferPool sPacketBufferPool4(sizeof(ReflectorPacketBuffer) + ReflectorPacket::kMaxReflectorPacketSize);
+static OSBufferPool* sPacketBufferPools[ReflectorPacketBuffer::kNumSizeClasses] =
+    { &sPacketBufferPool0, &sPacketBufferPool1, &sPacketBufferPool2, &sPacketBufferPool3, &sPacketBufferPool4 };
+
 // ATTRIBUTES
 
 static QTSS_AttributeID         sCantBindReflectorSocketErr = qtssIllegalAttrID;
@@ -60,6 +75,13 @@ static UInt32                   sDefaultBucketDelayInMsec           = 73;
 static Bool16                   sDefaultUsePacketReceiveTime        = false; 
 static UInt32                   sDefaultMaxFuturePacketTimeSec      = 60;
 static UInt32                   sDefaultFirstPacketOffsetMsec       = 500;
+static UInt32                   sDefaultBatchReceivePackets         = 32;
+static Bool16                   sDefaultUseKernelReceiveTime        = false;
+static UInt32                   sDefaultPacketRingSize              = 8192;
+static UInt32                   sDefaultNumBucketTasks              = 4;
+static UInt32                   sDefaultGOPCacheMaxBytes            = 2097152;
+static UInt32                   sDefaultFECGroupSize                = 8;
+static UInt32                   sDefaultFECPayloadType              = 127;
 
 UInt32                          ReflectorStream::sBucketSize  = 16;
 UInt32                          ReflectorStream::sOverBufferInMsec = 10000; // more or less what the client over buffer will be
@@ -71,9 +93,75 @@ UInt32                          ReflectorStream::sOverBufferInSec = 10;
 UInt32                          ReflectorStream::sBucketDelayInMsec = 73;
 Bool16                          ReflectorStream::sUsePacketReceiveTime = false;
 UInt32                          ReflectorStream::sFirstPacketOffsetMsec = 500;
+UInt32                          ReflectorStream::sBatchReceivePackets = 32;
+Bool16                          ReflectorStream::sUseKernelReceiveTime = false;
+UInt32                          ReflectorStream::sPacketRingSize = 8192;
+UInt32                          ReflectorStream::sNumBucketTasks = 4;
+UInt32                          ReflectorStream::sGOPCacheMaxBytes = 2097152;
+UInt32                          ReflectorStream::sFECGroupSize = 8;
+UInt32                          ReflectorStream::sFECPayloadType = 127;
+
+unsigned int                    ReflectorStream::sGOPCacheHits = 0;
+unsigned int                    ReflectorStream::sGOPCacheMisses = 0;
+unsigned int                    ReflectorStream::sNumFirstFrames = 0;
+unsigned int                    ReflectorStream::sTotalTimeToFirstFrameMSec = 0;
 
 UInt32                          ReflectorStream::sRelocatePacketAgeMSec = 10000;
 	
+UInt32 ReflectorPacketBuffer::GetCapacityFor(UInt32 inLen)
+{
+    for (UInt32 theClass = 0; theClass < kNumSizeClasses - 1; theClass++)
+    {
+        if (inLen <= sSizeClasses[theClass])
+            return sSizeClasses[theClass];
+    }
+    return sSizeClasses[kNumSizeClasses - 1];
+}
+
+ReflectorPacketBuffer* ReflectorPacketBuffer::Get(UInt32 inLen)
+{
+    Assert(inLen <= ReflectorPacket::kMaxReflectorPacketSize);
+    
+    UInt32 theClass = 0;
+    while ((theClass < kNumSizeClasses - 1) && (inLen > sSizeClasses[theClass]))
+        theClass++;
+        
+    ReflectorPacketBuffer* theBuffer = (ReflectorPacketBuffer*)sPacketBufferPools[theClass]->Get();
+    theBuffer->fRefCount = 1;
+    theBuffer->fSizeClass = theClass;
+    return theBuffer;
+}
+
+void ReflectorPacketBuffer::Release()
+{
+    Assert(fRefCount > 0);
+    if (atomic_sub(&fRefCount, 1) == 0)
+        sPacketBufferPools[fSizeClass]->Put(this);
+}
+
+void ReflectorPacket::ReserveBuffer(UInt32 inLen)
+{
+    if ((fBuffer == NULL) || fBuffer->IsShared() || (fBuffer->GetCapacity() != ReflectorPacketBuffer::GetCapacityFor(inLen)))
+    {
+        if (fBuffer != NULL)
+            fBuffer->Release();
+        fBuffer = ReflectorPacketBuffer::Get(inLen);
+    }
+    fPacketPtr.Set(fBuffer->GetData(), 0);
+}
+
+void ReflectorPacket::FitBuffer()
+{
+    if ((fBuffer == NULL) || (fBuffer->GetCapacity() == ReflectorPacketBuffer::GetCapacityFor(fPacketPtr.Len)))
+        return;
+    
+    ReflectorPacketBuffer* theBuffer = ReflectorPacketBuffer::Get(fPacketPtr.Len);
+    ::memcpy(theBuffer->GetData(), fPacketPtr.Ptr, fPacketPtr.Len);
+    fBuffer->Release();
+    fBuffer = theBuffer;
+    fPacketPtr.Ptr = theBuffer->GetData();
+}
+
 void ReflectorStream::Register()
 {
     // Add text messages attributes
@@ -105,12 +193,65 @@ void ReflectorStream::Initialize(QTSS_ModulePrefsObject inPrefs)
     QTSSModuleUtils::GetAttribute(inPrefs, "reflector_rtp_info_offset_msec", qtssAttrDataTypeUInt32,
                               &ReflectorStream::sFirstPacketOffsetMsec, &sDefaultFirstPacketOffsetMsec, sizeof(sDefaultFirstPacketOffsetMsec));
 
+    QTSSModuleUtils::GetAttribute(inPrefs, "reflector_batch_receive_packets", qtssAttrDataTypeUInt32,
+                              &ReflectorStream::sBatchReceivePackets, &sDefaultBatchReceivePackets, sizeof(sDefaultBatchReceivePackets));
+
+    QTSSModuleUtils::GetAttribute(inPrefs, "reflector_use_kernel_receive_time", qtssAttrDataTypeBool16,
+                              &ReflectorStream::sUseKernelReceiveTime, &sDefaultUseKernelReceiveTime, sizeof(sDefaultUseKernelReceiveTime));
+
+    QTSSModuleUtils::GetAttribute(inPrefs, "reflector_packet_ring_size", qtssAttrDataTypeUInt32,
+                              &ReflectorStream::sPacketRingSize, &sDefaultPacketRingSize, sizeof(sDefaultPacketRingSize));
+
+    QTSSModuleUtils::GetAttribute(inPrefs, "reflector_bucket_tasks", qtssAttrDataTypeUInt32,
+                              &ReflectorStream::sNumBucketTasks, &sDefaultNumBucketTasks, sizeof(sDefaultNumBucketTasks));
+
+    QTSSModuleUtils::GetAttribute(inPrefs, "reflector_gop_cache_max_bytes", qtssAttrDataTypeUInt32,
+                              &ReflectorStream::sGOPCacheMaxBytes, &sDefaultGOPCacheMaxBytes, sizeof(sDefaultGOPCacheMaxBytes));
+
+    QTSSModuleUtils::GetAttribute(inPrefs, "reflector_fec_group_size", qtssAttrDataTypeUInt32,
+                              &ReflectorStream::sFECGroupSize, &sDefaultFECGroupSize, sizeof(sDefaultFECGroupSize));
+
+    QTSSModuleUtils::GetAttribute(inPrefs, "reflector_fec_payload_type", qtssAttrDataTypeUInt32,
+                              &ReflectorStream::sFECPayloadType, &sDefaultFECPayloadType, sizeof(sDefaultFECPayloadType));
+
     ReflectorStream::sOverBufferInMsec = sOverBufferInSec * 1000;
     ReflectorStream::sMaxFuturePacketMSec = sMaxFuturePacketSec * 1000;
     ReflectorStream::sMaxPacketAgeMSec = (UInt32) (sOverBufferInMsec * 10.0); //allow a little time before deleting.
 	if(ReflectorStream::sMaxPacketAgeMSec == 0)
 		ReflectorStream::sMaxPacketAgeMSec = 10000;
     ReflectorStream::sRelocatePacketAgeMSec = (UInt32) (sOverBufferInMsec * 1.3); 
+    if (ReflectorStream::sBatchReceivePackets > UDPSocket::kMaxBatchSize)
+        ReflectorStream::sBatchReceivePackets = UDPSocket::kMaxBatchSize;
+    if (ReflectorStream::sFECGroupSize > ReflectorFECGenerator::kMaxGroupSize)
+        ReflectorStream::sFECGroupSize = ReflectorFECGenerator::kMaxGroupSize;
+    if ((ReflectorStream::sFECPayloadType < 96) || (ReflectorStream::sFECPayloadType > 127)) // dynamic payload types only
+        ReflectorStream::sFECPayloadType = sDefaultFECPayloadType;
+}
+
+void ReflectorStream::InitializeStats(QTSS_ServerObject inServer)
+{
+    static char*        sGOPCacheHitsName               = "QTSSReflectorModuleGOPCacheHits";
+    static char*        sGOPCacheMissesName             = "QTSSReflectorModuleGOPCacheMisses";
+    static char*        sNumFirstFramesName             = "QTSSReflectorModuleNumFirstFrames";
+    static char*        sTotalTimeToFirstFrameName      = "QTSSReflectorModuleTotalTimeToFirstFrameMSec";
+    static char*        sNumFECPacketsName              = "QTSSReflectorModuleNumFECPackets";
+    
+    // The attributes point straight at the counters, so they are always current.
+    // The average time to first frame is TotalTimeToFirstFrameMSec / NumFirstFrames.
+    QTSS_AttributeID theID = QTSSModuleUtils::CreateAttribute(inServer, sGOPCacheHitsName, qtssAttrDataTypeUInt32, NULL, 0);
+    (void)QTSS_SetValuePtr(inServer, theID, &sGOPCacheHits, sizeof(sGOPCacheHits));
+    
+    theID = QTSSModuleUtils::CreateAttribute(inServer, sGOPCacheMissesName, qtssAttrDataTypeUInt32, NULL, 0);
+    (void)QTSS_SetValuePtr(inServer, theID, &sGOPCacheMisses, sizeof(sGOPCacheMisses));
+    
+    theID = QTSSModuleUtils::CreateAttribute(inServer, sNumFirstFramesName, qtssAttrDataTypeUInt32, NULL, 0);
+    (void)QTSS_SetValuePtr(inServer, theID, &sNumFirstFrames, sizeof(sNumFirstFrames));
+    
+    theID = QTSSModuleUtils::CreateAttribute(inServer, sTotalTimeToFirstFrameName, qtssAttrDataTypeUInt32, NULL, 0);
+    (void)QTSS_SetValuePtr(inServer, theID, &sTotalTimeToFirstFrameMSec, sizeof(sTotalTimeToFirstFrameMSec));
+    
+    theID = QTSSModuleUtils::CreateAttribute(inServer, sNumFECPacketsName, qtssAttrDataTypeUInt32, NULL, 0);
+    (void)QTSS_SetValuePtr(inServer, theID, &ReflectorFECGenerator::sNumFECPackets, sizeof(ReflectorFECGenerator::sNumFECPackets));
 }
 
 void ReflectorStream::GenerateSourceID(SourceInfo::StreamInfo* inInfo, char* ioBuffer)
@@ -144,10 +285,12 @@ ReflectorStream::ReflectorStream(SourceInfo::StreamInfo* inInfo)
     fHasFirstRTPPacket(false),
     fEnableBuffer(false),
     fEyeCount(0),
+    fGOPCodec(kNoGOPCodec),
     fFirst_RTCP_RTP_Time(0),
     fFirst_RTCP_Arrival_Time(0),
 	fTransportType(qtssRTPTransportTypeUDP),
-	fMyReflectorSession(NULL)
+	fMyReflectorSession(NULL),
+    fNumFECOutputs(0)
 {
 
     fRTPSender.fStream = this;
@@ -155,6 +298,17 @@ ReflectorStream::ReflectorStream(SourceInfo::StreamInfo* inInfo)
 
     fStreamInfo.Copy(*inInfo);
     
+    // the GOP cache only knows where the key frames are in H.264 and H.265
+    if (fStreamInfo.fPayloadType == qtssVideoPayloadType)
+    {
+        static StrPtrLen sH264PayloadName("H264/90000");
+        static StrPtrLen sH265PayloadName("H265/90000");
+        if (fStreamInfo.fPayloadName.EqualIgnoreCase(sH264PayloadName))
+            fGOPCodec = kH264GOPCodec;
+        else if (fStreamInfo.fPayloadName.EqualIgnoreCase(sH265PayloadName))
+            fGOPCodec = kH265GOPCodec;
+    }
+    
     // ALLOCATE BUCKET ARRAY
     this->AllocateBucketArray(fNumBuckets);
 
@@ -204,9 +358,6 @@ ReflectorStream::ReflectorStream(SourceInfo::StreamInfo* inInfo)
         fDestRTCPAddr = fStreamInfo.fDestIPAddr;
         fDestRTCPPort = fStreamInfo.fPort + 1;
     }
-
-	pkeyFrameCache = new CKeyFrameCache(MAX_CACHE_SIZE);
-	
 }
 
 
@@ -214,6 +365,11 @@ ReflectorStream::~ReflectorStream()
 {
     Assert(fNumElements == 0);
 
+    // The senders are members, so they'd only stop their bucket tasks after the
+    // output array below and fBucketTaskLock are gone
+    fRTPSender.StopBucketTasks();
+    fRTCPSender.StopBucketTasks();
+
     if (fSockets != NULL)
     {
         //first things first, let's take this stream off the socket's queue
@@ -235,13 +391,6 @@ ReflectorStream::~ReflectorStream()
 		else if (qtssRTPTransportTypeTCP == fTransportType)
 			sSocketPool.DestructUDPSocketPair(fSockets);
     }
-	
-	// ͷŹؼ֡
-    if(pkeyFrameCache)
-    {
-        delete pkeyFrameCache;
-        pkeyFrameCache = NULL;
-    }		
 
 	//delete every client Bucket
     for (UInt32 y = 0; y < fNumBuckets; y++)
@@ -278,6 +427,7 @@ void ReflectorStream::AllocateBucketArray(UInt32 inNumBuckets)
 SInt32 ReflectorStream::AddOutput(ReflectorOutput* inOutput, SInt32 putInThisBucket)
 {
     OSMutexLocker locker(&fBucketMutex);
+    OSMutexWriteLocker taskLocker(&fBucketTaskLock); // the bucket array may get reallocated
     
 #if DEBUG
     // We should never be adding an output twice to a stream
@@ -335,6 +485,7 @@ SInt32 ReflectorStream::FindBucket()
 void  ReflectorStream::RemoveOutput(ReflectorOutput* inOutput)
 {
     OSMutexLocker locker(&fBucketMutex);
+    OSMutexWriteLocker taskLocker(&fBucketTaskLock); // the output goes away once we return
     Assert(fNumElements > 0);
     
     //look at all the indexes in the array
@@ -346,6 +497,8 @@ void  ReflectorStream::RemoveOutput(ReflectorOutput* inOutput)
             if (fOutputArray[x][y] == inOutput)
             {
                 fOutputArray[x][y] = NULL;//just clear out the pointer
+                if (inOutput->WantsFEC(this))
+                    (void)atomic_sub(&fNumFECOutputs, 1);
                 
 #if REFLECTOR_STREAM_DEBUGGING  
                 qtss_printf("Removing output %x from bucket %"_S32BITARG_", index %"_S32BITARG_"\n",inOutput,x,y);
@@ -362,6 +515,7 @@ void  ReflectorStream::TearDownAllOutputs()
 {
 
     OSMutexLocker locker(&fBucketMutex);
+    OSMutexWriteLocker taskLocker(&fBucketTaskLock); // the bucket tasks walk the same array
     
     //look at all the indexes in the array
     for (UInt32 x = 0; x < fNumBuckets; x++)
@@ -523,8 +677,6 @@ void ReflectorStream::SendReceiverReport()
 
 void ReflectorStream::PushPacket(char *packet, UInt32 packetLen, Bool16 isRTCP)
 {
-	FU_Head *head = (FU_Head*)&packet[13];
-
 	if (packetLen > 0)
 	{	
 		ReflectorPacket* thePacket = NULL;
@@ -540,7 +692,7 @@ void ReflectorStream::PushPacket(char *packet, UInt32 packetLen, Bool16 isRTCP)
 			
 			OSMutexLocker locker( ((ReflectorSocket*)(fSockets->GetSocketB()) )->GetDemuxer()->GetMutex());
 			thePacket->SetPacketData(packet, packetLen);
-			((ReflectorSocket*)fSockets->GetSocketB())->ProcessPacket(OS::Milliseconds(),thePacket,0,0);
+			((ReflectorSocket*)fSockets->GetSocketB())->ProcessPacket(OS::CachedMilliseconds(),thePacket,0,0);
 			((ReflectorSocket*)fSockets->GetSocketB())->Signal(Task::kIdleEvent);
 		}
 		else
@@ -555,27 +707,394 @@ void ReflectorStream::PushPacket(char *packet, UInt32 packetLen, Bool16 isRTCP)
 	
 			OSMutexLocker locker(((ReflectorSocket*)(fSockets->GetSocketA()))->GetDemuxer()->GetMutex());
 			thePacket->SetPacketData(packet, packetLen);
-
-			//if(this->fStreamInfo.fPayloadName.Equal("H264/90000"))
-			//{
-			//	if(head->nalu_type != 0)
-			//	{
-			//		pkeyFrameCache->PutOnePacket(packet,packetLen,head->nalu_type,head->s);
-			//	}
-			//}
-
-			((ReflectorSocket*)fSockets->GetSocketA())->ProcessPacket(OS::Milliseconds(),thePacket,0,0);
+			((ReflectorSocket*)fSockets->GetSocketA())->ProcessPacket(OS::CachedMilliseconds(),thePacket,0,0);
 			((ReflectorSocket*)fSockets->GetSocketA())->Signal(Task::kIdleEvent);
 		}
 	}
 }
 
+ReflectorPacketRing::ReflectorPacketRing(UInt32 inCapacity)
+:   fSlots(NULL),
+    fMask(0),
+    fHead(0),
+    fTail(0)
+{
+    UInt32 theCapacity = 16;
+    while ((theCapacity < inCapacity) && (theCapacity < 0x80000000))
+        theCapacity <<= 1;
+    
+    fSlots = NEW ReflectorPacket*[theCapacity];
+    ::memset(fSlots, 0, sizeof(ReflectorPacket*) * theCapacity);
+    fMask = theCapacity - 1;
+}
+
+Bool16 ReflectorPacketRing::Push(ReflectorPacket* inPacket)
+{
+    // The tail has to be read before the slot is reused, so the sender is
+    // done with whatever was in it. Only we write the head.
+    UInt64 theTail = atomic_load64(&fTail);
+    UInt64 theHead = fHead;
+    if ((theHead - theTail) > fMask)
+        return false;
+    
+    fSlots[theHead & fMask] = inPacket;
+    
+    // and the slot has to be filled before anybody can see the new head
+    atomic_store64(&fHead, theHead + 1);
+    return true;
+}
+
+ReflectorPacket* ReflectorPacketRing::PopTail()
+{
+    // Only we write the tail
+    UInt64 theTail = fTail;
+    if (theTail == this->GetHead())
+        return NULL;
+    
+    ReflectorPacket* thePacket = fSlots[theTail & fMask];
+    fSlots[theTail & fMask] = NULL;
+    
+    // hand the slot back to the producer only once we're done with it
+    atomic_store64(&fTail, theTail + 1);
+    return thePacket;
+}
+
+// Writes ioDst ^= inSrc over whole vectors from the start of the buffers, and
+// returns how many bytes that covered. XorBytes does the rest bytewise.
+typedef UInt32 (*ReflectorFECXorFunctionPtr)(UInt8* ioDst, const UInt8* inSrc, UInt32 inLen);
+
+#if OS_VECTOR_CODE
+
+#include <immintrin.h>
+
+OS_VECTOR_TARGET("sse2")
+static UInt32 XorSSE2(UInt8* ioDst, const UInt8* inSrc, UInt32 inLen)
+{
+    UInt32 theOffset = 0;
+    for ( ; theOffset + 16 <= inLen; theOffset += 16)
+    {
+        __m128i theBytes = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(ioDst + theOffset)),
+                                         _mm_loadu_si128((const __m128i*)(inSrc + theOffset)));
+        _mm_storeu_si128((__m128i*)(ioDst + theOffset), theBytes);
+    }
+    return theOffset;
+}
+
+OS_VECTOR_TARGET("avx2")
+static UInt32 XorAVX2(UInt8* ioDst, const UInt8* inSrc, UInt32 inLen)
+{
+    UInt32 theOffset = 0;
+    for ( ; theOffset + 32 <= inLen; theOffset += 32)
+    {
+        __m256i theBytes = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(ioDst + theOffset)),
+                                            _mm256_loadu_si256((const __m256i*)(inSrc + theOffset)));
+        _mm256_storeu_si256((__m256i*)(ioDst + theOffset), theBytes);
+    }
+    // a full size packet usually has a 16 byte piece left over
+    if (theOffset + 16 <= inLen)
+    {
+        __m128i theBytes = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(ioDst + theOffset)),
+                                         _mm_loadu_si128((const __m128i*)(inSrc + theOffset)));
+        _mm_storeu_si128((__m128i*)(ioDst + theOffset), theBytes);
+        theOffset += 16;
+    }
+    return theOffset;
+}
+
+#endif //OS_VECTOR_CODE
+
+static UInt32 GetSupportedXorLevel()
+{
+    UInt32 theVectorLevel = OS::GetVectorLevel();
+    if (theVectorLevel == OS::kVectorAVX2)
+        return ReflectorFECGenerator::kXorAVX2;
+    if (theVectorLevel == OS::kVectorSSE2)
+        return ReflectorFECGenerator::kXorSSE2;
+    return ReflectorFECGenerator::kXorScalar;
+}
+
+static ReflectorFECXorFunctionPtr GetXorFunction(UInt32 inLevel)
+{
+#if OS_VECTOR_CODE
+    if (inLevel == ReflectorFECGenerator::kXorAVX2)
+        return XorAVX2;
+    if (inLevel == ReflectorFECGenerator::kXorSSE2)
+        return XorSSE2;
+#endif
+    return NULL;
+}
+
+static UInt32                       sSupportedXorLevel = GetSupportedXorLevel();
+static UInt32                       sXorLevel = sSupportedXorLevel;
+static ReflectorFECXorFunctionPtr   sXorFunction = GetXorFunction(sSupportedXorLevel);
+
+unsigned int                        ReflectorFECGenerator::sNumFECPackets = 0;
+
+UInt32 ReflectorFECGenerator::GetXorLevel()
+{
+    return sXorLevel;
+}
+
+void ReflectorFECGenerator::SetXorLevel(UInt32 inLevel)
+{
+    if (inLevel > sSupportedXorLevel)
+        inLevel = sSupportedXorLevel;
+    sXorLevel = inLevel;
+    sXorFunction = GetXorFunction(inLevel);
+}
+
+void ReflectorFECGenerator::XorBytes(UInt8* ioDst, const UInt8* inSrc, UInt32 inLen)
+{
+    UInt32 theOffset = (sXorFunction != NULL) ? sXorFunction(ioDst, inSrc, inLen) : 0;
+    for ( ; theOffset < inLen; theOffset++)
+        ioDst[theOffset] ^= inSrc[theOffset];
+}
+
+ReflectorFECGenerator::ReflectorFECGenerator()
+:   fPayloadXor(NULL),
+    fPayloadXorLen(0),
+    fLengthXor(0),
+    fSNBase(0),
+    fMask(0),
+    fNumPackets(0),
+    fSSRC((UInt32)::rand()),
+    fSeqNum((UInt16)::rand())
+{
+    ::memset(fHeaderXor, 0, sizeof(fHeaderXor));
+}
+
+void ReflectorFECGenerator::Reset()
+{
+    if (fPayloadXorLen > 0)
+        ::memset(fPayloadXor, 0, fPayloadXorLen);
+    fPayloadXorLen = 0;
+    ::memset(fHeaderXor, 0, sizeof(fHeaderXor));
+    fLengthXor = 0;
+    fMask = 0;
+    fNumPackets = 0;
+}
+
+void ReflectorFECGenerator::AddPacket(ReflectorPacket* ioPacket, UInt32 inGroupSize, UInt8 inPayloadType)
+{
+    UInt8* thePacket = (UInt8*)ioPacket->fPacketPtr.Ptr;
+    UInt32 thePacketLen = ioPacket->fPacketPtr.Len;
+    if ((thePacket == NULL) || (thePacketLen < kRTPHeaderSize) || ((thePacket[0] & 0xC0) != 0x80))
+        return; // not RTP version 2
+        
+    if (inGroupSize > kMaxGroupSize)
+        inGroupSize = kMaxGroupSize;
+    
+    if (fPayloadXor == NULL)
+    {
+        fPayloadXor = NEW UInt8[ReflectorPacket::kMaxReflectorPacketSize];
+        ::memset(fPayloadXor, 0, ReflectorPacket::kMaxReflectorPacketSize);
+    }
+    
+    // The mask can say which packets are in the group as long as they are within
+    // kMaxGroupSize sequence numbers of the first one. Packets lost on the way in
+    // just leave holes. A packet that doesn't fit (a long loss, the broadcast
+    // restarting) ends the group early, its FEC packet then follows this packet.
+    UInt16 theSeqNum = ntohs(((UInt16*)thePacket)[1]);
+    if (fNumPackets > 0)
+    {
+        UInt16 theOffset = (UInt16)(theSeqNum - fSNBase);
+        if ((theOffset >= kMaxGroupSize) || ((fMask & (0x8000 >> theOffset)) != 0))
+        {
+            this->FinishGroup(ioPacket, inPayloadType);
+            this->Reset();
+        }
+    }
+    if (fNumPackets == 0)
+        fSNBase = theSeqNum;
+    
+    UInt32 thePayloadLen = thePacketLen - kRTPHeaderSize;
+    for (UInt32 x = 0; x < sizeof(fHeaderXor); x++)
+        fHeaderXor[x] ^= thePacket[x];
+    fLengthXor ^= (UInt16)thePayloadLen;
+    XorBytes(fPayloadXor, thePacket + kRTPHeaderSize, thePayloadLen);
+    if (thePayloadLen > fPayloadXorLen)
+        fPayloadXorLen = thePayloadLen;
+    
+    fMask |= 0x8000 >> (UInt16)(theSeqNum - fSNBase);
+    fNumPackets++;
+    
+    // A packet carries one FEC packet. If it already carries the one of the group
+    // it ended early, the new group can only be complete here if the group size
+    // went down to 1 since the last packet: let it run one packet longer instead.
+    if ((fNumPackets >= inGroupSize) && (ioPacket->fFECBuffer == NULL))
+    {
+        this->FinishGroup(ioPacket, inPayloadType);
+        this->Reset();
+    }
+}
+
+void ReflectorFECGenerator::FinishGroup(ReflectorPacket* ioPacket, UInt8 inPayloadType)
+{
+    UInt32 theLen = kRTPHeaderSize + kFECHeaderSize + kFECLevelHeaderSize + fPayloadXorLen;
+    Assert(ioPacket->fFECBuffer == NULL);
+    if ((fNumPackets == 0) || (theLen > ReflectorPacket::kMaxReflectorPacketSize) || (ioPacket->fFECBuffer != NULL))
+        return;
+    
+    ReflectorPacketBuffer* theBuffer = ReflectorPacketBuffer::Get(theLen);
+    UInt8* theFEC = (UInt8*)theBuffer->GetData();
+    
+    // RTP header, with the timestamp of the packet the FEC packet goes out after
+    theFEC[0] = 0x80;
+    theFEC[1] = inPayloadType & 0x7F;
+    ((UInt16*)theFEC)[1] = htons(fSeqNum++);
+    ::memcpy(&theFEC[4], ioPacket->fPacketPtr.Ptr + 4, 4);
+    ((UInt32*)theFEC)[2] = htonl(fSSRC);
+    
+    // FEC header: E and L are 0, P, X, CC, M, PT and TS recovery, SN base, length recovery
+    UInt8* theHeader = theFEC + kRTPHeaderSize;
+    theHeader[0] = fHeaderXor[0] & 0x3F;
+    theHeader[1] = fHeaderXor[1];
+    theHeader[2] = (UInt8)(fSNBase >> 8);
+    theHeader[3] = (UInt8)fSNBase;
+    ::memcpy(&theHeader[4], &fHeaderXor[4], 4);
+    theHeader[8] = (UInt8)(fLengthXor >> 8);
+    theHeader[9] = (UInt8)fLengthXor;
+    
+    // the one FEC level header, protection length and mask, then the level's payload
+    UInt8* theLevel = theHeader + kFECHeaderSize;
+    theLevel[0] = (UInt8)(fPayloadXorLen >> 8);
+    theLevel[1] = (UInt8)fPayloadXorLen;
+    theLevel[2] = (UInt8)(fMask >> 8);
+    theLevel[3] = (UInt8)fMask;
+    ::memcpy(theLevel + kFECLevelHeaderSize, fPayloadXor, fPayloadXorLen);
+    
+    ioPacket->fFECBuffer = theBuffer;
+    ioPacket->fFECPacketPtr.Set((char*)theFEC, theLen);
+    (void)atomic_add(&sNumFECPackets, 1);
+}
+
+#if REFLECTORFECTESTING
+
+Bool16 ReflectorFECGenerator::Test()
+{
+    enum { kTestGroupSize = 6 };
+    
+    UInt32 theLevel = GetXorLevel();
+    Bool16 theResult = true;
+    for (UInt32 theTestLevel = kXorScalar; theResult && (theTestLevel <= theLevel); theTestLevel++)
+    {
+        SetXorLevel(theTestLevel);
+        
+        // packets of different lengths, none a whole number of vectors, with a sequence number missing
+        ReflectorFECGenerator theGenerator;
+        ReflectorPacket thePackets[kTestGroupSize];
+        char theData[ReflectorPacket::kMaxReflectorPacketSize];
+        UInt32 theRandom = 1;
+        for (UInt32 x = 0; x < kTestGroupSize; x++)
+        {
+            UInt32 theLen = kRTPHeaderSize + 1 + (x * 277) % 1400;
+            for (UInt32 y = 0; y < theLen; y++)
+            {
+                theRandom = theRandom * 1103515245 + 12345;
+                theData[y] = (char)(theRandom >> 16);
+            }
+            theData[0] = (char)(0x80 | (theData[0] & 0x3F));
+            ((UInt16*)theData)[1] = htons((UInt16)(0xFFFD + x + ((x > 2) ? 1 : 0))); // wraps, too
+            thePackets[x].SetPacketData(theData, theLen);
+            theGenerator.AddPacket(&thePackets[x], kTestGroupSize, 127);
+        }
+        
+        StrPtrLen* theFEC = &thePackets[kTestGroupSize - 1].fFECPacketPtr;
+        if (theFEC->Len == 0)
+            theResult = false;
+        
+        // put each packet back together from the FEC packet and the others
+        for (UInt32 theLost = 0; theResult && (theLost < kTestGroupSize); theLost++)
+        {
+            UInt8* theHeader = (UInt8*)theFEC->Ptr + kRTPHeaderSize;
+            UInt8* theLevel = theHeader + kFECHeaderSize;
+            UInt16 theSNBase = (UInt16)((theHeader[2] << 8) | theHeader[3]);
+            UInt16 theLenRecovery = (UInt16)((theHeader[8] << 8) | theHeader[9]);
+            UInt16 theMask = (UInt16)((theLevel[2] << 8) | theLevel[3]);
+            UInt32 theProtectionLen = (theLevel[0] << 8) | theLevel[1];
+            
+            UInt8 theRTPHeader[8];
+            theRTPHeader[0] = theHeader[0];
+            theRTPHeader[1] = theHeader[1];
+            ::memcpy(&theRTPHeader[4], &theHeader[4], 4);
+            UInt8 thePayload[ReflectorPacket::kMaxReflectorPacketSize];
+            ::memcpy(thePayload, theLevel + kFECLevelHeaderSize, theProtectionLen);
+            
+            for (UInt32 y = 0; y < kTestGroupSize; y++)
+            {
+                if (y == theLost)
+                    continue;
+                UInt8* theOther = (UInt8*)thePackets[y].fPacketPtr.Ptr;
+                UInt32 theOtherLen = thePackets[y].fPacketPtr.Len - kRTPHeaderSize;
+                theRTPHeader[0] ^= theOther[0];
+                theRTPHeader[1] ^= theOther[1];
+                for (UInt32 z = 4; z < 8; z++)
+                    theRTPHeader[z] ^= theOther[z];
+                theLenRecovery ^= (UInt16)theOtherLen;
+                XorBytes(thePayload, theOther + kRTPHeaderSize, theOtherLen);
+            }
+            
+            UInt8* theOriginal = (UInt8*)thePackets[theLost].fPacketPtr.Ptr;
+            UInt32 theOriginalLen = thePackets[theLost].fPacketPtr.Len - kRTPHeaderSize;
+            UInt16 theOffset = (UInt16)(ntohs(((UInt16*)theOriginal)[1]) - theSNBase);
+            if (((theRTPHeader[0] & 0x3F) != (theOriginal[0] & 0x3F)) || (theRTPHeader[1] != theOriginal[1]) ||
+                (::memcmp(&theRTPHeader[4], &theOriginal[4], 4) != 0) || (theLenRecovery != theOriginalLen) ||
+                (theOffset >= kMaxGroupSize) || ((theMask & (0x8000 >> theOffset)) == 0) ||
+                (::memcmp(thePayload, theOriginal + kRTPHeaderSize, theOriginalLen) != 0))
+                theResult = false;
+        }
+    }
+    
+    // a packet that ends a group early while the group size drops to 1 must not
+    // complete its own group too: each group still gets its FEC packet
+    if (theResult)
+    {
+        ReflectorFECGenerator theGenerator;
+        ReflectorPacket thePackets[4];
+        char theData[kRTPHeaderSize + 4];
+        ::memset(theData, 0, sizeof(theData));
+        theData[0] = (char)0x80;
+        UInt16 theSeqNums[4] = { 10, 11, 40, 41 };
+        UInt32 theGroupSizes[4] = { 4, 4, 1, 1 };
+        for (UInt32 x = 0; x < 4; x++)
+        {
+            ((UInt16*)theData)[1] = htons(theSeqNums[x]);
+            thePackets[x].SetPacketData(theData, sizeof(theData));
+            theGenerator.AddPacket(&thePackets[x], theGroupSizes[x], 127);
+        }
+        UInt32 theMasks[4] = { 0, 0, 0xC000, 0xC000 };
+        UInt16 theSNBases[4] = { 0, 0, 10, 40 };
+        for (UInt32 x = 0; theResult && (x < 4); x++)
+        {
+            StrPtrLen* theFEC = &thePackets[x].fFECPacketPtr;
+            if (theMasks[x] == 0)
+            {
+                theResult = (theFEC->Len == 0);
+                continue;
+            }
+            UInt8* theHeader = theFEC->Len > 0 ? (UInt8*)theFEC->Ptr + kRTPHeaderSize : NULL;
+            theResult = (theHeader != NULL) && (((theHeader[2] << 8) | theHeader[3]) == theSNBases[x]) &&
+                        (((theHeader[kFECHeaderSize + 2] << 8) | theHeader[kFECHeaderSize + 3]) == theMasks[x]);
+        }
+    }
+    
+    SetXorLevel(theLevel);
+    return theResult;
+}
+
+#endif //REFLECTORFECTESTING
+
 ReflectorSender::ReflectorSender(ReflectorStream* inStream, UInt32 inWriteFlag)
 :   fStream(inStream),
     fWriteFlag(inWriteFlag),
-    fFirstNewPacketInQueue(NULL), 
-    fFirstPacketInQueueForNewOutput(NULL),
-	fKeyFrameStartPacketElementPointer(NULL),
+    fPacketRing((inWriteFlag == qtssWriteFlagsIsRTCP) ? (UInt32) kRTCPPacketRingSize : ReflectorStream::sPacketRingSize),
+    fFirstNewPacketSeq(0), 
+	fKeyFrameStartPacketSeq(ReflectorPacketRing::kNoPacket),
+    fKeyFrameRTPTime(0),
+    fParamSetStartPacketSeq(ReflectorPacketRing::kNoPacket),
+    fGOPBytes(0),
+    fBucketTasks(NULL),
+    fNumBucketTasks(0),
     fHasNewPackets(false),
     fNextTimeToRun(0),
     fLastRRTime(0),
@@ -586,12 +1105,12 @@ ReflectorSender::ReflectorSender(ReflectorStream* inStream, UInt32 inWriteFlag)
 
 ReflectorSender::~ReflectorSender()
 {
-    //dequeue and delete every buffer
-    while (fPacketQueue.GetLength() > 0)
-    {
-        ReflectorPacket* packet = (ReflectorPacket*)fPacketQueue.DeQueue()->GetEnclosingObject();
+    this->StopBucketTasks();
+
+    //take every packet out of the ring and delete it
+    ReflectorPacket* packet = NULL;
+    while ((packet = fPacketRing.PopTail()) != NULL)
         delete packet;
-    }
 }
 
 
@@ -617,11 +1136,7 @@ UInt32 ReflectorSender::GetOldestPacketRTPTime(Bool16 *foundPtr)
     if (foundPtr != NULL) 
         *foundPtr = false;
     OSMutexLocker locker(&fStream->fBucketMutex);
-    OSQueueElem* packetElem = this->GetClientBufferStartPacket();
-    if (packetElem == NULL)
-        return 0;
-        
-    ReflectorPacket* thePacket = (ReflectorPacket*)packetElem->GetEnclosingObject();
+    ReflectorPacket* thePacket = fPacketRing.GetPacket(this->GetClientBufferStartPacket());
     if (thePacket == NULL)
         return 0;
         
@@ -638,12 +1153,7 @@ UInt16 ReflectorSender::GetFirstPacketRTPSeqNum(Bool16 *foundPtr)
         
     UInt16 resultSeqNum = 0;
     OSMutexLocker locker(&fStream->fBucketMutex);
-    OSQueueElem* packetElem = this->GetClientBufferStartPacket();
-            
-    if (packetElem == NULL)
-        return 0;
-        
-    ReflectorPacket* thePacket = (ReflectorPacket*)packetElem->GetEnclosingObject();
+    ReflectorPacket* thePacket = fPacketRing.GetPacket(this->GetClientBufferStartPacket());
     if (thePacket == NULL)
         return 0;
    
@@ -655,34 +1165,24 @@ UInt16 ReflectorSender::GetFirstPacketRTPSeqNum(Bool16 *foundPtr)
    return resultSeqNum;
 }
 
-OSQueueElem*    ReflectorSender::GetClientBufferNextPacketTime(UInt32 inRTPTime)
+ReflectorPacket*    ReflectorSender::GetClientBufferNextPacketTime(UInt32 inRTPTime)
 {
-        
-    OSQueueIter qIter(&fPacketQueue);// start at oldest packet in q
-    OSQueueElem* requestedPacket = NULL;
-    OSQueueElem* elem =  NULL;
+    ReflectorPacket* requestedPacket = NULL;
+    UInt64 theHead = fPacketRing.GetHead();
     
-    while ( !qIter.IsDone() ) // start at oldest packet in q
+    for (UInt64 theSeq = fPacketRing.GetTail(); theSeq < theHead; theSeq++) // start at oldest packet in the ring
     {
-        elem = qIter.GetCurrent();
-        
-        if (requestedPacket == NULL)
-            requestedPacket = elem;
+        ReflectorPacket* thePacket = fPacketRing.GetPacket(theSeq);
+        Assert( thePacket );
         
         if (requestedPacket == NULL)
-            break;
-            
-        ReflectorPacket* thePacket = (ReflectorPacket*)elem->GetEnclosingObject();      
-        Assert( thePacket );
+            requestedPacket = thePacket;
                  
         if (thePacket->GetPacketRTPTime() > inRTPTime)
         {
-            requestedPacket = elem; // return the first packet we have that has a later time
+            requestedPacket = thePacket; // return the first packet we have that has a later time
             break; // found the packet we need: done processing
         }
-        qIter.Next();
-        
-        
     }
 
     return requestedPacket;
@@ -691,20 +1191,11 @@ OSQueueElem*    ReflectorSender::GetClientBufferNextPacketTime(UInt32 inRTPTime)
 Bool16 ReflectorSender::GetFirstRTPTimePacket(UInt16* outSeqNumPtr, UInt32* outRTPTimePtr, SInt64* outArrivalTimePtr) 
 {
     OSMutexLocker locker(&fStream->fBucketMutex);
-    OSQueueElem* packetElem = this->GetClientBufferStartPacketOffset(ReflectorStream::sFirstPacketOffsetMsec);
-            
-    if (packetElem == NULL)
-        return false;
-        
-    ReflectorPacket* thePacket = (ReflectorPacket*)packetElem->GetEnclosingObject();
+    ReflectorPacket* thePacket = fPacketRing.GetPacket(this->GetClientBufferStartPacketOffset(ReflectorStream::sFirstPacketOffsetMsec));
     if (thePacket == NULL)
         return false;
     
-    packetElem = GetClientBufferNextPacketTime(thePacket->GetPacketRTPTime());
-    if (packetElem == NULL)
-        return false;
-
-    thePacket = (ReflectorPacket*)packetElem->GetEnclosingObject();
+    thePacket = GetClientBufferNextPacketTime(thePacket->GetPacketRTPTime());
     if (thePacket == NULL)
         return false;
     
@@ -723,13 +1214,8 @@ Bool16 ReflectorSender::GetFirstRTPTimePacket(UInt16* outSeqNumPtr, UInt32* outR
 Bool16 ReflectorSender::GetFirstPacketInfo(UInt16* outSeqNumPtr, UInt32* outRTPTimePtr, SInt64* outArrivalTimePtr) 
 {
     OSMutexLocker locker(&fStream->fBucketMutex);
-    OSQueueElem* packetElem = this->GetClientBufferStartPacketOffset(ReflectorStream::sFirstPacketOffsetMsec);
-//    OSQueueElem* packetElem = this->GetClientBufferStartPacket();
-            
-    if (packetElem == NULL)
-        return false;
-        
-    ReflectorPacket* thePacket = (ReflectorPacket*)packetElem->GetEnclosingObject();
+    ReflectorPacket* thePacket = fPacketRing.GetPacket(this->GetClientBufferStartPacketOffset(ReflectorStream::sFirstPacketOffsetMsec));
+//    ReflectorPacket* thePacket = fPacketRing.GetPacket(this->GetClientBufferStartPacket());
     if (thePacket == NULL)
         return false;
        
@@ -741,8 +1227,6 @@ Bool16 ReflectorSender::GetFirstPacketInfo(UInt16* outSeqNumPtr, UInt32* outRTPT
 
     if (outArrivalTimePtr)
         *outArrivalTimePtr = thePacket->fTimeArrived;
-        
-    thePacket->fNeededByOutput = true; 
 
    return true;
 }
@@ -776,7 +1260,7 @@ void ReflectorSender::ReflectRelayPackets(SInt64* ioWakeupTime, OSQueue* inFreeQ
 	Bool16	printQueueLenOnExit = false;
 	#endif	
 
-	SInt64 currentTime = OS::Milliseconds();
+	SInt64 currentTime = OS::CachedMilliseconds();
 
 	//make sure to reset these state variables
 	fHasNewPackets = false;	
@@ -789,7 +1273,7 @@ void ReflectorSender::ReflectRelayPackets(SInt64* ioWakeupTime, OSQueue* inFreeQ
 		fStream->SendReceiverReport();
 		#if REFLECTOR_STREAM_DEBUGGING > 2
 		printQueueLenOnExit = true;
-		printf( "fPacketQueue len %li\n", (SInt32)fPacketQueue.GetLength() );
+		printf( "fPacketRing len %li\n", (SInt32)fPacketRing.GetLength() );
 		#endif	
 	}
 	
@@ -812,6 +1296,10 @@ void ReflectorSender::ReflectRelayPackets(SInt64* ioWakeupTime, OSQueue* inFreeQ
 		fStream->fLastBitRateSample = currentTime;
 	}
 
+	// only look at the packets that are in the ring now, more may come in while we work
+	UInt64 theHead = fPacketRing.GetHead();
+	UInt64 theOldestNeeded = theHead;
+
 	for (UInt32 bucketIndex = 0; bucketIndex < fStream->fNumBuckets; bucketIndex++)
 	{	
 		for (UInt32 bucketMemberIndex = 0; bucketMemberIndex < fStream->sBucketSize; bucketMemberIndex++)
@@ -821,162 +1309,79 @@ void ReflectorSender::ReflectRelayPackets(SInt64* ioWakeupTime, OSQueue* inFreeQ
 			
 			if (theOutput != NULL)
 			{	
-				SInt32			availBookmarksPosition = -1;	// -1 == invalid position
-				OSQueueElem*	packetElem = NULL;				
-				UInt32			curBookmark = 0;
-				
-				Assert( curBookmark < theOutput->fNumBookmarks );		
-				
-				// see if we've bookmarked a held packet for this Sender in this Output
-				while ( curBookmark < theOutput->fNumBookmarks )
-				{					
-					OSQueueElem* 	bookmarkedElem = theOutput->fBookmarkedPacketsElemsArray[curBookmark];
-					
-					if ( bookmarkedElem )	// there may be holes in this array
-					{							
-						if ( bookmarkedElem->IsMember( fPacketQueue ) )	
-						{	
-							// this packet was previously bookmarked for this specific queue
-							// remove if from the bookmark list and use it
-							// to jump ahead into the Sender's over all packet queue						
-							theOutput->fBookmarkedPacketsElemsArray[curBookmark] = NULL;
-							availBookmarksPosition = curBookmark;
-							packetElem = bookmarkedElem;
-							break;
-						}
-						
-					}
-					else
-					{
-						availBookmarksPosition = curBookmark;
-					}
-					
-					curBookmark++;
-						
-				}
+				UInt64 theSeq = 0;
 				
-				Assert( availBookmarksPosition != -1 );		
+				// see if we've bookmarked a held packet for this Sender in this Output,
+				// if not, show it the first new packet we have in this sender.
+				// ( since TCP flow control may delay the sending of packets, this may not
+				// be the same as the first packet in the ring )
+				if ( !theOutput->GetBookMarkedPacket( &fPacketRing, &theSeq ) || (theSeq > theHead) )
+					theSeq = fFirstNewPacketSeq;
+				if ( theSeq < fPacketRing.GetTail() )
+					theSeq = fPacketRing.GetTail();
 				
 				#if REFLECTOR_STREAM_DEBUGGING > 1
-				if ( packetElem )	// show 'em what we got johnny
-				{	ReflectorPacket* 	thePacket = (ReflectorPacket*)packetElem->GetEnclosingObject();
-					printf("Bookmarked packet time: %li, packetSeq %i\n", (SInt32)thePacket->fTimeArrived, DGetPacketSeqNumber( &thePacket->fPacketPtr ) );			
+				if ( theSeq < theHead )	// show 'em what we got johnny
+				{	ReflectorPacket* 	thePacket = fPacketRing.GetPacket(theSeq);
+					printf("First packet for output 0x%lx time: %li, packetSeq %i\n", (SInt32)theOutput, (SInt32)thePacket->fTimeArrived, DGetPacketSeqNumber( &thePacket->fPacketPtr ) );			
 				}
+				else
+					printf("no new packets\n" );
 				#endif
 				
-				// the output did not have a bookmarked packet if it's own
-				// so show it the first new packet we have in this sender.
-				// ( since TCP flow control may delay the sending of packets, this may not
-				// be the same as the first packet in the queue
-				if ( packetElem  == NULL )
-				{	
-					packetElem = fFirstNewPacketInQueue;
-						
-					#if REFLECTOR_STREAM_DEBUGGING > 1
-					if ( packetElem )	// show 'em what we got johnny
-					{	
-						ReflectorPacket* 	thePacket = (ReflectorPacket*)packetElem->GetEnclosingObject();
-						printf("1st NEW packet from Sender sess 0x%lx time: %li, packetSeq %i\n", (SInt32)theOutput, (SInt32)thePacket->fTimeArrived, DGetPacketSeqNumber( &thePacket->fPacketPtr ) );			
-					}
-					else
-						printf("no new packets\n" );
-					#endif
-				}
-				
-				OSQueueIter qIter(&fPacketQueue, packetElem);  // starts from beginning if packetElem == NULL, else from packetElem
-				
-				Bool16			dodBookmarkPacket = false;
-				
-				while ( !qIter.IsDone() )
+				for ( ; theSeq < theHead; theSeq++ )
 				{					
-					packetElem = qIter.GetCurrent();
-					
-					ReflectorPacket* 	thePacket = (ReflectorPacket*)packetElem->GetEnclosingObject();
+					ReflectorPacket* 	thePacket = fPacketRing.GetPacket(theSeq);
 					QTSS_Error			err = QTSS_NoErr;
 					
+					SInt64  packetLateness =  currentTime - thePacket->fTimeArrived - (ReflectorStream::sBucketDelayInMsec * (SInt64)bucketIndex);
+					// packetLateness measures how late this packet it after being corrected for the bucket delay
+					
 					#if REFLECTOR_STREAM_DEBUGGING > 2
-					printf("packet time: %li, packetSeq %i\n", (SInt32)thePacket->fTimeArrived, DGetPacketSeqNumber( &thePacket->fPacketPtr ) );			
+					printf("packetLateness %li, seq# %li\n", (SInt32)packetLateness, (SInt32) DGetPacketSeqNumber( &thePacket->fPacketPtr ) );			
 					#endif
 					
-					// once we see a packet we cant' send, we need to stop trying
-					// during this pass mark remaining as still needed
-					if ( !dodBookmarkPacket )
-					{
-						SInt64  packetLateness =  currentTime - thePacket->fTimeArrived - (ReflectorStream::sBucketDelayInMsec * (SInt64)bucketIndex);
-					    // packetLateness measures how late this packet it after being corrected for the bucket delay
-						
+					SInt64 timeToSendPacket = -1;
+					err = theOutput->WritePacket(&thePacket->fPacketPtr, fStream, fWriteFlag, packetLateness, &timeToSendPacket, NULL, NULL, false, thePacket->fBuffer);
+				
+					if ( err == QTSS_WouldBlock )
+					{	
 						#if REFLECTOR_STREAM_DEBUGGING > 2
-						printf("packetLateness %li, seq# %li\n", (SInt32)packetLateness, (SInt32) DGetPacketSeqNumber( &thePacket->fPacketPtr ) );			
+						printf("EAGAIN bookmark: %li, packetSeq %i\n", (SInt32)packetLateness, DGetPacketSeqNumber( &thePacket->fPacketPtr ) );			
 						#endif
 						
-						SInt64 timeToSendPacket = -1;
-						err = theOutput->WritePacket(&thePacket->fPacketPtr, fStream, fWriteFlag, packetLateness, &timeToSendPacket, NULL, NULL, false);
-					
-						if ( err == QTSS_WouldBlock )
-						{	
-							#if REFLECTOR_STREAM_DEBUGGING > 2
-							printf("EAGAIN bookmark: %li, packetSeq %i\n", (SInt32)packetLateness, DGetPacketSeqNumber( &thePacket->fPacketPtr ) );			
-							#endif
-							// tag it and bookmark it
-							thePacket->fNeededByOutput = true;
-							
-							Assert( availBookmarksPosition != -1 );
-							if ( availBookmarksPosition != -1 )
-								theOutput->fBookmarkedPacketsElemsArray[availBookmarksPosition] =  packetElem;
-
-							dodBookmarkPacket = true;
-							
-							// call us again in # ms to retry on an EAGAIN
-							if ((timeToSendPacket > 0) && (fNextTimeToRun > timeToSendPacket ))
-								fNextTimeToRun = timeToSendPacket;
-							if ( timeToSendPacket == -1 )
-								this->SetNextTimeToRun(5); // keep in synch with delay on would block for on-demand lower is better for high-bit rate movies.
+						// call us again in # ms to retry on an EAGAIN
+						if ((timeToSendPacket > 0) && (fNextTimeToRun > timeToSendPacket ))
+							fNextTimeToRun = timeToSendPacket;
+						if ( timeToSendPacket == -1 )
+							this->SetNextTimeToRun(5); // keep in synch with delay on would block for on-demand lower is better for high-bit rate movies.
 						
-						}
-					}
-					else
-					{	
-						if ( thePacket->fNeededByOutput )	// optimization: if the packet is already marked, another Output has been through this already
-							break;
-						thePacket->fNeededByOutput = true;
+						// once we see a packet we can't send, we need to stop trying
+						break;
 					}
-					
-					qIter.Next();
 				} 
 				
+				// bookmark the packet that didn't go out, it and the ones after it are still needed
+				(void) theOutput->SetBookMarkPacket( &fPacketRing, theSeq );
+				if ( theSeq < theOldestNeeded )
+					theOldestNeeded = theSeq;
 			}
 		}
+		
+		this->FlushBucket(bucketIndex);
 	}
 	
 	// reset our first new packet bookmark
-	fFirstNewPacketInQueue = NULL;
+	fFirstNewPacketSeq = theHead;
 
-	// iterate one more through the senders queue to clear out
-	// the unneeded packets
-	OSQueueIter removeIter(&fPacketQueue);
-	while ( !removeIter.IsDone() )
+	// everything before the oldest bookmark has been sent to every output, so
+	// moving the tail up to it is all it takes to clear out the unneeded packets
+	while ( fPacketRing.GetTail() < theOldestNeeded )
 	{
-		OSQueueElem* elem = removeIter.GetCurrent();
-		Assert( elem );
-
-		//at this point, move onto the next queue element, because we may be altering
-		//the queue itself in the code below
-		removeIter.Next();
-
-		ReflectorPacket* thePacket = (ReflectorPacket*)elem->GetEnclosingObject();		
+		ReflectorPacket* thePacket = fPacketRing.PopTail();
 		Assert( thePacket );
-		
-		if ( thePacket->fNeededByOutput == false )
-		{	
-			thePacket->fNeededByOutput = true;
-			fPacketQueue.Remove( elem );
-			inFreeQueue->EnQueue( elem );
-			
-		}
-		else	// reset for next call to ReflectPackets
-		{
-			thePacket->fNeededByOutput = false;
-		}
+		thePacket->Reset();
+		inFreeQueue->EnQueue( &thePacket->fQueueElem );
 	}
 	
 	//Don't forget that the caller also wants to know when we next want to run
@@ -989,7 +1394,7 @@ void ReflectorSender::ReflectRelayPackets(SInt64* ioWakeupTime, OSQueue* inFreeQ
 	
 	#if REFLECTOR_STREAM_DEBUGGING > 2
 	if ( printQueueLenOnExit )
-		printf( "EXIT fPacketQueue len %li\n", (SInt32)fPacketQueue.GetLength() );
+		printf( "EXIT fPacketRing len %li\n", (SInt32)fPacketRing.GetLength() );
 	#endif
 }
 
@@ -1023,7 +1428,7 @@ void ReflectorSender::ReflectPackets(SInt64* ioWakeupTime, OSQueue* inFreeQueue)
         return;
     }
 
-    SInt64 currentTime = OS::Milliseconds();
+    SInt64 currentTime = OS::CachedMilliseconds();
 
     //make sure to reset these state variables
     fHasNewPackets = false; 
@@ -1047,154 +1452,256 @@ void ReflectorSender::ReflectPackets(SInt64* ioWakeupTime, OSQueue* inFreeQueue)
     // Check to see if we should update the session's bitrate average
     fStream->UpdateBitRate(currentTime);
 
-    // ƵֱӶλһؼ֡ʼƵʱһЩ
-	
-	fFirstPacketInQueueForNewOutput = NULL;
+    // Outputs fill the buckets in order, so it only pays to spread them
+    // out once there are more than one bucket's worth
+    if ((fWriteFlag == qtssWriteFlagsIsRTP) && (fBucketTasks == NULL) && (fStream->fNumElements > ReflectorStream::sBucketSize) && (ReflectorStream::sNumBucketTasks > 1))
+        this->StartBucketTasks();
 
-    if(fKeyFrameStartPacketElementPointer)
-    {	
-		fFirstPacketInQueueForNewOutput = fKeyFrameStartPacketElementPointer;		
+    if (fBucketTasks != NULL)
+    {
+        // The buckets are written by the bucket tasks, on whatever threads they get
+        for (UInt32 taskIndex = 0; taskIndex < fNumBucketTasks; taskIndex++)
+            fBucketTasks[taskIndex]->Signal(Task::kUpdateEvent);
     }
-    
-	if(fFirstPacketInQueueForNewOutput == NULL)
+    else
     {
-       	// where to start new clients in the q
-		fFirstPacketInQueueForNewOutput = this->GetClientBufferStartPacketOffset(0); 
+        // only look at the packets that are in the ring now, more may come in while we work
+        UInt64 theHead = fPacketRing.GetHead();
+        Bool16 fromGOPCache = false;
+        UInt64 theFirstPacketForNewOutput = this->GetFirstPacketForNewOutput(&fromGOPCache);
+        
+        for (UInt32 bucketIndex = 0; bucketIndex < fStream->fNumBuckets; bucketIndex++)
+            this->ReflectBucket(bucketIndex, theHead, theFirstPacketForNewOutput, fromGOPCache, currentTime, &fNextTimeToRun);
     }
 
-#if (0) //test code 
-    if (NULL != fFirstPacketInQueueForNewOutput)
-        printf("ReflectorSender::ReflectPackets SET first packet fFirstPacketInQueueForNewOutput %d \n",  DGetPacketSeqNumber( &( (ReflectorPacket*) ( fFirstPacketInQueueForNewOutput->GetEnclosingObject()))->fPacketPtr ));
-    
-    ReflectorPacket* thePacket = NULL;
-    if (fFirstPacketInQueueForNewOutput != NULL)
-        thePacket = (ReflectorPacket*) fFirstPacketInQueueForNewOutput->GetEnclosingObject();
-    if (thePacket == NULL)
-    {    printf("fFirstPacketInQueueForNewOutput is NULL \n");
-      
-    }
+    this->RemoveOldPackets(inFreeQueue);
 
-#endif
+    //Don't forget that the caller also wants to know when we next want to run
+    if (*ioWakeupTime == 0)
+        *ioWakeupTime = fNextTimeToRun;
+    else if ((fNextTimeToRun > 0) && (*ioWakeupTime > fNextTimeToRun))
+        *ioWakeupTime = fNextTimeToRun;
+    // exit with fNextTimeToRun in real time, not relative time.
+    fNextTimeToRun += currentTime;
+     
+   // qtss_printf("SetNextTimeToRun fNextTimeToRun=%qd + currentTime=%qd\n", fNextTimeToRun, currentTime);
+   // qtss_printf("ReflectorSender::ReflectPackets *ioWakeupTime = %qd\n", *ioWakeupTime);
 
-	Bool16 firstPacket =false;
+}
 
-    for (UInt32 bucketIndex = 0; bucketIndex < fStream->fNumBuckets; bucketIndex++)
-    {   
-        for (UInt32 bucketMemberIndex = 0; bucketMemberIndex < fStream->sBucketSize; bucketMemberIndex++)
-        {    
-            ReflectorOutput* theOutput = fStream->fOutputArray[bucketIndex][bucketMemberIndex];
-            if (theOutput != NULL)
-            {                 
-                if ( false == theOutput->IsPlaying() ) 
-                    continue;
+UInt64 ReflectorSender::GetFirstPacketForNewOutput(Bool16* outFromGOPCache)
+{
+    // ƵֱӶλһؼ֡ʼƵʱһЩ
+	UInt64 theFirstPacketForNewOutput = atomic_load64(&fKeyFrameStartPacketSeq);
+    *outFromGOPCache = true;
+
+    if(fPacketRing.GetPacket(theFirstPacketForNewOutput) == NULL)
+    {
+        *outFromGOPCache = false;
+       	// where to start new clients in the ring, or the oldest packet if none are recent enough
+		theFirstPacketForNewOutput = this->GetClientBufferStartPacketOffset(0); 
+		if (theFirstPacketForNewOutput == ReflectorPacketRing::kNoPacket)
+			theFirstPacketForNewOutput = fPacketRing.GetTail();
+    }
+    
+    return theFirstPacketForNewOutput;
+}
+
+void ReflectorSender::ReflectBucket(UInt32 bucketIndex, UInt64 theHead, UInt64 theFirstPacketForNewOutput, Bool16 inFromGOPCache, SInt64 currentTime, SInt64* ioNextTimeToRun)
+{
+    Bool16 isGOPCached = (fWriteFlag == qtssWriteFlagsIsRTP) && (fStream->GetGOPCodec() != ReflectorStream::kNoGOPCodec);
+
+    for (UInt32 bucketMemberIndex = 0; bucketMemberIndex < fStream->sBucketSize; bucketMemberIndex++)
+    {    
+        ReflectorOutput* theOutput = fStream->fOutputArray[bucketIndex][bucketMemberIndex];
+        if (theOutput != NULL)
+        {                 
+            if ( false == theOutput->IsPlaying() ) 
+                continue;
 				{
 					OSMutexLocker locker(&theOutput->fMutex);
-					OSQueueElem* packetElem = theOutput->GetBookMarkedPacket(&fPacketQueue); 
-					if ( packetElem  == NULL ) // should only be a new output
+					UInt64 theSeq = 0;
+					Bool16 firstPacket = false;
+					if ( !theOutput->GetBookMarkedPacket(&fPacketRing, &theSeq) || (theSeq > theHead) ) // should only be a new output
 					{
-						packetElem = fFirstPacketInQueueForNewOutput; // everybody starts at the oldest packet in the buffer delay or uses a bookmark
+						theSeq = theFirstPacketForNewOutput; // everybody starts at the oldest packet in the buffer delay or uses a bookmark
 						firstPacket = true;
 						theOutput->setNewFlag(false);
+						
+						if (isGOPCached)
+						{
+							(void)atomic_add(inFromGOPCache ? &ReflectorStream::sGOPCacheHits : &ReflectorStream::sGOPCacheMisses, 1);
+							theOutput->fFirstFrameWaitStart = currentTime;
+							theOutput->fFirstFrameWaitSeq = theSeq;
+						}
 
-						//if(packetElem)
+						//if(fPacketRing.GetPacket(theSeq))
 						//{
-						//	ReflectorPacket* packet = (ReflectorPacket*)packetElem->GetEnclosingObject();
+						//	ReflectorPacket* packet = fPacketRing.GetPacket(theSeq);
 						//	printf("New Output Packet: %s \n", this->IsKeyFrameFirstPacket(packet)?"I":"P");
 						//}
 
 					}
+					else if ( theSeq < fPacketRing.GetTail() )
+					{
+						// the output fell so far behind that the packets it was waiting for
+						// have aged out, pick up from the oldest one we still have
+						theSeq = fPacketRing.GetTail();
+					}
 
 					//->geyijyn@20150427
 					//жǷҪ¶λǩλ
 					//<-
-					//if(NeedRelocateBookMark(packetElem))
+					//if(NeedRelocateBookMark(theSeq))
 					//{
-					//	OSQueueElem* nextElem = packetElem->Prev();	//һλÿʼ¶λ
-					//	Assert(nextElem != NULL);					//ȻΪ
-					//	packetElem =  this->GetNewestKeyFrameFirstPacket(nextElem,0);	
-					//	if (packetElem)
+					//	UInt64 nextSeq = theSeq + 1;	//һλÿʼ¶λ
+					//	Assert(nextSeq < theHead);					//ȻΪ
+					//	theSeq =  this->GetNewestKeyFrameFirstPacket(nextSeq,0);	
+					//	if (theSeq != ReflectorPacketRing::kNoPacket)
 					//	{
 					//		printf("[geyijun] =======> RtpSeq [%d]=>[%d] \n",
-					//			((ReflectorPacket*)(nextElem->GetEnclosingObject()))->GetPacketRTPSeqNum(),
-					//			((ReflectorPacket*)(packetElem->GetEnclosingObject()))->GetPacketRTPSeqNum());
+					//			fPacketRing.GetPacket(nextSeq)->GetPacketRTPSeqNum(),
+					//			fPacketRing.GetPacket(theSeq)->GetPacketRTPSeqNum());
 					//	}
 					//	else
 					//	{
-					//		packetElem = nextElem;	
+					//		theSeq = nextSeq;	
 					//	}
 					//}
 
 					SInt64  bucketDelay = ReflectorStream::sBucketDelayInMsec * (SInt64)bucketIndex;
-					packetElem = this->SendPacketsToOutput(theOutput, packetElem,currentTime, bucketDelay, firstPacket);
-					if (packetElem)
+					theSeq = this->SendPacketsToOutput(theOutput, theSeq, theHead, currentTime, bucketDelay, firstPacket, ioNextTimeToRun);
+					(void) theOutput->SetBookMarkPacket(&fPacketRing, theSeq); 	// where to pick up next time
+					
+					// the output has its first frame once it's past a key frame it started at or before
+					if (isGOPCached && (theOutput->fFirstFrameWaitStart != 0))
 					{
-						ReflectorPacket*   thePacket = (ReflectorPacket*)packetElem->GetEnclosingObject();
-						thePacket->fNeededByOutput = true; 				// flag to prevent removal in RemoveOldPackets
-						(void) theOutput->SetBookMarkPacket(packetElem); 	// store a reference to the packet
+						UInt64 theKeyFrameSeq = atomic_load64(&fKeyFrameStartPacketSeq);
+						if ((theKeyFrameSeq != ReflectorPacketRing::kNoPacket) && (theKeyFrameSeq >= theOutput->fFirstFrameWaitSeq) && (theSeq > theKeyFrameSeq))
+						{
+							(void)atomic_add(&ReflectorStream::sNumFirstFrames, 1);
+							(void)atomic_add(&ReflectorStream::sTotalTimeToFirstFrameMSec, (unsigned int)(currentTime - theOutput->fFirstFrameWaitStart));
+							theOutput->fFirstFrameWaitStart = 0;
+						}
 					}
 				}
-            } 
-        }
+        } 
     }
+    
+    // everything due for this bucket has been written, send it out before the next one
+    this->FlushBucket(bucketIndex);
+}
 
-    this->RemoveOldPackets(inFreeQueue);
-    fFirstNewPacketInQueue = NULL;
+SInt64 ReflectorSender::ReflectBuckets(UInt32 inTaskIndex)
+{
+    SInt64 currentTime = OS::CachedMilliseconds();
+    SInt64 theNextTimeToRun = 1000;
+    
+    // Keeps the output array and the ring's tail from changing under us, but
+    // lets the other bucket tasks of this stream run at the same time.
+    OSMutexReadLocker locker(&fStream->fBucketTaskLock);
+    
+    UInt64 theHead = fPacketRing.GetHead();
+    Bool16 fromGOPCache = false;
+    UInt64 theFirstPacketForNewOutput = this->GetFirstPacketForNewOutput(&fromGOPCache);
+    
+    // Every fNumBucketTasks'th bucket belongs to this task, so an output is only
+    // ever written by one task and its packets can't get out of order.
+    for (UInt32 bucketIndex = inTaskIndex; bucketIndex < fStream->fNumBuckets; bucketIndex += fNumBucketTasks)
+        this->ReflectBucket(bucketIndex, theHead, theFirstPacketForNewOutput, fromGOPCache, currentTime, &theNextTimeToRun);
+    
+    return theNextTimeToRun;
+}
 
-    //Don't forget that the caller also wants to know when we next want to run
-    if (*ioWakeupTime == 0)
-        *ioWakeupTime = fNextTimeToRun;
-    else if ((fNextTimeToRun > 0) && (*ioWakeupTime > fNextTimeToRun))
-        *ioWakeupTime = fNextTimeToRun;
-    // exit with fNextTimeToRun in real time, not relative time.
-    fNextTimeToRun += currentTime;
-     
-   // qtss_printf("SetNextTimeToRun fNextTimeToRun=%qd + currentTime=%qd\n", fNextTimeToRun, currentTime);
-   // qtss_printf("ReflectorSender::ReflectPackets *ioWakeupTime = %qd\n", *ioWakeupTime);
+void ReflectorSender::StartBucketTasks()
+{
+    fNumBucketTasks = ReflectorStream::sNumBucketTasks;
+    fBucketTasks = NEW BucketTask*[fNumBucketTasks];
+    for (UInt32 taskIndex = 0; taskIndex < fNumBucketTasks; taskIndex++)
+        fBucketTasks[taskIndex] = NEW BucketTask(this, taskIndex);
+}
+
+void ReflectorSender::StopBucketTasks()
+{
+    // the bucket tasks delete themselves once they know we're gone
+    for (UInt32 taskIndex = 0; taskIndex < fNumBucketTasks; taskIndex++)
+    {
+        fBucketTasks[taskIndex]->Detach();
+        fBucketTasks[taskIndex]->Signal(Task::kKillEvent);
+    }
+    delete [] fBucketTasks;
+    fBucketTasks = NULL;
+    fNumBucketTasks = 0;
+}
 
+ReflectorSender::BucketTask::BucketTask(ReflectorSender* inSender, UInt32 inTaskIndex)
+:   fSender(inSender),
+    fTaskIndex(inTaskIndex)
+{
+    this->SetTaskName("ReflectorSender::BucketTask");
 }
 
-OSQueueElem*    ReflectorSender::SendPacketsToOutput(ReflectorOutput* theOutput, OSQueueElem* currentPacket, SInt64 currentTime,  SInt64  bucketDelay, Bool16 firstPacket)
+void ReflectorSender::BucketTask::Detach()
 {
-    OSQueueElem* lastPacket = currentPacket;
-    OSQueueIter qIter(&fPacketQueue, currentPacket);  // starts from beginning if currentPacket == NULL, else from currentPacket                
+    // Waits for Run to be done with the sender
+    OSMutexLocker locker(&fMutex);
+    fSender = NULL;
+}
+
+SInt64 ReflectorSender::BucketTask::Run()
+{
+    EventFlags theEvents = this->GetEvents();
     
+    OSMutexLocker locker(&fMutex);
+    if ((theEvents & Task::kKillEvent) || (fSender == NULL))
+        return -1;
+    
+    return fSender->ReflectBuckets(fTaskIndex);
+}
+
+UInt64  ReflectorSender::SendPacketsToOutput(ReflectorOutput* theOutput, UInt64 inSeq, UInt64 inEndSeq, SInt64 currentTime,  SInt64  bucketDelay, Bool16 firstPacket, SInt64* ioNextTimeToRun)
+{
     UInt32 count = 0;
     QTSS_Error err = QTSS_NoErr;
-    while ( !qIter.IsDone() )
+    for ( ; inSeq < inEndSeq; inSeq++ )
     {                   
-        currentPacket = qIter.GetCurrent();
-        lastPacket = currentPacket;
-        
-        ReflectorPacket*    thePacket = (ReflectorPacket*)currentPacket->GetEnclosingObject();
+        ReflectorPacket*    thePacket = fPacketRing.GetPacket(inSeq);
+        Assert( thePacket );
         SInt64  packetLateness =  bucketDelay;
         SInt64 timeToSendPacket = -1;
               
         //printf("packetLateness %qd, seq# %li\n", packetLateness, (SInt32) DGetPacketSeqNumber( &thePacket->fPacketPtr ) );          
                                          
-        err = theOutput->WritePacket(&thePacket->fPacketPtr, fStream, fWriteFlag, packetLateness, &timeToSendPacket,&thePacket->fStreamCountID,&thePacket->fTimeArrived, firstPacket );                
+        err = theOutput->WritePacket(&thePacket->fPacketPtr, fStream, fWriteFlag, packetLateness, &timeToSendPacket,&thePacket->fStreamCountID,&thePacket->fTimeArrived, firstPacket, thePacket->fBuffer );                
+
+        // The FEC packet for a group goes right after its last packet. If it blocks, the
+        // retry finds the packet already sent (see RTPSessionOutput::PacketAlreadySent)
+        // and gets here again.
+        if ((err == QTSS_NoErr) && (thePacket->fFECPacketPtr.Len > 0))
+            err = theOutput->WriteFECPacket(&thePacket->fFECPacketPtr, fStream, packetLateness, &timeToSendPacket, &thePacket->fTimeArrived);
 
         if (err == QTSS_WouldBlock)
         { // call us again in # ms to retry on an EAGAIN
             
-            if ((timeToSendPacket > 0) && ( (fNextTimeToRun + currentTime) > timeToSendPacket )) // blocked but we are scheduled to wake up later
-                fNextTimeToRun = timeToSendPacket - currentTime;
+            if ((timeToSendPacket > 0) && ( (*ioNextTimeToRun + currentTime) > timeToSendPacket )) // blocked but we are scheduled to wake up later
+                *ioNextTimeToRun = timeToSendPacket - currentTime;
             
             if (theOutput->fLastIntervalMilliSec < 5 )
                 theOutput->fLastIntervalMilliSec = 5;
 
             if ( timeToSendPacket < 0 ) // blocked and we are behind
             {    //qtss_printf("fNextTimeToRun = theOutput->fLastIntervalMilliSec=%qd;\n", theOutput->fLastIntervalMilliSec); // Use the last packet interval 
-                 this->SetNextTimeToRun(theOutput->fLastIntervalMilliSec);
+                 *ioNextTimeToRun = theOutput->fLastIntervalMilliSec;
             }
                
-            if (fNextTimeToRun > 100) //don't wait that long
-            {    //qtss_printf("fNextTimeToRun = %qd now 100;\n", fNextTimeToRun);
-                 this->SetNextTimeToRun(100);
+            if (*ioNextTimeToRun > 100) //don't wait that long
+            {    //qtss_printf("fNextTimeToRun = %qd now 100;\n", *ioNextTimeToRun);
+                 *ioNextTimeToRun = 100;
             }
 
-            if (fNextTimeToRun < 5) //wait longer
+            if (*ioNextTimeToRun < 5) //wait longer
             {    //qtss_printf("fNextTimeToRun = 5;\n");
-                 this->SetNextTimeToRun(5);
+                 *ioNextTimeToRun = 5;
             }
 
             if (theOutput->fLastIntervalMilliSec >= 100) // allow up to 1 second max -- allow some time for the socket to clear and don't go into a tight loop if the client is gone.
@@ -1208,105 +1715,189 @@ OSQueueElem*    ReflectorSender::SendPacketsToOutput(ReflectorOutput* theOutput,
         }
 
         count++;
-        qIter.Next();
-    
     }
 
-    return lastPacket;
+    return inSeq;
+}
+
+
+void ReflectorSender::FlushBucket(UInt32 inBucketIndex)
+{
+    // Outputs may buffer the packets they are given (see RTPSessionOutput::WritePacket)
+    // so this has to happen before RemoveOldPackets hands the packets back to the free queue
+    for (UInt32 bucketMemberIndex = 0; bucketMemberIndex < fStream->sBucketSize; bucketMemberIndex++)
+    {
+        ReflectorOutput* theOutput = fStream->fOutputArray[inBucketIndex][bucketMemberIndex];
+        if (theOutput != NULL)
+        {
+            OSMutexLocker locker(&theOutput->fMutex);
+            theOutput->Flush();
+        }
+    }
 }
 
 
-OSQueueElem* ReflectorSender::GetClientBufferStartPacketOffset(SInt64 offsetMsec,Bool16 needKeyFrameFirstPacket)
+UInt64  ReflectorSender::GetClientBufferStartPacketOffset(SInt64 offsetMsec,Bool16 needKeyFrameFirstPacket)
 {     
-    OSQueueIter qIter(&fPacketQueue);// start at oldest packet in q
-    SInt64 theCurrentTime = OS::Milliseconds();
+    SInt64 theCurrentTime = OS::CachedMilliseconds();
     SInt64 packetDelay = 0;
-    OSQueueElem* oldestPacketInClientBufferTime = NULL;
+    UInt64 theHead = fPacketRing.GetHead();
     
+    if (offsetMsec > ReflectorStream::sOverBufferInMsec)
+        offsetMsec = ReflectorStream::sOverBufferInMsec;
     
-    while ( !qIter.IsDone() ) // start at oldest packet in q
+    for (UInt64 theSeq = fPacketRing.GetTail(); theSeq < theHead; theSeq++) // start at oldest packet in the ring
     {
-        OSQueueElem* elem = qIter.GetCurrent();
-        Assert( elem );
-        qIter.Next();
-       
-        ReflectorPacket* thePacket = (ReflectorPacket*)elem->GetEnclosingObject();      
+        ReflectorPacket* thePacket = fPacketRing.GetPacket(theSeq);
         Assert( thePacket );
              
         packetDelay = theCurrentTime - thePacket->fTimeArrived;
-        if (offsetMsec > ReflectorStream::sOverBufferInMsec)
-            offsetMsec = ReflectorStream::sOverBufferInMsec;
-            
         if ( packetDelay <= (ReflectorStream::sOverBufferInMsec - offsetMsec) ) 
-        {   
-            oldestPacketInClientBufferTime = &thePacket->fQueueElem;
-            break; // found the packet we need: done processing
-        }
-        
+            return theSeq; // found the packet we need: done processing
     }
     
-    return oldestPacketInClientBufferTime;
+    return ReflectorPacketRing::kNoPacket;
 }
 
 void    ReflectorSender::RemoveOldPackets(OSQueue* inFreeQueue)
 {
-        
-// Iterate through the senders queue to clear out packets
-// Start at the oldest packet and walk forward to the newest packet
-// 
-    OSQueueIter removeIter(&fPacketQueue);
-    SInt64 theCurrentTime = OS::Milliseconds();
+// Move the tail of the ring past the packets that are too old. Outputs that were
+// still waiting on them pick up from the new tail the next time through.
+    SInt64 theCurrentTime = OS::CachedMilliseconds();
     SInt64 packetDelay = 0;
     SInt64 currentMaxPacketDelay = ReflectorStream::sMaxPacketAgeMSec;
-    
+    UInt64 theKeyFrameSeq = atomic_load64(&fKeyFrameStartPacketSeq);
 
-    while ( !removeIter.IsDone() )
+    // Nothing to do unless the oldest packet has aged out. Nobody else moves
+    // the tail, so it's safe to look at the oldest packet without the lock.
+    ReflectorPacket* theOldestPacket = fPacketRing.GetPacket(fPacketRing.GetTail());
+    if ((theOldestPacket == NULL) || ((theCurrentTime - theOldestPacket->fTimeArrived) <= currentMaxPacketDelay))
+        return;
+
+    // The bucket tasks read the ring without the bucket mutex. Don't wait for
+    // them unless the ring is filling up, we'll be back here shortly.
+    if (fStream->fBucketTaskLock.TryLockWrite() != 0)
     {
-        OSQueueElem* elem = removeIter.GetCurrent();
-        Assert( elem );
-    
-        //at this point, move onto the next queue element, because we may be altering
-        //the queue itself in the code below
-        removeIter.Next();
-    
-        ReflectorPacket* thePacket = (ReflectorPacket*)elem->GetEnclosingObject();      
+        if (fPacketRing.GetLength() < (fPacketRing.GetCapacity() / 2))
+            return;
+        fStream->fBucketTaskLock.LockWrite();
+    }
+
+    while ( fPacketRing.GetLength() > 0 )
+    {
+        UInt64 theTail = fPacketRing.GetTail();
+        ReflectorPacket* thePacket = fPacketRing.GetPacket(theTail);
         Assert( thePacket );
-        //printf("ReflectorSender::RemoveOldPackets Packet %d in queue is %qd milliseconds old\n", DGetPacketSeqNumber( &thePacket->fPacketPtr ) ,theCurrentTime - thePacket->fTimeArrived);
-    
+        //printf("ReflectorSender::RemoveOldPackets Packet %d in ring is %qd milliseconds old\n", DGetPacketSeqNumber( &thePacket->fPacketPtr ) ,theCurrentTime - thePacket->fTimeArrived);
             
         packetDelay = theCurrentTime - thePacket->fTimeArrived;
-                
-        // walk q and remove packets that are too old
-        if ( !thePacket->fNeededByOutput && packetDelay > currentMaxPacketDelay) // delete based on late tolerance and whether a client is blocked on the packet
-        {   // not needed and older than our required buffer
-            thePacket->Reset();
-            fPacketQueue.Remove( elem );
-            inFreeQueue->EnQueue( elem );
-        }
-        else   
-        {   // we want to keep all of these but we should reset the ones that should be aged out unless marked
-            // as need the next time through reflect packets.
-
-			if(fKeyFrameStartPacketElementPointer)
-			{
-				ReflectorPacket* keyPacket = (ReflectorPacket*)(fKeyFrameStartPacketElementPointer->GetEnclosingObject());
-				if(keyPacket == thePacket)
-					break;
-			}
+        if (packetDelay <= currentMaxPacketDelay)  // this packet is going to be kept around as well as the ones that follow.
+            break;
 
-			//if(IsKeyFrameFirstPacket(thePacket))
-			//	break;
+        // new outputs start at the newest key frame, so keep it around, unless a long
+        // GOP would fill up the ring with it and leave no room for new packets
+        if ((theTail == theKeyFrameSeq) && (fPacketRing.GetLength() < (fPacketRing.GetCapacity() / 2)))
+            break;
 
-			thePacket->fNeededByOutput = false; //mark not needed.. will be set next time through reflect packets
-            if (packetDelay <= currentMaxPacketDelay)  // this packet is going to be kept around as well as the ones that follow.
-                break;
-        }   
+        (void)fPacketRing.PopTail();
+        thePacket->Reset();
+        inFreeQueue->EnQueue( &thePacket->fQueueElem );
     }
+
+    fStream->fBucketTaskLock.Unlock();
+}
+
+void ReflectorSender::MakeRoomInRing(OSQueue* inFreeQueue)
+{
+    // Same locks as RemoveOldPackets, but we can't skip this when the bucket tasks are busy
+    OSMutexLocker locker(&fStream->fBucketMutex);
+    OSMutexWriteLocker taskLocker(&fStream->fBucketTaskLock);
     
+    for (UInt32 count = fPacketRing.GetCapacity() / kRingFullDropFraction; count > 0; count--)
+    {
+        ReflectorPacket* thePacket = fPacketRing.PopTail();
+        if (thePacket == NULL)
+            break;
+        thePacket->Reset();
+        inFreeQueue->EnQueue(&thePacket->fQueueElem);
+    }
+}
 
+#if REFLECTORSENDERTESTING
+Bool16 ReflectorSender::Test()
+{
+    SourceInfo::StreamInfo theInfo;
+    ReflectorStream* theStream = NEW ReflectorStream(&theInfo);
+    ReflectorSender* theSender = theStream->GetRTPSender();
+    ReflectorPacketRing* theRing = &theSender->fPacketRing;
+    UInt32 theCapacity = theRing->GetCapacity();
+    UInt32 theNumPackets = theCapacity * 3;
+    OSQueue theFreeQueue;
+    UInt32 theNumAllocated = 0;
+    Bool16 passed = true;
+    
+    // the way ReflectorSocket::ProcessPacket fills the ring, with no packet old enough to age out
+    for (UInt32 index = 0; index < theNumPackets; index++)
+    {
+        OSQueueElem* theElem = theFreeQueue.DeQueue();
+        ReflectorPacket* thePacket = NULL;
+        if (theElem != NULL)
+            thePacket = (ReflectorPacket*)theElem->GetEnclosingObject();
+        else
+        {
+            thePacket = NEW ReflectorPacket();
+            theNumAllocated++;
+        }
+        thePacket->SetPacketData((char*)&index, sizeof(index));
+        
+        if (theRing->IsFull())
+            theSender->MakeRoomInRing(&theFreeQueue);
+        if (!theRing->Push(thePacket))
+        {
+            qtss_printf("ReflectorSender::Test packet %"_U32BITARG_" didn't fit in the ring\n", index);
+            delete thePacket;
+            passed = false;
+        }
+    }
+    
+    if ((theRing->GetHead() != theNumPackets) || (theRing->GetLength() < theCapacity - (theCapacity / kRingFullDropFraction)))
+    {
+        qtss_printf("ReflectorSender::Test head %"_64BITARG_"u length %"_U32BITARG_", expected %"_U32BITARG_" and at least %"_U32BITARG_"\n",
+                    theRing->GetHead(), theRing->GetLength(), theNumPackets, theCapacity - (theCapacity / kRingFullDropFraction));
+        passed = false;
+    }
+    
+    // what's left is the newest packets, in order
+    for (UInt64 theSeq = theRing->GetTail(); theSeq < theRing->GetHead(); theSeq++)
+    {
+        ReflectorPacket* thePacket = theRing->GetPacket(theSeq);
+        UInt32 theIndex = 0;
+        ::memcpy(&theIndex, thePacket->fPacketPtr.Ptr, sizeof(theIndex));
+        if (theIndex != theSeq)
+        {
+            qtss_printf("ReflectorSender::Test packet %"_64BITARG_"u holds %"_U32BITARG_"\n", theSeq, theIndex);
+            passed = false;
+            break;
+        }
+    }
+    
+    // and the dropped ones went back to the free queue
+    if (theFreeQueue.GetLength() + theRing->GetLength() != theNumAllocated)
+    {
+        qtss_printf("ReflectorSender::Test lost track of %"_U32BITARG_" packets\n", theNumAllocated - theFreeQueue.GetLength() - theRing->GetLength());
+        passed = false;
+    }
+    
+    OSQueueElem* theElem = NULL;
+    while ((theElem = theFreeQueue.DeQueue()) != NULL)
+        delete (ReflectorPacket*)theElem->GetEnclosingObject();
+    delete theStream; // deletes the packets still in the ring
+    
+    return passed;
 }
+#endif
 
-Bool16 ReflectorSender::NeedRelocateBookMark(OSQueueElem* currentElem)
+Bool16 ReflectorSender::NeedRelocateBookMark(UInt64 inSeq)
 {
 	//ֻƵҪ
 	SourceInfo::StreamInfo* streamInfo = fStream->GetStreamInfo();
@@ -1320,25 +1911,24 @@ Bool16 ReflectorSender::NeedRelocateBookMark(OSQueueElem* currentElem)
 	}
 
 	//Ϊ豸£ݶлݰ
-	//ʱfFirstPacketInQueueForNewOutput ΪաԲʹöԡ
-	//Assert(currentElem);	
-	if(currentElem==NULL)
+	//ʱtheFirstPacketForNewOutput ΪաԲʹöԡ
+	ReflectorPacket* currentPacket = fPacketRing.GetPacket(inSeq);
+	if(currentPacket==NULL)
 	{
 		return false;
 	}
 	//ҪԪزضĿ
-	OSQueueElem* nextElem = currentElem->Prev();
-	if((nextElem == NULL)||(nextElem->GetEnclosingObject() == NULL))
+	ReflectorPacket* nextPacket = fPacketRing.GetPacket(inSeq + 1);
+	if(nextPacket == NULL)
 	{
 		return false;
 	}
 	
 	//1 :  ǰ֡Ѿضʱ
-	ReflectorPacket* currentPacket = (ReflectorPacket*)currentElem->GetEnclosingObject();
 	//if((currentPacket)&&IsFrameLastPacket(currentPacket))
 	if((currentPacket)&&IsFrameFirstPacket(currentPacket))
 	{	
-		SInt64 packetDelay = OS::Milliseconds() - currentPacket->fTimeArrived;
+		SInt64 packetDelay = OS::CachedMilliseconds() - currentPacket->fTimeArrived;
 		if ( packetDelay >= (ReflectorStream::sRelocatePacketAgeMSec) )
 		{
 			return true;
@@ -1346,8 +1936,6 @@ Bool16 ReflectorSender::NeedRelocateBookMark(OSQueueElem* currentElem)
 	}
 	//2 :  Ѿ֡ŲݰѾϻ
 	{
-		ReflectorPacket* currentPacket = (ReflectorPacket*)currentElem->GetEnclosingObject();  
-		ReflectorPacket* nextPacket = (ReflectorPacket*)nextElem->GetEnclosingObject();  
 		if((currentPacket)&&(nextPacket)&&((currentPacket->fStreamCountID+1) != nextPacket->fStreamCountID))
 		{
 			printf("[geyijun] ===========>Find Not Continued Seq[%qd]==[%qd]\n",currentPacket->fStreamCountID,nextPacket->fStreamCountID);
@@ -1357,27 +1945,25 @@ Bool16 ReflectorSender::NeedRelocateBookMark(OSQueueElem* currentElem)
 	return false;
 }
 
-OSQueueElem*    ReflectorSender::GetNewestKeyFrameFirstPacket(OSQueueElem* currentElem,SInt64 offsetMsec)
+UInt64  ReflectorSender::GetNewestKeyFrameFirstPacket(UInt64 inSeq,SInt64 offsetMsec)
 {
 	//printf("[geyijun] GetNewestKeyFrameFirstPacket---------------->1\n");
-	SInt64 theCurrentTime = OS::Milliseconds();
+	SInt64 theCurrentTime = OS::CachedMilliseconds();
 	SInt64 packetDelay = 0;
-	OSQueueElem* requestedPacket = NULL;
-	OSQueueIter qIter(&fPacketQueue,currentElem);
-	while ( !qIter.IsDone() ) // start at oldest packet in q
+	UInt64 requestedPacket = ReflectorPacketRing::kNoPacket;
+	UInt64 theHead = fPacketRing.GetHead();
+	if (inSeq < fPacketRing.GetTail())
+		inSeq = fPacketRing.GetTail();
+	for ( ; inSeq < theHead; inSeq++ ) // start at inSeq and walk towards the newest packet
 	{
-		OSQueueElem* elem = qIter.GetCurrent();
-		Assert( elem );
-		qIter.Next();
-
-		ReflectorPacket* thePacket = (ReflectorPacket*)elem->GetEnclosingObject();      
+		ReflectorPacket* thePacket = fPacketRing.GetPacket(inSeq);
 		if(thePacket == NULL)
 		{
 			break;
 		}
 		if (IsKeyFrameFirstPacket(thePacket)) 
 		{
-			requestedPacket = &thePacket->fQueueElem;
+			requestedPacket = inSeq;
 			//printf("[geyijun]Maybe,GetNewestKeyFrameFirstPacket --->[%#x]\n",requestedPacket);	
 
 			//
@@ -1390,13 +1976,13 @@ OSQueueElem*    ReflectorSender::GetNewestKeyFrameFirstPacket(OSQueueElem* curre
 			}
 		}
 	}
-	if(requestedPacket == NULL)
+	if(requestedPacket == ReflectorPacketRing::kNoPacket)
 	{
 		printf("[geyijun]GetNewestKeyFrameFirstPacket --->[NotFound]\n");	
 	}	
 	else
 	{
-		printf("[geyijun]Final,GetNewestKeyFrameFirstPacket --->[%#x]\n",requestedPacket);		
+		printf("[geyijun]Final,GetNewestKeyFrameFirstPacket --->[%"_64BITARG_"u]\n",requestedPacket);		
 	}	
 	return requestedPacket;
 }
@@ -1577,6 +2163,123 @@ Bool16 ReflectorSender::IsFrameLastPacket(ReflectorPacket* thePacket)
 	return false;	
 }	
 
+// Looks at the NAL unit header at inNAL, and returns whether that NAL unit starts a key frame,
+// is a parameter set (or something else that can lead the access unit of one), or neither
+static UInt32 GetNALUnitGOPType(UInt32 inGOPCodec, UInt8* inNAL)
+{
+    if (inGOPCodec == ReflectorStream::kH265GOPCodec)
+    {
+        UInt8 theType = (inNAL[0] >> 1) & 0x3f;
+        if ((theType >= 16) && (theType <= 21))     // BLA, IDR, CRA
+            return ReflectorSender::kKeyFramePacket;
+        if (((theType >= 32) && (theType <= 35)) || (theType == 39))    // VPS, SPS, PPS, AUD, prefix SEI
+            return ReflectorSender::kParameterSetPacket;
+        return ReflectorSender::kOtherPacket;
+    }
+    
+    UInt8 theType = inNAL[0] & 0x1f;
+    if (theType == 5)                               // IDR slice
+        return ReflectorSender::kKeyFramePacket;
+    if ((theType >= 6) && (theType <= 9))           // SEI, SPS, PPS, AUD
+        return ReflectorSender::kParameterSetPacket;
+    return ReflectorSender::kOtherPacket;
+}
+
+UInt32 ReflectorSender::GetGOPPacketType(ReflectorPacket* inPacket)
+{
+    UInt8* thePacket = (UInt8*)inPacket->fPacketPtr.Ptr;
+    UInt32 theLen = inPacket->fPacketPtr.Len;
+    if ((thePacket == NULL) || (theLen <= 12))
+        return kOtherPacket;
+    
+    // skip the CSRCs and the header extension
+    UInt32 theOffset = 12 + ((thePacket[0] & 0x0f) * 4);
+    if ((thePacket[0] & 0x10) && (theOffset + 4 <= theLen))
+        theOffset += 4 + ((((UInt32)thePacket[theOffset + 2] << 8) | thePacket[theOffset + 3]) * 4);
+    
+    UInt32 theCodec = fStream->GetGOPCodec();
+    Bool16 isH265 = (theCodec == ReflectorStream::kH265GOPCodec);
+    UInt32 theNALHeaderSize = isH265 ? 2 : 1;
+    if (theOffset + theNALHeaderSize >= theLen)
+        return kOtherPacket;
+    
+    UInt8 theType = isH265 ? ((thePacket[theOffset] >> 1) & 0x3f) : (thePacket[theOffset] & 0x1f);
+    if ((isH265 && (theType == 49)) || (!isH265 && ((theType == 28) || (theType == 29))))
+    {
+        // FU: only the first fragment tells us anything. The FU header holds the
+        // type of the fragmented NAL unit in the same bits as a NAL unit header.
+        UInt8 theFUHeader = thePacket[theOffset + theNALHeaderSize];
+        if ((theFUHeader & 0x80) == 0)
+            return kOtherPacket;
+        
+        UInt8 theNAL[2] = { (UInt8)(theFUHeader << (isH265 ? 1 : 0)), 0 };
+        return GetNALUnitGOPType(theCodec, theNAL);
+    }
+    
+    if ((isH265 && (theType == 48)) || (!isH265 && (theType == 24)))
+    {
+        // STAP-A / AP: 16 bit size, then the NAL unit. A key frame anywhere in it wins.
+        UInt32 theResult = kOtherPacket;
+        theOffset += theNALHeaderSize;
+        while (theOffset + 2 + theNALHeaderSize <= theLen)
+        {
+            UInt32 theNALSize = ((UInt32)thePacket[theOffset] << 8) | thePacket[theOffset + 1];
+            UInt32 theNALGOPType = GetNALUnitGOPType(theCodec, &thePacket[theOffset + 2]);
+            if (theNALGOPType > theResult)
+                theResult = theNALGOPType;
+            theOffset += 2 + theNALSize;
+        }
+        return theResult;
+    }
+    
+    return GetNALUnitGOPType(theCodec, &thePacket[theOffset]);
+}
+
+void ReflectorSender::UpdateGOPCache(ReflectorPacket* inPacket, UInt64 inSeq)
+{
+    // ProcessPacket calls this for every RTP packet of an H.264 or H.265 stream,
+    // right before the packet goes into the ring at inSeq
+    UInt32 thePacketType = this->GetGOPPacketType(inPacket);
+    
+    // Every slice of an IDR picture starts with a key frame NAL unit, only the
+    // first of them (the first with a new RTP time) starts a new GOP
+    if ((thePacketType == kKeyFramePacket) && (ReflectorStream::sGOPCacheMaxBytes > 0)
+        && ((fGOPBytes == 0) || (inPacket->GetPacketRTPTime() != fKeyFrameRTPTime)))
+    {
+        // the parameter sets sent right before the key frame go with it
+        UInt64 theStartSeq = inSeq;
+        fGOPBytes = 0;
+        if (fParamSetStartPacketSeq != ReflectorPacketRing::kNoPacket)
+        {
+            theStartSeq = fParamSetStartPacketSeq;
+            if (theStartSeq < fPacketRing.GetTail())
+                theStartSeq = fPacketRing.GetTail();
+            for (UInt64 theSeq = theStartSeq; theSeq < inSeq; theSeq++)
+                fGOPBytes += fPacketRing.GetPacket(theSeq)->fPacketPtr.Len;
+        }
+        
+        atomic_store64(&fKeyFrameStartPacketSeq, theStartSeq);
+        fKeyFrameRTPTime = inPacket->GetPacketRTPTime();
+        
+        // the audio of this session starts over from here too
+        fStream->GetMyReflectorSession()->SetHasVideoKeyFrameUpdate(true);
+    }
+    
+    if (thePacketType != kParameterSetPacket)
+        fParamSetStartPacketSeq = ReflectorPacketRing::kNoPacket;
+    else if (fParamSetStartPacketSeq == ReflectorPacketRing::kNoPacket)
+        fParamSetStartPacketSeq = inSeq;
+    
+    // Stop holding on to a GOP that has grown too big, new outputs start in the
+    // client buffer and wait for the next key frame instead
+    if (fKeyFrameStartPacketSeq != ReflectorPacketRing::kNoPacket)
+    {
+        fGOPBytes += inPacket->fPacketPtr.Len;
+        if (fGOPBytes > ReflectorStream::sGOPCacheMaxBytes)
+            atomic_store64(&fKeyFrameStartPacketSeq, ReflectorPacketRing::kNoPacket);
+    }
+}
+
 void ReflectorSocketPool::SetUDPSocketOptions(UDPSocketPair* inPair)
 {
     // Fix add ReuseAddr for compatibility with MPEG4IP broadcaster which likes to use the same
@@ -1586,6 +2289,11 @@ void ReflectorSocketPool::SetUDPSocketOptions(UDPSocketPair* inPair)
     //inPair->GetSocketA()->ReuseAddr();
     //inPair->GetSocketA()->ReuseAddr();
 
+    if (ReflectorStream::sUseKernelReceiveTime)
+    {
+        (void)inPair->GetSocketA()->SetReceiveTimestamps(true);
+        (void)inPair->GetSocketB()->SetReceiveTimestamps(true);
+    }
 }
 
 
@@ -1738,7 +2446,7 @@ void ReflectorSocket::FilterInvalidSSRCs(ReflectorPacket* thePacket,Bool16 isRTC
 {   // assume the first SSRC we see is valid and all others are to be ignored.
     if ( thePacket->fPacketPtr.Len > 0) do 
     {
-        SInt64 currentTime = OS::Milliseconds() / 1000;
+        SInt64 currentTime = OS::CachedMilliseconds() / 1000;
         if (0 == fValidSSRC)
         {   fValidSSRC = thePacket->GetSSRC(isRTCP); // SSRC of 0 is allowed
             fLastValidSSRCTime = currentTime;
@@ -1838,7 +2546,10 @@ Bool16 ReflectorSocket::ProcessPacket(const SInt64& inMilliseconds,ReflectorPack
             
         Assert(theSender != NULL); // at this point we have a sender
             
-        const UInt32 maxQSize = 4000;
+        // A busy stream fills the ring before its packets age out. The newest packet
+        // is the one every live output still needs, so make room by dropping the oldest.
+        if (theSender->fPacketRing.IsFull())
+            theSender->MakeRoomInRing(&fFreeQueue);
                
          // Check to see if we need to set the remote RTCP address
         // for this stream. This will be necessary if the source is unicast.
@@ -1873,60 +2584,21 @@ Bool16 ReflectorSocket::ProcessPacket(const SInt64& inMilliseconds,ReflectorPack
         thePacket->fStreamCountID = ++(theSender->fStream->fPacketCount);
         thePacket->fBucketsSeenThisPacket = 0;
         thePacket->fTimeArrived = inMilliseconds;
-        theSender->fPacketQueue.EnQueue(&thePacket->fQueueElem);
+        UInt64 thePacketSeq = theSender->fPacketRing.GetHead(); // the packet is pushed once it is all set up
 
 		// TODO:AH264ƵRTPйؼ֡ˣ¹ؼ֡׸RTPָ
-		// 1жǷΪƵH.264 RTP
 		SourceInfo::StreamInfo* streamInfo = theSender->fStream->GetStreamInfo();
-		if(!(thePacket->IsRTCP()) &&(streamInfo->fPayloadType == qtssVideoPayloadType) && (streamInfo->fPayloadName.Equal("H264/90000")))
-		{
-			// 2жthePacketǷΪؼ֡ʼRTPǣ¼thePacket->fQueueElem
-			if(theSender->IsKeyFrameFirstPacket(thePacket))
-			{
-				//printf("\nI");
-				//3ȡԭfKeyFrameStartPacketElementPointer
-				if(theSender->fKeyFrameStartPacketElementPointer)
-				{
-					ReflectorPacket* oldKeyFramePacket = (ReflectorPacket*)theSender->fKeyFrameStartPacketElementPointer->GetEnclosingObject();
-					oldKeyFramePacket->fNeededByOutput = false;
-				}
-
-				//4µfKeyFrameStartPacketElementPointer
-				{
-					//ؼ֡ᱻRemove
-					thePacket->fNeededByOutput = true;
-					//µĹؼ֡ʼ
-					theSender->fKeyFrameStartPacketElementPointer = &thePacket->fQueueElem; 
-				}
-
-				//5ReflectorSession־λNotifyƵؼ֡Ƶи
-				{
-					theSender->fStream->GetMyReflectorSession()->SetHasVideoKeyFrameUpdate(true);
-				}
-			}
-			//else if(theSender->IsFrameFirstPacket(thePacket))
-			//{
-			//	printf("P");
-			//}
-		}
+		if(!(thePacket->IsRTCP()) && (theSender->fStream->GetGOPCodec() != ReflectorStream::kNoGOPCodec))
+			theSender->UpdateGOPCache(thePacket, thePacketSeq);
 
 		// TODO:BƵؼ֡и£ƵҲƵĸи
 		// 1жǷΪƵRTPƵؼ֡Notify
 		if(!(thePacket->IsRTCP()) &&(streamInfo->fPayloadType == qtssAudioPayloadType) && (theSender->fStream->GetMyReflectorSession()->HasVideoKeyFrameUpdate()))
 		{
-			//2ȡԭƵfKeyFrameStartPacketElementPointer
-			if(theSender->fKeyFrameStartPacketElementPointer)
-			{
-				ReflectorPacket* oldKeyFramePacket = (ReflectorPacket*)theSender->fKeyFrameStartPacketElementPointer->GetEnclosingObject();
-				oldKeyFramePacket->fNeededByOutput = false;
-			}
-
-			//4µƵfKeyFrameStartPacketElementPointer
+			//4µƵfKeyFrameStartPacketSeq
 			{
 				//ؼ֡ᱻRemove
-				thePacket->fNeededByOutput = true;
-				//µĹؼ֡ʼ
-				theSender->fKeyFrameStartPacketElementPointer = &thePacket->fQueueElem; 
+				atomic_store64(&theSender->fKeyFrameStartPacketSeq, thePacketSeq);
 			}
 
 			//5ReflectorSession־λNotifyƵؼ֡Ƶи
@@ -1937,10 +2609,6 @@ Bool16 ReflectorSocket::ProcessPacket(const SInt64& inMilliseconds,ReflectorPack
 
 
 
-        if ( theSender->fFirstNewPacketInQueue == NULL )
-            theSender->fFirstNewPacketInQueue = &thePacket->fQueueElem;                 
-        theSender->fHasNewPackets = true;
-
         if (!(thePacket->IsRTCP()))
         {
             // don't check for duplicate packets, they may be needed to keep in sync.
@@ -1996,15 +2664,18 @@ Bool16 ReflectorSocket::ProcessPacket(const SInt64& inMilliseconds,ReflectorPack
         }
          
         //printf("ReflectorSocket::GetIncomingData has packet from time=%qd src addr=%"_U32BITARG_" src port=%u packetlen=%"_U32BITARG_"\n",inMilliseconds, theRemoteAddr,theRemotePort,thePacket->fPacketPtr.Len);
-        if (0) //turn on / off buffer size checking --  pref can go here if we find we need to adjust this
-        if (theSender->fPacketQueue.GetLength() > maxQSize) //don't grow memory too big
-        { 
-            char outMessage[256];
-            sprintf(outMessage,"Packet Queue for port=%d qsize = %"_S32BITARG_" hit max qSize=%"_U32BITARG_"", theRemotePort,theSender->fPacketQueue.GetLength(), maxQSize);
-            WarnV(false, outMessage); 
+        // The FEC packets are built here, once for all the outputs that want them
+        if (!thePacket->fIsRTCP)
+        {
+            if (theSender->fStream->HasFECOutputs() && (ReflectorStream::sFECGroupSize > 0))
+                theSender->fStream->fFECGenerator.AddPacket(thePacket, ReflectorStream::sFECGroupSize, (UInt8)ReflectorStream::sFECPayloadType);
+            else
+                theSender->fStream->fFECGenerator.Reset();
         }
-
-
+        
+        // publish the packet to the sender's outputs, we checked there is room for it above
+        (void)theSender->fPacketRing.Push(thePacket);
+        theSender->fHasNewPackets = true;
 
     } while(false);
     
@@ -2015,6 +2686,12 @@ Bool16 ReflectorSocket::ProcessPacket(const SInt64& inMilliseconds,ReflectorPack
 void ReflectorSocket::GetIncomingData(const SInt64& inMilliseconds)
 {
     OSMutexLocker locker(this->GetDemuxer()->GetMutex());
+    if (ReflectorStream::sBatchReceivePackets > 1)
+    {
+        this->GetIncomingDataBatch(inMilliseconds);
+        return;
+    }
+    
     UInt32 theRemoteAddr = 0;
     UInt16 theRemotePort = 0;
     //get all the outstanding packets for this socket
@@ -2023,9 +2700,16 @@ void ReflectorSocket::GetIncomingData(const SInt64& inMilliseconds)
         //get a packet off the free queue.
         ReflectorPacket* thePacket = this->GetPacket();
 
+        thePacket->ReserveBuffer(ReflectorPacket::kMaxReflectorPacketSize);
         thePacket->fPacketPtr.Len = 0;
         (void)this->RecvFrom(&theRemoteAddr, &theRemotePort, thePacket->fPacketPtr.Ptr,
                             ReflectorPacket::kMaxReflectorPacketSize, &thePacket->fPacketPtr.Len);
+        
+        // A datagram can be as long as the largest size class, but the ring only
+        // keeps it in a buffer as long as what arrived. The large buffer goes back
+        // to its pool for the next receive.
+        if (thePacket->fPacketPtr.Len > 0)
+            thePacket->FitBuffer();
                       
         if (this->ProcessPacket(inMilliseconds,thePacket,theRemoteAddr, theRemotePort))
             break;
@@ -2038,6 +2722,56 @@ void ReflectorSocket::GetIncomingData(const SInt64& inMilliseconds)
 
 
 
+void ReflectorSocket::GetIncomingDataBatch(const SInt64& inMilliseconds)
+{
+    // Same as the loop in GetIncomingData, but reads up to sBatchReceivePackets
+    // datagrams per recvmmsg call straight into packets from the free queue
+    ReflectorPacket*    thePackets[UDPSocket::kMaxBatchSize];
+    UDPRecvBuf          theBufs[UDPSocket::kMaxBatchSize];
+    UInt32              theBatchSize = ReflectorStream::sBatchReceivePackets;
+    
+    while (true)
+    {
+        for (UInt32 x = 0; x < theBatchSize; x++)
+        {
+            thePackets[x] = this->GetPacket();
+            thePackets[x]->ReserveBuffer(ReflectorPacket::kMaxReflectorPacketSize);
+            theBufs[x].fBuffer = thePackets[x]->fPacketPtr.Ptr;
+            theBufs[x].fBufLen = ReflectorPacket::kMaxReflectorPacketSize;
+        }
+        
+        UInt32 theNumReceived = 0;
+        (void)this->RecvMultiple(theBufs, theBatchSize, &theNumReceived);
+        
+        for (UInt32 y = 0; y < theNumReceived; y++)
+        {
+            thePackets[y]->fPacketPtr.Len = theBufs[y].fRecvLen;
+            if (thePackets[y]->fPacketPtr.Len == 0)
+            {
+                // an empty datagram, not the end of the data: ProcessPacket would stop on it
+                fFreeQueue.EnQueue(&thePackets[y]->fQueueElem);
+                continue;
+            }
+            
+            thePackets[y]->FitBuffer();
+            
+            // With kernel timestamps each packet carries its own arrival time
+            SInt64 theArrivalTime = (theBufs[y].fArrivalTime > 0) ? theBufs[y].fArrivalTime : inMilliseconds;
+            (void)this->ProcessPacket(theArrivalTime, thePackets[y], theBufs[y].fRemoteAddr, theBufs[y].fRemotePort);
+        }
+        
+        for (UInt32 z = theNumReceived; z < theBatchSize; z++)
+            fFreeQueue.EnQueue(&thePackets[z]->fQueueElem);
+            
+        // A short read means the socket is drained, so don't spend another call finding that out
+        if (theNumReceived < theBatchSize)
+        {
+            this->RequestEvent(EV_RE);
+            break;
+        }
+    }
+}
+
 ReflectorPacket* ReflectorSocket::GetPacket()
 {
     OSMutexLocker locker(this->GetDemuxer()->GetMutex());
@@ -49,6 +49,7 @@
 #include "SequenceNumberMap.h"
 
 #include "OSMutex.h"
+#include "OSMutexRW.h"
 #include "OSQueue.h"
 #include "OSRef.h"
 
@@ -56,12 +57,14 @@
 #include "ReflectorOutput.h"
 #include "atomic.h"
 
-/*fantasy add this*/
-#include "keyframecache.h"
-
 //This will add some printfs that are useful for checking the thinning
 #define REFLECTOR_THINNING_DEBUGGING 0 
-#define MAX_CACHE_SIZE  1024*1024*2
+
+//Compiles ReflectorFECGenerator::Test
+#define REFLECTORFECTESTING 0
+
+//Compiles ReflectorSender::Test
+#define REFLECTORSENDERTESTING 0
 
 //Define to use new potential workaround for NAT problems
 #define NAT_WORKAROUND 1
@@ -88,22 +91,76 @@ class ReflectorStream;
 class RTPSessionOutput;
 class ReflectorSession;
 
+// ReflectorPacketBuffer
+//
+// Reference counted storage for the bytes of one packet. Buffers come from one
+// OSBufferPool per size class, so a packet only ties up the smallest class that
+// holds it rather than kMaxReflectorPacketSize. The ReflectorPacket holds one
+// reference; anything that needs the data after the packet leaves the sender's
+// queue (a cache, a deferred send) takes another with Retain instead of copying.
+class ReflectorPacketBuffer
+{
+    public:
+    
+        enum
+        {
+            kNumSizeClasses = 5 //UInt32
+        };
+        
+        // Returns an unshared buffer that holds at least inLen bytes
+        static ReflectorPacketBuffer*   Get(UInt32 inLen);
+        static UInt32                   GetCapacityFor(UInt32 inLen);
+        
+        void    Retain()        { (void)atomic_add(&fRefCount, 1); }
+        void    Release();      // the last Release puts the buffer back in its pool
+        Bool16  IsShared()      { return fRefCount > 1; }
+        
+        char*   GetData()       { return (char*)(this + 1); }
+        UInt32  GetCapacity()   { return sSizeClasses[fSizeClass]; }
+        
+    private:
+    
+        unsigned int    fRefCount;
+        UInt32          fSizeClass;
+        
+        static UInt32   sSizeClasses[kNumSizeClasses];
+};
+
 class ReflectorPacket
 {
     public:
     
-        ReflectorPacket() : fQueueElem() { fQueueElem.SetEnclosingObject(this); this->Reset();}
+        enum
+        {
+            kMaxReflectorPacketSize = 2060    //jm 5/02 increased from 2048 by 12 bytes for test bytes appended to packets
+        };
+    
+        ReflectorPacket() : fQueueElem(), fBuffer(NULL), fFECBuffer(NULL) { fQueueElem.SetEnclosingObject(this); this->Reset();}
         void Reset()    { // make packet ready to reuse fQueueElem is always in use
                             fBucketsSeenThisPacket = 0; 
                             fTimeArrived = 0; 
                             //fQueueElem -- should be set to this
-                            fPacketPtr.Set(fPacketData, 0); 
+                            if ((fBuffer != NULL) && fBuffer->IsShared())
+                            {   // someone else still reads it, so let them have it
+                                fBuffer->Release();
+                                fBuffer = NULL;
+                            }
+                            fPacketPtr.Set(fBuffer != NULL ? fBuffer->GetData() : NULL, 0); 
                             fIsRTCP = false;
                             fStreamCountID = 0;
-                            fNeededByOutput = false; 
+                            if (fFECBuffer != NULL)
+                                fFECBuffer->Release();
+                            fFECBuffer = NULL;
+                            fFECPacketPtr.Set(NULL, 0);
                         }
 
-        ~ReflectorPacket() {}
+        ~ReflectorPacket() { if (fBuffer != NULL) fBuffer->Release(); if (fFECBuffer != NULL) fFECBuffer->Release(); }
+        
+        // Makes sure the packet has a buffer of its own of the size class for inLen bytes
+        void    ReserveBuffer(UInt32 inLen);
+        
+        // Moves the data into a buffer of its own size class if it has a bigger one
+        void    FitBuffer();
         
         void    SetPacketData(char *data, UInt32 len) 
 		{ 
@@ -112,11 +169,13 @@ class ReflectorPacket
 			if(len > kMaxReflectorPacketSize)
 				len = kMaxReflectorPacketSize;
 
+			this->ReserveBuffer(len);
 			if (len > 0) 
 				memcpy(this->fPacketPtr.Ptr,data,len); 
 			this->fPacketPtr.Len = len;
 		}
 
+        ReflectorPacketBuffer*  GetBuffer() { return fBuffer; }
         Bool16  IsRTCP() { return fIsRTCP; }
 inline  UInt32  GetPacketRTPTime();
 inline  UInt16  GetPacketRTPSeqNum();
@@ -125,23 +184,22 @@ inline  SInt64  GetPacketNTPTime();
  
  private: 
 
-        enum
-        {
-            kMaxReflectorPacketSize = 2060    //jm 5/02 increased from 2048 by 12 bytes for test bytes appended to packets
-        };
-
         UInt32      fBucketsSeenThisPacket;
         SInt64      fTimeArrived;
         OSQueueElem fQueueElem;
-        char        fPacketData[kMaxReflectorPacketSize];
+        ReflectorPacketBuffer*  fBuffer;    // NULL until data is put in the packet
         StrPtrLen   fPacketPtr;
         Bool16      fIsRTCP;
-        Bool16      fNeededByOutput; // is this packet still needed for output?
         UInt64      fStreamCountID;
+        
+        // The FEC packet that goes out right after this one, if this packet ends an FEC group
+        ReflectorPacketBuffer*  fFECBuffer;
+        StrPtrLen   fFECPacketPtr;
                 
         friend class ReflectorSender;
         friend class ReflectorSocket;
         friend class RTPSessionOutput;
+        friend class ReflectorFECGenerator;
         
    
 };
@@ -221,7 +279,7 @@ class ReflectorSocket : public IdleTask, public UDPSocket
         void    RemoveBroadcasterSession(QTSS_ClientSessionObject inSession){   OSMutexLocker locker(this->GetDemuxer()->GetMutex()); if (inSession == fBroadcasterClientSession) fBroadcasterClientSession = NULL; }
         void    AddSender(ReflectorSender* inSender);
         void    RemoveSender(ReflectorSender* inStreamElem);
-        Bool16  HasSender() { return (this->GetDemuxer()->GetHashTable()->GetNumEntries() > 0); }
+        Bool16  HasSender() { return (this->GetDemuxer()->GetNumTasks() > 0); }
         Bool16  ProcessPacket(const SInt64& inMilliseconds,ReflectorPacket* thePacket,UInt32 theRemoteAddr,UInt16 theRemotePort);
         ReflectorPacket*    GetPacket();
         virtual SInt64      Run();
@@ -230,6 +288,7 @@ class ReflectorSocket : public IdleTask, public UDPSocket
         
         //virtual SInt64        Run();
         void    GetIncomingData(const SInt64& inMilliseconds);
+        void    GetIncomingDataBatch(const SInt64& inMilliseconds);
         void    FilterInvalidSSRCs(ReflectorPacket* thePacket,Bool16 isRTCP);
 
         //Number of packets to allocate when the socket is first created
@@ -275,6 +334,128 @@ class ReflectorSocketPool : public UDPSocketPool
         
 };
 
+// Fixed capacity ring of the packets a ReflectorSender holds on to, indexed by a
+// sequence number that only ever goes up. There is a single producer, the task
+// that received the packet: it fills the slot at the head and then publishes the
+// new head, so it never waits for the threads reading the ring. (The producer still
+// runs with its socket's demuxer mutex held, but no reader takes that mutex.)
+// Readers keep their own position in the ring (see
+// ReflectorOutput::GetBookMarkedPacket). Only the sender moves the tail forward,
+// with the stream's bucket mutex held, which is also what every reader holds while
+// it looks at a packet. That happens as packets age out, and on the producer's task
+// when a new packet finds the ring full (see ReflectorSender::MakeRoomInRing).
+//
+// The head and tail are read and written with atomic_load64 and atomic_store64,
+// so that a reader on a 32 bit target can't see half of a new sequence number.
+class ReflectorPacketRing
+{
+    public:
+    
+        ReflectorPacketRing(UInt32 inCapacity); // rounded up to a power of 2
+        ~ReflectorPacketRing() { delete [] fSlots; }
+        
+        // Sequence numbers of the oldest packet in the ring, and of the next packet to be pushed
+        UInt64  GetTail()       { return atomic_load64(&fTail); }
+        UInt64  GetHead()       { return atomic_load64(&fHead); }
+        UInt32  GetLength()     { return (UInt32)(this->GetHead() - this->GetTail()); }
+        UInt32  GetCapacity()   { return fMask + 1; }
+        Bool16  IsFull()        { return this->GetLength() > fMask; }
+        
+        // Returns NULL if the packet with this sequence number isn't (or is no longer) in the ring
+        ReflectorPacket*    GetPacket(UInt64 inSeq)
+                            { return ((inSeq < this->GetTail()) || (inSeq >= this->GetHead())) ? NULL : fSlots[inSeq & fMask]; }
+        
+        // Producer only. Returns false if the ring is full, the packet is then left to the caller.
+        Bool16              Push(ReflectorPacket* inPacket);
+        
+        // Sender only. Takes the oldest packet out of the ring, NULL if it is empty.
+        ReflectorPacket*    PopTail();
+        
+        static const UInt64 kNoPacket = ~(UInt64)0;
+    
+    private:
+    
+        ReflectorPacket**   fSlots;
+        UInt32              fMask;
+        unsigned long long  fHead;  // the atomic helpers take unsigned long long, not UInt64
+        unsigned long long  fTail;
+};
+
+// ReflectorFECGenerator
+//
+// Builds RFC 5109 XOR parity packets (ULPFEC, a single level protecting whole
+// packets) for the RTP packets of one stream. The parity of a group of up to
+// kMaxGroupSize consecutive packets is computed once as the packets come in, and
+// hung off the last packet of the group (ReflectorPacket::fFECPacketPtr). The
+// sender writes it to the outputs that asked for FEC right after that packet, so
+// it costs the same however many outputs get it.
+//
+// FEC packets are an RTP stream of their own, like FlexFEC's: they have their own
+// SSRC and sequence numbers, and the payload type the outputs were told in SETUP.
+//
+// Only the socket task that receives the stream uses this, with the demuxer
+// mutex held.
+class ReflectorFECGenerator
+{
+    public:
+    
+        enum
+        {
+            kMaxGroupSize       = 16,   //UInt32, the mask in the FEC level header has 16 bits
+            kRTPHeaderSize      = 12,   //UInt32
+            kFECHeaderSize      = 10,   //UInt32
+            kFECLevelHeaderSize = 4     //UInt32
+        };
+        
+        ReflectorFECGenerator();
+        ~ReflectorFECGenerator() { delete [] fPayloadXor; }
+        
+        // Adds an RTP packet to the current group. When the packet completes the
+        // group, the FEC packet for the group is attached to it.
+        void    AddPacket(ReflectorPacket* ioPacket, UInt32 inGroupSize, UInt8 inPayloadType);
+        
+        // Drops the packets of the current group, the next packet starts a new one
+        void    Reset();
+        
+        // ioDst ^= inSrc over inLen bytes, 16 or 32 bytes at a time when the CPU can.
+        // The level is picked at startup. SetXorLevel is for benchmarks and tests, it
+        // clamps to what the CPU supports and must not be called while streaming.
+        enum
+        {
+            kXorScalar  = 0,
+            kXorSSE2    = 1,
+            kXorAVX2    = 2
+        };
+        static void     XorBytes(UInt8* ioDst, const UInt8* inSrc, UInt32 inLen);
+        static UInt32   GetXorLevel();
+        static void     SetXorLevel(UInt32 inLevel);
+        
+#if REFLECTORFECTESTING
+        // Rebuilds each packet of a group from the others and the FEC packet, at every XOR level
+        static Bool16   Test();
+#endif
+        
+    private:
+    
+        void    FinishGroup(ReflectorPacket* ioPacket, UInt8 inPayloadType);
+        
+        UInt8*  fPayloadXor;        // XOR of everything after the RTP header, kMaxReflectorPacketSize bytes
+        UInt32  fPayloadXorLen;     // longest payload in the group, the rest of fPayloadXor is 0
+        UInt8   fHeaderXor[8];      // XOR of the first 8 bytes of the RTP headers
+        UInt16  fLengthXor;         // XOR of the payload lengths
+        UInt16  fSNBase;            // sequence number of the first packet in the group
+        UInt16  fMask;              // bit 15 - n set when packet fSNBase + n is in the group
+        UInt32  fNumPackets;
+        
+        UInt32  fSSRC;
+        UInt16  fSeqNum;
+        
+        // FEC packets built by all the generators, published by ReflectorStream::InitializeStats
+        static unsigned int sNumFECPackets;
+        
+        friend class ReflectorStream;
+};
+
 class ReflectorSender : public UDPDemuxerTask
 {
     public:
@@ -300,34 +481,105 @@ class ReflectorSender : public UDPDemuxerTask
     //this is the old way of doing reflect packets. It is only here until the relay code can be cleaned up.
     void        ReflectRelayPackets(SInt64* ioWakeupTime, OSQueue* inFreeQueue);
     
-    OSQueueElem*    SendPacketsToOutput(ReflectorOutput* theOutput, OSQueueElem* currentPacket, SInt64 currentTime,  SInt64  bucketDelay, Bool16 firstPacket);
+    // Writes the packets from inSeq up to inEndSeq, returns the sequence number of the first one not written
+    UInt64          SendPacketsToOutput(ReflectorOutput* theOutput, UInt64 inSeq, UInt64 inEndSeq, SInt64 currentTime,  SInt64  bucketDelay, Bool16 firstPacket, SInt64* ioNextTimeToRun);
+    void            FlushBucket(UInt32 inBucketIndex);
+    
+    // Writes the packets up to inHead to every playing output in the bucket, then flushes it
+    void            ReflectBucket(UInt32 inBucketIndex, UInt64 inHead, UInt64 inFirstPacketForNewOutput, Bool16 inFromGOPCache, SInt64 inCurrentTime, SInt64* ioNextTimeToRun);
+    
+    // New outputs start at the cached GOP if there is one (outFromGOPCache is then true),
+    // otherwise at the start of the client buffer
+    UInt64          GetFirstPacketForNewOutput(Bool16* outFromGOPCache);
+    
+    // Once a stream has more than one bucket, its RTP sender hands the buckets
+    // out to sNumBucketTasks tasks, so the outputs of a busy stream get written
+    // on more than one thread. Returns when the task wants to run again.
+    SInt64          ReflectBuckets(UInt32 inTaskIndex);
+    void            StartBucketTasks();
+    
+    // Waits for the bucket tasks to be done with the sender and kills them. The
+    // stream calls this before it frees the output array.
+    void            StopBucketTasks();
+    
+    class BucketTask : public Task
+    {
+        public:
+            BucketTask(ReflectorSender* inSender, UInt32 inTaskIndex);
+            virtual ~BucketTask() {}
+            
+            virtual SInt64 Run();
+            
+            // The sender calls this before it goes away
+            void    Detach();
+        
+        private:
+            OSMutex             fMutex;     // held while the task is using the sender
+            ReflectorSender*    fSender;
+            UInt32              fTaskIndex;
+    };
 
     UInt32      GetOldestPacketRTPTime(Bool16 *foundPtr);          
     UInt16      GetFirstPacketRTPSeqNum(Bool16 *foundPtr);             
     Bool16      GetFirstPacketInfo(UInt16* outSeqNumPtr, UInt32* outRTPTimePtr, SInt64* outArrivalTimePtr);
 
-    OSQueueElem*GetClientBufferNextPacketTime(UInt32 inRTPTime);
+    ReflectorPacket*GetClientBufferNextPacketTime(UInt32 inRTPTime);
     Bool16      GetFirstRTPTimePacket(UInt16* outSeqNumPtr, UInt32* outRTPTimePtr, SInt64* outArrivalTimePtr);
 
     void        RemoveOldPackets(OSQueue* inFreeQueue);
-    OSQueueElem* GetClientBufferStartPacketOffset(SInt64 offsetMsec,Bool16 needKeyFrameFirstPacket=false); 
-    OSQueueElem* GetClientBufferStartPacket() { return this->GetClientBufferStartPacketOffset(0); };
+    
+    // The producer calls this when a new packet finds the ring full. Drops the oldest
+    // kRingFullDropFraction of the ring, outputs that were still waiting on those
+    // packets resume at the new tail, like they do after RemoveOldPackets.
+    void        MakeRoomInRing(OSQueue* inFreeQueue);
+    
+#if REFLECTORSENDERTESTING
+    // Pushes three rings' worth of packets into a sender and checks that the newest are all kept
+    static Bool16   Test();
+#endif
+    // Sequence number of the oldest packet inside the client buffer window, kNoPacket if there is none
+    UInt64      GetClientBufferStartPacketOffset(SInt64 offsetMsec,Bool16 needKeyFrameFirstPacket=false); 
+    UInt64      GetClientBufferStartPacket() { return this->GetClientBufferStartPacketOffset(0); };
 
     // ->geyijyn@20150427
     // 关键帧索引及丢帧方案
-    Bool16 NeedRelocateBookMark(OSQueueElem* currentElem);
-    OSQueueElem* GetNewestKeyFrameFirstPacket(OSQueueElem* currentElem,SInt64 offsetMsec);
+    Bool16 NeedRelocateBookMark(UInt64 inSeq);
+    UInt64 GetNewestKeyFrameFirstPacket(UInt64 inSeq,SInt64 offsetMsec);
     Bool16 IsKeyFrameFirstPacket(ReflectorPacket* thePacket);
     Bool16 IsFrameFirstPacket(ReflectorPacket* thePacket);
     Bool16 IsFrameLastPacket(ReflectorPacket* thePacket);
+    
+    // GOP cache. fKeyFrameStartPacketSeq is the first packet of the newest GOP that
+    // still fits in sGOPCacheMaxBytes, parameter sets sent ahead of the key frame included.
+    // Only the producer writes it, the bucket tasks read it without a lock, so it goes
+    // through atomic_load64 / atomic_store64 like the ring's head.
+    enum
+    {
+        kOtherPacket        = 0,    // what GetGOPPacketType returns
+        kParameterSetPacket = 1,    // SPS, PPS, VPS, or an AUD / SEI leading an access unit
+        kKeyFramePacket     = 2     // starts an IDR / IRAP picture
+    };
+    UInt32      GetGOPPacketType(ReflectorPacket* inPacket);
+    void        UpdateGOPCache(ReflectorPacket* inPacket, UInt64 inSeq);
 	
     ReflectorStream*    fStream;
     UInt32              fWriteFlag;
     
-    OSQueue         fPacketQueue;
-    OSQueueElem*    fFirstNewPacketInQueue;
-    OSQueueElem*    fFirstPacketInQueueForNewOutput;
-	OSQueueElem*	fKeyFrameStartPacketElementPointer;//最新关键帧指针
+    ReflectorPacketRing fPacketRing;
+    UInt64          fFirstNewPacketSeq;     // head of the ring at the end of the last ReflectRelayPackets
+	unsigned long long	fKeyFrameStartPacketSeq;//最新关键帧序号, kNoPacket if none
+    UInt32          fKeyFrameRTPTime;       // RTP time of that key frame
+    UInt64          fParamSetStartPacketSeq;// first of the parameter sets right before the next key frame, kNoPacket if none
+    UInt32          fGOPBytes;              // bytes in the ring from fKeyFrameStartPacketSeq on
+    
+    enum
+    {
+        kRTCPPacketRingSize     = 256,  //UInt32, sender reports only
+        kRingFullDropFraction   = 16    //UInt32, so the locks are taken once every so many packets, not for each
+    };
+    
+    BucketTask**    fBucketTasks;
+    UInt32          fNumBucketTasks;
     
     //these serve as an optimization, keeping track of when this
     //sender needs to run so it doesn't run unnecessarily
@@ -416,6 +668,7 @@ class ReflectorStream
 		UInt32                  GetBitRate()        { return fCurrentBitRate; }
         SourceInfo::StreamInfo* GetStreamInfo()     { return &fStreamInfo; }
         OSMutex*                GetMutex()          { return &fBucketMutex; }
+        OSMutexRW*              GetBucketTaskLock() { return &fBucketTaskLock; }
         void*                   GetStreamCookie()   { return this; }
         SInt16                  GetRTPChannel()     { return fRTPChannel; }
         SInt16                  GetRTCPChannel()    { return fRTCPChannel; }
@@ -451,6 +704,26 @@ inline  void                    UpdateBitRate(SInt64 currentTime);
 
 		void					SetMyReflectorSession(ReflectorSession* reflector)	{ fMyReflectorSession = reflector; }
 		ReflectorSession*		GetMyReflectorSession()	{ return fMyReflectorSession; }
+        
+        // Video codecs the GOP cache knows how to find key frames in
+        enum
+        {
+            kNoGOPCodec     = 0,
+            kH264GOPCodec   = 1,
+            kH265GOPCodec   = 2
+        };
+        UInt32                  GetGOPCodec()   { return fGOPCodec; }
+        
+        // GOP cache counters, published as attributes of the server object
+        static void             InitializeStats(QTSS_ServerObject inServer);
+        
+        // Forward error correction. FEC packets are only built while some output wants
+        // them: call AddFECOutput once an output has FEC turned on for this stream,
+        // RemoveOutput takes it off again. A group size of 0 turns FEC off.
+        static UInt32           GetFECGroupSize()                       { return sFECGroupSize; }
+        static UInt8            GetFECPayloadType()                     { return (UInt8)sFECPayloadType; }
+        void                    AddFECOutput()                          { (void)atomic_add(&fNumFECOutputs, 1); }
+        Bool16                  HasFECOutputs()                         { return fNumFECOutputs > 0; }
 
     private:
     
@@ -490,6 +763,10 @@ inline  void                    UpdateBitRate(SInt64 currentTime);
         //Bucket array can't be modified while we are sending packets.
         OSMutex     fBucketMutex;
         
+        // Read locked by the bucket tasks of the senders while they write to the outputs,
+        // write locked by whatever changes the output array or moves a packet ring's tail.
+        OSMutexRW   fBucketTaskLock;
+        
         // RTCP RR information
         
         char        fReceiverReportBuffer[kReceiverReportSize + kAppSize +
@@ -516,11 +793,15 @@ inline  void                    UpdateBitRate(SInt64 currentTime);
         
         Bool16              fEnableBuffer;
         UInt32              fEyeCount;
+        UInt32              fGOPCodec;
         
         UInt32              fFirst_RTCP_RTP_Time;
         SInt64              fFirst_RTCP_Arrival_Time;
 
 		ReflectorSession*	fMyReflectorSession;
+        
+        ReflectorFECGenerator   fFECGenerator;
+        unsigned int            fNumFECOutputs; // unsigned int because we need to atomic_add
     
         static UInt32       sBucketSize;
         static UInt32       sMaxPacketAgeMSec;
@@ -531,14 +812,26 @@ inline  void                    UpdateBitRate(SInt64 currentTime);
         static UInt32       sBucketDelayInMsec;
         static Bool16       sUsePacketReceiveTime;
         static UInt32       sFirstPacketOffsetMsec;
+        static UInt32       sBatchReceivePackets;   // datagrams per recvmmsg, 0 or 1 reads them one at a time
+        static Bool16       sUseKernelReceiveTime;  // stamp fTimeArrived with SO_TIMESTAMPNS
+        static UInt32       sPacketRingSize;        // packets each RTP sender can hold on to
+        static UInt32       sNumBucketTasks;        // tasks a stream's buckets are spread over, 0 or 1 for none
+        static UInt32       sGOPCacheMaxBytes;      // largest GOP kept for new outputs, 0 turns the GOP cache off
+        static UInt32       sFECGroupSize;          // RTP packets protected by each FEC packet, 0 turns FEC off
+        static UInt32       sFECPayloadType;        // payload type of the FEC packets
+        
+        // new video outputs that started at a cached GOP, and those that had to wait for one
+        static unsigned int sGOPCacheHits;
+        static unsigned int sGOPCacheMisses;
+        // time from the first look at a new video output until its first key frame went out
+        static unsigned int sNumFirstFrames;
+        static unsigned int sTotalTimeToFirstFrameMSec;
 
 		static UInt32       sRelocatePacketAgeMSec;	
         
         friend class ReflectorSocket;
+        friend class ReflectorSocketPool;
         friend class ReflectorSender;
-
-public:
-		CKeyFrameCache*		pkeyFrameCache;
 };
 
 
@@ -62,7 +62,7 @@ class RelayOutput : public ReflectorOutput
         OS_Error BindSocket();
         
         // Writes the packet directly to a UDP socket
-        virtual QTSS_Error  WritePacket(StrPtrLen* inPacket, void* inStreamCookie, UInt32 inFlags, SInt64 packetLatenessInMSec,  SInt64* timeToSendThisPacketAgain, UInt64* packetIDPtr, SInt64* arrivalTime, Bool16 firstPacket);
+        virtual QTSS_Error  WritePacket(StrPtrLen* inPacket, void* inStreamCookie, UInt32 inFlags, SInt64 packetLatenessInMSec,  SInt64* timeToSendThisPacketAgain, UInt64* packetIDPtr, SInt64* arrivalTime, Bool16 firstPacket, ReflectorPacketBuffer* inBuffer);
         
         virtual Bool16              IsUDP() { return true; }
         
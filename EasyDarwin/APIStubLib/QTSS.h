@@ -104,7 +104,8 @@ enum
     qtssWriteFlagsIsRTP             = 0x00000001,
     qtssWriteFlagsIsRTCP            = 0x00000002,   
     qtssWriteFlagsWriteBurstBegin   = 0x00000004,
-    qtssWriteFlagsBufferData        = 0x00000008
+    qtssWriteFlagsBufferData        = 0x00000008,
+    qtssWriteFlagsSharedPacket      = 0x00000010    // the buffer is a QTSS_SharedPacketStruct
 };
 typedef UInt32 QTSS_WriteFlags;
 
@@ -744,7 +745,10 @@ enum
     qtssSvrRTSPServerComment        = 40,   //read      //char array //RTSP comment for the server header    
     qtssSvrNumThinned               = 41,   //read      //SInt32    //Number of thinned sessions
     qtssSvrNumThreads               = 42,   //read		//UInt32    //Number of task threads // see also qtssPrefsRunNumThreads
-    qtssSvrNumParams                = 43
+    qtssSvrTotalUDPBatches          = 43,   //read      //UInt64    //Number of batched UDP sends (one sendmmsg each) since the server started
+    qtssSvrTotalUDPBatchedPackets   = 44,   //read      //UInt64    //Number of RTP packets sent in those batches
+    qtssSvrAvgUDPBatchSize          = 45,   //read      //Float32   //Average number of packets per batched UDP send over the last stats interval
+    qtssSvrNumParams                = 46
 };
 typedef UInt32 QTSS_ServerAttributes;
 
@@ -863,8 +867,22 @@ enum
     qtssPrefsPlayersReqDisableThinning 		= 89,   // "player_requires_disable_thinning" //Char array //name of player to set the target time for
 	
 	easyPrefsHTTPServicePort				= 90,	// "http_service_port"
-
-    qtssPrefsNumParams                      = 91
+    easyPrefsNumEventThreads                = 91,   // "run_num_event_threads" //UInt32 // number of event threads, each running its own epoll loop; 0 means one per processor
+    easyPrefsTaskWorkStealing               = 92,   // "enable_task_work_stealing" //Bool16 // idle task threads steal work from busy ones through lock-free per-thread run queues
+    easyPrefsRTSPTCPCoalesceBufferSize      = 93,   // "rtsp_tcp_coalesce_buffer_size" //UInt32 // bytes of interleaved RTP an RTSP session may coalesce into one write, 0 turns coalescing off
+    easyPrefsRTSPTCPCoalesceFlushMsec       = 94,   // "rtsp_tcp_coalesce_flush_msec" //UInt32 // longest an interleaved RTP packet may wait in the coalesce buffer
+    easyPrefsRTSPTCPZeroCopy                = 95,   // "enable_rtsp_tcp_zerocopy" //Bool16 // send full interleaved coalesce buffers with MSG_ZEROCOPY
+    easyPrefsRTSPListenersPerPort           = 96,   // "rtsp_listeners_per_port" //UInt32 // SO_REUSEPORT listener sockets opened on each RTSP port, 0 means one per event thread. Read at startup. Leave at 1 unless a single accept thread is the bottleneck on a multi-core host; on one CPU the extra listeners only add latency
+    easyPrefsRTCPNackEnabled                = 97,   // "enable_rtcp_nack" //Bool16 // retransmit RTP over UDP packets that clients report lost with RFC 4585 generic NACKs
+    easyPrefsRTCPNackRepairPercent          = 98,   // "rtcp_nack_repair_percent" //UInt32 // NACK repairs a stream may send, as a percentage of the bytes it sends
+    easyPrefsRTPPacingEnabled               = 99,   // "enable_rtp_pacing" //Bool16 // spread RTP over UDP packets out with a token bucket per session instead of sending them in bursts
+    easyPrefsRTPPacingRateMultiplier        = 100,  // "rtp_pacing_rate_multiplier" //Float32 // pacing rate of a session, as a multiple of its current bit rate
+    easyPrefsRTPPacingMinRateKBits          = 101,  // "rtp_pacing_min_rate_kbits" //UInt32 // lowest pacing rate of a session
+    easyPrefsRTPPacingBurstBytes            = 102,  // "rtp_pacing_burst_bytes" //UInt32 // bytes a session may send back to back when it has been idle
+    easyPrefsRTPPacingMaxQueuePackets       = 103,  // "rtp_pacing_max_queue_packets" //UInt32 // packets a session may have waiting in the pacer before writes get flow controlled
+    easyPrefsRTPPacingInterfaceRateKBits    = 104,  // "rtp_pacing_interface_rate_kbits" //UInt32 // pacing rate of all sessions sending from one local address together, 0 means no limit
+
+    qtssPrefsNumParams                      = 105
 };
 
 typedef UInt32 QTSS_PrefsAttributes;
@@ -1283,6 +1301,18 @@ typedef struct
     QTSS_TimeVal                    suggestedWakeupTime;
 } QTSS_PacketStruct;
 
+// With qtssWriteFlagsSharedPacket, the packet data lives in a reference counted buffer
+// of the caller's. The stream may keep the data past the QTSS_Write (to answer NACKs)
+// by calling retainProc on bufferRef, and calls releaseProc when it is done with it.
+typedef void (*QTSS_PacketBufferProcPtr)(void* inBufferRef);
+typedef struct
+{
+    QTSS_PacketStruct               packet;     // must come first
+    void*                           bufferRef;
+    QTSS_PacketBufferProcPtr        retainProc;
+    QTSS_PacketBufferProcPtr        releaseProc;
+} QTSS_SharedPacketStruct;
+
 
 /********************************************************************/
 // ENTRYPOINTS & FUNCTION TYPEDEFS
@@ -1688,6 +1718,48 @@ QTSS_Error  QTSS_Flush(QTSS_StreamRef inRef);
 //              QTSS_BadArgument
 QTSS_Error  QTSS_Read(QTSS_StreamRef inRef, void* ioBuffer, UInt32 inBufLen, UInt32* outLengthRead);
 
+/********************************************************************/
+//  QTSS_ReadBody
+//
+//  Reads the body of the current RTSP request off the stream, as far as it has
+//  arrived, and hands it to inChunkFunction one chunk at a time. The chunks are
+//  only valid for the duration of the call. Body data that arrived along with the
+//  request headers is passed without being copied. Call this again on a
+//  QTSS_ReadableEvent until it returns QTSS_NoErr.
+//
+//  If inChunkFunction is NULL, the body is read and thrown away. If inChunkFunction
+//  returns anything other than QTSS_NoErr, reading stops and that error is returned.
+//
+//  Arguments   inRef:              The stream to read from (a QTSS_RTSPRequestObject).
+//              inChunkFunction:    Called with each chunk of the body.
+//              inUserData:         Passed to inChunkFunction.
+//
+//  Returns:    QTSS_NoErr:         The whole body has been read. Also returned right away
+//                                  if the request has no body, or no Content-Length to
+//                                  tell how long the body is.
+//              QTSS_WouldBlock:    The rest of the body hasn't arrived yet.
+//              QTSS_NotConnected
+//              QTSS_Unimplemented: inRef isn't an RTSP request stream.
+//              QTSS_BadArgument
+typedef QTSS_Error (*QTSS_BodyChunkFunctionPtr)(void* inUserData, char* inChunk, UInt32 inChunkLen);
+QTSS_Error  QTSS_ReadBody(QTSS_StreamRef inRef, QTSS_BodyChunkFunctionPtr inChunkFunction, void* inUserData);
+
+/********************************************************************/
+//  QTSS_AllocRequestMemory
+//
+//  Allocates memory that is owned by the RTSP request. It stays valid across
+//  repeated calls for the same request (e.g. while waiting for the request body),
+//  and is freed by the server all at once after the response has been sent.
+//  Don't delete it, and don't keep pointers to it past the request.
+//
+//  Arguments   inRequest:  The request the memory belongs to.
+//              inSize:     Number of bytes wanted.
+//              outBuffer:  On output, the memory.
+//
+//  Returns:    QTSS_NoErr
+//              QTSS_BadArgument
+QTSS_Error  QTSS_AllocRequestMemory(QTSS_RTSPRequestObject inRequest, UInt32 inSize, void** outBuffer);
+
 /********************************************************************/
 //  QTSS_Seek
 //
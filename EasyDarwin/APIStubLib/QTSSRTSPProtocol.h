@@ -145,9 +145,11 @@ enum
 	qtssXInitPostDecBufPeriodHeader      = 60,
 	qtss3GPPVideoPostDecBufSizeHeader    = 61,
 	
+	// forward error correction for RTP over UDP
+	qtssXFECHeader              = 62,
 	
-	qtssNumHeaders				= 62,
-	qtssIllegalHeader 			= 62
+	qtssNumHeaders				= 63,
+	qtssIllegalHeader 			= 63
     
 };
 typedef UInt32 QTSS_RTSPHeader;
@@ -225,6 +225,16 @@ QTSS_Error  QTSS_Read(QTSS_StreamRef inRef, void* ioBuffer, UInt32 inBufLen, UIn
     return (sCallbacks->addr [kReadCallback]) (inRef, ioBuffer, inBufLen, outLengthRead);       
 }
 
+QTSS_Error  QTSS_ReadBody(QTSS_StreamRef inRef, QTSS_BodyChunkFunctionPtr inChunkFunction, void* inUserData)
+{
+    return (sCallbacks->addr [kReadBodyCallback]) (inRef, inChunkFunction, inUserData);
+}
+
+QTSS_Error  QTSS_AllocRequestMemory(QTSS_RTSPRequestObject inRequest, UInt32 inSize, void** outBuffer)
+{
+    return (sCallbacks->addr [kAllocRequestMemoryCallback]) (inRequest, inSize, outBuffer);
+}
+
 QTSS_Error  QTSS_Seek(QTSS_StreamRef inRef, UInt64 inNewPosition)
 {
     return (sCallbacks->addr [kSeekCallback]) (inRef, inNewPosition);
@@ -123,7 +123,9 @@ enum
 	kStopHLSessionCallback			= 62,
 	kGetHLSessionsCallback			= 63,
 	kGetRTSPPushSessionsCallback		= 64,
-	kLastCallback                   = 65
+	kReadBodyCallback               = 65,
+	kAllocRequestMemoryCallback     = 66,
+	kLastCallback                   = 67
 };
 
 typedef struct {
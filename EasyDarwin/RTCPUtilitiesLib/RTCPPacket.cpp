@@ -162,6 +162,30 @@ Bool16 RTCPSenderReportPacket::ParseReport(UInt8* inPacketBuffer, UInt32 inPacke
     return true;
 }
 
+Bool16 RTCPGenericNackPacket::ParseNackPacket(UInt8* inPacketBuffer, UInt32 inPacketLength)
+{
+    if (inPacketLength < kFCIOffset + kFCISizeInBytes)
+        return false;
+    if (!this->ParsePacket(inPacketBuffer, inPacketLength))
+        return false;
+    if ((this->GetPacketType() != kRTPFeedbackPacketType) || (this->GetReportCount() != kGenericNackFormat))
+        return false;
+
+    //the advertised length must cover the media source SSRC and at least one FCI
+    if ((UInt32)(this->GetPacketLength() * 4 + kRTCPHeaderSizeInBytes) < kFCIOffset + kFCISizeInBytes)
+        return false;
+
+    return true;
+}
+
+void RTCPGenericNackPacket::Dump()//Override
+{
+    RTCPPacket::Dump();
+    qtss_printf(" media_ssrc=%"_U32BITARG_"\n", this->GetMediaSourceSSRC());
+    for (UInt32 i = 0; i < this->GetNumFCIs(); i++)
+        qtss_printf("              RTCP NACK[%"_U32BITARG_"] PID=%u BLP=0x%04x\n", i, this->GetPID(i), this->GetBLP(i));
+}
+
 
 void RTCPPacket::Dump()
 {  
@@ -54,7 +54,8 @@ public:
     {
         kReceiverPacketType     = 201,  //UInt32
         kSDESPacketType         = 202,  //UInt32
-        kAPPPacketType          = 204   //UInt32
+        kAPPPacketType          = 204,  //UInt32
+        kRTPFeedbackPacketType  = 205   //UInt32
     };
     
 
@@ -204,6 +205,39 @@ protected:
     };
 };
 
+// RFC 4585 Generic NACK. The report count field holds the feedback message type (FMT),
+// and the FCI is a list of PID/BLP pairs, each naming a lost packet plus a bitmask of
+// lost packets among the 16 that follow it.
+class RTCPGenericNackPacket : public RTCPPacket
+{
+public:
+
+    enum
+    {
+        kGenericNackFormat = 1  //UInt32
+    };
+
+    RTCPGenericNackPacket() : RTCPPacket() {}
+
+    //Call this before any accessor method. Returns true if successful, false otherwise
+    Bool16 ParseNackPacket(UInt8* inPacketBuffer, UInt32 inPacketLength);
+
+    UInt32 GetMediaSourceSSRC()     { return ntohl(*(UInt32*)&fReceiverPacketBuffer[kMediaSourceSSRCOffset]); }
+    UInt32 GetNumFCIs()             { return (this->GetPacketLength() * 4 + kRTCPHeaderSizeInBytes - kFCIOffset) / kFCISizeInBytes; }
+    UInt16 GetPID(UInt32 inIndex)   { return ntohs(*(UInt16*)&fReceiverPacketBuffer[kFCIOffset + (inIndex * kFCISizeInBytes)]); }
+    UInt16 GetBLP(UInt32 inIndex)   { return ntohs(*(UInt16*)&fReceiverPacketBuffer[kFCIOffset + (inIndex * kFCISizeInBytes) + 2]); }
+
+    virtual void Dump(); //Override
+
+private:
+
+    enum
+    {
+        kMediaSourceSSRCOffset = 8,
+        kFCIOffset = 12,
+        kFCISizeInBytes = 4
+    };
+};
 
 /**************  RTCPPacket  inlines **************/
 inline int RTCPPacket::GetVersion()
@@ -328,6 +362,20 @@ Receiver Report
 +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
 
 
+Generic NACK (RFC 4585)
+-----------------------
+ 0                   1                   2                   3
+ 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
++-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+|V=2|P| FMT=1   |  PT=RTPFB=205 |          length               |
++-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+|                  SSRC of packet sender                        |
++-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+|                  SSRC of media source                         |
++-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+|            PID                |             BLP               | FCI
++-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+:                               ...                             :
 
 */
 
@@ -83,7 +83,8 @@ HTTPSession::HTTPSession( )
   fRequest(NULL),
   fReadMutex(),
   fCurrentModule(0),
-  fState(kReadingFirstRequest)
+  fState(kReadingFirstRequest),
+  fCloseAfterResponse(false)
 {
     this->SetTaskName("HTTPSession");
     
@@ -356,6 +357,10 @@ SInt64 HTTPSession::Run()
 				//һĶȡӦȴһ籨ģ
                 this->CleanupRequest();
                 fState = kReadingRequest;
+
+                // The response told the client this connection ends here
+                if (fCloseAfterResponse)
+                    fLiveSession = false;
             }
         }
     } 
@@ -561,6 +566,27 @@ void HTTPSession::CleanupRequest()
     this->SetRequestBodyLength(-1);
 }
 
+/*
+    Persistent connections: an HTTP/1.1 client keeps the connection unless it sends
+    Connection: close, an HTTP/1.0 client only if it sends Connection: keep-alive.
+    Requests the client pipelined are already in fInputStream and are handled before
+    Run waits on the socket again. A connection that isn't kept gets Connection: close
+    in the response, and Run ends the session once the response is out.
+*/
+void HTTPSession::AppendConnectionHeader(HTTPRequest* inResponse)
+{
+    if ((fRequest != NULL) && fRequest->IsRequestKeepAlive())
+    {
+        // An HTTP/1.0 client only keeps the connection if the response agrees
+        if (fRequest->GetVersion() == http10Version)
+            inResponse->AppendConnectionKeepAliveHeader();
+        return;
+    }
+
+    inResponse->AppendConnectionCloseHeader();
+    fCloseAfterResponse = true;
+}
+
 Bool16 HTTPSession::OverMaxConnections(UInt32 buffer)
 {
     QTSServerInterface* theServer = QTSServerInterface::GetServer();
@@ -670,8 +696,8 @@ QTSS_Error HTTPSession::ExecNetMsgEasyHLSModuleReq(char* queryString, char* json
 	if (msgJson.Len)
 		httpAck.AppendContentLengthHeader(msgJson.Len);
 
-	//ӦɺϿ
-	httpAck.AppendConnectionCloseHeader();
+	//ǳ־ӦɺϿ
+	this->AppendConnectionHeader(&httpAck);
 
 	//Push MSG to OutputBuffer
 	char respHeader[2048] = { 0 };
@@ -702,8 +728,8 @@ QTSS_Error HTTPSession::ExecNetMsgGetHlsSessionsReq(char* queryString, char* jso
 		if (msgJson.Len)
 			httpAck.AppendContentLengthHeader(msgJson.Len);
 
-		//ӦɺϿ
-		httpAck.AppendConnectionCloseHeader();
+		//ǳ־ӦɺϿ
+		this->AppendConnectionHeader(&httpAck);
 
 		//Push MSG to OutputBuffer
 		char respHeader[2048] = { 0 };
@@ -738,8 +764,8 @@ QTSS_Error HTTPSession::ExecNetMsgGetRTSPPushSessionsReq(char* queryString, char
 		if (msgJson.Len)
 			httpAck.AppendContentLengthHeader(msgJson.Len);
 
-		// ӦɺϿ
-		httpAck.AppendConnectionCloseHeader();
+		// ǳ־ӦɺϿ
+		this->AppendConnectionHeader(&httpAck);
 
 		// HTTPӦBody
 		char respHeader[2048] = { 0 };
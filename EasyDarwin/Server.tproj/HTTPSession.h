@@ -42,6 +42,9 @@ class HTTPSession : public HTTPSessionInterface
         // Does request prep & request cleanup, respectively
         QTSS_Error SetupRequest();
         void CleanupRequest();
+
+        // Adds Connection: close to a response unless the request asked to keep the connection
+        void AppendConnectionHeader(HTTPRequest* inResponse);
 		
 		QTSS_Error ExecNetMsgEasyHLSModuleReq(char* queryString, char* json);
 		QTSS_Error ExecNetMsgGetHlsSessionsReq(char* queryString, char* json);
@@ -69,6 +72,7 @@ class HTTPSession : public HTTPSessionInterface
         
         UInt32 fCurrentModule;
         UInt32 fState;
+        Bool16 fCloseAfterResponse; // the response says Connection: close
 
         QTSS_RoleParams     fRoleParams;//module param blocks for roles.
         QTSS_ModuleState    fModuleState;
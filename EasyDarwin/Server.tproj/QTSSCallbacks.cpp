@@ -415,6 +415,29 @@ QTSS_Error  QTSSCallbacks::QTSS_Read(QTSS_StreamRef inStream, void* ioBuffer, UI
         return theErr;
 }
 
+QTSS_Error  QTSSCallbacks::QTSS_ReadBody(QTSS_StreamRef inStream, QTSS_BodyChunkFunctionPtr inChunkFunction, void* inUserData)
+{
+    if (inStream == NULL)
+        return QTSS_BadArgument;
+    QTSS_Error theErr = ((QTSSStream*)inStream)->ReadBody(inChunkFunction, inUserData);
+
+    // Same error mapping as QTSS_Read. Errors returned by the chunk function are passed through.
+    if (theErr == EAGAIN)
+        return QTSS_WouldBlock;
+    else if (theErr > 0)
+        return QTSS_NotConnected;
+    else
+        return theErr;
+}
+
+QTSS_Error  QTSSCallbacks::QTSS_AllocRequestMemory(QTSS_RTSPRequestObject inRequest, UInt32 inSize, void** outBuffer)
+{
+    if ((inRequest == NULL) || (outBuffer == NULL))
+        return QTSS_BadArgument;
+    *outBuffer = ((RTSPRequestInterface*)inRequest)->GetSession()->GetRequestArena()->Alloc(inSize);
+    return QTSS_NoErr;
+}
+
 QTSS_Error  QTSSCallbacks::QTSS_Seek(QTSS_StreamRef inStream, UInt64 inNewPosition)
 {
     if (inStream == NULL)
@@ -107,6 +107,8 @@ class QTSSCallbacks
         static QTSS_Error   QTSS_WriteV(QTSS_StreamRef inStream, iovec* inVec, UInt32 inNumVectors, UInt32 inTotalLength, UInt32* outLenWritten);
         static QTSS_Error   QTSS_Flush(QTSS_StreamRef inStream);
         static QTSS_Error   QTSS_Read(QTSS_StreamRef inRef, void* ioBuffer, UInt32 inBufLen, UInt32* outLengthRead);
+        static QTSS_Error   QTSS_ReadBody(QTSS_StreamRef inRef, QTSS_BodyChunkFunctionPtr inChunkFunction, void* inUserData);
+        static QTSS_Error   QTSS_AllocRequestMemory(QTSS_RTSPRequestObject inRequest, UInt32 inSize, void** outBuffer);
         static QTSS_Error   QTSS_Seek(QTSS_StreamRef inRef, UInt64 inNewPosition);
         static QTSS_Error   QTSS_Advise(QTSS_StreamRef inRef, UInt64 inPosition, UInt32 inAdviseSize);
 
@@ -42,18 +42,27 @@
 
 #include <errno.h>
 
+#if __DICTIONARY_TESTING__
+#include "QTSSCallbacks.h"
+#include "OS.h"
+#endif
+
 
 
-QTSSDictionary::QTSSDictionary(QTSSDictionaryMap* inMap, OSMutex* inMutex) 
+QTSSDictionary::QTSSDictionary(QTSSDictionaryMap* inMap, OSMutex* inMutex, OSArena* inArena) 
 :   fAttributes(NULL), fInstanceAttrs(NULL), fInstanceArraySize(0),
-    fMap(inMap), fInstanceMap(NULL), fMutexP(inMutex), fMyMutex(false), fLocked(false)
+    fMap(inMap), fInstanceMap(NULL), fMutexP(inMutex), fMyMutex(false), fLocked(false),
+    fArena(inArena)
 {
     if (fMap != NULL)
-        fAttributes = NEW DictValueElement[inMap->GetNumAttrs()];
+        fAttributes = this->NewValueArray(inMap->GetNumAttrs());
 	if (fMutexP == NULL)
 	{
 		fMyMutex = true;
-		fMutexP = NEW OSMutex();
+		if (fArena != NULL)
+			fMutexP = new (fArena->Alloc(sizeof(OSMutex))) OSMutex();
+		else
+			fMutexP = NEW OSMutex();
 	}
 }
 
@@ -61,13 +70,44 @@ QTSSDictionary::~QTSSDictionary()
 {
     if (fMap != NULL)
         this->DeleteAttributeData(fAttributes, fMap->GetNumAttrs(), fMap);
-    if (fAttributes != NULL)
-        delete [] fAttributes;
     this->DeleteAttributeData(fInstanceAttrs, fInstanceArraySize, fInstanceMap);
-    delete [] fInstanceAttrs;
     delete fInstanceMap;
+    if (fArena == NULL)
+    {
+        delete [] fAttributes;
+        delete [] fInstanceAttrs;
+    }
 	if (fMyMutex)
-		delete fMutexP;
+	{
+		if (fArena != NULL)
+			fMutexP->~OSMutex();
+		else
+			delete fMutexP;
+	}
+}
+
+char* QTSSDictionary::AllocBuffer(UInt32 inLen)
+{
+    if (fArena != NULL)
+        return (char*)fArena->Alloc(inLen);
+    return NEW char[inLen];
+}
+
+void QTSSDictionary::FreeBuffer(char* inBuffer)
+{
+    if (fArena == NULL)
+        delete [] inBuffer;
+}
+
+QTSSDictionary::DictValueElement* QTSSDictionary::NewValueArray(UInt32 inNumValues)
+{
+    if (fArena == NULL)
+        return NEW DictValueElement[inNumValues];
+
+    DictValueElement* theArray = (DictValueElement*)fArena->Alloc(sizeof(DictValueElement) * inNumValues);
+    for (UInt32 x = 0; x < inNumValues; x++)
+        (void)new (&theArray[x]) DictValueElement();
+    return theArray;
 }
 
 QTSSDictionary* QTSSDictionary::CreateNewDictionary(QTSSDictionaryMap* inMap, OSMutex* inMutex)
@@ -79,6 +119,19 @@ QTSS_Error QTSSDictionary::GetValuePtr(QTSS_AttributeID inAttrID, UInt32 inIndex
                                             void** outValueBuffer, UInt32* outValueLen,
                                             Bool16 isInternal)
 {
+    // Most gets are for the first value of a static attribute that is preemptive safe
+    // and has no param retrieval function. None of the checks below can fail for those,
+    // so just hand back the value out of the attribute array.
+    if ((inIndex == 0) && (inAttrID >= 0) && (fMap != NULL) && ((UInt32)inAttrID < fMap->fNextAvailableID)
+        && fMap->fDirectReadArray[inAttrID] && (fAttributes[inAttrID].fNumAttributes <= 1))
+    {
+        *outValueLen = fAttributes[inAttrID].fAttributeData.Len;
+        if (*outValueLen == 0)
+            return QTSS_ValueNotFound;
+        *outValueBuffer = fAttributes[inAttrID].fAttributeData.Ptr;
+        return QTSS_NoErr;
+    }
+
     // Check first to see if this is a static attribute or an instance attribute
     QTSSDictionaryMap* theMap = fMap;
     DictValueElement* theAttrs = fAttributes;
@@ -328,15 +381,15 @@ QTSS_Error QTSSDictionary::SetValue(QTSS_AttributeID inAttrID, UInt32 inIndex,
                 // instead of directly using the old storage as the old storage didn't 
                 // have its string null terminated
                         UInt32 tempStringLen = theAttrs[theMapIndex].fAttributeData.Len;
-                        char* temp = NEW char[tempStringLen + 1];
+                        char* temp = this->AllocBuffer(tempStringLen + 1);
                         ::memcpy(temp, theAttrs[theMapIndex].fAttributeData.Ptr, tempStringLen);
                         temp[tempStringLen] = '\0';
-                        delete [] theAttrs[theMapIndex].fAttributeData.Ptr;
+                        this->FreeBuffer(theAttrs[theMapIndex].fAttributeData.Ptr);
                         
             //char* temp = theAttrs[theMapIndex].fAttributeData.Ptr;
             
             theAttrs[theMapIndex].fAllocatedLen = 16 * sizeof(char*);
-            theAttrs[theMapIndex].fAttributeData.Ptr = NEW char[theAttrs[theMapIndex].fAllocatedLen];
+            theAttrs[theMapIndex].fAttributeData.Ptr = this->AllocBuffer(theAttrs[theMapIndex].fAllocatedLen);
             theAttrs[theMapIndex].fAttributeData.Len = sizeof(char*);
             // store off original string as first value in array
             *(char**)theAttrs[theMapIndex].fAttributeData.Ptr = temp;
@@ -367,7 +420,7 @@ QTSS_Error QTSSDictionary::SetValue(QTSS_AttributeID inAttrID, UInt32 inIndex,
             theLen = attrLen;   // most attributes are single valued, so allocate just enough space
         else
             theLen = 2 * (attrLen * (inIndex + 1));// Allocate twice as much as we need
-        char* theNewBuffer = NEW char[theLen];
+        char* theNewBuffer = this->AllocBuffer(theLen);
         if (inIndex > 0)
         {
             // Copy out the old attribute data
@@ -378,7 +431,7 @@ QTSS_Error QTSSDictionary::SetValue(QTSS_AttributeID inAttrID, UInt32 inIndex,
         // Now get rid of the old stuff. Delete the buffer
         // if it was already allocated internally
         if (theAttrs[theMapIndex].fAllocatedInternally)
-            delete [] theAttrs[theMapIndex].fAttributeData.Ptr;
+            this->FreeBuffer(theAttrs[theMapIndex].fAttributeData.Ptr);
         
         // Finally, update this attribute structure with all the new values.
         theAttrs[theMapIndex].fAttributeData.Ptr = theNewBuffer;
@@ -400,7 +453,7 @@ QTSS_Error QTSSDictionary::SetValue(QTSS_AttributeID inAttrID, UInt32 inIndex,
     {
             //attributeBufferPtr = NEW char[inLen];
             // allocating one extra so that we can null terminate the string
-            attributeBufferPtr = NEW char[inLen + 1];
+            attributeBufferPtr = this->AllocBuffer(inLen + 1);
                 char* tempBuffer = (char*)attributeBufferPtr;
                 tempBuffer[inLen] = '\0';
                 
@@ -408,7 +461,7 @@ QTSS_Error QTSSDictionary::SetValue(QTSS_AttributeID inAttrID, UInt32 inIndex,
         // The offset should be (attrLen * inIndex) and not (inLen * inIndex) 
         char** valuePtr = (char**)(theAttrs[theMapIndex].fAttributeData.Ptr + (attrLen * inIndex));
         if (inIndex < numValues)    // we're replacing an existing string
-            delete [] *valuePtr;
+            this->FreeBuffer(*valuePtr);
         *valuePtr = (char*)attributeBufferPtr;
     }
     
@@ -523,7 +576,7 @@ QTSS_Error QTSSDictionary::RemoveValue(QTSS_AttributeID inAttrID, UInt32 inIndex
     {
         // we need to delete the string
         char* str = *(char**)(theAttrs[theMapIndex].fAttributeData.Ptr + (theValueLen * inIndex));
-        delete [] str;
+        this->FreeBuffer(str);
     }
 
     //
@@ -544,7 +597,7 @@ QTSS_Error QTSSDictionary::RemoveValue(QTSS_AttributeID inAttrID, UInt32 inIndex
     {
         // we only have one string left, so we don't need the extra pointer
         char* str = *(char**)(theAttrs[theMapIndex].fAttributeData.Ptr);
-        delete theAttrs[theMapIndex].fAttributeData.Ptr;
+        this->FreeBuffer(theAttrs[theMapIndex].fAttributeData.Ptr);
         theAttrs[theMapIndex].fAttributeData.Ptr = str;
         theAttrs[theMapIndex].fAttributeData.Len = strlen(str);
         theAttrs[theMapIndex].fAllocatedLen = strlen(str);
@@ -696,14 +749,15 @@ QTSS_Error  QTSSDictionary::AddInstanceAttribute(   const char* inAttrName,
             theNewArraySize = QTSSDictionaryMap::kMinArraySize;
         Assert(theNewArraySize > fInstanceMap->GetNumAttrs());
         
-        DictValueElement* theNewArray = NEW DictValueElement[theNewArraySize];
+        DictValueElement* theNewArray = this->NewValueArray(theNewArraySize);
         if (fInstanceAttrs != NULL)
         {
             ::memcpy(theNewArray, fInstanceAttrs, sizeof(DictValueElement) * fInstanceArraySize);
 
             //
             // Delete the old instance attr structs, this does not delete the actual attribute memory
-            delete [] fInstanceAttrs;
+            if (fArena == NULL)
+                delete [] fInstanceAttrs;
         }
         fInstanceAttrs = theNewArray;
         fInstanceArraySize = theNewArraySize;
@@ -810,9 +864,9 @@ void QTSSDictionary::DeleteAttributeData(DictValueElement* inDictValues,
                 UInt32 z = 0;
                 for (char **y = (char **) (inDictValues[x].fAttributeData.Ptr);
                            z < inDictValues[x].fNumAttributes; z++)
-                    delete [] y[z];
+                    this->FreeBuffer(y[z]);
             }
-            delete [] inDictValues[x].fAttributeData.Ptr;
+            this->FreeBuffer(inDictValues[x].fAttributeData.Ptr);
 	}
     }
 }
@@ -880,6 +934,16 @@ QTSSDictionaryMap::QTSSDictionaryMap(UInt32 inNumReservedAttrs, UInt32 inFlags)
         fAttrArraySize = kMinArraySize;
     fAttrArray = NEW QTSSAttrInfoDict*[fAttrArraySize];
     ::memset(fAttrArray, 0, sizeof(QTSSAttrInfoDict*) * fAttrArraySize);
+    fDirectReadArray = NEW UInt8[fAttrArraySize];
+    ::memset(fDirectReadArray, 0, sizeof(UInt8) * fAttrArraySize);
+}
+
+void QTSSDictionaryMap::UpdateDirectRead(UInt32 inIndex)
+{
+    QTSSAttrInfoDict::AttrInfo* theInfo = &fAttrArray[inIndex]->fAttrInfo;
+    fDirectReadArray[inIndex] = (UInt8) (((theInfo->fAttrPermission & qtssAttrModePreempSafe) != 0)
+                                    && ((theInfo->fAttrPermission & qtssPrivateAttrModeRemoved) == 0)
+                                    && (theInfo->fFuncPtr == NULL));
 }
 
 QTSS_Error QTSSDictionaryMap::AddAttribute( const char* inAttrName,
@@ -902,6 +966,7 @@ QTSS_Error QTSSDictionaryMap::AddAttribute( const char* inAttrName,
                     this->UnRemoveAttribute(attrID); 
                     fAttrArray[count]->fAttrInfo.fFuncPtr = inFuncPtr; // reset
                     fAttrArray[count]->fAttrInfo.fAttrPermission = inPermission;// reset
+                    this->UpdateDirectRead(count);
                     return QTSS_NoErr; // nothing left to do. It is re-added.
                 }
                 
@@ -930,6 +995,15 @@ QTSS_Error QTSSDictionaryMap::AddAttribute( const char* inAttrName,
             delete [] fAttrArray;
         }
         fAttrArray = theNewArray;
+
+        UInt8* theNewDirectReadArray = NEW UInt8[theNewArraySize];
+        ::memset(theNewDirectReadArray, 0, sizeof(UInt8) * theNewArraySize);
+        if (fDirectReadArray != NULL)
+        {
+            ::memcpy(theNewDirectReadArray, fDirectReadArray, sizeof(UInt8) * fAttrArraySize);
+            delete [] fDirectReadArray;
+        }
+        fDirectReadArray = theNewDirectReadArray;
         fAttrArraySize = theNewArraySize;
     }
     
@@ -965,6 +1039,7 @@ void QTSSDictionaryMap::SetAttribute(   QTSS_AttributeID inID,
     fAttrArray[theIndex]->fAttrInfo.fFuncPtr = inFuncPtr;
     fAttrArray[theIndex]->fAttrInfo.fAttrDataType = inDataType; 
     fAttrArray[theIndex]->fAttrInfo.fAttrPermission = inPermission;
+    this->UpdateDirectRead(theIndex);
     
     fAttrArray[theIndex]->SetVal(qtssAttrName, &fAttrArray[theIndex]->fAttrInfo.fAttrName[0], theNameLen);
     fAttrArray[theIndex]->SetVal(qtssAttrID, &fAttrArray[theIndex]->fID, sizeof(fAttrArray[theIndex]->fID));
@@ -1002,6 +1077,7 @@ QTSS_Error  QTSSDictionaryMap::RemoveAttribute(QTSS_AttributeID inAttrID)
     // Don't actually touch the attribute or anything. Just flag the
     // it as removed.
     fAttrArray[theIndex]->fAttrInfo.fAttrPermission |= qtssPrivateAttrModeRemoved;
+    this->UpdateDirectRead(theIndex);
     fNumValidAttrs--;
     Assert(fNumValidAttrs < 1000000);
     return QTSS_NoErr;
@@ -1017,6 +1093,7 @@ QTSS_Error  QTSSDictionaryMap::UnRemoveAttribute(QTSS_AttributeID inAttrID)
         return QTSS_AttrDoesntExist;
         
     fAttrArray[theIndex]->fAttrInfo.fAttrPermission &= ~qtssPrivateAttrModeRemoved;
+    this->UpdateDirectRead(theIndex);
     
     fNumValidAttrs++;
     return QTSS_NoErr;
@@ -1151,3 +1228,41 @@ QTSS_ObjectType QTSSDictionaryMap::CreateNewMap()
     
     return result;
 }
+
+#if __DICTIONARY_TESTING__
+
+void QTSSDictionary::Benchmark(UInt32 inNumIterations)
+{
+    // Two copies of the same value. The second attribute isn't preemptive safe, so
+    // gets on it take the generic path (the dictionary is locked to make them legal),
+    // which is the path every get took before there was a direct read path.
+    QTSSDictionaryMap theMap(2);
+    theMap.SetAttribute(0, "direct", NULL, qtssAttrDataTypeUInt32, qtssAttrModeRead | qtssAttrModePreempSafe);
+    theMap.SetAttribute(1, "generic", NULL, qtssAttrDataTypeUInt32, qtssAttrModeRead);
+
+    QTSSDictionary theDict(&theMap);
+    UInt32 theValue = 1;
+    theDict.SetVal(0, &theValue, sizeof(theValue));
+    theDict.SetVal(1, &theValue, sizeof(theValue));
+    theDict.SetLocked(true);
+
+    SInt64 theTimes[2];
+    UInt32 theSum = 0;
+    for (QTSS_AttributeID theID = 0; theID < 2; theID++)
+    {
+        SInt64 theStart = OS::Microseconds();
+        for (UInt32 x = 0; x < inNumIterations; x++)
+        {
+            void* theBuffer = NULL;
+            UInt32 theLen = 0;
+            if (QTSSCallbacks::QTSS_GetValuePtr(&theDict, theID, 0, &theBuffer, &theLen) == QTSS_NoErr)
+                theSum += *(UInt32*)theBuffer;
+        }
+        theTimes[theID] = OS::Microseconds() - theStart;
+    }
+
+    qtss_printf("QTSSDictionary::Benchmark %"_U32BITARG_" QTSS_GetValuePtr calls: direct %"_64BITARG_"d usec, generic %"_64BITARG_"d usec (sum %"_U32BITARG_")\n",
+                inNumIterations, theTimes[0], theTimes[1], theSum);
+}
+
+#endif
@@ -43,6 +43,7 @@
 #include "QTSS.h"
 #include "OSHeaders.h"
 #include "OSMutex.h"
+#include "OSArena.h"
 #include "StrPtrLen.h"
 #include "MyAssert.h"
 #include "QTSSStream.h"
@@ -64,7 +65,10 @@ class QTSSDictionary : public QTSSStream
         //
         // CONSTRUCTOR / DESTRUCTOR
         
-        QTSSDictionary(QTSSDictionaryMap* inMap, OSMutex* inMutex = NULL);
+        // If inArena is set, the attribute storage and all values set internally
+        // are allocated in it and are not freed one by one. The arena must not be
+        // Reset until this object is deleted.
+        QTSSDictionary(QTSSDictionaryMap* inMap, OSMutex* inMutex = NULL, OSArena* inArena = NULL);
         virtual ~QTSSDictionary();
         
         //
@@ -174,6 +178,10 @@ class QTSSDictionary : public QTSSStream
         
 #if __DICTIONARY_TESTING__
         static void Test(); // API test for these objects
+
+        // prints the cost of QTSS_GetValuePtr on attributes that take the
+        // direct read path, compared to ones that take the generic path
+        static void Benchmark(UInt32 inNumIterations);
 #endif
 
     protected:
@@ -214,6 +222,12 @@ class QTSSDictionary : public QTSSStream
         OSMutex*            fMutexP;
 		Bool16				fMyMutex;
 		Bool16				fLocked;
+        OSArena*            fArena;
+        
+        // Allocate from fArena if there is one, otherwise from the heap
+        char*               AllocBuffer(UInt32 inLen);
+        void                FreeBuffer(char* inBuffer);
+        DictValueElement*   NewValueArray(UInt32 inNumValues);
         
         void DeleteAttributeData(DictValueElement* inDictValues,
                                  UInt32 inNumValues, QTSSDictionaryMap* theMap);
@@ -276,6 +290,7 @@ class QTSSDictionaryMap
             for (UInt32 i = 0; i < fAttrArraySize; i++)
                 delete fAttrArray[i];
             delete [] fAttrArray;
+            delete [] fDirectReadArray;
         }
 
         //
@@ -334,6 +349,11 @@ class QTSSDictionaryMap
         Bool16                  IsRemoved(UInt32 inIndex) 
             { Assert(inIndex < fNextAvailableID); return (Bool16) (fAttrArray[inIndex]->fAttrInfo.fAttrPermission & qtssPrivateAttrModeRemoved) ; }
 
+        // True if the value can be read straight out of the attribute array:
+        // preemptive safe, not removed and no param retrieval function.
+        Bool16                  IsDirectRead(UInt32 inIndex)
+            { Assert(inIndex < fNextAvailableID); return (Bool16) fDirectReadArray[inIndex]; }
+
         QTSS_AttrFunctionPtr    GetAttrFunction(UInt32 inIndex)
             { Assert(inIndex < fNextAvailableID); return fAttrArray[inIndex]->fAttrInfo.fFuncPtr; }
             
@@ -419,10 +439,14 @@ class QTSSDictionaryMap
             kMinArraySize = 20
         };
 
+        // Keeps fDirectReadArray in step with the attribute's permissions and function
+        void                            UpdateDirectRead(UInt32 inIndex);
+
         UInt32                          fNextAvailableID;
         UInt32                          fNumValidAttrs;
         UInt32                          fAttrArraySize;
         QTSSAttrInfoDict**              fAttrArray;
+        UInt8*                          fDirectReadArray; // flat copy of IsDirectRead, parallel to fAttrArray
         UInt32                          fFlags;
         
         friend class QTSSDictionary;
@@ -71,6 +71,9 @@ class QTSSStream
                                                             
         virtual QTSS_Error  RequestEvent(QTSS_EventType /*inEventMask*/)
                                                             { return QTSS_Unimplemented; }
+
+        virtual QTSS_Error  ReadBody(QTSS_BodyChunkFunctionPtr /*inChunkFunction*/, void* /*inUserData*/)
+                                                            { return QTSS_Unimplemented; }
     
     private:
     
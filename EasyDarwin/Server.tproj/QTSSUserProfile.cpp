@@ -59,8 +59,8 @@ void  QTSSUserProfile::Initialize()
 }
 
 //CONSTRUCTOR / DESTRUCTOR: very simple stuff
-QTSSUserProfile::QTSSUserProfile()
-:   QTSSDictionary(QTSSDictionaryMap::GetMap(QTSSDictionaryMap::kQTSSUserProfileDictIndex))
+QTSSUserProfile::QTSSUserProfile(OSArena* inArena)
+:   QTSSDictionary(QTSSDictionaryMap::GetMap(QTSSDictionaryMap::kQTSSUserProfileDictIndex), NULL, inArena)
 {
     this->SetEmptyVal(qtssUserName, &fUserNameBuf[0], kMaxUserProfileNameLen);
     this->SetEmptyVal(qtssUserPassword, &fUserPasswordBuf[0], kMaxUserProfilePasswordLen);
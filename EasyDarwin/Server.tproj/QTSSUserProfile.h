@@ -52,7 +52,7 @@ class QTSSUserProfile : public QTSSDictionary
         static void         Initialize();
         
         //CONSTRUCTOR & DESTRUCTOR
-        QTSSUserProfile();
+        QTSSUserProfile(OSArena* inArena = NULL);
         virtual ~QTSSUserProfile() {}
         
     protected:
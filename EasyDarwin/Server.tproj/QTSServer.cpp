@@ -438,6 +438,35 @@ Bool16 QTSServer::CreateListeners(Bool16 startListeningNow, QTSServerPrefs* inPr
 		delete [] thePorts;
     }
 
+    // With more than one listener per port, every RTSP address and port gets that
+    // many SO_REUSEPORT listeners. Sockets are handed out to the event threads round
+    // robin, so each listener accepts on its own event thread, and the kernel
+    // spreads the incoming connections over them.
+    //
+    // The count is only read at startup. A listener opened without SO_REUSEPORT
+    // can't share its port, so new shards would fail to bind next to it, and
+    // opening every listener with SO_REUSEPORT would let a second server on the
+    // same port start without an error and take half of the connections.
+    UInt32 theListenersPerPort = inPrefs->GetRTSPListenersPerPort();
+    if (theListenersPerPort == 0)
+        theListenersPerPort = Socket::GetNumEventThreads();
+    if (fRTSPListenersPerPort == 0)
+        fRTSPListenersPerPort = theListenersPerPort;
+    else if (theListenersPerPort != fRTSPListenersPerPort)
+    {
+        QTSSModuleUtils::LogErrorStr(qtssWarningVerbosity, "rtsp_listeners_per_port changes take effect when the server restarts");
+        theListenersPerPort = fRTSPListenersPerPort;
+    }
+    if (theListenersPerPort > 1)
+    {
+        PortTracking* theShardedPortTrackers = NEW PortTracking[theTotalRTSPPortTrackers * theListenersPerPort];
+        for (index = 0; index < theTotalRTSPPortTrackers * theListenersPerPort; index++)
+            theShardedPortTrackers[index] = theRTSPPortTrackers[index / theListenersPerPort];
+        delete [] theRTSPPortTrackers;
+        theRTSPPortTrackers = theShardedPortTrackers;
+        theTotalRTSPPortTrackers *= theListenersPerPort;
+    }
+
 	// Stat Total Num of HTTP Port
 	{
 		theTotalHTTPPortTrackers = theNumAddrs;
@@ -466,6 +495,16 @@ Bool16 QTSServer::CreateListeners(Bool16 startListeningNow, QTSServerPrefs* inPr
     {
         for (UInt32 count2 = 0; count2 < fNumListeners; count2++)
         {
+            // Several listeners share a port when it is sharded, don't take one twice
+            Bool16 alreadyTaken = false;
+            for (UInt32 count3 = 0; count3 < curPortIndex; count3++)
+            {
+                if (newListenerArray[count3] == fListeners[count2])
+                    alreadyTaken = true;
+            }
+            if (alreadyTaken)
+                continue;
+
             if ((fListeners[count2]->GetLocalPort() == theRTSPPortTrackers[count].fPort) &&
                 (fListeners[count2]->GetLocalAddr() == theRTSPPortTrackers[count].fIPAddr))
             {
@@ -499,7 +538,7 @@ Bool16 QTSServer::CreateListeners(Bool16 startListeningNow, QTSServerPrefs* inPr
         if (theRTSPPortTrackers[count3].fNeedsCreating)
         {
             newListenerArray[curPortIndex] = NEW RTSPListenerSocket();
-            QTSS_Error err = newListenerArray[curPortIndex]->Initialize(theRTSPPortTrackers[count3].fIPAddr, theRTSPPortTrackers[count3].fPort);
+            QTSS_Error err = newListenerArray[curPortIndex]->Initialize(theRTSPPortTrackers[count3].fIPAddr, theRTSPPortTrackers[count3].fPort, theListenersPerPort > 1);
 
             char thePortStr[20];
             qtss_sprintf(thePortStr, "%hu", theRTSPPortTrackers[count3].fPort);
@@ -583,6 +622,17 @@ Bool16 QTSServer::CreateListeners(Bool16 startListeningNow, QTSServerPrefs* inPr
     
     for (UInt32 count6 = 0; count6 < fNumListeners; count6++)
     {
+        // report a sharded port once
+        Bool16 isDuplicate = false;
+        for (UInt32 count7 = 0; count7 < count6; count7++)
+        {
+            if ((fListeners[count7]->GetLocalPort() == fListeners[count6]->GetLocalPort()) &&
+                (fListeners[count7]->GetLocalAddr() == fListeners[count6]->GetLocalAddr()))
+                isDuplicate = true;
+        }
+        if (isDuplicate)
+            continue;
+
         if  (fListeners[count6]->GetLocalAddr() != INADDR_LOOPBACK)
         {
             UInt16 thePort = fListeners[count6]->GetLocalPort();
@@ -683,7 +733,6 @@ Bool16  QTSServer::SetupUDPSockets()
                 {
             theNumAllocatedPairs++;
                         thePair->GetSocketA()->RequestEvent(EV_RE);
-                        thePair->GetSocketB()->RequestEvent(EV_RE);
                 }
         }
     //only return an error if we couldn't allocate ANY pairs of sockets
@@ -846,6 +895,8 @@ void    QTSServer::InitCallbacks()
     sCallbacks.addr[kWriteVCallback] =              (QTSS_CallbackProcPtr)QTSSCallbacks::QTSS_WriteV;
     sCallbacks.addr[kFlushCallback] =               (QTSS_CallbackProcPtr)QTSSCallbacks::QTSS_Flush;
     sCallbacks.addr[kReadCallback] =                (QTSS_CallbackProcPtr)QTSSCallbacks::QTSS_Read;
+    sCallbacks.addr[kReadBodyCallback] =            (QTSS_CallbackProcPtr)QTSSCallbacks::QTSS_ReadBody;
+    sCallbacks.addr[kAllocRequestMemoryCallback] =  (QTSS_CallbackProcPtr)QTSSCallbacks::QTSS_AllocRequestMemory;
     sCallbacks.addr[kSeekCallback] =                (QTSS_CallbackProcPtr)QTSSCallbacks::QTSS_Seek;
     sCallbacks.addr[kAdviseCallback] =              (QTSS_CallbackProcPtr)QTSSCallbacks::QTSS_Advise;
 
@@ -1285,15 +1336,16 @@ Bool16 HTTPListenerSocket::OverMaxConnections(UInt32 buffer)
 
 UDPSocketPair*  RTPSocketPool::ConstructUDPSocketPair()
 {
-    Task* theTask = ((QTSServer*)QTSServerInterface::GetServer())->fRTCPTask;
+    RTCPTask* theTask = ((QTSServer*)QTSServerInterface::GetServer())->fRTCPTask;
     
     //construct a pair of UDP sockets, the lower one for RTP data (outgoing only, no demuxer
     //necessary), and one for RTCP data (incoming, so definitely need a demuxer).
     //These are nonblocking sockets that DON'T receive events (we are going to poll for data)
-	// They do receive events - we don't poll from them anymore
+	// They do receive events - we don't poll from them anymore. The RTCP socket tells
+	// the RTCPTask which socket is readable, so only that one gets drained.
     return NEW
         UDPSocketPair(  NEW UDPSocket(theTask, Socket::kNonBlockingSocketType),
-                        NEW UDPSocket(theTask, UDPSocket::kWantsDemuxer | Socket::kNonBlockingSocketType));
+                        NEW RTCPSocket(theTask, UDPSocket::kWantsDemuxer | Socket::kNonBlockingSocketType));
 }
 
 void RTPSocketPool::DestructUDPSocketPair(UDPSocketPair* inPair)
@@ -1336,6 +1388,12 @@ void RTPSocketPool::SetUDPSocketOptions(UDPSocketPair* inPair)
         // For now, do not log an error, though we should enable this in the future.
         //QTSSModuleUtils::LogError(qtssWarningVerbosity, qtssMsgSockBufSizesTooLarge, theRcvBufSizeStr);
     }
+    
+    //
+    // The RTCPTask only reads sockets that have reported themselves readable, so every
+    // RTCP socket has to be watching for data from the start, including the pairs
+    // RTPStreams create after startup.
+    inPair->GetSocketB()->RequestEvent(EV_RE);
 }
 
 
@@ -47,7 +47,7 @@ class QTSServer : public QTSServerInterface
 {
     public:
 
-        QTSServer() {}
+        QTSServer() : fRTSPListenersPerPort(0) {}
         virtual ~QTSServer();
 
         //
@@ -117,6 +117,9 @@ class QTSServer : public QTSServerInterface
         RTCPTask*           fRTCPTask;
         RTPStatsUpdaterTask*fStatsTask;
         SessionTimeoutTask  *fSessionTimeoutTask;
+
+        // RTSP listeners per port the listeners were first created with, 0 until then
+        UInt32              fRTSPListenersPerPort;
         static char*        sPortPrefString;
         static XMLPrefsParser* sPrefsSource;
         static PrefsSource* sMessagesSource;
@@ -140,7 +140,10 @@ QTSSAttrInfoDict::AttrInfo  QTSServerInterface::sAttributes[] =
     /* 39  */ { "qtssSvrServerPlatform",        NULL,   qtssAttrDataTypeCharArray,  qtssAttrModeRead | qtssAttrModePreempSafe },
     /* 40  */ { "qtssSvrRTSPServerComment",     NULL,   qtssAttrDataTypeCharArray,  qtssAttrModeRead | qtssAttrModePreempSafe },
 	/* 41  */ { "qtssSvrNumThinned",            NULL,   qtssAttrDataTypeSInt32,     qtssAttrModeRead | qtssAttrModePreempSafe },
-    /* 42  */ { "qtssSvrNumThreads",            NULL,   qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModePreempSafe }
+    /* 42  */ { "qtssSvrNumThreads",            NULL,   qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModePreempSafe },
+    /* 43  */ { "qtssSvrTotalUDPBatches",       NULL,   qtssAttrDataTypeUInt64,     qtssAttrModeRead | qtssAttrModePreempSafe },
+    /* 44  */ { "qtssSvrTotalUDPBatchedPackets",NULL,   qtssAttrDataTypeUInt64,     qtssAttrModeRead | qtssAttrModePreempSafe },
+    /* 45  */ { "qtssSvrAvgUDPBatchSize",       NULL,   qtssAttrDataTypeFloat32,    qtssAttrModeRead | qtssAttrModePreempSafe }
     
 };
 
@@ -231,7 +234,21 @@ QTSServerInterface::QTSServerInterface()
     fCurrentMaxLate(0),
     fTotalQuality(0),
     fNumThinned(0),
-    fNumThreads(0)
+    fNumThreads(0),
+    fTotalUDPBatches(0),
+    fTotalUDPBatchedPackets(0),
+    fAvgUDPBatchSize(0),
+    fNumRTSPRequestsCounted(0),
+    fRTSPRequestHeapAllocs(0),
+    fRTSPRequestArenaAllocs(0),
+    fNumNackedPackets(0),
+    fNumNackRepairs(0),
+    fNumNackLateRepairs(0),
+    fNumNackRateLimited(0),
+    fNumPacedPackets(0),
+    fTotalPacingDelayInUSec(0),
+    fPacingQueueDepth(0),
+    fMaxPacingQueueDepth(0)
 {
     for (UInt32 y = 0; y < QTSSModule::kNumRoles; y++)
     {
@@ -271,6 +288,10 @@ QTSServerInterface::QTSServerInterface()
     this->SetVal(qtssSvrNumThinned,         &fNumThinned,               sizeof(fNumThinned));
     this->SetVal(qtssSvrNumThreads,         &fNumThreads,               sizeof(fNumThreads));
     
+    this->SetVal(qtssSvrTotalUDPBatches,        &fTotalUDPBatches,          sizeof(fTotalUDPBatches));
+    this->SetVal(qtssSvrTotalUDPBatchedPackets, &fTotalUDPBatchedPackets,   sizeof(fTotalUDPBatchedPackets));
+    this->SetVal(qtssSvrAvgUDPBatchSize,        &fAvgUDPBatchSize,          sizeof(fAvgUDPBatchSize));
+    
 
     sServer = this;
 }
@@ -408,6 +429,17 @@ SInt64 RTPStatsUpdaterTask::Run()
     (void)atomic_sub(&theServer->fPeriodicRTPPacketsLost, periodicPacketsLost);
     theServer->fTotalRTPPacketsLost += periodicPacketsLost;
     
+    // ..and for the batched UDP sends. The average is over this interval only.
+    UInt32 periodicBatches = 0;
+    UInt32 periodicBatchedPackets = 0;
+    UDPSocket::GetBatchStats(&periodicBatches, &periodicBatchedPackets);
+    theServer->fTotalUDPBatches += periodicBatches;
+    theServer->fTotalUDPBatchedPackets += periodicBatchedPackets;
+    if (periodicBatches > 0)
+        theServer->fAvgUDPBatchSize = (Float32)periodicBatchedPackets / (Float32)periodicBatches;
+    else
+        theServer->fAvgUDPBatchSize = 0;
+    
     SInt64 curTime = OS::Milliseconds();
     
     //for cpu percent
@@ -131,6 +131,31 @@ class QTSServerInterface : public QTSSDictionary
         void            IncrementNumThinned(SInt32 inDifference)
            { OSMutexLocker locker(&fMutex); fNumThinned += inDifference; }
 
+        // Allocation counts of one finished RTSP request, for the debug status display
+        void            IncrementRTSPRequestAllocs(UInt32 inHeapAllocs, UInt32 inArenaAllocs)
+           {    (void)atomic_add(&fNumRTSPRequestsCounted, 1);
+                (void)atomic_add(&fRTSPRequestHeapAllocs, inHeapAllocs);
+                (void)atomic_add(&fRTSPRequestArenaAllocs, inArenaAllocs); }
+
+        // Outcome of the packets one RTCP generic NACK asked for
+        void            IncrementRTCPNacks(UInt32 inRequested, UInt32 inRepaired, UInt32 inLate, UInt32 inRateLimited)
+           {    (void)atomic_add(&fNumNackedPackets, inRequested);
+                (void)atomic_add(&fNumNackRepairs, inRepaired);
+                (void)atomic_add(&fNumNackLateRepairs, inLate);
+                (void)atomic_add(&fNumNackRateLimited, inRateLimited); }
+
+        // RTP pacer queue, see RTPPacer. Packets are counted when they leave the queue,
+        // together with the microseconds they waited there. Only the pacer thread
+        // sends queued packets, so the delay total needs no atomic.
+        void            IncrementPacedPackets(UInt32 inDelayInUSec)
+           {    (void)atomic_add(&fNumPacedPackets, 1);
+                fTotalPacingDelayInUSec += inDelayInUSec; }
+        void            IncrementPacingQueueDepth()
+           {    UInt32 theDepth = atomic_add(&fPacingQueueDepth, 1);
+                if (theDepth > fMaxPacingQueueDepth) fMaxPacingQueueDepth = theDepth; }
+        void            DecrementPacingQueueDepth(UInt32 inNumPackets)
+           {    (void)atomic_sub(&fPacingQueueDepth, inNumPackets); }
+
         void            ClearTotalLate()
            { OSMutexLocker locker(&fMutex); fTotalLate = 0;  }
         void            ClearCurrentMaxLate()
@@ -176,6 +201,24 @@ class QTSServerInterface : public QTSSDictionary
         SInt64				GetTotalQuality()           { return fTotalQuality; };
         SInt32				GetNumThinned()             { return fNumThinned; };
         UInt32				GetNumThreads()             { return fNumThreads; };
+        
+        UInt64              GetTotalUDPBatches()        { return fTotalUDPBatches; }
+        UInt64              GetTotalUDPBatchedPackets() { return fTotalUDPBatchedPackets; }
+        Float32             GetAvgUDPBatchSize()        { return fAvgUDPBatchSize; }
+
+        UInt32              GetNumRTSPRequestsCounted() { return fNumRTSPRequestsCounted; }
+        UInt32              GetRTSPRequestHeapAllocs()  { return fRTSPRequestHeapAllocs; }
+        UInt32              GetRTSPRequestArenaAllocs() { return fRTSPRequestArenaAllocs; }
+
+        UInt32              GetNumNackedPackets()       { return fNumNackedPackets; }
+        UInt32              GetNumNackRepairs()         { return fNumNackRepairs; }
+        UInt32              GetNumNackLateRepairs()     { return fNumNackLateRepairs; }
+        UInt32              GetNumNackRateLimited()     { return fNumNackRateLimited; }
+
+        UInt32              GetNumPacedPackets()        { return fNumPacedPackets; }
+        UInt64              GetTotalPacingDelayInUSec() { return fTotalPacingDelayInUSec; }
+        UInt32              GetPacingQueueDepth()       { return fPacingQueueDepth; }
+        UInt32              GetMaxPacingQueueDepth()    { return fMaxPacingQueueDepth; }
 
         //
         //
@@ -398,6 +441,29 @@ class QTSServerInterface : public QTSSDictionary
         SInt64          fTotalQuality;
         SInt32          fNumThinned;
         UInt32          fNumThreads;
+        
+        // Batched UDP sends (see UDPSocket::SendToBatch), updated by the RTPStatsUpdaterTask
+        UInt64          fTotalUDPBatches;
+        UInt64          fTotalUDPBatchedPackets;
+        Float32         fAvgUDPBatchSize;
+
+        // Totals over all RTSP requests, see IncrementRTSPRequestAllocs
+        unsigned int    fNumRTSPRequestsCounted;
+        unsigned int    fRTSPRequestHeapAllocs;
+        unsigned int    fRTSPRequestArenaAllocs;
+
+        // Totals over all RTCP generic NACKs, see IncrementRTCPNacks
+        unsigned int    fNumNackedPackets;
+        unsigned int    fNumNackRepairs;
+        unsigned int    fNumNackLateRepairs;
+        unsigned int    fNumNackRateLimited;
+
+        // RTP pacer totals since startup, see IncrementPacedPackets. The max depth
+        // is only a hint, racing updates may miss the odd new maximum
+        unsigned int    fNumPacedPackets;
+        UInt64          fTotalPacingDelayInUSec;
+        unsigned int    fPacingQueueDepth;
+        unsigned int    fMaxPacingQueueDepth;
  
         // Param retrieval functions
         static void* CurrentUnixTimeMilli(QTSSDictionary* inServer, UInt32* outLen);
@@ -194,7 +194,21 @@ QTSServerPrefs::PrefInfo QTSServerPrefs::sPrefInfo[] =
     { kDontAllowMultipleValues, "3000",     NULL                        }, //3gpp_target_time_milliseconds
     { kAllowMultipleValues,     "",         sDisable_Thinning_Players   }, //player_requires_disable_thinning
     
-    { kDontAllowMultipleValues, "8080",     NULL                        }  //http_service_port
+    { kDontAllowMultipleValues, "8080",     NULL                        },  //http_service_port
+    { kDontAllowMultipleValues, "1",      NULL                        },  //run_num_event_threads
+    { kDontAllowMultipleValues, "false",  NULL                        },  //enable_task_work_stealing
+    { kDontAllowMultipleValues, "65536",  NULL                        },  //rtsp_tcp_coalesce_buffer_size
+    { kDontAllowMultipleValues, "20",     NULL                        },  //rtsp_tcp_coalesce_flush_msec
+    { kDontAllowMultipleValues, "false",  NULL                        },  //enable_rtsp_tcp_zerocopy
+    { kDontAllowMultipleValues, "1",      NULL                        },  //rtsp_listeners_per_port
+    { kDontAllowMultipleValues, "false",  NULL                        },  //enable_rtcp_nack
+    { kDontAllowMultipleValues, "20",     NULL                        }, //rtcp_nack_repair_percent
+    { kDontAllowMultipleValues, "false",  NULL                        }, //enable_rtp_pacing
+    { kDontAllowMultipleValues, "2.5",    NULL                        }, //rtp_pacing_rate_multiplier
+    { kDontAllowMultipleValues, "10000",  NULL                        }, //rtp_pacing_min_rate_kbits
+    { kDontAllowMultipleValues, "4500",   NULL                        }, //rtp_pacing_burst_bytes
+    { kDontAllowMultipleValues, "256",    NULL                        }, //rtp_pacing_max_queue_packets
+    { kDontAllowMultipleValues, "0",      NULL                        }  //rtp_pacing_interface_rate_kbits
     
     
     
@@ -296,7 +310,21 @@ QTSSAttrInfoDict::AttrInfo  QTSServerPrefs::sAttributes[] =
     /* 88 */ { "3gpp_target_time_milliseconds",   NULL,                         qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModeWrite },
     /* 89 */ { "player_requires_disable_thinning", NULL,                        qtssAttrDataTypeCharArray,  qtssAttrModeRead | qtssAttrModeWrite },
     
-    /* 90 */ { "http_service_port",					NULL,                       qtssAttrDataTypeUInt16,     qtssAttrModeRead | qtssAttrModeWrite }
+    /* 90 */ { "http_service_port",					NULL,                       qtssAttrDataTypeUInt16,     qtssAttrModeRead | qtssAttrModeWrite },
+    /* 91 */ { "run_num_event_threads",                 NULL,                       qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModeWrite },
+    /* 92 */ { "enable_task_work_stealing",             NULL,                       qtssAttrDataTypeBool16,     qtssAttrModeRead | qtssAttrModeWrite },
+    /* 93 */ { "rtsp_tcp_coalesce_buffer_size",         NULL,                       qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModeWrite },
+    /* 94 */ { "rtsp_tcp_coalesce_flush_msec",          NULL,                       qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModeWrite },
+    /* 95 */ { "enable_rtsp_tcp_zerocopy",              NULL,                       qtssAttrDataTypeBool16,     qtssAttrModeRead | qtssAttrModeWrite },
+    /* 96 */ { "rtsp_listeners_per_port",               NULL,                       qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModeWrite },
+    /* 97 */ { "enable_rtcp_nack",                      NULL,                       qtssAttrDataTypeBool16,     qtssAttrModeRead | qtssAttrModeWrite },
+    /* 98 */ { "rtcp_nack_repair_percent",              NULL,                       qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModeWrite },
+    /* 99 */ { "enable_rtp_pacing",                     NULL,                       qtssAttrDataTypeBool16,     qtssAttrModeRead | qtssAttrModeWrite },
+    /* 100 */ { "rtp_pacing_rate_multiplier",           NULL,                       qtssAttrDataTypeFloat32,    qtssAttrModeRead | qtssAttrModeWrite },
+    /* 101 */ { "rtp_pacing_min_rate_kbits",            NULL,                       qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModeWrite },
+    /* 102 */ { "rtp_pacing_burst_bytes",               NULL,                       qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModeWrite },
+    /* 103 */ { "rtp_pacing_max_queue_packets",         NULL,                       qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModeWrite },
+    /* 104 */ { "rtp_pacing_interface_rate_kbits",      NULL,                       qtssAttrDataTypeUInt32,     qtssAttrModeRead | qtssAttrModeWrite }
 
 };
 
@@ -377,7 +405,21 @@ QTSServerPrefs::QTSServerPrefs(XMLPrefsParser* inPrefsSource, Bool16 inWriteMiss
 	fUDPMonitorAudioPort(0),
 	fAllowGuestAuthorizeDefault(true),
 	f3GPPRateAdaptTargetTime(0),
-	fHTTPServicePort(8080)
+	fHTTPServicePort(8080),
+	fNumEventThreads(1),
+	fTaskWorkStealing(false),
+	fTCPCoalesceBufferSize(65536),
+	fTCPCoalesceFlushMsec(20),
+	fTCPZeroCopy(false),
+	fRTSPListenersPerPort(1),
+	fRTCPNackEnabled(false),
+	fRTCPNackRepairPercent(20),
+	fRTPPacingEnabled(false),
+	fRTPPacingRateMultiplier(2.5),
+	fRTPPacingMinRateKBits(10000),
+	fRTPPacingBurstBytes(4500),
+	fRTPPacingMaxQueuePackets(256),
+	fRTPPacingInterfaceRateKBits(0)
 {
     SetupAttributes();
     RereadServerPreferences(inWriteMissingPrefs);
@@ -472,6 +514,20 @@ void QTSServerPrefs::SetupAttributes()
     this->SetVal(qtssPrefs3GPPTargetTime,               &f3GPPRateAdaptTargetTime,      sizeof(f3GPPRateAdaptTargetTime));
 
 	this->SetVal(easyPrefsHTTPServicePort,				&fHTTPServicePort,				sizeof(fHTTPServicePort));
+	this->SetVal(easyPrefsNumEventThreads, &fNumEventThreads,        sizeof(fNumEventThreads));
+	this->SetVal(easyPrefsTaskWorkStealing, &fTaskWorkStealing,       sizeof(fTaskWorkStealing));
+	this->SetVal(easyPrefsRTSPTCPCoalesceBufferSize, &fTCPCoalesceBufferSize,  sizeof(fTCPCoalesceBufferSize));
+	this->SetVal(easyPrefsRTSPTCPCoalesceFlushMsec, &fTCPCoalesceFlushMsec,   sizeof(fTCPCoalesceFlushMsec));
+	this->SetVal(easyPrefsRTSPTCPZeroCopy, &fTCPZeroCopy,            sizeof(fTCPZeroCopy));
+	this->SetVal(easyPrefsRTSPListenersPerPort, &fRTSPListenersPerPort,   sizeof(fRTSPListenersPerPort));
+	this->SetVal(easyPrefsRTCPNackEnabled,  &fRTCPNackEnabled,        sizeof(fRTCPNackEnabled));
+	this->SetVal(easyPrefsRTCPNackRepairPercent, &fRTCPNackRepairPercent, sizeof(fRTCPNackRepairPercent));
+	this->SetVal(easyPrefsRTPPacingEnabled, &fRTPPacingEnabled,       sizeof(fRTPPacingEnabled));
+	this->SetVal(easyPrefsRTPPacingRateMultiplier, &fRTPPacingRateMultiplier, sizeof(fRTPPacingRateMultiplier));
+	this->SetVal(easyPrefsRTPPacingMinRateKBits, &fRTPPacingMinRateKBits,  sizeof(fRTPPacingMinRateKBits));
+	this->SetVal(easyPrefsRTPPacingBurstBytes, &fRTPPacingBurstBytes,    sizeof(fRTPPacingBurstBytes));
+	this->SetVal(easyPrefsRTPPacingMaxQueuePackets, &fRTPPacingMaxQueuePackets, sizeof(fRTPPacingMaxQueuePackets));
+	this->SetVal(easyPrefsRTPPacingInterfaceRateKBits, &fRTPPacingInterfaceRateKBits, sizeof(fRTPPacingInterfaceRateKBits));
 
     
     
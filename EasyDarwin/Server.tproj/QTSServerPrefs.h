@@ -213,6 +213,28 @@ class QTSServerPrefs : public QTSSPrefs
 
 		UInt16 GetHTTPServicePort()					{return fHTTPServicePort; }
         
+		UInt32 GetNumEventThreads()          { return fNumEventThreads; }
+        
+		Bool16 GetTaskWorkStealingEnabled()  { return fTaskWorkStealing; }
+        
+		UInt32 GetTCPCoalesceBufferSize()    { return fTCPCoalesceBufferSize; }
+        
+		UInt32 GetTCPCoalesceFlushMsec()     { return fTCPCoalesceFlushMsec; }
+        
+		Bool16 GetTCPZeroCopyEnabled()       { return fTCPZeroCopy; }
+        
+		UInt32 GetRTSPListenersPerPort()     { return fRTSPListenersPerPort; }
+        
+		Bool16 IsRTCPNackEnabled()           { return fRTCPNackEnabled; }
+		UInt32 GetRTCPNackRepairPercent()    { return fRTCPNackRepairPercent; }
+        
+		Bool16  IsRTPPacingEnabled()                 { return fRTPPacingEnabled; }
+		Float32 GetRTPPacingRateMultiplier()         { return fRTPPacingRateMultiplier; }
+		UInt32  GetRTPPacingMinRateKBits()           { return fRTPPacingMinRateKBits; }
+		UInt32  GetRTPPacingBurstBytes()             { return fRTPPacingBurstBytes; }
+		UInt32  GetRTPPacingMaxQueuePackets()        { return fRTPPacingMaxQueuePackets; }
+		UInt32  GetRTPPacingInterfaceRateKBits()     { return fRTPPacingInterfaceRateKBits; }
+        
     private:
 
         UInt32      fRTSPTimeoutInSecs;
@@ -280,6 +302,20 @@ class QTSServerPrefs : public QTSSPrefs
 
 		UInt16	fHTTPServicePort;
         
+		UInt32	fNumEventThreads;
+		Bool16	fTaskWorkStealing;
+		UInt32	fTCPCoalesceBufferSize;
+		UInt32	fTCPCoalesceFlushMsec;
+		Bool16	fTCPZeroCopy;
+		UInt32	fRTSPListenersPerPort;
+		Bool16	fRTCPNackEnabled;
+		UInt32	fRTCPNackRepairPercent;
+		Bool16	fRTPPacingEnabled;
+		Float32	fRTPPacingRateMultiplier;
+		UInt32	fRTPPacingMinRateKBits;
+		UInt32	fRTPPacingBurstBytes;
+		UInt32	fRTPPacingMaxQueuePackets;
+		UInt32	fRTPPacingInterfaceRateKBits;
         Bool16  fEnableMonitorStatsFile;
         UInt32  fStatsFileIntervalSeconds;
     
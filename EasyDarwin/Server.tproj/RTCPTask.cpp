@@ -37,78 +37,135 @@
 #include "QTSServerInterface.h"
 #include "UDPSocketPool.h"
 #include "RTPStream.h"
+#include "atomic.h"
+
+unsigned int RTCPTask::sNumWakeups = 0;
+unsigned int RTCPTask::sNumSocketsRead = 0;
+unsigned int RTCPTask::sNumPacketsRead = 0;
+
+RTCPSocket::RTCPSocket(RTCPTask* inTask, UInt32 inSocketType)
+:   UDPSocket(inTask, inSocketType),
+    fRTCPTask(inTask)
+{
+    fReadyElem.SetEnclosingObject(this);
+}
+
+RTCPSocket::~RTCPSocket()
+{
+    //Sockets are deleted with the socket pool mutex held, which RTCPTask::Run also
+    //holds while it drains, so the only thing to do is get off the ready queue.
+    fRTCPTask->RemoveSocket(this);
+}
+
+void RTCPSocket::ProcessEvent(int /*eventBits*/)
+{
+    fRTCPTask->SocketReadable(this);
+}
+
+void RTCPTask::SocketReadable(RTCPSocket* inSocket)
+{
+    {
+        OSMutexLocker locker(&fReadyMutex);
+        if (!inSocket->fReadyElem.IsMemberOfAnyQueue())
+            fReadyQueue.EnQueue(&inSocket->fReadyElem);
+    }
+    this->Signal(Task::kReadEvent);
+}
+
+void RTCPTask::RemoveSocket(RTCPSocket* inSocket)
+{
+    OSMutexLocker locker(&fReadyMutex);
+    if (inSocket->fReadyElem.IsMember(fReadyQueue))
+        fReadyQueue.Remove(&inSocket->fReadyElem);
+}
+
+void RTCPTask::GetWakeupStats(UInt32* outNumWakeups, UInt32* outNumSockets, UInt32* outNumPackets)
+{
+    *outNumWakeups = sNumWakeups;
+    (void)atomic_sub(&sNumWakeups, *outNumWakeups);
+    *outNumSockets = sNumSocketsRead;
+    (void)atomic_sub(&sNumSocketsRead, *outNumSockets);
+    *outNumPackets = sNumPacketsRead;
+    (void)atomic_sub(&sNumPacketsRead, *outNumPackets);
+}
 
 SInt64 RTCPTask::Run()
 {
-    const UInt32 kMaxRTCPPacketSize = 2048;
-    char thePacketBuffer[kMaxRTCPPacketSize];
-    StrPtrLen thePacket(thePacketBuffer, 0);
+    char thePacketBuffers[kRecvBatchSize][kMaxRTCPPacketSize];
+    UDPRecvBuf theBufs[kRecvBatchSize];
     QTSServerInterface* theServer = QTSServerInterface::GetServer();
     
-    //This task goes through all the UDPSockets in the RTPSocketPool, checking to see
-    //if they have data. If they do, it demuxes the packets and sends the packet onto
-    //the proper RTP session.
+    //This task drains the RTCPSockets that signalled they were readable, demuxes the
+    //packets and sends each one onto the proper RTP session.
     EventFlags events = this->GetEvents(); // get and clear events
     
     if ( (events & Task::kReadEvent) || (events & Task::kIdleEvent) )
+    {
+        UInt32 theNumSockets = 0;
+        UInt32 theNumPackets = 0;
+        
+        //Keeps the sockets from being deleted while we read them
+        OSMutexLocker locker(theServer->GetSocketPool()->GetMutex());
+        while (true)
         {
-                //Must be done atomically wrt the socket pool.
+            RTCPSocket* theSocket = NULL;
+            {
+                OSMutexLocker readyLocker(&fReadyMutex);
+                OSQueueElem* theElem = fReadyQueue.DeQueue();
+                if (theElem == NULL)
+                    break;
+                theSocket = (RTCPSocket*)theElem->GetEnclosingObject();
+            }
+            theNumSockets++;
+            
+            UDPDemuxer* theDemuxer = theSocket->GetDemuxer();
+            if (theDemuxer == NULL)
+                continue;
+            
+            while (true) //get all the outstanding packets for this socket
+            {
+                for (UInt32 x = 0; x < kRecvBatchSize; x++)
+                {
+                    theBufs[x].fBuffer = thePacketBuffers[x];
+                    theBufs[x].fBufLen = kMaxRTCPPacketSize;
+                }
                 
-                OSMutexLocker locker(theServer->GetSocketPool()->GetMutex());
-                for (OSQueueIter iter(theServer->GetSocketPool()->GetSocketQueue());
-                                !iter.IsDone(); iter.Next())
+                UInt32 theNumReceived = 0;
+                (void)theSocket->RecvMultiple(theBufs, kRecvBatchSize, &theNumReceived);
+                
+                // Lookups don't block RTPStreams registering or unregistering. A stream
+                // that unregisters waits for this batch to be done with it.
+                UDPDemuxerReadLocker theReadLocker(theDemuxer);
+                for (UInt32 y = 0; y < theNumReceived; y++)
                 {
-                        UInt32 theRemoteAddr = 0;
-                        UInt16 theRemotePort = 0;
-        
-                        UDPSocketPair* thePair = (UDPSocketPair*)iter.GetCurrent()->GetEnclosingObject();
-                        Assert(thePair != NULL);
-                        
-                        for (UInt32 x = 0; x < 2; x++)
-                        {
-                                UDPSocket* theSocket = NULL;
-                                if (x == 0)
-                                        theSocket = thePair->GetSocketA();
-                                else
-                                        theSocket = thePair->GetSocketB();
-                                        
-                                UDPDemuxer* theDemuxer = theSocket->GetDemuxer();
-                        if (theDemuxer == NULL) 
-                            continue;
-                        else
-                        {
-                                        theDemuxer->GetMutex()->Lock();
-                            while (true) //get all the outstanding packets for this socket
-                                {
-                                        thePacket.Len = 0;
-                                        theSocket->RecvFrom(&theRemoteAddr, &theRemotePort, thePacket.Ptr,  
-                                                                        kMaxRTCPPacketSize, &thePacket.Len);
-                                        if (thePacket.Len == 0)
-                                        {
-                                                theSocket->RequestEvent(EV_RE);   
-                                                break;//no more packets on this socket!
-                                        }
-                                        
-                                        //if this socket has a demuxer, find the target RTPStream
-                                        if (theDemuxer != NULL)
-                                        {
-                                                RTPStream* theStream = (RTPStream*)theDemuxer->GetTask(theRemoteAddr, theRemotePort);
-                                                if (theStream != NULL)
-                                                        theStream->ProcessIncomingRTCPPacket(&thePacket);
-                                        }
-                                }
-                                        theDemuxer->GetMutex()->Unlock();
-                        }
+                    if (theBufs[y].fRecvLen == 0)
+                        continue;
+                    theNumPackets++;
+                    
+                    RTPStream* theStream = (RTPStream*)theDemuxer->GetTask(theBufs[y].fRemoteAddr, theBufs[y].fRemotePort);
+                    if (theStream != NULL)
+                    {
+                        StrPtrLen thePacket(thePacketBuffers[y], theBufs[y].fRecvLen);
+                        theStream->ProcessIncomingRTCPPacket(&thePacket);
+                    }
+                }
+                
+                // A short read means the socket is drained
+                if (theNumReceived < kRecvBatchSize)
+                {
+                    theSocket->RequestEvent(EV_RE);
+                    break;//no more packets on this socket!
                 }
+            }
+        }
+        
+        if (theNumSockets > 0)
+        {
+            (void)atomic_add(&sNumWakeups, 1);
+            (void)atomic_add(&sNumSocketsRead, theNumSockets);
+            (void)atomic_add(&sNumPacketsRead, theNumPackets);
         }
     }
      
     return 0; /* Fix for 4004432 */   
-    /*
-    SInt64 result = 0;
-    if (theServer->GetNumRTPSessions() > 0)
-        result =  theServer->GetPrefs()->GetRTCPPollIntervalInMsec();
-    
-   return result;
-   */
 }
@@ -35,17 +35,61 @@
 #define __RTCP_TASK_H__
 
 #include "Task.h"
+#include "UDPSocket.h"
+#include "OSQueue.h"
+#include "OSMutex.h"
+
+class RTCPTask;
+
+//The RTCP socket of an RTPSocketPool pair. When the event thread reports it readable,
+//it puts itself on its RTCPTask's ready queue, so the task only reads the sockets that
+//actually have data instead of every socket in the pool.
+class RTCPSocket : public UDPSocket
+{
+    public:
+        RTCPSocket(RTCPTask* inTask, UInt32 inSocketType);
+        virtual ~RTCPSocket();
+        
+    private:
+        virtual void ProcessEvent(int eventBits);
+        
+        RTCPTask*   fRTCPTask;
+        OSQueueElem fReadyElem;
+        
+        friend class RTCPTask;
+};
 
 class RTCPTask : public Task
 {
     public:
-        //This task handles all incoming RTCP data. It just polls, so make sure
-        //to start the polling process by signalling a start event.
+        //This task handles all incoming RTCP data. It is signalled by the RTCPSockets
+        //as they become readable.
         RTCPTask() : Task() {this->SetTaskName("RTCPTask"); this->Signal(Task::kStartEvent); }
         virtual ~RTCPTask() {}
+        
+        //Wakeups that read RTCP, and the sockets and packets they read, since the last call
+        static void GetWakeupStats(UInt32* outNumWakeups, UInt32* outNumSockets, UInt32* outNumPackets);
     
     private:
         virtual SInt64 Run();
+        
+        void    SocketReadable(RTCPSocket* inSocket);
+        void    RemoveSocket(RTCPSocket* inSocket);
+        
+        enum
+        {
+            kMaxRTCPPacketSize  = 2048, //UInt32
+            kRecvBatchSize      = 16    //UInt32, datagrams per RecvMultiple call
+        };
+        
+        OSMutex fReadyMutex;
+        OSQueue fReadyQueue;    //RTCPSockets waiting to be drained
+        
+        static unsigned int sNumWakeups;
+        static unsigned int sNumSocketsRead;
+        static unsigned int sNumPacketsRead;
+        
+        friend class RTCPSocket;
 };
 
 #endif //__RTCP_TASK_H__
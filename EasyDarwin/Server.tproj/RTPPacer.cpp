@@ -0,0 +1,451 @@
+/*
+	Copyright (c) 2013-2016 EasyDarwin.ORG.  All rights reserved.
+	Github: https://github.com/EasyDarwin
+	WEChat: EasyDarwin
+	Website: http://www.easydarwin.org
+*/
+/*
+    File:       RTPPacer.cpp
+
+    Contains:   Implementation of RTPPacer, RTPTokenBucket and the pacer thread
+*/
+
+#include <string.h>
+
+#include "RTPPacer.h"
+#include "QTSServerInterface.h"
+#include "OS.h"
+#include "OSMemory.h"
+#include "MyAssert.h"
+#include "atomic.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <time.h>
+#endif
+
+RTPPacerThread* RTPPacer::sPacerThread = NULL;
+
+SInt64 RTPTokenBucket::GetSendTime(SInt64 inCurrentTime)
+{
+    if (fRate == 0)
+        return inCurrentTime;
+
+    SInt64 theElapsed = inCurrentTime - fLastFillTime;
+    if ((fLastFillTime == -1) || (theElapsed >= 1000000))
+        fTokens = fDepth;   // idle long enough to be full, and no overflow below
+    else if (theElapsed > 0)
+    {
+        fTokens += theElapsed * fRate;
+        if (fTokens > fDepth)
+            fTokens = fDepth;
+    }
+    // gettimeofday may step back, just wait for it to catch up again
+    if ((fLastFillTime == -1) || (theElapsed > 0))
+        fLastFillTime = inCurrentTime;
+
+    if (fTokens >= 0)
+        return inCurrentTime;
+    return inCurrentTime + (-fTokens + fRate - 1) / fRate;
+}
+
+void RTPPacer::Initialize()
+{
+    if (sPacerThread == NULL)
+    {
+        sPacerThread = NEW RTPPacerThread();
+        sPacerThread->Start();
+    }
+#if RTPPACERTESTING
+    qtss_printf("RTPPacer::Test %s\n", RTPPacer::Test() ? "passed" : "failed");
+#endif
+}
+
+Bool16 RTPPacer::IsEnabled()
+{
+    return (sPacerThread != NULL) && QTSServerInterface::GetServer()->GetPrefs()->IsRTPPacingEnabled();
+}
+
+RTPPacer::RTPPacer()
+:   fQueue(NULL),
+    fQueueSize(0),
+    fQueueHead(0),
+    fNumQueued(0),
+    fStopped(false),
+    fHeapElem(this)
+{
+}
+
+RTPPacer::~RTPPacer()
+{
+    this->Stop();
+    if (fQueue != NULL)
+    {
+        for (UInt32 x = 0; x < fQueueSize; x++)
+            delete [] fQueue[x].fData;
+        delete [] fQueue;
+    }
+}
+
+void RTPPacer::SetRate(UInt32 inBitRate)
+{
+    QTSServerPrefs* thePrefs = QTSServerInterface::GetServer()->GetPrefs();
+    Float32 theRate = (Float32)inBitRate * thePrefs->GetRTPPacingRateMultiplier();
+    Float32 theMinRate = (Float32)thePrefs->GetRTPPacingMinRateKBits() * 1000;
+    if (theRate < theMinRate)
+        theRate = theMinRate;
+    fBucket.SetRate((UInt32)(theRate / 8), thePrefs->GetRTPPacingBurstBytes());
+}
+
+OS_Error RTPPacer::Send(UDPSocket* inSocket, UInt32 inRemoteAddr, UInt16 inRemotePort,
+                            void* inBuffer, UInt32 inLength, UInt32 inBitRate, Bool16 inBatch, SInt64* outWakeupTime)
+{
+    SInt64 theCurrentTime = OS::Microseconds();
+
+    fMutex.Lock();
+    if (fStopped || (sPacerThread == NULL))
+    {
+        fMutex.Unlock();
+        return inSocket->SendTo(inRemoteAddr, inRemotePort, inBuffer, inLength);
+    }
+
+    this->SetRate(inBitRate);
+    SInt64 theSendTime = fBucket.GetSendTime(theCurrentTime);
+
+    // The interface buckets belong to the pacer thread, so with a limit per
+    // interface every packet goes through the queue
+    QTSServerPrefs* thePrefs = QTSServerInterface::GetServer()->GetPrefs();
+    if ((fNumQueued == 0) && (theSendTime <= theCurrentTime) && (thePrefs->GetRTPPacingInterfaceRateKBits() == 0))
+    {
+        fBucket.Consume(inLength);
+        fMutex.Unlock();
+        if (inBatch)
+            return inSocket->SendToBatch(inRemoteAddr, inRemotePort, inBuffer, inLength);
+        return inSocket->SendTo(inRemoteAddr, inRemotePort, inBuffer, inLength);
+    }
+
+    // Packets already in the socket's batch have to leave before the pacer thread
+    // sends this one
+    if (inBatch)
+        (void)inSocket->FlushBatch();
+
+    if (fQueue == NULL)
+    {
+        fQueueSize = thePrefs->GetRTPPacingMaxQueuePackets();
+        if (fQueueSize == 0)
+            fQueueSize = 1;
+        fQueue = NEW QueuedPacket[fQueueSize];
+        ::memset(fQueue, 0, sizeof(QueuedPacket) * fQueueSize);
+    }
+
+    if (fNumQueued == fQueueSize)
+    {
+        // Sending the head of the queue makes room
+        *outWakeupTime = OS::Milliseconds() + (theSendTime - theCurrentTime) / 1000 + 1;
+        fMutex.Unlock();
+        return EAGAIN;
+    }
+
+    QueuedPacket* thePacket = &fQueue[(fQueueHead + fNumQueued) % fQueueSize];
+    if (thePacket->fBufferSize < inLength)
+    {
+        delete [] thePacket->fData;
+        thePacket->fData = NEW char[inLength];
+        thePacket->fBufferSize = inLength;
+    }
+    ::memcpy(thePacket->fData, inBuffer, inLength);
+    thePacket->fLength = inLength;
+    thePacket->fSocket = inSocket;
+    thePacket->fRemoteAddr = inRemoteAddr;
+    thePacket->fRemotePort = inRemotePort;
+    thePacket->fQueueTime = theCurrentTime;
+
+    fNumQueued++;
+    Bool16 wasEmpty = (fNumQueued == 1);
+    fMutex.Unlock();
+
+    QTSServerInterface::GetServer()->IncrementPacingQueueDepth();
+
+    // While there are packets queued the pacer thread keeps the pacer scheduled
+    if (wasEmpty)
+        sPacerThread->Schedule(this, theSendTime);
+    return OS_NoErr;
+}
+
+SInt64 RTPPacer::SendQueuedPackets(SInt64 inCurrentTime)
+{
+    // Count the packets that are due with the lock held, and send them without
+    // it. Send only fills slots behind them, and Stop can't run meanwhile, it
+    // waits for us in RTPPacerThread::Unschedule.
+    fMutex.Lock();
+
+    SInt64 theSendTime = -1;
+    UInt32 theNumDue = 0;
+    while (theNumDue < fNumQueued)
+    {
+        QueuedPacket* thePacket = &fQueue[(fQueueHead + theNumDue) % fQueueSize];
+
+        theSendTime = fBucket.GetSendTime(inCurrentTime);
+        RTPTokenBucket* theInterfaceBucket = sPacerThread->GetInterfaceBucket(thePacket->fSocket->GetLocalAddr());
+        if (theInterfaceBucket != NULL)
+        {
+            SInt64 theInterfaceSendTime = theInterfaceBucket->GetSendTime(inCurrentTime);
+            if (theInterfaceSendTime > theSendTime)
+                theSendTime = theInterfaceSendTime;
+        }
+        if (theSendTime > inCurrentTime)
+            break;
+
+        fBucket.Consume(thePacket->fLength);
+        if (theInterfaceBucket != NULL)
+            theInterfaceBucket->Consume(thePacket->fLength);
+        theNumDue++;
+        theSendTime = -1;
+    }
+    UInt32 theQueueHead = fQueueHead;
+    fMutex.Unlock();
+
+    if (theNumDue == 0)
+        return theSendTime;
+
+    for (UInt32 x = 0; x < theNumDue; x++)
+    {
+        QueuedPacket* thePacket = &fQueue[(theQueueHead + x) % fQueueSize];
+        (void)thePacket->fSocket->SendTo(thePacket->fRemoteAddr, thePacket->fRemotePort, thePacket->fData, thePacket->fLength);
+
+        SInt64 theDelay = inCurrentTime - thePacket->fQueueTime;
+        QTSServerInterface::GetServer()->IncrementPacedPackets(theDelay > 0 ? (UInt32)theDelay : 0);
+    }
+
+    fMutex.Lock();
+    fQueueHead = (fQueueHead + theNumDue) % fQueueSize;
+    fNumQueued -= theNumDue;
+    // Send didn't schedule us for packets it queued while we were sending, the
+    // queue wasn't empty then
+    if ((theSendTime == -1) && (fNumQueued > 0))
+        theSendTime = inCurrentTime;
+    fMutex.Unlock();
+
+    QTSServerInterface::GetServer()->DecrementPacingQueueDepth(theNumDue);
+    return theSendTime;
+}
+
+void RTPPacer::Stop()
+{
+    if (sPacerThread != NULL)
+        sPacerThread->Unschedule(this);
+
+    OSMutexLocker locker(&fMutex);
+    fStopped = true;
+    if (fNumQueued > 0)
+    {
+        QTSServerInterface::GetServer()->DecrementPacingQueueDepth(fNumQueued);
+        fNumQueued = 0;
+    }
+}
+
+#if RTPPACERTESTING
+Bool16 RTPPacer::Test()
+{
+    enum
+    {
+        kTestNumPackets = 100,
+        kTestPacketSize = 1200
+    };
+
+    UDPSocket theSender(NULL, Socket::kNonBlockingSocketType);
+    UDPSocket theReceiver(NULL, Socket::kNonBlockingSocketType);
+    if ((theSender.Open() != OS_NoErr) || (theReceiver.Open() != OS_NoErr))
+        return false;
+    if ((theSender.Bind(INADDR_LOOPBACK, 0) != OS_NoErr) || (theReceiver.Bind(INADDR_LOOPBACK, 0) != OS_NoErr))
+        return false;
+    (void)theReceiver.SetSocketRcvBufSize(kTestNumPackets * kTestPacketSize * 2);
+
+    // One key frame worth of packets, all written at once
+    RTPPacer thePacer;
+    char thePacket[kTestPacketSize];
+    ::memset(thePacket, 0, sizeof(thePacket));
+    SInt64 theWakeupTime = -1;
+    for (UInt32 x = 0; x < kTestNumPackets; x++)
+    {
+        if (thePacer.Send(&theSender, INADDR_LOOPBACK, theReceiver.GetLocalPort(), thePacket, sizeof(thePacket), 0, false, &theWakeupTime) != OS_NoErr)
+            return false;
+    }
+
+    SInt64 theArrivals[kTestNumPackets];
+    UInt32 theNumReceived = 0;
+    SInt64 theGiveUpTime = OS::Microseconds() + 5000000;
+    while ((theNumReceived < kTestNumPackets) && (OS::Microseconds() < theGiveUpTime))
+    {
+        UInt32 theAddr = 0, theLen = 0;
+        UInt16 thePort = 0;
+        if (theReceiver.RecvFrom(&theAddr, &thePort, thePacket, sizeof(thePacket), &theLen) == OS_NoErr)
+            theArrivals[theNumReceived++] = OS::Microseconds();
+    }
+    thePacer.Stop();
+
+    // The burst the bucket allows arrives back to back, the rest should be
+    // spaced by the time one packet takes at the pacing rate
+    UInt32 theRate = thePacer.fBucket.GetRate();
+    UInt32 theFirstPaced = QTSServerInterface::GetServer()->GetPrefs()->GetRTPPacingBurstBytes() / kTestPacketSize + 2;
+    if ((theRate == 0) || (theNumReceived < kTestNumPackets) || (theFirstPaced >= kTestNumPackets))
+        return false;
+
+    Float64 theExpectedGap = (Float64)kTestPacketSize * 1000000 / theRate;
+    SInt64 theMinGap = kSInt64_Max, theMaxGap = 0, theTotalGap = 0;
+    for (UInt32 y = theFirstPaced; y < kTestNumPackets; y++)
+    {
+        SInt64 theGap = theArrivals[y] - theArrivals[y - 1];
+        if (theGap < theMinGap)
+            theMinGap = theGap;
+        if (theGap > theMaxGap)
+            theMaxGap = theGap;
+        theTotalGap += theGap;
+    }
+    Float64 theAvgGap = (Float64)theTotalGap / (kTestNumPackets - theFirstPaced);
+    qtss_printf("RTPPacer::Test rate=%"_U32BITARG_" bytes/sec expected gap=%.0f usec: min=%"_S64BITARG_" avg=%.0f max=%"_S64BITARG_" usec\n",
+        theRate, theExpectedGap, theMinGap, theAvgGap, theMaxGap);
+
+    return (theAvgGap > theExpectedGap * 0.8) && (theAvgGap < theExpectedGap * 1.2);
+}
+#endif
+
+RTPPacerThread::RTPPacerThread()
+:   OSThread(),
+    fWakeCount(0),
+    fSendingPacer(NULL),
+    fNumInterfaces(0)
+{
+}
+
+void RTPPacerThread::Schedule(RTPPacer* inPacer, SInt64 inSendTime)
+{
+    OSMutexLocker locker(&fMutex);
+
+    OSHeapElem* theFirst = fHeap.PeekMin();
+    SInt64 theFirstTime = (theFirst != NULL) ? theFirst->GetValue() : kSInt64_Max;
+    if (inPacer->fHeapElem.IsMemberOfAnyHeap())
+    {
+        if (inPacer->fHeapElem.GetValue() <= inSendTime)
+            return;
+        (void)fHeap.Remove(&inPacer->fHeapElem);
+    }
+    inPacer->fHeapElem.SetValue(inSendTime);
+    fHeap.Insert(&inPacer->fHeapElem);
+
+    // Only wake the thread if it is sleeping past this send time
+    if (inSendTime < theFirstTime)
+        this->Wake();
+}
+
+void RTPPacerThread::Unschedule(RTPPacer* inPacer)
+{
+    // Once the pacer thread is done sending for the pacer, it's either back in
+    // the heap or it won't be scheduled again
+    OSMutexLocker locker(&fMutex);
+    while (fSendingPacer == inPacer)
+        fSendDoneCond.Wait(&fMutex);
+    if (inPacer->fHeapElem.IsMemberOfAnyHeap())
+        (void)fHeap.Remove(&inPacer->fHeapElem);
+}
+
+RTPTokenBucket* RTPPacerThread::GetInterfaceBucket(UInt32 inLocalAddr)
+{
+    QTSServerPrefs* thePrefs = QTSServerInterface::GetServer()->GetPrefs();
+    UInt32 theRateInKBits = thePrefs->GetRTPPacingInterfaceRateKBits();
+    if (theRateInKBits == 0)
+        return NULL;
+
+    InterfaceBucket* theInterface = NULL;
+    for (UInt32 x = 0; x < fNumInterfaces; x++)
+    {
+        if (fInterfaces[x].fLocalAddr == inLocalAddr)
+        {
+            theInterface = &fInterfaces[x];
+            break;
+        }
+    }
+    if (theInterface == NULL)
+    {
+        // More local addresses than we keep buckets for go unlimited
+        if (fNumInterfaces == kMaxInterfaces)
+            return NULL;
+        theInterface = &fInterfaces[fNumInterfaces++];
+        theInterface->fLocalAddr = inLocalAddr;
+    }
+    theInterface->fBucket.SetRate(theRateInKBits * 125, thePrefs->GetRTPPacingBurstBytes());
+    return &theInterface->fBucket;
+}
+
+void RTPPacerThread::Wake()
+{
+    (void)atomic_add(&fWakeCount, 1);
+#if defined(__linux__)
+    (void)::syscall(SYS_futex, &fWakeCount, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+    fCond.Signal();
+#endif
+}
+
+void RTPPacerThread::Wait(SInt64 inTimeoutInUSec)
+{
+    // Called with fMutex held. A negative timeout waits until Wake.
+#if defined(__linux__)
+    unsigned int theWakeCount = fWakeCount;
+    struct timespec theTimeout;
+    theTimeout.tv_sec = (time_t)(inTimeoutInUSec / 1000000);
+    theTimeout.tv_nsec = (long)(inTimeoutInUSec % 1000000) * 1000;
+
+    fMutex.Unlock();
+    // Returns right away if Wake was called since we looked at fWakeCount
+    (void)::syscall(SYS_futex, &fWakeCount, FUTEX_WAIT_PRIVATE, theWakeCount, (inTimeoutInUSec < 0) ? NULL : &theTimeout, NULL, 0);
+    fMutex.Lock();
+#else
+    // Other platforms only have millisecond timeouts, round up so we never wake early
+    SInt32 theTimeoutInMSec = 0;
+    if (inTimeoutInUSec >= 0)
+        theTimeoutInMSec = (SInt32)((inTimeoutInUSec + 999) / 1000) + 1;
+    fCond.Wait(&fMutex, theTimeoutInMSec);
+#endif
+}
+
+void RTPPacerThread::Entry()
+{
+    OSMutexLocker locker(&fMutex);
+
+    while (!this->IsStopRequested())
+    {
+        SInt64 theCurrentTime = OS::Microseconds();
+
+        //send what is due, and put the pacers that still have packets waiting back in the heap
+        OSHeapElem* theElem = NULL;
+        while (((theElem = fHeap.PeekMin()) != NULL) && (theElem->GetValue() <= theCurrentTime))
+        {
+            (void)fHeap.ExtractMin();
+            RTPPacer* thePacer = (RTPPacer*)theElem->GetEnclosingObject();
+
+            // Sending a key frame for one session mustn't hold up Schedule and
+            // Unschedule for the others
+            fSendingPacer = thePacer;
+            fMutex.Unlock();
+            SInt64 theNextSendTime = thePacer->SendQueuedPackets(theCurrentTime);
+            fMutex.Lock();
+            fSendingPacer = NULL;
+            fSendDoneCond.Broadcast();
+
+            // Schedule may have put it back in the meantime
+            if ((theNextSendTime != -1) && !theElem->IsMemberOfAnyHeap())
+            {
+                theElem->SetValue(theNextSendTime);
+                fHeap.Insert(theElem);
+            }
+        }
+
+        SInt64 theTimeout = -1;
+        if (theElem != NULL)
+            theTimeout = theElem->GetValue() - theCurrentTime;
+        this->Wait(theTimeout);
+    }
+}
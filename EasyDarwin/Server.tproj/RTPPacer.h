@@ -0,0 +1,197 @@
+/*
+	Copyright (c) 2013-2016 EasyDarwin.ORG.  All rights reserved.
+	Github: https://github.com/EasyDarwin
+	WEChat: EasyDarwin
+	Website: http://www.easydarwin.org
+*/
+/*
+    File:       RTPPacer.h
+
+    Contains:   Token bucket pacing of RTP over UDP. Without it a session sends
+                everything that is due whenever its task wakes up, so a key frame
+                leaves as one line rate burst that shallow switch and home router
+                buffers drop. Each RTPSession owns an RTPPacer, which lets packets
+                through at a rate that follows the session's bit rate and queues
+                the rest.
+
+                Queued packets are sent by a single pacer thread that sleeps with
+                microsecond timeouts. The task threads can't do this: their wait
+                has a 10 ms floor (see TaskThread::WaitForTask), so a task that
+                asked to run again in a few hundred microseconds would still send
+                in bursts. The pacer thread also keeps an optional token bucket per
+                local address, which caps all sessions sending from one interface
+                together.
+*/
+
+#ifndef __RTP_PACER_H__
+#define __RTP_PACER_H__
+
+#include "OSHeaders.h"
+#include "OSMutex.h"
+#include "OSCond.h"
+#include "OSHeap.h"
+#include "OSThread.h"
+#include "UDPSocket.h"
+
+#define RTPPACERTESTING 0
+
+class RTPPacerThread;
+
+//
+// RTPTokenBucket
+//
+// Rate in bytes per second, depth in bytes, times in OS::Microseconds. A packet
+// may go out whenever the bucket isn't in debt, and then takes its size out of
+// the bucket, so the longest burst is the depth plus one packet.
+class RTPTokenBucket
+{
+    public:
+
+        RTPTokenBucket() : fRate(0), fDepth(0), fTokens(0), fLastFillTime(-1) {}
+
+        // A rate of 0 lets everything through
+        void    SetRate(UInt32 inRate, UInt32 inDepth)  { fRate = inRate; fDepth = (SInt64)inDepth * kTokensPerByte; }
+        UInt32  GetRate()                               { return (UInt32)fRate; }
+
+        // Returns the time the next packet may go out, inCurrentTime if it may go now
+        SInt64  GetSendTime(SInt64 inCurrentTime);
+
+        void    Consume(UInt32 inBytes)     { fTokens -= (SInt64)inBytes * kTokensPerByte; }
+
+    private:
+
+        enum
+        {
+            // Tokens are kept in millionths of a byte, so that refills a few
+            // microseconds apart aren't rounded away
+            kTokensPerByte = 1000000    //SInt64
+        };
+
+        SInt64  fRate;
+        SInt64  fDepth;
+        SInt64  fTokens;
+        SInt64  fLastFillTime;
+};
+
+class RTPPacer
+{
+    public:
+
+        // Starts the pacer thread. Call once, before any session sends.
+        static void     Initialize();
+
+        static Bool16   IsEnabled();
+
+                        RTPPacer();
+                        ~RTPPacer();
+
+        // Sends an RTP packet of the session. The packet goes out right away if
+        // the session's token bucket allows it and no earlier packet is waiting,
+        // otherwise a copy is queued for the pacer thread. The pacing rate follows
+        // inBitRate, the session's current bit rate in bits per second.
+        //
+        // With inBatch a packet that may go right away is added to the socket's
+        // batch (see UDPSocket::SendToBatch) rather than sent, so the caller must
+        // keep the data until it flushes the socket.
+        //
+        // Returns EAGAIN if the queue is full, and then *outWakeupTime is the time
+        // in OS::Milliseconds when there will be room again.
+        OS_Error        Send(UDPSocket* inSocket, UInt32 inRemoteAddr, UInt16 inRemotePort,
+                                void* inBuffer, UInt32 inLength, UInt32 inBitRate, Bool16 inBatch, SInt64* outWakeupTime);
+
+        // Drops the queued packets and stops using the pacer thread. The session
+        // must call this before it releases the sockets its packets go out on.
+        void            Stop();
+
+        UInt32          GetNumQueued()  { return fNumQueued; }
+
+#if RTPPACERTESTING
+        // Pushes a burst through a pacer to a loopback socket and prints the gaps
+        // between the arrivals. Returns true if they match the pacing rate.
+        static Bool16   Test();
+#endif
+
+    private:
+
+        struct QueuedPacket
+        {
+            char*       fData;
+            UInt32      fBufferSize;
+            UInt32      fLength;
+            UDPSocket*  fSocket;
+            UInt32      fRemoteAddr;
+            UInt16      fRemotePort;
+            SInt64      fQueueTime;
+        };
+
+        void            SetRate(UInt32 inBitRate);
+
+        // Called by the pacer thread. Sends the queued packets that are due and
+        // returns when the next one is, or -1 if the queue is empty. The packets go
+        // out without fMutex held, so the session can keep queueing meanwhile.
+        SInt64          SendQueuedPackets(SInt64 inCurrentTime);
+
+        OSMutex         fMutex;     // protects the bucket and the queue from the pacer thread
+        RTPTokenBucket  fBucket;
+
+        QueuedPacket*   fQueue;     // ring, allocated when the first packet has to wait
+        UInt32          fQueueSize;
+        UInt32          fQueueHead;
+        UInt32          fNumQueued;
+        Bool16          fStopped;
+
+        OSHeapElem      fHeapElem;  // keyed by the time the head of the queue is due
+
+        static RTPPacerThread*  sPacerThread;
+
+        friend class RTPPacerThread;
+};
+
+//merely a private implementation detail of RTPPacer
+class RTPPacerThread : public OSThread
+{
+    private:
+
+        enum
+        {
+            kMaxInterfaces = 16 //UInt32
+        };
+
+        RTPPacerThread();
+        virtual ~RTPPacerThread() {}
+
+        // Makes the pacer thread send inPacer's queue, starting at inSendTime
+        void            Schedule(RTPPacer* inPacer, SInt64 inSendTime);
+        void            Unschedule(RTPPacer* inPacer);
+
+        // The aggregate bucket of a local address, or NULL if there is no limit
+        // per interface. Only the pacer thread uses these buckets.
+        RTPTokenBucket* GetInterfaceBucket(UInt32 inLocalAddr);
+
+        virtual void    Entry();
+        void            Wait(SInt64 inTimeoutInUSec);
+        void            Wake();
+
+        OSMutex         fMutex;     // protects the heap and fSendingPacer
+        OSHeap          fHeap;      // pacers with queued packets
+        unsigned int    fWakeCount;
+        
+        // The pacer the thread is sending for. It sends without fMutex, so
+        // Unschedule waits on fSendDoneCond until it is done with the pacer.
+        RTPPacer*       fSendingPacer;
+        OSCond          fSendDoneCond;
+#if !defined(__linux__)
+        OSCond          fCond;
+#endif
+        struct InterfaceBucket
+        {
+            UInt32          fLocalAddr;
+            RTPTokenBucket  fBucket;
+        };
+        InterfaceBucket fInterfaces[kMaxInterfaces];
+        UInt32          fNumInterfaces;
+
+        friend class RTPPacer;
+};
+
+#endif //__RTP_PACER_H__
@@ -77,6 +77,13 @@ static const UInt32 kInitialPacketArraySize = 64;// must be multiple of kPacketA
 //static const UInt32 kMaxPacketArraySize = 512;// must be multiple of kPacketArrayIncreaseInterval it would have to be a 3 mbit or more
 
 static const UInt32 kMaxDataBufferSize = 1600;
+
+static const UInt32 kNackHistorySize = 512;             // must be a power of 2
+static const SInt64 kNackHistoryMaxAgeMSec = 1000;
+static const UInt32 kNackBufferSize = 256 * 1024;       // a second of a 2 Mbit/s stream
+static const UInt16 kMaxNackRepairsPerPacket = 2;
+static const SInt32 kMaxNackBudgetBytes = 64 * 1024;    // how much unused budget may pile up during quiet periods
+static const UInt32 kNackEntriesSweptPerPacket = 2;
 OSBufferPool RTPPacketResender::sBufferPool(kMaxDataBufferSize);
 unsigned int    RTPPacketResender::sNumWastedBytes = 0;
 
@@ -96,7 +103,13 @@ RTPPacketResender::RTPPacketResender()
     fPacketArrayMask(0),
     fHighestSeqNum(0),
     fLastUsed(0),
-    fPacketQMutex()
+    fPacketQMutex(),
+    fNackHistory(NULL),
+    fNackBuffer(NULL),
+    fNackBufferPos(0),
+    fNackRepairPercent(0),
+    fNackBudgetBytes(0),
+    fNackSweepIndex(0)
 {
     fPacketArray = (RTPResenderEntry*) NEW char[sizeof(RTPResenderEntry) * fPacketArraySize];
     ::memset(fPacketArray,0,sizeof(RTPResenderEntry) * fPacketArraySize);
@@ -119,6 +132,13 @@ RTPPacketResender::~RTPPacketResender()
     }
             
     delete [] fPacketArray;
+    if (fNackHistory != NULL)
+    {
+        for (UInt32 y = 0; y < kNackHistorySize; y++)
+            this->ClearNackHistoryEntry(&fNackHistory[y]);
+    }
+    delete [] (char*)fNackHistory;
+    delete [] fNackBuffer;
     
 
 }
@@ -331,7 +351,7 @@ void RTPPacketResender::AddPacket( void * inRTPPacket, UInt32 packetSize, SInt32
         // Reset all the information in the RTPResenderEntry
         ::memcpy(theEntry->fPacketData, inRTPPacket, packetSize);
         theEntry->fPacketSize = packetSize;
-        theEntry->fAddedTime = OS::Milliseconds();
+        theEntry->fAddedTime = OS::CachedMilliseconds();
         theEntry->fOrigRetransTimeout = fBandwidthTracker->CurRetransmitTimeout();
         theEntry->fExpireTime = theEntry->fAddedTime + ageLimit;
         theEntry->fNumResends = 0;
@@ -488,7 +508,7 @@ void RTPPacketResender::ResendDueEntries()
     //
     SInt32 numResends = 0;
     RTPResenderEntry* theEntry = NULL; 
-    SInt64 curTime = OS::Milliseconds();
+    SInt64 curTime = OS::CachedMilliseconds();
     for (SInt32 packetIndex = fPacketsInList -1; packetIndex >= 0; packetIndex--) // walk backwards because remove packet moves array members forward
     {
         theEntry = &fPacketArray[packetIndex];
@@ -555,3 +575,109 @@ void RTPPacketResender::ResendDueEntries()
     }
 }
 void RTPPacketResender::RemovePacket(RTPResenderEntry* inEntry){ Assert(0); }
+
+void RTPPacketResender::StartNackHistory()
+{
+    if (fNackHistory != NULL)
+        return;
+        
+    fNackHistory = (RTPNackHistoryEntry*) NEW char[sizeof(RTPNackHistoryEntry) * kNackHistorySize];
+    ::memset(fNackHistory, 0, sizeof(RTPNackHistoryEntry) * kNackHistorySize);
+}
+
+void RTPPacketResender::ClearNackHistoryEntry(RTPNackHistoryEntry* inEntry)
+{
+    if (inEntry->fSharedBufferRef != NULL)
+        (inEntry->fReleaseProc)(inEntry->fSharedBufferRef);
+    inEntry->fSharedBufferRef = NULL;
+    inEntry->fSharedData = NULL;
+    inEntry->fPacketSize = 0;
+}
+
+void RTPPacketResender::AddNackHistoryPacket(void* inRTPPacket, UInt32 inPacketSize, const SInt64& inCurTimeInMsec, QTSS_SharedPacketStruct* inSharedPacket)
+{
+    if ((fNackHistory == NULL) || (inPacketSize < 12) || (inPacketSize > kMaxDataBufferSize)) // not even an RTP header, or no ordinary RTP packet
+        return;
+
+    UInt16 theSeqNum = ntohs(((UInt16*)inRTPPacket)[1]);
+    RTPNackHistoryEntry* theEntry = &fNackHistory[theSeqNum & (kNackHistorySize - 1)];
+    this->ClearNackHistoryEntry(theEntry);
+    
+    if (inSharedPacket != NULL)
+    {
+        (inSharedPacket->retainProc)(inSharedPacket->bufferRef);
+        theEntry->fSharedBufferRef = inSharedPacket->bufferRef;
+        theEntry->fReleaseProc = inSharedPacket->releaseProc;
+        theEntry->fSharedData = inRTPPacket;
+    }
+    else
+    {
+        //
+        // The sender may reuse its buffer as soon as we return, so keep a copy. A packet
+        // that doesn't fit before the end of the ring starts over at the beginning.
+        if (fNackBuffer == NULL)
+            fNackBuffer = NEW char[kNackBufferSize];
+            
+        UInt32 theOffset = (UInt32)(fNackBufferPos % kNackBufferSize);
+        if (theOffset + inPacketSize > kNackBufferSize)
+        {
+            fNackBufferPos += kNackBufferSize - theOffset;
+            theOffset = 0;
+        }
+        ::memcpy(fNackBuffer + theOffset, inRTPPacket, inPacketSize);
+        theEntry->fBufferPos = fNackBufferPos;
+        fNackBufferPos += inPacketSize;
+    }
+    
+    theEntry->fPacketSize = inPacketSize;
+    theEntry->fSentTime = inCurTimeInMsec;
+    theEntry->fSeqNum = theSeqNum;
+    theEntry->fNumRepairs = 0;
+    
+    //
+    // Shared buffers are pool buffers the sender would otherwise reuse, so don't keep
+    // them much past kNackHistoryMaxAgeMSec even when the stream slows down
+    for (UInt32 x = 0; x < kNackEntriesSweptPerPacket; x++)
+    {
+        RTPNackHistoryEntry* theOldEntry = &fNackHistory[fNackSweepIndex];
+        fNackSweepIndex = (fNackSweepIndex + 1) & (kNackHistorySize - 1);
+        if ((theOldEntry->fSharedBufferRef != NULL) && (inCurTimeInMsec - theOldEntry->fSentTime > kNackHistoryMaxAgeMSec))
+            this->ClearNackHistoryEntry(theOldEntry);
+    }
+
+    fNackBudgetBytes += (SInt32)((inPacketSize * fNackRepairPercent) / 100);
+    if (fNackBudgetBytes > kMaxNackBudgetBytes)
+        fNackBudgetBytes = kMaxNackBudgetBytes;
+}
+
+UInt32 RTPPacketResender::ResendNackedPacket(UInt16 inSeqNum, const SInt64& inCurTimeInMsec)
+{
+    if ((fNackHistory == NULL) || (fSocket == NULL))
+        return kNackLate;
+
+    RTPNackHistoryEntry* theEntry = &fNackHistory[inSeqNum & (kNackHistorySize - 1)];
+    if ((theEntry->fPacketSize == 0) || (theEntry->fSeqNum != inSeqNum) || (inCurTimeInMsec - theEntry->fSentTime > kNackHistoryMaxAgeMSec))
+        return kNackLate;
+
+    //
+    // At high bit rates the ring wraps in less than kNackHistoryMaxAgeMSec, and
+    // newer packets may already have been written over this one
+    if ((theEntry->fSharedBufferRef == NULL) && (fNackBufferPos - theEntry->fBufferPos > kNackBufferSize))
+        return kNackLate;
+
+    if ((theEntry->fNumRepairs >= kMaxNackRepairsPerPacket) || ((SInt32)theEntry->fPacketSize > fNackBudgetBytes))
+        return kNackRateLimited;
+    
+    // Only a tracker that is running on acks (RUDP) knows anything about the path
+    if ((fBandwidthTracker != NULL) && fBandwidthTracker->ReadyForAckProcessing() && fBandwidthTracker->IsFlowControlled())
+        return kNackRateLimited;
+
+    fNackBudgetBytes -= theEntry->fPacketSize;
+    theEntry->fNumRepairs++;
+    fNumResends++;
+    if (theEntry->fSharedBufferRef != NULL)
+        (void)fSocket->SendTo(fDestAddr, fDestPort, theEntry->fSharedData, theEntry->fPacketSize);
+    else
+        (void)fSocket->SendTo(fDestAddr, fDestPort, fNackBuffer + (UInt32)(theEntry->fBufferPos % kNackBufferSize), theEntry->fPacketSize);
+    return kNackRepaired;
+}
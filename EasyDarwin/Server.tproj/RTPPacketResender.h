@@ -44,6 +44,7 @@
 #include "OSMemory.h"
 #include "OSBufferPool.h"
 #include "OSMutex.h"
+#include "QTSS.h"
 
 #define RTP_PACKET_RESENDER_DEBUGGING 0
 
@@ -66,6 +67,22 @@ class RTPResenderEntry
 #endif
 };
 
+class RTPNackHistoryEntry
+{
+    public:
+    
+        UInt64              fBufferPos;     // where the copy starts in the NACK buffer's byte stream
+        UInt32              fPacketSize;    // 0 if the entry is empty
+        SInt64              fSentTime;
+        UInt16              fSeqNum;
+        UInt16              fNumRepairs;
+        
+        // A shared packet isn't copied, the entry holds a reference on the sender's buffer instead
+        void*                       fSharedData;
+        void*                       fSharedBufferRef;   // NULL if the packet is in the NACK buffer
+        QTSS_PacketBufferProcPtr    fReleaseProc;
+};
+
 
 class RTPPacketResender
 {
@@ -97,6 +114,25 @@ class RTPPacketResender
         // outstanding, unacked packets
         void                ClearOutstandingPackets();
 
+        //
+        // NACK repair (RFC 4585 generic NACK) for plain UDP streams. Most clients never
+        // send a NACK, so there is no history until StartNackHistory is called for the
+        // first one. From then on the history holds a reference on each shared packet
+        // (qtssWriteFlagsSharedPacket) sent, and a copy of other packets in a ring buffer,
+        // for kNackHistoryMaxAgeMSec or until newer packets take their place. Repairs may
+        // use up to inPercent of the bytes sent. Not thread safe either.
+        enum
+        {
+            kNackRepaired       = 0,
+            kNackLate           = 1,    // no longer (or never) in the history
+            kNackRateLimited    = 2     // over the repair budget or the bandwidth tracker's window
+        };
+        void                SetNackRepairPercent(UInt32 inPercent) { fNackRepairPercent = inPercent; }
+        void                StartNackHistory();
+        Bool16              IsNackHistoryStarted() { return fNackHistory != NULL; }
+        void                AddNackHistoryPacket(void* inRTPPacket, UInt32 inPacketSize, const SInt64& inCurTimeInMsec, QTSS_SharedPacketStruct* inSharedPacket);
+        UInt32              ResendNackedPacket(UInt16 inSeqNum, const SInt64& inCurTimeInMsec);
+
         //
         // ACCESSORS
         Bool16              IsFlowControlled()      { return fBandwidthTracker->IsFlowControlled(); }
@@ -152,10 +188,18 @@ class RTPPacketResender
         UInt32              fLastUsed;
         OSMutex             fPacketQMutex;
 
+        RTPNackHistoryEntry* fNackHistory;          // allocated by StartNackHistory
+        char*               fNackBuffer;            // ring unshared packets are copied into, allocated by the first one
+        UInt64              fNackBufferPos;         // bytes written to the ring so far
+        UInt32              fNackRepairPercent;
+        SInt32              fNackBudgetBytes;
+        UInt32              fNackSweepIndex;        // next history entry to check for old shared packets
+
         RTPResenderEntry*   GetEntryByIndex(UInt16 inIndex);
         RTPResenderEntry*   GetEntryBySeqNum(UInt16 inSeqNum);
 
         RTPResenderEntry*   GetEmptyEntry(UInt16 inSeqNum, UInt32 inPacketSize);
+        void                ClearNackHistoryEntry(RTPNackHistoryEntry* inEntry);
         void ReallocatePacketArray();
         void RemovePacket(UInt32 packetIndex, Bool16 reuse=true);
         void RemovePacket(RTPResenderEntry* inEntry);
@@ -70,6 +70,9 @@ RTPSession::RTPSession() :
 
 RTPSession::~RTPSession()
 {
+    // Queued packets go out on the streams' sockets, drop them before the sockets go away
+    this->GetPacer()->Stop();
+
     // Delete all the streams
     RTPStream** theStream = NULL;
     UInt32 theLen = 0;
@@ -493,17 +496,8 @@ void    RTPSession::SendDescribeResponse(RTSPRequestInterface* inRequest)
     // write date and expires
     inRequest->AppendDateAndExpires();
     
-    //write content type header
-    static StrPtrLen sContentType("application/sdp");
-    inRequest->AppendHeader(qtssContentTypeHeader, &sContentType);
-    
-    // write x-Accept-Retransmit header
-    static StrPtrLen sRetransmitProtocolName("our-retransmit");
-    inRequest->AppendHeader(qtssXAcceptRetransmitHeader, &sRetransmitProtocolName);
-	
-	// write x-Accept-Dynamic-Rate header
-	static StrPtrLen dynamicRateEnabledStr("1");
-	inRequest->AppendHeader(qtssXAcceptDynamicRateHeader, &dynamicRateEnabledStr);
+    // write the premade content type, x-Accept-Retransmit & x-Accept-Dynamic-Rate headers
+    inRequest->AppendDescribeHeaders();
     
     //write content base header
     
@@ -44,6 +44,7 @@
 #include "Task.h"
 #include "RTPBandwidthTracker.h"
 #include "RTPOverbufferWindow.h"
+#include "RTPPacer.h"
 #include "QTSServerInterface.h"
 #include "OSMutex.h"
 #include "atomic.h"
@@ -106,6 +107,7 @@ class RTPSessionInterface : public QTSSDictionary, public Task
         UInt32  GetUniqueID()           { return fUniqueID; }
         RTPBandwidthTracker* GetBandwidthTracker() { return &fTracker; }
         RTPOverbufferWindow* GetOverbufferWindow() { return &fOverbufferWindow; }
+        RTPPacer*       GetPacer()          { return &fPacer; }
         UInt32  GetFramesSkipped() { return fFramesSkipped; }
         
         //
@@ -327,6 +329,7 @@ class RTPSessionInterface : public QTSSDictionary, public Task
         
         RTPBandwidthTracker fTracker;
         RTPOverbufferWindow fOverbufferWindow;
+        RTPPacer            fPacer;
         
         // Built in dictionary attributes
         static QTSSAttrInfoDict::AttrInfo   sAttributes[];
@@ -254,7 +254,8 @@ RTPStream::RTPStream(UInt32 inSSRC, RTPSessionInterface* inSession)
     fInitialMaxQualityLevelIsSet(false),
     fUDPMonitorEnabled(QTSServerInterface::GetServer()->GetPrefs()->GetUDPMonitorEnabled()),
     fMonitorVideoDestPort(QTSServerInterface::GetServer()->GetPrefs()->GetUDPMonitorVideoPort() ),
-    fMonitorAudioDestPort(QTSServerInterface::GetServer()->GetPrefs()->GetUDPMonitorAudioPort() )
+    fMonitorAudioDestPort(QTSServerInterface::GetServer()->GetPrefs()->GetUDPMonitorAudioPort() ),
+    fNackEnabled(false)
 {
     Bool16 doRateAdaptation = QTSServerInterface::GetServer()->GetPrefs()->Get3GPPEnabled() && QTSServerInterface::GetServer()->GetPrefs()->Get3GPPRateAdaptationEnabled();
     
@@ -616,6 +617,17 @@ QTSS_Error RTPStream::Setup(RTSPRequestInterface* request, QTSS_AddStreamFlags i
         }
 #endif
     }
+    else if ((fTransportType == qtssRTPTransportTypeUDP) && !SocketUtils::IsMulticastIPAddr(fRemoteAddr) &&
+             QTSServerInterface::GetServer()->GetPrefs()->IsRTCPNackEnabled())
+    {
+        //
+        // NACK repairs go out the RTP socket like the original packets, out of a budget
+        // that is a share of what this stream sends
+        fNackEnabled = true;
+        fResender.SetBandwidthTracker( fSession->GetBandwidthTracker() );
+        fResender.SetDestination( fSockets->GetSocketA(), fRemoteAddr, fRemoteRTPPort );
+        fResender.SetNackRepairPercent( QTSServerInterface::GetServer()->GetPrefs()->GetRTCPNackRepairPercent() );
+    }
     
     //
     // Record the Server RTP port
@@ -1115,7 +1127,7 @@ QTSS_Error  RTPStream::Write(void* inBuffer, UInt32 inLen, UInt32* outLenWritten
 
 
     QTSS_Error err = QTSS_NoErr;
-    SInt64 theTime = OS::Milliseconds();
+    SInt64 theTime = OS::CachedMilliseconds();
     
     //
     // Data passed into this version of write must be a QTSS_PacketStruct
@@ -1210,9 +1222,31 @@ QTSS_Error  RTPStream::Write(void* inBuffer, UInt32 inLen, UInt32* outLenWritten
                 err = this->ReliableRTPWrite( thePacket->packetData, inLen, theCurrentPacketDelay );
             else if ( inLen > 0 )
 			{
-                (void)fSockets->GetSocketA()->SendTo(fRemoteAddr, fRemoteRTPPort, thePacket->packetData, inLen);
-            
-                this->UDPMonitorWrite(thePacket->packetData, inLen, kIsRTPPacket);
+                // The session's pacer sends the packet now, or batches it like below, or keeps a
+                // copy until its token bucket allows it. A full pacer queue flow controls the
+                // caller like a full overbuffer window does.
+                if (RTPPacer::IsEnabled())
+                {
+                    if (fSession->GetPacer()->Send(fSockets->GetSocketA(), fRemoteAddr, fRemoteRTPPort, thePacket->packetData, inLen,
+                                                    fSession->GetCurrentMovieBitRate(), (inFlags & qtssWriteFlagsBufferData) != 0,
+                                                    &thePacket->suggestedWakeupTime) == EAGAIN)
+                        err = QTSS_WouldBlock;
+                }
+                // With qtssWriteFlagsBufferData the packet is only queued on the socket and goes
+                // out with the others on the next QTSS_Flush, so the packet data must stay put until then
+                else if (inFlags & qtssWriteFlagsBufferData)
+                    (void)fSockets->GetSocketA()->SendToBatch(fRemoteAddr, fRemoteRTPPort, thePacket->packetData, inLen);
+                else
+                    (void)fSockets->GetSocketA()->SendTo(fRemoteAddr, fRemoteRTPPort, thePacket->packetData, inLen);
+
+                if (err == QTSS_NoErr)
+                {
+                    if (fNackEnabled)
+                        fResender.AddNackHistoryPacket(thePacket->packetData, inLen, theTime,
+                                                        (inFlags & qtssWriteFlagsSharedPacket) ? (QTSS_SharedPacketStruct*)inBuffer : NULL);
+                
+                    this->UDPMonitorWrite(thePacket->packetData, inLen, kIsRTPPacket);
+                }
 			}
 
             if (err == QTSS_NoErr)
@@ -1328,6 +1362,17 @@ QTSS_Error  RTPStream::Write(void* inBuffer, UInt32 inLen, UInt32* outLenWritten
     return err;
 }
 
+QTSS_Error  RTPStream::Flush()
+{
+    // The socket batch and the RTSP session's coalesce buffer have their own
+    // locks, so the session mutex isn't needed here
+    if ((fSockets != NULL) && (fTransportType == qtssRTPTransportTypeUDP))
+        (void)fSockets->GetSocketA()->FlushBatch();
+    else if ((fTransportType == qtssRTPTransportTypeTCP) && (fSession->GetRTSPSession() != NULL))
+        (void)fSession->GetRTSPSession()->FlushInterleavedWrites();
+    return QTSS_NoErr;
+}
+
 
 
 // SendRTCPSR is called by the session as well as the strem
@@ -1495,6 +1540,53 @@ Bool16 RTPStream::ProcessAckPacket(RTCPPacket &rtcpPacket, SInt64 &curTime)
 
 }
 
+Bool16 RTPStream::ProcessNackPacket(RTCPPacket &rtcpPacket, SInt64 &curTime)
+{
+    RTCPGenericNackPacket theNackPacket;
+    UInt32 packetLen = (rtcpPacket.GetPacketLength() * 4) + RTCPPacket::kRTCPHeaderSizeInBytes;
+
+    if (!theNackPacket.ParseNackPacket(rtcpPacket.GetPacketBuffer(), packetLen))
+        return false;
+
+    if (!fNackEnabled)
+        return true;
+
+    // The first NACK starts the history, so it can only repair later losses
+    fResender.StartNackHistory();
+
+#ifdef DEBUG_RTCP_PACKETS
+    theNackPacket.Dump();
+#endif
+
+    UInt32 numRequested = 0;
+    UInt32 numRepaired = 0;
+    UInt32 numLate = 0;
+    UInt32 numRateLimited = 0;
+    for (UInt32 fciCount = 0; fciCount < theNackPacket.GetNumFCIs(); fciCount++)
+    {
+        UInt16 thePID = theNackPacket.GetPID(fciCount);
+        UInt16 theBLP = theNackPacket.GetBLP(fciCount);
+        
+        // The PID itself is lost, and BLP bit n means PID + n + 1 is lost too
+        for (UInt16 offset = 0; offset <= 16; offset++)
+        {
+            if ((offset > 0) && !(theBLP & (1 << (offset - 1))))
+                continue;
+
+            numRequested++;
+            switch (fResender.ResendNackedPacket(thePID + offset, curTime))
+            {
+                case RTPPacketResender::kNackRepaired:      numRepaired++;      break;
+                case RTPPacketResender::kNackLate:          numLate++;          break;
+                case RTPPacketResender::kNackRateLimited:   numRateLimited++;   break;
+            }
+        }
+    }
+    
+    QTSServerInterface::GetServer()->IncrementRTCPNacks(numRequested, numRepaired, numLate, numRateLimited);
+    return true;
+}
+
 Bool16 RTPStream::TestRTCPPackets(StrPtrLen* inPacketPtr, UInt32 itemName)
 {
     // Testing?
@@ -1552,8 +1644,8 @@ void RTPStream::ProcessIncomingRTCPPacket(StrPtrLen* inPacket)
 
     // Modules are guarenteed atomic access to the session. Also, the RTSP Session accessed
     // below could go away at any time. So we need to lock the RTP session mutex.
-    // *BUT*, when this function is called the caller already has the UDP socket pool &
-    // UDP Demuxer mutexes. Blocking on grabbing this mutex could cause a deadlock.
+    // *BUT*, when this function is called the caller already has the UDP socket pool
+    // mutex and a UDP Demuxer read lock. Blocking on grabbing this mutex could cause a deadlock.
     // So, dump this RTCP packet if we can't get the mutex.
     if (!fSession->GetSessionMutex()->TryLock())
         return;
@@ -1711,6 +1803,18 @@ void RTPStream::ProcessIncomingRTCPPacket(StrPtrLen* inPacket)
             }
             break;
             
+            case RTCPPacket::kRTPFeedbackPacketType:
+            {
+                DEBUG_RTCP_PRINTF(("RTPStream::ProcessIncomingRTCPPacket kRTPFeedbackPacketType\n"));
+                // Generic NACK is the only transport layer feedback we act on, skip the others
+                if ((rtcpPacket.GetReportCount() == RTCPGenericNackPacket::kGenericNackFormat) && !this->ProcessNackPacket(rtcpPacket, curTime))
+                {
+                    fSession->GetSessionMutex()->Unlock();
+                    return;//abort if we discover a malformed NACK
+                }
+            }
+            break;
+            
             case RTCPPacket::kSDESPacketType:
             {
                   DEBUG_RTCP_PRINTF(("RTPStream::ProcessIncomingRTCPPacket kSDESPacketType\n"));
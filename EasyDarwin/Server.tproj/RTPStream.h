@@ -102,6 +102,9 @@ class RTPStream : public QTSSDictionary, public UDPDemuxerTask
         virtual QTSS_Error  Write(void* inBuffer, UInt32 inLen,
                                         UInt32* outLenWritten, QTSS_WriteFlags inFlags);
         
+        // Sends the RTP packets buffered by Write with qtssWriteFlagsBufferData
+        virtual QTSS_Error  Flush();
+        
         
         //UTILITY FUNCTIONS:
         //These are not necessary to call and do not manipulate the state of the
@@ -135,6 +138,9 @@ class RTPStream : public QTSSDictionary, public UDPDemuxerTask
         
         Bool16 ProcessNADUPacket(RTCPPacket &rtcpPacket, SInt64 &curTime, StrPtrLen &currentPtr, UInt32 highestSeqNum);
 
+        //Process the incoming RFC 4585 generic NACK, resending what we still have
+        Bool16 ProcessNackPacket(RTCPPacket &rtcpPacket, SInt64 &curTime);
+
 
         // Send a RTCP SR on this stream. Pass in true if this SR should also have a BYE
         void SendRTCPSR(const SInt64& inTime, Bool16 inAppendBye = false);
@@ -357,6 +363,7 @@ class RTPStream : public QTSSDictionary, public UDPDemuxerTask
 		Bool16 fUDPMonitorEnabled;
 		UInt16 fMonitorVideoDestPort;
 		UInt16 fMonitorAudioDestPort;
+		Bool16 fNackEnabled;    // UDP stream that answers generic NACKs from fResender's history
         
         //-----------------------------------------------------------
         // acutally write the data out that way
@@ -32,6 +32,11 @@
 #include <ctype.h>
 #include "RTSPProtocol.h"
 
+#if __RTSPPROTOCOL_TESTING__
+#include "StringParser.h"
+#include "OS.h"
+#endif
+
 StrPtrLen RTSPProtocol::sRetrProtName("our-retransmit");
 
 StrPtrLen RTSPProtocol::sMethods[] =
@@ -144,58 +149,61 @@ StrPtrLen RTSPProtocol::sHeaders[] =
 	StrPtrLen("x-predecbufsize"),
 	StrPtrLen("x-initpredecbufperiod"),
 	StrPtrLen("x-initpostdecbufperiod"),
-	StrPtrLen("3gpp-videopostdecbufsize")
+	StrPtrLen("3gpp-videopostdecbufsize"),
+	
+	//forward error correction for RTP over UDP
+	StrPtrLen("x-FEC")
 	
 	
 	
 };
 
+// Perfect hash of the header names in sHeaders, case insensitive. Every name
+// lands in its own slot of sHeaderHashTable, so a lookup is the hash plus one
+// compare. The multipliers and the table were generated offline for this set of
+// names: adding a header means picking multipliers that keep the names apart
+// again, and regenerating the table (RTSPProtocol::Test checks it).
+inline UInt32 RTSPProtocol::HashHeaderName(const StrPtrLen &inHeaderStr)
+{
+    // | 0x20 lowercases letters and leaves '-', ',' and digits alone
+    UInt8* theName = (UInt8*)inHeaderStr.Ptr;
+    UInt32 theLen = inHeaderStr.Len;
+    UInt32 theSecond = (theLen > 1) ? 1 : 0;
+    UInt32 theNextToLast = (theLen > 1) ? theLen - 2 : 0;
+    return ((theLen * 5) + ((theName[0] | 0x20) * 2) + ((theName[theSecond] | 0x20) * 9)
+            + (theName[theLen - 1] | 0x20) + ((theName[theNextToLast] | 0x20) * 3)) & 0xFF;
+}
+
+UInt8 RTSPProtocol::sHeaderHashTable[] =
+{
+     5, 63, 63, 63, 63, 63, 20, 63, 63, 63, 63, 55, 63, 63, 63, 63, //0-15
+    63, 63, 63, 63, 63, 26, 63, 63, 63, 63, 63, 63, 63, 63,  9,  0, //16-31
+    63, 24,  7, 34, 63, 63, 63, 63, 63, 11, 63, 63, 63, 63, 43, 63, //32-47
+    62, 63, 41, 63, 63, 30, 63, 63, 37,  6, 63, 63, 63, 63, 63, 63, //48-63
+    63, 63, 63, 63, 63, 63, 63, 63, 38, 31, 63, 25, 63, 63, 63, 32, //64-79
+    61,  4, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 50, 63, 63, //80-95
+    63, 63, 63, 63, 63, 49, 63, 63, 63, 63, 63, 39, 63, 12, 63, 63, //96-111
+    45, 47, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 36, 63, 63, //112-127
+    63, 63, 35, 63, 63,  1, 63, 63, 63, 63, 63, 63, 51, 63, 63, 63, //128-143
+    10, 63, 42, 46, 63, 63, 63, 16, 23, 44, 13, 63, 22, 63, 19, 59, //144-159
+    63, 48, 27, 58, 60, 63, 63, 14, 63, 63, 63, 63, 63, 63, 15, 52, //160-175
+    63, 63, 53, 63, 63, 63, 63, 17, 18, 40, 63, 63, 63, 63, 63, 63, //176-191
+    63, 33, 63, 63, 63, 63, 63, 21, 63, 63, 63, 63, 63, 63, 63, 63, //192-207
+    63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63,  8, 63, 63, 29, 63, //208-223
+    54,  3, 63, 63, 63,  2, 63, 63, 63, 63, 63, 63, 63, 63, 56, 63, //224-239
+    63, 57, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 28, 63, 63  //240-255
+};
+
 QTSS_RTSPHeader RTSPProtocol::GetRequestHeader(const StrPtrLen &inHeaderStr)
 {
     if (inHeaderStr.Len == 0)
         return qtssIllegalHeader;
     
-    QTSS_RTSPHeader theHeader = qtssIllegalHeader;
-    
-    //chances are this is one of our selected "VIP" headers. so check for this.
-    switch(*inHeaderStr.Ptr)
-    {
-        case 'C':   case 'c':   theHeader = qtssCSeqHeader;         break;
-        case 'S':   case 's':   theHeader = qtssSessionHeader;      break;
-        case 'U':   case 'u':   theHeader = qtssUserAgentHeader;    break;
-        case 'A':   case 'a':   theHeader = qtssAcceptHeader;       break;
-        case 'T':   case 't':   theHeader = qtssTransportHeader;    break;
-        case 'R':   case 'r':   theHeader = qtssRangeHeader;        break;
-        case 'X':   case 'x':   theHeader = qtssExtensionHeaders;   break;
-    }
-    
-    //
-    // Check to see whether this is one of our extension headers. These
-    // are very likely to appear in requests.
-    if (theHeader == qtssExtensionHeaders)
-    {
-        for (SInt32 y = qtssExtensionHeaders; y < qtssNumHeaders; y++)
-        {
-            if (inHeaderStr.EqualIgnoreCase(sHeaders[y].Ptr, sHeaders[y].Len))
-                return y;
-        }
-    }
-    
-    //
-    // It's not one of our extension headers, check to see if this is one of
-    // our normal VIP headers
+    QTSS_RTSPHeader theHeader = sHeaderHashTable[HashHeaderName(inHeaderStr)];
     if ((theHeader != qtssIllegalHeader) &&
         (inHeaderStr.EqualIgnoreCase(sHeaders[theHeader].Ptr, sHeaders[theHeader].Len)))
         return theHeader;
 
-    //
-    //If this isn't one of our VIP headers, go through the remaining request headers, trying
-    //to find the right one.
-    for (SInt32 x = qtssNumVIPHeaders; x < qtssNumHeaders; x++)
-    {
-        if (inHeaderStr.EqualIgnoreCase(sHeaders[x].Ptr, sHeaders[x].Len))
-            return x;
-    }
     return qtssIllegalHeader;
 }
 
@@ -370,3 +378,226 @@ RTSPProtocol::GetVersion(StrPtrLen &versionStr)
     else
         return k10Version;
 }
+
+#if __RTSPPROTOCOL_TESTING__
+
+// The header lookup the hash replaced: a guess on the first character, then
+// a walk down the name list
+static QTSS_RTSPHeader LinearGetRequestHeader(StrPtrLen* inHeaders, const StrPtrLen &inHeaderStr)
+{
+    if (inHeaderStr.Len == 0)
+        return qtssIllegalHeader;
+    
+    QTSS_RTSPHeader theHeader = qtssIllegalHeader;
+    
+    //chances are this is one of our selected "VIP" headers. so check for this.
+    switch(*inHeaderStr.Ptr)
+    {
+        case 'C':   case 'c':   theHeader = qtssCSeqHeader;         break;
+        case 'S':   case 's':   theHeader = qtssSessionHeader;      break;
+        case 'U':   case 'u':   theHeader = qtssUserAgentHeader;    break;
+        case 'A':   case 'a':   theHeader = qtssAcceptHeader;       break;
+        case 'T':   case 't':   theHeader = qtssTransportHeader;    break;
+        case 'R':   case 'r':   theHeader = qtssRangeHeader;        break;
+        case 'X':   case 'x':   theHeader = qtssExtensionHeaders;   break;
+    }
+    
+    //
+    // Check to see whether this is one of our extension headers. These
+    // are very likely to appear in requests.
+    if (theHeader == qtssExtensionHeaders)
+    {
+        for (SInt32 y = qtssExtensionHeaders; y < qtssNumHeaders; y++)
+        {
+            if (inHeaderStr.EqualIgnoreCase(inHeaders[y].Ptr, inHeaders[y].Len))
+                return y;
+        }
+    }
+    
+    //
+    // It's not one of our extension headers, check to see if this is one of
+    // our normal VIP headers
+    if ((theHeader != qtssIllegalHeader) &&
+        (inHeaderStr.EqualIgnoreCase(inHeaders[theHeader].Ptr, inHeaders[theHeader].Len)))
+        return theHeader;
+
+    //
+    //If this isn't one of our VIP headers, go through the remaining request headers, trying
+    //to find the right one.
+    for (SInt32 x = qtssNumVIPHeaders; x < qtssNumHeaders; x++)
+    {
+        if (inHeaderStr.EqualIgnoreCase(inHeaders[x].Ptr, inHeaders[x].Len))
+            return x;
+    }
+    return qtssIllegalHeader;
+}
+
+// Requests as sent by VLC, ffmpeg, QuickTime and EasyPusher
+static char* sRequestCorpus[] =
+{
+    "OPTIONS rtsp://192.168.1.10:554/live/camera1.sdp RTSP/1.0\r\n"
+    "CSeq: 2\r\n"
+    "User-Agent: LibVLC/3.0.16 (LIVE555 Streaming Media v2016.11.28)\r\n\r\n",
+
+    "DESCRIBE rtsp://192.168.1.10:554/live/camera1.sdp RTSP/1.0\r\n"
+    "CSeq: 3\r\n"
+    "User-Agent: LibVLC/3.0.16 (LIVE555 Streaming Media v2016.11.28)\r\n"
+    "Accept: application/sdp\r\n\r\n",
+
+    "SETUP rtsp://192.168.1.10:554/live/camera1.sdp/trackID=0 RTSP/1.0\r\n"
+    "CSeq: 4\r\n"
+    "User-Agent: LibVLC/3.0.16 (LIVE555 Streaming Media v2016.11.28)\r\n"
+    "Transport: RTP/AVP;unicast;client_port=57870-57871\r\n\r\n",
+
+    "SETUP rtsp://192.168.1.10:554/live/camera1.sdp/trackID=1 RTSP/1.0\r\n"
+    "Transport: RTP/AVP/TCP;unicast;interleaved=2-3\r\n"
+    "CSeq: 5\r\n"
+    "User-Agent: Lavf58.29.100\r\n"
+    "Session: 1867315923286734218\r\n\r\n",
+
+    "PLAY rtsp://192.168.1.10:554/live/camera1.sdp RTSP/1.0\r\n"
+    "CSeq: 6\r\n"
+    "User-Agent: LibVLC/3.0.16 (LIVE555 Streaming Media v2016.11.28)\r\n"
+    "Session: 1867315923286734218\r\n"
+    "Range: npt=0.000-\r\n\r\n",
+
+    "PLAY rtsp://192.168.1.10/sample_100kbit.mp4/ RTSP/1.0\r\n"
+    "CSeq: 5\r\n"
+    "Session: 1210526578426425371\r\n"
+    "Range: npt=0.000000-\r\n"
+    "x-prebuffer: maxtime=2.000000\r\n"
+    "x-transport-options: late-tolerance=10\r\n"
+    "Bandwidth: 384000\r\n"
+    "Speed: 1.00\r\n"
+    "User-Agent: QTS (qtver=7.7.1;os=Windows NT 6.1Service Pack 1)\r\n"
+    "Accept-Language: en-US\r\n\r\n",
+
+    "ANNOUNCE rtsp://192.168.1.10:554/live/camera1.sdp RTSP/1.0\r\n"
+    "Content-Type: application/sdp\r\n"
+    "CSeq: 1\r\n"
+    "User-Agent: EasyPusher v1.2.16.1105\r\n"
+    "Authorization: Digest username=\"admin\", realm=\"Streaming Server\", nonce=\"7a6f4f2b\", uri=\"rtsp://192.168.1.10:554/live/camera1.sdp\", response=\"1b6f9ad0\"\r\n"
+    "Content-Length: 478\r\n\r\n",
+
+    "SETUP rtsp://192.168.1.10:554/live/camera1.sdp/streamid=0 RTSP/1.0\r\n"
+    "Transport: RTP/AVP/TCP;unicast;interleaved=0-1;mode=record\r\n"
+    "CSeq: 2\r\n"
+    "User-Agent: EasyPusher v1.2.16.1105\r\n\r\n",
+
+    "RECORD rtsp://192.168.1.10:554/live/camera1.sdp RTSP/1.0\r\n"
+    "Range: npt=0.000-\r\n"
+    "CSeq: 4\r\n"
+    "User-Agent: EasyPusher v1.2.16.1105\r\n"
+    "Session: 3482516172846172381\r\n\r\n"
+};
+
+// Walks the headers of a request the way RTSPRequest::ParseHeaders does, and
+// returns the sum of the header enums, so that the work can't be optimized away.
+// The header names are also stored in ioNames, if that's not NULL.
+static UInt32 ParseCorpusHeaders(StrPtrLen* inRequest, Bool16 inUseHash, StrPtrLen* ioNames = NULL, UInt32* ioNumNames = NULL)
+{
+    StringParser theParser(inRequest);
+    theParser.GetThruEOL(NULL); // the request line
+
+    UInt32 theSum = 0;
+    StrPtrLen theKeyWord;
+    while ((theParser.GetDataRemaining() > 0) && (theParser.PeekFast() != '\r') && (theParser.PeekFast() != '\n'))
+    {
+        if (!theParser.GetThru(&theKeyWord, ':'))
+            break;
+        theKeyWord.TrimWhitespace();
+        theSum += inUseHash ? RTSPProtocol::GetRequestHeader(theKeyWord) : LinearGetRequestHeader(&RTSPProtocol::GetHeaderString(0), theKeyWord);
+        if (ioNames != NULL)
+            ioNames[(*ioNumNames)++] = theKeyWord;
+        theParser.GetThruEOL(NULL);
+    }
+    return theSum;
+}
+
+Bool16 RTSPProtocol::Test()
+{
+    // Every name must hash to itself, whatever the case
+    for (UInt32 x = 0; x < qtssNumHeaders; x++)
+    {
+        char theName[64];
+        Assert(sHeaders[x].Len < sizeof(theName));
+        ::memcpy(theName, sHeaders[x].Ptr, sHeaders[x].Len);
+        StrPtrLen theNameStr(theName, sHeaders[x].Len);
+        if (GetRequestHeader(theNameStr) != x)
+            return false;
+
+        for (UInt32 y = 0; y < theNameStr.Len; y++)
+            theName[y] = toupper(theName[y]);
+        if (GetRequestHeader(theNameStr) != x)
+            return false;
+        for (UInt32 y = 0; y < theNameStr.Len; y++)
+            theName[y] = tolower(theName[y]);
+        if (GetRequestHeader(theNameStr) != x)
+            return false;
+    }
+
+    // Names that aren't headers, and names that only share a hash with one
+    static char* sNotHeaders[] = { "X", "Cseqq", "Sessio", "Transports", "x-Unknown", "Content-Lengthy", "Accepts" };
+    for (UInt32 z = 0; z < sizeof(sNotHeaders) / sizeof(char*); z++)
+    {
+        StrPtrLen theNameStr(sNotHeaders[z]);
+        if (GetRequestHeader(theNameStr) != qtssIllegalHeader)
+            return false;
+    }
+
+    // and both lookups have to agree on real requests
+    for (UInt32 r = 0; r < sizeof(sRequestCorpus) / sizeof(char*); r++)
+    {
+        StrPtrLen theRequest(sRequestCorpus[r]);
+        if (ParseCorpusHeaders(&theRequest, true) != ParseCorpusHeaders(&theRequest, false))
+            return false;
+    }
+    return true;
+}
+
+void RTSPProtocol::Benchmark(UInt32 inNumIterations)
+{
+    UInt32 theNumRequests = sizeof(sRequestCorpus) / sizeof(char*);
+    StrPtrLen theRequests[sizeof(sRequestCorpus) / sizeof(char*)];
+    StrPtrLen theNames[128];
+    UInt32 theNumNames = 0;
+    for (UInt32 r = 0; r < theNumRequests; r++)
+    {
+        theRequests[r].Set(sRequestCorpus[r]);
+        (void)ParseCorpusHeaders(&theRequests[r], true, theNames, &theNumNames);
+    }
+
+    // The lookups on their own
+    UInt32 theSum = 0;
+    SInt64 theLinearLookupStart = OS::Microseconds();
+    for (UInt32 x = 0; x < inNumIterations; x++)
+        for (UInt32 n = 0; n < theNumNames; n++)
+            theSum += LinearGetRequestHeader(&RTSPProtocol::GetHeaderString(0), theNames[n]);
+    SInt64 theLinearLookupTime = OS::Microseconds() - theLinearLookupStart;
+
+    SInt64 theHashLookupStart = OS::Microseconds();
+    for (UInt32 x = 0; x < inNumIterations; x++)
+        for (UInt32 n = 0; n < theNumNames; n++)
+            theSum += GetRequestHeader(theNames[n]);
+    SInt64 theHashLookupTime = OS::Microseconds() - theHashLookupStart;
+
+    // and as part of walking the whole header block
+    SInt64 theLinearStart = OS::Microseconds();
+    for (UInt32 x = 0; x < inNumIterations; x++)
+        for (UInt32 r = 0; r < theNumRequests; r++)
+            theSum += ParseCorpusHeaders(&theRequests[r], false);
+    SInt64 theLinearTime = OS::Microseconds() - theLinearStart;
+
+    SInt64 theHashStart = OS::Microseconds();
+    for (UInt32 x = 0; x < inNumIterations; x++)
+        for (UInt32 r = 0; r < theNumRequests; r++)
+            theSum += ParseCorpusHeaders(&theRequests[r], true);
+    SInt64 theHashTime = OS::Microseconds() - theHashStart;
+
+    qtss_printf("RTSPProtocol::Benchmark %"_U32BITARG_" header lookups: linear %"_64BITARG_"d usec, perfect hash %"_64BITARG_"d usec\n",
+                inNumIterations * theNumNames, theLinearLookupTime, theHashLookupTime);
+    qtss_printf("RTSPProtocol::Benchmark %"_U32BITARG_" requests parsed: linear %"_64BITARG_"d usec, perfect hash %"_64BITARG_"d usec (%"_U32BITARG_")\n",
+                inNumIterations * theNumRequests, theLinearTime, theHashTime, theSum);
+}
+
+#endif
@@ -41,6 +41,8 @@
 #include "QTSSRTSPProtocol.h"
 #include "StrPtrLen.h"
 
+#define __RTSPPROTOCOL_TESTING__ 0
+
 class RTSPProtocol
 {
     public:
@@ -59,7 +61,7 @@ class RTSPProtocol
 
         //  Header enumerated type definitions in QTSS_RTSPProtocol.h
         
-        //The lookup function. Very simple
+        //The lookup function. A perfect hash of the header name, then one compare
         static UInt32 GetRequestHeader(const StrPtrLen& inHeaderStr);
         
         //The lookup function. Very simple.
@@ -93,12 +95,24 @@ class RTSPProtocol
         static RTSPVersion      GetVersion(StrPtrLen &versionStr);
         static StrPtrLen&       GetVersionString(RTSPVersion version)
             { return sVersionString[version]; }
+
+#if __RTSPPROTOCOL_TESTING__
+        //returns true if every header name hashes to itself, false otherwise
+        static Bool16           Test();
+
+        //prints the time spent looking up the headers of a corpus of real
+        //requests inNumIterations times, with the hash and the old linear lookup
+        static void             Benchmark(UInt32 inNumIterations);
+#endif
         
     private:
 
+        static UInt32               HashHeaderName(const StrPtrLen &inHeaderStr);
+
         //for other lookups
         static StrPtrLen            sMethods[];
         static StrPtrLen            sHeaders[];
+        static UInt8                sHeaderHashTable[];
         static StrPtrLen            sStatusCodeStrings[];
         static StrPtrLen            sStatusCodeAsStrings[];
         static SInt32               sStatusCodes[];
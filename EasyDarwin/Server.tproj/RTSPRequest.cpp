@@ -196,9 +196,7 @@ QTSS_Error RTSPRequest::ParseURI(StringParser &parser)
 // might need this for rate adapt   if (qtssSetupMethod != fMethod && qtssOptionsMethod != fMethod && qtssSetParameterMethod != fMethod) // any method not a setup, options, or setparameter is not allowed to have a "/trackID=" in the url.
     if (qtssSetupMethod != fMethod) // any method not a setup is not allowed to have a "/trackID=" in the url.
     {
-        StrPtrLenDel tempCStr(theAbsURL.GetAsCString()); 
-        StrPtrLen nonaggregate(tempCStr.FindString("/trackID="));
-        if (nonaggregate.Len > 0) // check for non-aggregate method and return error
+        if (theAbsURL.FindString("/trackID=") != NULL) // check for non-aggregate method and return error
             return QTSSModuleUtils::SendErrorResponse(this, qtssClientAggregateOptionAllowed, qtssMsgBadRTSPMethod, &theAbsURL);
     }
 
@@ -745,7 +743,7 @@ void RTSPRequest::ParseClientPortSubHeader(StrPtrLen* inClientPortSubHeader)
     {
         // The following to setup and log the error as a message level 2.
         StrPtrLen *userAgentPtr = fHeaderDictionary.GetValue(qtssUserAgentHeader);
-        ResizeableStringFormatter errorPortMessage;
+        ResizeableStringFormatter errorPortMessage(NULL, 0, this->GetSession()->GetRequestArena());
         errorPortMessage.Put(sErrorMessage);
         if (userAgentPtr != NULL)
             errorPortMessage.Put(*userAgentPtr);
@@ -813,11 +811,9 @@ QTSS_Error RTSPRequest::ParseBasicHeader(StringParser *inParsedAuthLinePtr)
     if (0 == authWord.Len ) 
         return theErr;
         
-    char* encodedStr = authWord.GetAsCString();
-    OSCharArrayDeleter encodedStrDeleter(encodedStr);   
-    
-    char *decodedAuthWord = NEW char[Base64decode_len(encodedStr) + 1];
-    OSCharArrayDeleter decodedAuthWordDeleter(decodedAuthWord);
+    OSArena* theArena = this->GetSession()->GetRequestArena();
+    char* encodedStr = theArena->GetAsCString(&authWord);
+    char *decodedAuthWord = (char*)theArena->Alloc(Base64decode_len(encodedStr) + 1);
 
     (void) Base64decode(decodedAuthWord, encodedStr);
     
@@ -958,7 +954,7 @@ QTSS_Error RTSPRequest::SendDigestChallenge(UInt32 qop, StrPtrLen *nonce, StrPtr
     QTSS_Error theErr = QTSS_NoErr;
 
     char challengeBuf[kAuthChallengeHeaderBufSize];
-    ResizeableStringFormatter challengeFormatter(challengeBuf, kAuthChallengeHeaderBufSize);
+    ResizeableStringFormatter challengeFormatter(challengeBuf, kAuthChallengeHeaderBufSize, this->GetSession()->GetRequestArena());
     
     StrPtrLen realm;
     char *prefRealmPtr = NULL;
@@ -218,8 +218,8 @@ void  RTSPRequest3GPP::Initialize()
 }
 
 
-RTSPRequest3GPP::RTSPRequest3GPP(Bool16 enabled)
-:   QTSSDictionary(QTSSDictionaryMap::GetMap(QTSSDictionaryMap::k3GPPRequestDictIndex)),
+RTSPRequest3GPP::RTSPRequest3GPP(Bool16 enabled, OSArena* inArena)
+:   QTSSDictionary(QTSSDictionaryMap::GetMap(QTSSDictionaryMap::k3GPPRequestDictIndex), NULL, inArena),
     fEnabled (enabled),fIs3GPP(false), fHasRateAdaptation(false), fHasLinkChar(false)
 {
     this->SetVal(qtss3GPPRequestEnabled, &fEnabled, sizeof(fEnabled));
@@ -214,7 +214,7 @@ class RTSPRequest3GPP : public QTSSDictionary
         //these do very little. Just initialize / delete some member data.
         //
         //Arguments:        enable the object
-        RTSPRequest3GPP(Bool16 enabled);
+        RTSPRequest3GPP(Bool16 enabled, OSArena* inArena = NULL);
         ~RTSPRequest3GPP() {}
     
         //Parses the request. Returns an error if there was an error encountered
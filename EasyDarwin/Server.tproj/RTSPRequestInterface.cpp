@@ -58,6 +58,9 @@ StrPtrLen   RTSPRequestInterface::sPremadeHeaderPtr(sPremadeHeader, kStaticHeade
 char        RTSPRequestInterface::sPremadeNoHeader[kStaticHeaderSizeInBytes];
 StrPtrLen   RTSPRequestInterface::sPremadeNoHeaderPtr(sPremadeNoHeader, kStaticHeaderSizeInBytes);
 
+char        RTSPRequestInterface::sPremadeDescribeHeaders[kStaticHeaderSizeInBytes];
+StrPtrLen   RTSPRequestInterface::sPremadeDescribeHeadersPtr(sPremadeDescribeHeaders, kStaticHeaderSizeInBytes);
+
 
 StrPtrLen   RTSPRequestInterface::sColonSpace(": ", 2);
 
@@ -136,6 +139,26 @@ void  RTSPRequestInterface::Initialize(void)
     sPremadeNoHeaderPtr.Len = noServerInfoHeaderFormatter.GetCurrentOffset();
     Assert(sPremadeNoHeaderPtr.Len < kStaticHeaderSizeInBytes);
     
+    //the fixed part of every DESCRIBE response
+    static StrPtrLen sContentType("application/sdp");
+    static StrPtrLen sRetransmitProtocolName("our-retransmit");
+    static StrPtrLen sDynamicRateEnabled("1");
+    StringFormatter describeHeaderFormatter(sPremadeDescribeHeadersPtr.Ptr, kStaticHeaderSizeInBytes);
+    describeHeaderFormatter.Put(RTSPProtocol::GetHeaderString(qtssContentTypeHeader));
+    describeHeaderFormatter.Put(sColonSpace);
+    describeHeaderFormatter.Put(sContentType);
+    describeHeaderFormatter.PutEOL();
+    describeHeaderFormatter.Put(RTSPProtocol::GetHeaderString(qtssXAcceptRetransmitHeader));
+    describeHeaderFormatter.Put(sColonSpace);
+    describeHeaderFormatter.Put(sRetransmitProtocolName);
+    describeHeaderFormatter.PutEOL();
+    describeHeaderFormatter.Put(RTSPProtocol::GetHeaderString(qtssXAcceptDynamicRateHeader));
+    describeHeaderFormatter.Put(sColonSpace);
+    describeHeaderFormatter.Put(sDynamicRateEnabled);
+    describeHeaderFormatter.PutEOL();
+    sPremadeDescribeHeadersPtr.Len = describeHeaderFormatter.GetCurrentOffset();
+    Assert(sPremadeDescribeHeadersPtr.Len < kStaticHeaderSizeInBytes);
+    
     //Setup all the dictionary stuff
     for (UInt32 x = 0; x < qtssRTSPReqNumParams; x++)
         QTSSDictionaryMap::GetMap(QTSSDictionaryMap::kRTSPRequestDictIndex)->
@@ -149,7 +172,7 @@ void  RTSPRequestInterface::Initialize(void)
 
 //CONSTRUCTOR / DESTRUCTOR: very simple stuff
 RTSPRequestInterface::RTSPRequestInterface(RTSPSessionInterface *session)
-:   QTSSDictionary(QTSSDictionaryMap::GetMap(QTSSDictionaryMap::kRTSPRequestDictIndex)),
+:   QTSSDictionary(QTSSDictionaryMap::GetMap(QTSSDictionaryMap::kRTSPRequestDictIndex), NULL, session->GetRequestArena()),
 	fMethod(qtssIllegalMethod),
 	fStatus(qtssSuccessOK),
     fRealStatusCode(0),
@@ -172,7 +195,7 @@ RTSPRequestInterface::RTSPRequestInterface(RTSPSessionInterface *session)
     fPrebufferAmt(-1),
     fWindowSize(0),
     fMovieFolderPtr(&fMovieFolderPath[0]),
-    fHeaderDictionary(QTSSDictionaryMap::GetMap(QTSSDictionaryMap::kRTSPHeaderDictIndex)),
+    fHeaderDictionary(QTSSDictionaryMap::GetMap(QTSSDictionaryMap::kRTSPHeaderDictIndex), NULL, session->GetRequestArena()),
     fAllowed(true),
     fHasUser(false),
     fAuthHandled(false),
@@ -181,14 +204,14 @@ RTSPRequestInterface::RTSPRequestInterface(RTSPSessionInterface *session)
     fAction(qtssActionFlagsNoFlags),
     fAuthScheme(qtssAuthNone),
     fAuthQop(RTSPSessionInterface::kNoQop),
-    fUserProfile(),
+    fUserProfile(session->GetRequestArena()),
     fUserProfilePtr(&fUserProfile),
     fStale(false),
     fSkipAuthorization(true),
     fEnableDynamicRateState(-1),// -1 undefined, 0 disabled, 1 enabled
 	// DJM PROTOTYPE
 	fRandomDataSize(0),
-    fRequest3GPP( QTSServerInterface::GetServer()->GetPrefs()->Get3GPPEnabled() ),
+    fRequest3GPP( QTSServerInterface::GetServer()->GetPrefs()->Get3GPPEnabled(), session->GetRequestArena() ),
     fRequest3GPPPtr(&fRequest3GPP),
     fBandwidthBits(0),
     	
@@ -289,8 +312,9 @@ void RTSPRequestInterface::AppendDateAndExpires()
         this->WriteStandardHeaders();
 
     Assert(OSThread::GetCurrent() != NULL);
+    // Each thread keeps its own date string, rebuilt at most once a second
     DateBuffer* theDateBuffer = OSThread::GetCurrent()->GetDateBuffer();
-    theDateBuffer->InexactUpdate(); // Update the date buffer to the current date & time
+    theDateBuffer->SecondUpdate();
     StrPtrLen theDate(theDateBuffer->GetDateBuffer(), DateBuffer::kDateBufferLen);
     
     // Append dates, and have this response expire immediately
@@ -298,6 +322,14 @@ void RTSPRequestInterface::AppendDateAndExpires()
     this->AppendHeader(qtssExpiresHeader, &theDate);
 }
 
+void RTSPRequestInterface::AppendDescribeHeaders()
+{
+    if (!fStandardHeadersWritten)
+        this->WriteStandardHeaders();
+
+    fOutputStream->Put(sPremadeDescribeHeadersPtr);
+}
+
 
 void RTSPRequestInterface::AppendSessionHeaderWithTimeout( StrPtrLen* inSessionID, StrPtrLen* inTimeout )
 {
@@ -368,6 +400,7 @@ void RTSPRequestInterface::AppendTransportHeader(StrPtrLen* serverPortA,
     static StrPtrLen    sInterLeaved("interleaved");//match the interleaved tag
     static StrPtrLen    sClientPort("client_port");
     static StrPtrLen    sClientPortString(";client_port=");
+    static const char   sHexChars[] = "0123456789ABCDEF";
     
     if (!fStandardHeadersWritten)
         this->WriteStandardHeaders();
@@ -376,10 +409,19 @@ void RTSPRequestInterface::AppendTransportHeader(StrPtrLen* serverPortA,
     fOutputStream->Put(RTSPProtocol::GetHeaderString(qtssTransportHeader));
     fOutputStream->Put(sColonSpace);
 
-    StrPtrLen outFirstTransport(fFirstTransport.GetAsCString());
-    OSCharArrayDeleter outFirstTransportDeleter(outFirstTransport.Ptr);
+    // Work on a copy of the client's transport. It is on the stack unless the
+    // transport is unusually long.
+    char theTransportBuf[kTransportBufSizeInBytes];
+    char* theTransportCopy = theTransportBuf;
+    if (fFirstTransport.Len >= kTransportBufSizeInBytes)
+        theTransportCopy = NEW char[fFirstTransport.Len + 1];
+    OSCharArrayDeleter outFirstTransportDeleter((theTransportCopy != theTransportBuf) ? theTransportCopy : NULL);
+    ::memcpy(theTransportCopy, fFirstTransport.Ptr, fFirstTransport.Len);
+    theTransportCopy[fFirstTransport.Len] = '\0';
+    
+    StrPtrLen outFirstTransport(theTransportCopy, fFirstTransport.Len);
     outFirstTransport.RemoveWhitespace();
-    while (outFirstTransport[outFirstTransport.Len - 1] == ';')
+    while ((outFirstTransport.Len > 0) && (outFirstTransport[outFirstTransport.Len - 1] == ';'))
         outFirstTransport.Len --;
 
     // see if it contains an interleaved field or client port field
@@ -408,14 +450,9 @@ void RTSPRequestInterface::AppendTransportHeader(StrPtrLen* serverPortA,
     if (stripClientPortStr.Len != 0)
     {
         fOutputStream->Put(sClientPortString);
-        UInt16 portA = this->GetClientPortA();
-        UInt16 portB = this->GetClientPortB();
-        StrPtrLenDel clientPortA(QTSSDataConverter::ValueToString( &portA, sizeof(portA), qtssAttrDataTypeUInt16));
-        StrPtrLenDel clientPortB(QTSSDataConverter::ValueToString( &portB, sizeof(portB), qtssAttrDataTypeUInt16));
-        
-        fOutputStream->Put(clientPortA);
+        fOutputStream->Put((SInt32)this->GetClientPortA());
         fOutputStream->PutChar('-');
-        fOutputStream->Put(clientPortB);        
+        fOutputStream->Put((SInt32)this->GetClientPortB());
     }
     
     // Append the server ports, if provided.
@@ -438,18 +475,16 @@ void RTSPRequestInterface::AppendTransportHeader(StrPtrLen* serverPortA,
     
     if (ssrc != NULL && ssrc->Ptr != NULL && ssrc->Len != 0 && fNetworkMode == qtssRTPNetworkModeUnicast && fTransportMode == qtssRTPTransportModePlay)
     {
-        char* theCString = ssrc->GetAsCString();
-        OSCharArrayDeleter cStrDeleter(theCString);
-        
-        UInt32 ssrcVal = 0;
-        ::sscanf(theCString, "%"_U32BITARG_"", &ssrcVal);
-        ssrcVal = htonl(ssrcVal);
+        // the SSRC comes in as a decimal string and goes out as 8 hex digits
+        StringParser theSSRCParser(ssrc);
+        UInt32 ssrcVal = theSSRCParser.ConsumeInteger(NULL);
         
-        StrPtrLen hexSSRC(QTSSDataConverter::ValueToString( &ssrcVal, sizeof(ssrcVal), qtssAttrDataTypeUnknown));
-        OSCharArrayDeleter hexStrDeleter(hexSSRC.Ptr);
+        char hexSSRC[8];
+        for (UInt32 x = 0; x < sizeof(hexSSRC); x++)
+            hexSSRC[x] = sHexChars[(ssrcVal >> (28 - (4 * x))) & 0xF];
 
         fOutputStream->Put(sSSRC);
-        fOutputStream->Put(hexSSRC);
+        fOutputStream->Put(hexSSRC, sizeof(hexSSRC));
     }
 
     fOutputStream->PutEOL();
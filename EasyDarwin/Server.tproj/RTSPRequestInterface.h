@@ -86,6 +86,10 @@ class RTSPRequestInterface : public QTSSDictionary
 
         void    AppendContentLength(UInt32 contentLength);
         void    AppendDateAndExpires();
+        
+        // Appends the Content-Type, x-Accept-Retransmit & x-Accept-Dynamic-Rate
+        // headers of a DESCRIBE response. They never change, so they are premade.
+        void    AppendDescribeHeaders();
         void    AppendSessionHeaderWithTimeout( StrPtrLen* inSessionID, StrPtrLen* inTimeout );
         void    AppendRetransmitHeader(UInt32 inAckTimeout);
 
@@ -115,6 +119,10 @@ class RTSPRequestInterface : public QTSSDictionary
         virtual QTSS_Error Read(void* ioBuffer, UInt32 inLength, UInt32* outLenRead)
             { return fSession->Read(ioBuffer, inLength, outLenRead); }
             
+        // Reads the request body in chunks. Same behavior as calling RTSPSessionInterface::ReadBody
+        virtual QTSS_Error ReadBody(QTSS_BodyChunkFunctionPtr inChunkFunction, void* inUserData)
+            { return fSession->ReadBody(inChunkFunction, inUserData); }
+
         // Requests an event. Same behavior as calling RTSPSessionInterface::RequestEvent
         virtual QTSS_Error RequestEvent(QTSS_EventType inEventMask)
             { return fSession->RequestEvent(inEventMask); }
@@ -303,7 +311,8 @@ class RTSPRequestInterface : public QTSSDictionary
 
         enum
         {
-            kStaticHeaderSizeInBytes = 512  //UInt32
+            kStaticHeaderSizeInBytes = 512,  //UInt32
+            kTransportBufSizeInBytes = 256   //UInt32
         };
         
         Bool16                  fStandardHeadersWritten;
@@ -330,6 +339,9 @@ class RTSPRequestInterface : public QTSSDictionary
         static char             sPremadeNoHeader[kStaticHeaderSizeInBytes];
         static StrPtrLen        sPremadeNoHeaderPtr;
         
+        static char             sPremadeDescribeHeaders[kStaticHeaderSizeInBytes];
+        static StrPtrLen        sPremadeDescribeHeadersPtr;
+        
         static StrPtrLen        sColonSpace;
         
         //Dictionary support
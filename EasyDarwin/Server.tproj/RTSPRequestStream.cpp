@@ -51,6 +51,8 @@ RTSPRequestStream::RTSPRequestStream(TCPSocket* sock)
     fEncodedBytesRemaining(0),
     fRequest(fRequestBuffer, 0),
     fRequestPtr(NULL),
+    fHeaderScanOffset(0),
+    fHeaderScanLines(0),
     fDecode(false),
     fPrintRTSP(false)
 {}
@@ -63,6 +65,7 @@ void RTSPRequestStream::SnarfRetreat( RTSPRequestStream &fromRequest )
     Assert(fRetreatBytes < kRequestBufferSizeInBytes);
     fRetreatBytes = fromRequest.fRetreatBytes;
     fEncodedBytesRemaining = fCurOffset = fRequest.Len = 0;
+    fHeaderScanOffset = fHeaderScanLines = 0;
     ::memcpy(&fRequestBuffer[0], fromRequest.fRequest.Ptr + fromRequest.fRequest.Len, fromRequest.fRetreatBytes);
 }
 
@@ -108,6 +111,7 @@ QTSS_Error RTSPRequestStream::ReadRequest()
                 
             newOffset = fRequest.Len = fRetreatBytes;
             fRetreatBytes = fRetreatBytesRead = 0;
+            fHeaderScanOffset = fHeaderScanLines = 0;
         }
 
         // We don't have any new data, so try and get some
@@ -214,9 +218,16 @@ QTSS_Error RTSPRequestStream::ReadRequest()
         Bool16 weAreDone = false;
         StringParser headerParser(&fRequest);
         
-        UInt16 lcount = 0;
+        //lines that were complete on an earlier read don't need to be looked at again,
+        //except for the last one, whose EOL may have been cut in half by that read
+        headerParser.ConsumeLength(NULL, fHeaderScanOffset);
+        UInt32 theLineStart = fHeaderScanOffset;
+        UInt16 theLinesBefore = fHeaderScanLines;
+        UInt16 lcount = fHeaderScanLines;
         while (headerParser.GetThruEOL(NULL))
         {
+            fHeaderScanOffset = theLineStart;
+            fHeaderScanLines = theLinesBefore;
             lcount++;
             if (headerParser.ExpectEOL())
             {
@@ -247,6 +258,8 @@ QTSS_Error RTSPRequestStream::ReadRequest()
                     break;
                 }
             }
+            theLineStart = headerParser.GetDataParsedLen();
+            theLinesBefore = lcount;
         }
         
         //weAreDone means we have gotten a full request
@@ -317,6 +330,17 @@ QTSS_Error RTSPRequestStream::Read(void* ioBuffer, UInt32 inBufLen, UInt32* outL
     return theErr;
 }
 
+void RTSPRequestStream::ReadRetreatBytes(UInt32 inMaxLen, StrPtrLen* outData)
+{
+    UInt32 theLengthRead = fRetreatBytes;
+    if (inMaxLen < theLengthRead)
+        theLengthRead = inMaxLen;
+    
+    outData->Set(fRequest.Ptr + fRequest.Len + fRetreatBytesRead, theLengthRead);
+    fRetreatBytes -= theLengthRead;
+    fRetreatBytesRead += theLengthRead;
+}
+
 QTSS_Error RTSPRequestStream::DecodeIncomingData(char* inSrcData, UInt32 inSrcDataLen)
 {
     Assert(fRetreatBytes == 0);
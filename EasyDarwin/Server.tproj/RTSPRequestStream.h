@@ -70,6 +70,13 @@ public:
     // Returns: QTSS_NoErr, EAGAIN if it will block, or another socket error.
     QTSS_Error      Read(void* ioBuffer, UInt32 inBufLen, UInt32* outLengthRead);
     
+    // ReadRetreatBytes
+    //
+    // Like Read, but only returns data that came in along with the request header,
+    // pointing outData at it in place instead of copying it. Returns at most inMaxLen
+    // bytes. outData->Len is 0 if there are none left.
+    void            ReadRetreatBytes(UInt32 inMaxLen, StrPtrLen* outData);
+    
     // Use a different TCPSocket to read request data 
     // this will be used by RTSPSessionInterface::SnarfInputSocket
     void                AttachToSocket(TCPSocket* sock) { fSocket = sock; }
@@ -110,6 +117,11 @@ private:
     
     StrPtrLen               fRequest;
     StrPtrLen*              fRequestPtr;    // pointer to a request header
+
+    // Where the search for the end of the header picks up after a partial read:
+    // the start of the last complete line, and the number of lines before it
+    UInt32                  fHeaderScanOffset;
+    UInt16                  fHeaderScanLines;
     Bool16                  fDecode;        // should we base 64 decode?
     Bool16                  fIsDataPacket;  // is this a data packet? Like for a record?
     Bool16                  fPrintRTSP;     // debugging printfs
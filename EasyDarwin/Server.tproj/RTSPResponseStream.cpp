@@ -148,6 +148,42 @@ QTSS_Error RTSPResponseStream::WriteV(iovec* inVec, UInt32 inNumVectors, UInt32
     return QTSS_NoErr;
 }
 
+QTSS_Error RTSPResponseStream::WriteZeroCopy(char* inBuffer, UInt32 inLength, Bool16* outPinned, UInt32* outSendID)
+{
+    *outPinned = false;
+
+    // Data already buffered here has to go out first, WriteV takes care of that
+    if ((this->GetCurrentOffset() == fBytesSentInBuffer) && fSocket->IsZeroCopyEnabled())
+    {
+        struct iovec theVec;
+        theVec.iov_base = inBuffer;
+        theVec.iov_len = inLength;
+
+        UInt32 theLengthSent = 0;
+        QTSS_Error theErr = fSocket->WriteVZeroCopy(&theVec, 1, &theLengthSent, outSendID);
+        if (theErr == QTSS_NoErr)
+        {
+            *outPinned = true;
+            fTimeoutTask->RefreshTimeout();
+            fBytesWritten += theLengthSent;
+
+            // Whatever the socket didn't take is buffered, as with kAllOrNothing
+            if (theLengthSent < inLength)
+                this->Put(inBuffer + theLengthSent, inLength - theLengthSent);
+            return QTSS_NoErr;
+        }
+
+        // ENOBUFS: the socket can't pin any more memory, copy the data instead
+        if (theErr != ENOBUFS)
+            return theErr;
+    }
+
+    iovec theVec[2];
+    theVec[1].iov_base = inBuffer;
+    theVec[1].iov_len = inLength;
+    return this->WriteV(theVec, 2, inLength, NULL, kAllOrNothing);
+}
+
 QTSS_Error RTSPResponseStream::Flush()
 {
     UInt32 amtInBuffer = this->GetCurrentOffset() - fBytesSentInBuffer;
@@ -80,9 +80,20 @@ class RTSPResponseStream : public ResizeableStringFormatter
         QTSS_Error WriteV(iovec* inVec, UInt32 inNumVectors, UInt32 inTotalLength,
                                 UInt32* outLengthSent, UInt32 inSendType);
 
+        // WriteZeroCopy
+        //
+        // Same as WriteV with kAllOrNothing for a single buffer, but if the socket has
+        // zero copy enabled and nothing is buffered in this stream, the buffer is sent
+        // with MSG_ZEROCOPY. Then outPinned is true, and the buffer must be left untouched
+        // until the socket's ZeroCopySendDone returns true for outSendID.
+        QTSS_Error WriteZeroCopy(char* inBuffer, UInt32 inLength, Bool16* outPinned, UInt32* outSendID);
+
         // Flushes any buffered data to the socket. If all data could be sent,
         // this returns QTSS_NoErr, otherwise, it returns EWOULDBLOCK
         QTSS_Error Flush();
+
+        // Bytes that were Put, or left over from a WriteV, and haven't gone out yet
+        UInt32      GetBytesUnsent()    { return this->GetCurrentOffset() - fBytesSentInBuffer; }
         
         void        ShowRTSP(Bool16 enable) {fPrintRTSP = enable; }     
 
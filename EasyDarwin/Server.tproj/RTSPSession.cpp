@@ -143,6 +143,20 @@ void RTSPSession::Initialize()
     Assert(sHTTPResponseNoServerHeaderPtr.Len < kMaxHTTPResponseLen);
 }
 
+// Adds the heap allocations made by this thread while it is in scope to the
+// session's count for the request in progress
+class RTSPSessionAllocCounter
+{
+    public:
+        RTSPSessionAllocCounter(RTSPSession* inSession) : fSession(inSession)
+            { fSession->fRunAllocsStart = OSMemory::GetThreadNumAllocs(); fSession->fCountingAllocs = true; }
+        ~RTSPSessionAllocCounter()
+            {   fSession->fRequestHeapAllocs += OSMemory::GetThreadNumAllocs() - fSession->fRunAllocsStart;
+                fSession->fCountingAllocs = false; }
+    private:
+        RTSPSession* fSession;
+};
+
 RTSPSession::RTSPSession( Bool16 doReportHTTPConnectionAddress )
 : RTSPSessionInterface(),
   fRequest(NULL),
@@ -153,7 +167,10 @@ RTSPSession::RTSPSession( Bool16 doReportHTTPConnectionAddress )
   fFoundValidAccept( false),
   fDoReportHTTPConnectionAddress(doReportHTTPConnectionAddress),
   fCurrentModule(0),
-  fState(kReadingFirstRequest)
+  fState(kReadingFirstRequest),
+  fRequestHeapAllocs(0),
+  fRunAllocsStart(0),
+  fCountingAllocs(false)
 {
     this->SetTaskName("RTSPSession");
 
@@ -230,12 +247,18 @@ SInt64 RTSPSession::Run()
 
     // Some callbacks look for this struct in the thread object
     OSThreadDataSetter theSetter(&fModuleState, NULL);
+    RTSPSessionAllocCounter theAllocCounter(this);
         
     //check for a timeout or a kill. If so, just consider the session dead
 	// 鳬ʱ¼Kill¼Ϊ棬RTSPSessionỰѽ
     if ((events & Task::kTimeoutEvent) || (events & Task::kKillEvent))
         fLiveSession = false;
     
+    // Interleaved data that was left queued, see InterleavedWrite. While a request
+    // is in progress it waits for CleanupRequest.
+    if ((events & (Task::kIdleEvent | Task::kWriteEvent)) && (fRequest == NULL) && this->IsLiveSession())
+        (void)this->FlushInterleavedWrites();
+    
     while (this->IsLiveSession())
     {
         // RTSP Session state machine. There are several well defined points in an RTSP request
@@ -389,7 +412,9 @@ SInt64 RTSPSession::Run()
                 
                 Assert(fRequest == NULL);
 				// RTSPRequestڽRTSPϢ
-                fRequest = NEW RTSPRequest(this);
+                // The request lives in the request arena, CleanupRequest destroys it
+                // just before resetting the arena.
+                fRequest = new (fRequestArena.Alloc(sizeof(RTSPRequest))) RTSPRequest(this);
                 fRoleParams.rtspRequestParams.inRTSPRequest = fRequest;
                 fRoleParams.rtspRequestParams.inRTSPHeaders = fRequest->GetHeaderDictionary();
 
@@ -1545,8 +1570,8 @@ void RTSPSession::CheckAuthentication() {
         // For basic authentication, the authentication module returns the crypt of the password, 
         // so compare crypt of qtssRTSPReqUserPassword and the text in qtssUserPassword
         StrPtrLen* reqPassword = fRequest->GetValue(qtssRTSPReqUserPassword);
-        char* userPasswdStr = userPassword->GetAsCString(); // memory allocated
-        char* reqPasswdStr = reqPassword->GetAsCString();   // memory allocated
+        char* userPasswdStr = fRequestArena.GetAsCString(userPassword);
+        char* reqPasswdStr = fRequestArena.GetAsCString(reqPassword);
         
         if(userPassword->Len == 0)
         {
@@ -1566,11 +1591,6 @@ void RTSPSession::CheckAuthentication() {
             authenticated = false;
 #endif
         }
-
-        delete [] userPasswdStr;    // deleting allocated memory
-        userPasswdStr = NULL;
-        delete [] reqPasswdStr;
-        reqPasswdStr = NULL;        // deleting allocated memory
     }
     else if(scheme == qtssAuthDigest) { // md5֤
 		// For digest authentication, md5 digest comparison
@@ -1622,7 +1642,7 @@ void RTSPSession::CheckAuthentication() {
                 {
                      // Convert nounce count (which is a string of 8 hex digits) into a UInt32                 
                     UInt32 bufSize = sizeof(ncValue);
-                    StrPtrLenDel tempString(nonceCount->GetAsCString());
+                    StrPtrLen tempString(fRequestArena.GetAsCString(nonceCount), nonceCount->Len);
                     tempString.ToUpper();
                     QTSSDataConverter::ConvertCHexStringToBytes(tempString.Ptr,
                                                         &ncValue,
@@ -1916,6 +1936,15 @@ void RTSPSession::CleanupRequest()
     
     if (fRequest != NULL)
     {
+        if (fCountingAllocs)
+        {
+            UInt32 theNumAllocs = OSMemory::GetThreadNumAllocs();
+            fRequestHeapAllocs += theNumAllocs - fRunAllocsStart;
+            fRunAllocsStart = theNumAllocs;
+            QTSServerInterface::GetServer()->IncrementRTSPRequestAllocs(fRequestHeapAllocs, fRequestArena.GetNumAllocs());
+        }
+        fRequestHeapAllocs = 0;
+        
         // Check to see if a filter module has replaced the request. If so, delete
         // their request now.
         if (fRequest->GetValue(qtssRTSPReqFullRequest)->Ptr != fInputStream.GetRequestBuffer()->Ptr)
@@ -1923,18 +1952,25 @@ void RTSPSession::CleanupRequest()
             
         // NULL out any references to the current request
 		// ͷfRequestֵΪNULL
-        delete fRequest;
+        fRequest->~RTSPRequest();
         fRequest = NULL;
         fRoleParams.rtspRequestParams.inRTSPRequest = NULL;
         fRoleParams.rtspRequestParams.inRTSPHeaders = NULL;
     }
     
 	// 
+    // Interleaved packets that were queued while the request was processed can go out now.
+    // Not from the destructor, or once the client is gone.
+    if (this->IsLiveSession())
+        (void)this->FlushInterleavedWrites();
     fSessionMutex.Unlock();
     fReadMutex.Unlock();
     
     // Clear out our last value for request body length before moving onto the next request
     this->SetRequestBodyLength(-1);
+    
+    // Everything modules allocated for this request goes away at once
+    fRequestArena.Reset();
 }
 
 QTSS_Error  RTSPSession::FindRTPSession(OSRefTable* inRefTable)
@@ -2248,13 +2284,7 @@ void RTSPSession::SaveRequestAuthorizationParams(RTSPRequest *theRTSPRequest)
 
 QTSS_Error RTSPSession::DumpRequestData()
 {
-    char theDumpBuffer[2048];
-    
-    QTSS_Error theErr = QTSS_NoErr;
-    while (theErr == QTSS_NoErr)
-        theErr = this->Read(theDumpBuffer, 2048, NULL);
-        
-    return theErr;
+    return this->ReadBody(NULL, NULL);
 }
 
 /*
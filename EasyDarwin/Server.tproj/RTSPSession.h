@@ -168,6 +168,14 @@ class RTSPSession : public RTSPSessionInterface
         QTSS_RoleParams     fRoleParams;//module param blocks for roles.
         QTSS_ModuleState    fModuleState;
         
+        // Heap allocations made on behalf of the current request, for the debug
+        // status display. Run counts them with a RTSPSessionAllocCounter.
+        UInt32              fRequestHeapAllocs;
+        UInt32              fRunAllocsStart;    // thread's allocation count when counting began
+        Bool16              fCountingAllocs;
+        
+        friend class RTSPSessionAllocCounter;
+        
         QTSS_Error SetupAuthLocalPath(RTSPRequest *theRTSPRequest);
         
         
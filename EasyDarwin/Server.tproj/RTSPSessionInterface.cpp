@@ -93,13 +93,18 @@ void    RTSPSessionInterface::Initialize()
 
 RTSPSessionInterface::RTSPSessionInterface() 
 :   QTSSDictionary(QTSSDictionaryMap::GetMap(QTSSDictionaryMap::kRTSPSessionDictIndex)),
-    Task(), 
+    IdleTask(), 
     fTimeoutTask(NULL, QTSServerInterface::GetServer()->GetPrefs()->GetRealRTSPTimeoutInSecs() * 1000),
     fInputStream(&fSocket),
     fOutputStream(&fSocket, &fTimeoutTask),
+    fRequestArena(kRequestArenaBlockSize),
     fSessionMutex(),
+    fTCPCoalesceMutex(),
     fTCPCoalesceBuffer(NULL),
+    fTCPCoalesceBufferSize(0),
     fNumInCoalesceBuffer(0),
+    fTCPCoalesceStartTime(0),
+    fCurZeroCopyBuffer(0),
     fSocket(NULL, Socket::kNonBlockingSocketType),
     fOutputSocketP(&fSocket),
     fInputSocketP(&fSocket),
@@ -121,6 +126,10 @@ RTSPSessionInterface::RTSPSessionInterface()
     fSocket.SetTask(this);
     fStreamRef = this;
 
+    ::memset(fZeroCopyBuffers, 0, sizeof(fZeroCopyBuffers));
+    ::memset(fZeroCopySendIDs, 0, sizeof(fZeroCopySendIDs));
+    ::memset(fZeroCopyPinned, 0, sizeof(fZeroCopyPinned));
+
     fSessionID = (UInt32)atomic_add(&sSessionIDCounter, 1);
     this->SetVal(qtssRTSPSesID, &fSessionID, sizeof(fSessionID));
     this->SetVal(qtssRTSPSesEventCntxt, &fOutputSocketP, sizeof(fOutputSocketP));
@@ -144,7 +153,14 @@ RTSPSessionInterface::~RTSPSessionInterface()
     if (fInputSocketP != fOutputSocketP) 
         delete fInputSocketP;
     
-    delete [] fTCPCoalesceBuffer;
+    // Buffers the kernel still sends from are only referenced by it, not owned
+    if (fZeroCopyBuffers[0] != NULL)
+    {
+        for (UInt32 x = 0; x < kNumZeroCopyBuffers; x++)
+            delete [] fZeroCopyBuffers[x];
+    }
+    else
+        delete [] fTCPCoalesceBuffer;
     
     for (UInt8 x = 0; x < (fCurChannelNum >> 1); x++)
         delete [] fChNumToSessIDMap[x].Ptr;
@@ -207,6 +223,44 @@ QTSS_Error RTSPSessionInterface::Read(void* ioBuffer, UInt32 inLength, UInt32* o
     return theErr;
 }
 
+QTSS_Error RTSPSessionInterface::ReadBody(QTSS_BodyChunkFunctionPtr inChunkFunction, void* inUserData)
+{
+    char theChunkBuffer[kBodyChunkSizeInBytes];
+    
+    while (fRequestBodyLen > 0)
+    {
+        // Whatever came in with the request header can be passed on as it is,
+        // the rest is read off the socket one buffer at a time.
+        StrPtrLen theChunk;
+        fInputStream.ReadRetreatBytes(fRequestBodyLen, &theChunk);
+        if (theChunk.Len == 0)
+        {
+            UInt32 theLenRead = 0;
+            UInt32 theLenToRead = sizeof(theChunkBuffer);
+            if ((SInt32)theLenToRead > fRequestBodyLen)
+                theLenToRead = fRequestBodyLen;
+                
+            QTSS_Error theErr = fInputStream.Read(theChunkBuffer, theLenToRead, &theLenRead);
+            if (theErr != QTSS_NoErr)
+                return theErr;
+            if (theLenRead == 0)
+                return EAGAIN;
+            theChunk.Set(theChunkBuffer, theLenRead);
+        }
+        
+        fRequestBodyLen -= theChunk.Len;
+        
+        if (inChunkFunction != NULL)
+        {
+            QTSS_Error theErr = (inChunkFunction)(inUserData, theChunk.Ptr, theChunk.Len);
+            if (theErr != QTSS_NoErr)
+                return theErr;
+        }
+    }
+    
+    return QTSS_NoErr;
+}
+
 QTSS_Error RTSPSessionInterface::RequestEvent(QTSS_EventType inEventMask)
 {
     if (inEventMask & QTSS_ReadableEvent)
@@ -221,8 +275,25 @@ UInt8 RTSPSessionInterface::GetTwoChannelNumbers(StrPtrLen* inRTSPSessionID)
 {
     //
     // Allocate a TCP coalesce buffer if still needed
-    if (fTCPCoalesceBuffer != NULL)
-        fTCPCoalesceBuffer = new char[kTCPCoalesceBufferSize];
+    if (fTCPCoalesceBuffer == NULL)
+    {
+        OSMutexLocker locker(&fTCPCoalesceMutex);
+        UInt32 theBufferSize = QTSServerInterface::GetServer()->GetPrefs()->GetTCPCoalesceBufferSize();
+        if (theBufferSize > kMaxTCPCoalesceBufferSize)
+            theBufferSize = kMaxTCPCoalesceBufferSize;
+        if (theBufferSize > kInteleaveHeaderSize)
+        {
+            if (QTSServerInterface::GetServer()->GetPrefs()->GetTCPZeroCopyEnabled() && (fSocket.EnableZeroCopy() == OS_NoErr))
+            {
+                for (UInt32 x = 0; x < kNumZeroCopyBuffers; x++)
+                    fZeroCopyBuffers[x] = NEW char[theBufferSize];
+                fTCPCoalesceBuffer = fZeroCopyBuffers[0];
+            }
+            else
+                fTCPCoalesceBuffer = NEW char[theBufferSize];
+            fTCPCoalesceBufferSize = theBufferSize;
+        }
+    }
 
     //
     // Allocate 2 channel numbers
@@ -266,21 +337,157 @@ StrPtrLen*  RTSPSessionInterface::GetSessionIDForChannelNum(UInt8 inChannelNum)
 
 QTSS_Error RTSPSessionInterface::InterleavedWrite(void* inBuffer, UInt32 inLen, UInt32* outLenWritten, unsigned char channel)
 {
-
-    if ( inLen == 0 && fNumInCoalesceBuffer == 0 )
+    if (inLen == 0)
     {   if (outLenWritten != NULL)
 			*outLenWritten = 0;
-        return QTSS_NoErr;
+        return this->FlushInterleavedWrites();
     }
-        
-    // First attempt to grab the RTSPSession mutex. This is to prevent writing data to
-    // the connection at the same time an RTSPRequest is being processed. We cannot
-    // wait for this mutex to be freed (there would be a deadlock possibility), so
-    // just try to grab it, and if we can't, then just report it as an EAGAIN
-    if ( this->GetSessionMutex()->TryLock() == false )
+
+    OSMutexLocker locker(&fTCPCoalesceMutex);
+
+    // Make room for the packet. If the buffer can't be written out, the client
+    // is flow controlled (or a request is taking long), report that as an EAGAIN
+    if (fNumInCoalesceBuffer + kInteleaveHeaderSize + inLen > fTCPCoalesceBufferSize)
     {
+        (void)this->WriteCoalesceBuffer();
+        if (fNumInCoalesceBuffer > 0)
+            return EAGAIN;
+    }
+
+    // Packets that don't fit in the buffer (or coalescing is off) are written
+    // directly. The buffer is empty at this point, so the order is kept.
+    if (kInteleaveHeaderSize + inLen > fTCPCoalesceBufferSize)
+        return this->DirectInterleavedWrite(inBuffer, inLen, outLenWritten, channel);
+
+    if (fNumInCoalesceBuffer == 0)
+    {
+        // All the buffers are still being sent from, the client is behind
+        if (!this->CoalesceBufferAvailable())
+            return EAGAIN;
+        fTCPCoalesceStartTime = OS::Milliseconds();
+    }
+
+    char* theHeader = &fTCPCoalesceBuffer[fNumInCoalesceBuffer];
+    theHeader[0] = '$';
+    theHeader[1] = channel;
+    UInt16 thePacketLen = htons((UInt16)inLen);
+    ::memcpy(&theHeader[2], &thePacketLen, 2);
+    ::memcpy(&theHeader[kInteleaveHeaderSize], inBuffer, inLen);
+    fNumInCoalesceBuffer += kInteleaveHeaderSize + inLen;
+
+#if RTSP_SESSION_INTERFACE_DEBUGGING 
+    qtss_printf("InterleavedWrite: coalesce %"_U32BITARG_", total buff %"_U32BITARG_"\n", inLen, fNumInCoalesceBuffer);
+#endif
+
+    // flush rules. The marker bit is in the second byte of an RTP header (even channels)
+    Bool16 isFrameEnd = ((channel & 1) == 0) && (inLen > 1) && ((((UInt8*)inBuffer)[1] & 0x80) != 0);
+    if (isFrameEnd
+        || (fNumInCoalesceBuffer >= (fTCPCoalesceBufferSize >> 1))
+        || (OS::Milliseconds() - fTCPCoalesceStartTime >= (SInt64)QTSServerInterface::GetServer()->GetPrefs()->GetTCPCoalesceFlushMsec()))
+    {
+        (void)this->WriteCoalesceBuffer();
+    }
+    
+    // If no more packets come along, the session task writes these out once they are old enough
+    if (fNumInCoalesceBuffer > 0)
+        this->SetIdleTimer(QTSServerInterface::GetServer()->GetPrefs()->GetTCPCoalesceFlushMsec());
+
+    // The packet is either sent or queued, as far as the caller is concerned it is written
+    if (outLenWritten != NULL)
+        *outLenWritten = inLen;
+
+    return QTSS_NoErr;
+}
+
+QTSS_Error RTSPSessionInterface::FlushInterleavedWrites()
+{
+    OSMutexLocker locker(&fTCPCoalesceMutex);
+    return this->WriteCoalesceBuffer();
+}
+
+QTSS_Error RTSPSessionInterface::WriteCoalesceBuffer()
+{
+    // Must be called with fTCPCoalesceMutex held. A write that only got part of the
+    // way leaves the rest in the output stream, which WriteV sends first next time.
+    if ((fNumInCoalesceBuffer == 0) && (this->GetOutputStream()->GetBytesUnsent() == 0))
+        return QTSS_NoErr;
+
+    // Don't write data to the connection at the same time an RTSPRequest is being
+    // processed. We cannot wait for this mutex (there would be a deadlock possibility),
+    // the data just stays in the buffer until the request is done with.
+    if (this->GetSessionMutex()->TryLock() == false)
         return EAGAIN;
+
+    QTSS_Error err = QTSS_NoErr;
+    if (fNumInCoalesceBuffer == 0)
+        err = this->GetOutputStream()->Flush();
+    else if ((fZeroCopyBuffers[0] != NULL) && (fNumInCoalesceBuffer >= kMinZeroCopyWriteSize))
+    {
+        Bool16 isPinned = false;
+        err = this->GetOutputStream()->WriteZeroCopy(fTCPCoalesceBuffer, fNumInCoalesceBuffer, &isPinned, &fZeroCopySendIDs[fCurZeroCopyBuffer]);
+        if (isPinned)
+        {
+            // Fill the next buffer while the kernel sends from this one
+            fZeroCopyPinned[fCurZeroCopyBuffer] = true;
+            fCurZeroCopyBuffer = (fCurZeroCopyBuffer + 1) % kNumZeroCopyBuffers;
+            fTCPCoalesceBuffer = fZeroCopyBuffers[fCurZeroCopyBuffer];
+        }
     }
+    else
+    {
+        struct  iovec   iov[2];
+        UInt32          buffLenWritten = 0;
+
+        // skip iov[0], WriteV uses it
+        iov[1].iov_base = fTCPCoalesceBuffer;
+        iov[1].iov_len = fNumInCoalesceBuffer;
+
+        // GetOutputStream()->WriteV guarantees all or nothing for writes
+        err = this->GetOutputStream()->WriteV(iov, 2, fNumInCoalesceBuffer, &buffLenWritten, RTSPResponseStream::kAllOrNothing);
+    }
+
+#if RTSP_SESSION_INTERFACE_DEBUGGING 
+    qtss_printf("InterleavedWrite: flushing %"_U32BITARG_"\n", fNumInCoalesceBuffer);
+#endif
+
+    if (err == QTSS_NoErr)
+        fNumInCoalesceBuffer = 0;
+
+    this->ScheduleBlockedWrite();
+    this->GetSessionMutex()->Unlock();
+    return err;
+}
+
+void RTSPSessionInterface::ScheduleBlockedWrite()
+{
+    // Must be called with fTCPCoalesceMutex and fSessionMutex held, after a write.
+    // If the client is flow controlled, have the session task try again when the
+    // socket can take more, and in any case once the flush interval is over: the
+    // write event request is lost if the task asks for a read event meanwhile.
+    if ((fNumInCoalesceBuffer > 0) || (this->GetOutputStream()->GetBytesUnsent() > 0))
+    {
+        fOutputSocketP->RequestEvent(EV_WR);
+        this->SetIdleTimer(QTSServerInterface::GetServer()->GetPrefs()->GetTCPCoalesceFlushMsec());
+    }
+}
+
+Bool16 RTSPSessionInterface::CoalesceBufferAvailable()
+{
+    // Must be called with fTCPCoalesceMutex held. Only a buffer that went out
+    // with MSG_ZEROCOPY can be unavailable, until the kernel is done with it
+    if (!fZeroCopyPinned[fCurZeroCopyBuffer])
+        return true;
+    if (!fSocket.ZeroCopySendDone(fZeroCopySendIDs[fCurZeroCopyBuffer]))
+        return false;
+
+    fZeroCopyPinned[fCurZeroCopyBuffer] = false;
+    return true;
+}
+
+QTSS_Error RTSPSessionInterface::DirectInterleavedWrite(void* inBuffer, UInt32 inLen, UInt32* outLenWritten, unsigned char channel)
+{
+    if (this->GetSessionMutex()->TryLock() == false)
+        return EAGAIN;
 
     // DMS - this struct should be packed.
     //rt todo -- is this struct more portable (byte alignment could be a problem)?
@@ -290,103 +497,37 @@ QTSS_Error RTSPSessionInterface::InterleavedWrite(void* inBuffer, UInt32 inLen,
         unsigned char channel;
         UInt16      len;
     };
-    
+
     struct  iovec               iov[3];
-    QTSS_Error                  err = QTSS_NoErr;
-    
-    
+    struct RTPInterleaveHeader  rih;
 
-    // flush rules
-    if ( ( inLen > kTCPCoalesceDirectWriteSize || inLen == 0 ) && fNumInCoalesceBuffer > 0 
-        || ( inLen + fNumInCoalesceBuffer + kInteleaveHeaderSize > kTCPCoalesceBufferSize ) && fNumInCoalesceBuffer > 0
-        )
-    {
-        UInt32      buffLenWritten;
-        
-        // skip iov[0], WriteV uses it
-        iov[1].iov_base = fTCPCoalesceBuffer;
-        iov[1].iov_len = fNumInCoalesceBuffer;
-        
-        err = this->GetOutputStream()->WriteV( iov, 2, fNumInCoalesceBuffer, &buffLenWritten, RTSPResponseStream::kAllOrNothing );
+    // write direct to stream
+    rih.header = '$';
+    rih.channel = channel;
+    rih.len = htons( (UInt16)inLen);
 
-    #if RTSP_SESSION_INTERFACE_DEBUGGING 
-        qtss_printf("InterleavedWrite: flushing %li\n", fNumInCoalesceBuffer );
-    #endif
-        
-        if ( err == QTSS_NoErr )
-            fNumInCoalesceBuffer = 0;
-    }
-    
-    
-    
-    if ( err == QTSS_NoErr )
-    {
-        
-        if ( inLen > kTCPCoalesceDirectWriteSize )  
-        {
-            struct RTPInterleaveHeader  rih;
-            
-            // write direct to stream
-            rih.header = '$';
-            rih.channel = channel;
-            rih.len = htons( (UInt16)inLen);
-            
-            iov[1].iov_base = (char*)&rih;
-            iov[1].iov_len = sizeof(rih);
-            
-            iov[2].iov_base = (char*)inBuffer;
-            iov[2].iov_len = inLen;
-
-            err = this->GetOutputStream()->WriteV( iov, 3, inLen + sizeof(rih), outLenWritten, RTSPResponseStream::kAllOrNothing );
-
-        #if RTSP_SESSION_INTERFACE_DEBUGGING 
-            qtss_printf("InterleavedWrite: bypass %li\n", inLen );
-        #endif
-            
-        }
-        else
-        {
-            // coalesce with other small writes
-            
-            fTCPCoalesceBuffer[fNumInCoalesceBuffer] = '$';
-            fNumInCoalesceBuffer++;;
-            
-            fTCPCoalesceBuffer[fNumInCoalesceBuffer] = channel;
-            fNumInCoalesceBuffer++;
-            
-            //*((short*)&fTCPCoalesceBuffer[fNumInCoalesceBuffer]) = htons(inLen);
-            // if we ever turn TCPCoalesce back on, this should be optimized
-            // for processors w/o alignment restrictions as above.
-            
-            SInt16  pcketLen = htons( (UInt16) inLen);
-            ::memcpy( &fTCPCoalesceBuffer[fNumInCoalesceBuffer], &pcketLen, 2 );
-            fNumInCoalesceBuffer += 2;
-            
-            ::memcpy( &fTCPCoalesceBuffer[fNumInCoalesceBuffer], inBuffer, inLen );
-            fNumInCoalesceBuffer += inLen;
-        
-        #if RTSP_SESSION_INTERFACE_DEBUGGING 
-            qtss_printf("InterleavedWrite: coalesce %li, total bufff %li\n", inLen, fNumInCoalesceBuffer);
-        #endif
-        }
-    }
-    
-    if ( err == QTSS_NoErr )
-    {   
-        /*  if no error sure to correct outLenWritten, cuz WriteV above includes the interleave header count
-        
-             GetOutputStream()->WriteV guarantees all or nothing for writes
-             if no error, then all was written.
-        */
-        if ( outLenWritten != NULL )
-            *outLenWritten = inLen;
-    }
+    // skip iov[0], WriteV uses it
+    iov[1].iov_base = (char*)&rih;
+    iov[1].iov_len = sizeof(rih);
 
-    this->GetSessionMutex()->Unlock();
+    iov[2].iov_base = (char*)inBuffer;
+    iov[2].iov_len = inLen;
 
+    QTSS_Error err = this->GetOutputStream()->WriteV( iov, 3, inLen + sizeof(rih), outLenWritten, RTSPResponseStream::kAllOrNothing );
+
+#if RTSP_SESSION_INTERFACE_DEBUGGING 
+    qtss_printf("InterleavedWrite: bypass %"_U32BITARG_"\n", inLen );
+#endif
 
+    /*  if no error sure to correct outLenWritten, cuz WriteV above includes the interleave header count
+         if no error, then all was written.
+    */
+    if ( ( err == QTSS_NoErr ) && ( outLenWritten != NULL ) )
+        *outLenWritten = inLen;
+
+    this->ScheduleBlockedWrite();
+    this->GetSessionMutex()->Unlock();
     return err;
-    
 }
 
 /*
@@ -36,13 +36,14 @@
 
 #include "RTSPRequestStream.h"
 #include "RTSPResponseStream.h"
-#include "Task.h"
+#include "IdleTask.h"
 #include "QTSS.h"
 #include "QTSSDictionary.h"
 #include "atomic.h"
+#include "OSArena.h"
 #include "RTSPSession3GPP.h"
 
-class RTSPSessionInterface : public QTSSDictionary, public Task
+class RTSPSessionInterface : public QTSSDictionary, public IdleTask
 {
 public:
 
@@ -90,6 +91,10 @@ public:
     TCPSocket*          GetSocket()         { return &fSocket; }
     OSMutex*            GetSessionMutex()   { return &fSessionMutex; }
     
+    // Memory for the request in progress. Everything in it is freed at once
+    // when the request is cleaned up.
+    OSArena*            GetRequestArena()   { return &fRequestArena; }
+    
     UInt32              GetSessionID()      { return fSessionID; }
     
     // Request Body Length
@@ -108,11 +113,29 @@ public:
     virtual QTSS_Error WriteV(iovec* inVec, UInt32 inNumVectors, UInt32 inTotalLength, UInt32* outLenWritten);
     virtual QTSS_Error Write(void* inBuffer, UInt32 inLength, UInt32* outLenWritten, UInt32 inFlags);
     virtual QTSS_Error Read(void* ioBuffer, UInt32 inLength, UInt32* outLenRead);
+    
+    // Reads as much of the request body as has arrived and passes it to inChunkFunction
+    // in chunks, or throws it away if inChunkFunction is NULL. Returns QTSS_NoErr once
+    // the whole body has been read, EAGAIN if more is to come, or the first error
+    // inChunkFunction returns. Without a Content-Length there is nothing to read, and
+    // it returns QTSS_NoErr right away.
+    virtual QTSS_Error ReadBody(QTSS_BodyChunkFunctionPtr inChunkFunction, void* inUserData);
     virtual QTSS_Error RequestEvent(QTSS_EventType inEventMask);
 
-    // performs RTP over RTSP
+    // performs RTP over RTSP. Packets are coalesced in a per session buffer, which
+    // goes out in a single write once it is half full, the oldest packet in it is
+    // rtsp_tcp_coalesce_flush_msec old, or a packet ends a frame (RTP marker bit).
+    // While an RTSP request is in progress the packets stay in the buffer, EAGAIN
+    // is only returned once it is full. Packets that are left queued are written
+    // out by the session task, on an idle event rtsp_tcp_coalesce_flush_msec later
+    // or on a write event once a flow controlled socket can take more.
     QTSS_Error  InterleavedWrite(void* inBuffer, UInt32 inLen, UInt32* outLenWritten, unsigned char channel);
 
+    // Writes out any coalesced interleaved data, and whatever an earlier partial
+    // write left in the output stream, unless an RTSP request is in progress on
+    // another thread.
+    QTSS_Error  FlushInterleavedWrites();
+
 	// OPTIONS request
 	void		SaveOutputStream();
 	void		RevertOutputStream();
@@ -145,6 +168,8 @@ protected:
     enum
     {
         kFirstRTSPSessionID     = 1,    //UInt32
+        kBodyChunkSizeInBytes   = 4096, //UInt32, stack buffer ReadBody reads the socket into
+        kRequestArenaBlockSize  = 16384 //UInt32, holds an RTSPRequest with its dictionaries and values
     };
 
     //Each RTSP session has a unique number that identifies it.
@@ -157,20 +182,44 @@ protected:
     
     RTSPRequestStream   fInputStream;
     RTSPResponseStream  fOutputStream;
+    OSArena             fRequestArena;
     
     // Any RTP session sending interleaved data on this RTSP session must
     // be prevented from writing while an RTSP request is in progress
     OSMutex             fSessionMutex;
     
-    // for coalescing small interleaved writes into a single TCP frame
+    // for coalescing interleaved writes into a single TCP write. The buffer has its
+    // own mutex so that packets can be queued while fSessionMutex is held by a request.
+    // The lock order is fSessionMutex, then fTCPCoalesceMutex: CleanupRequest flushes
+    // with fSessionMutex held. With fTCPCoalesceMutex held, fSessionMutex is only
+    // ever tried, never waited for.
     enum
     {
-          kTCPCoalesceBufferSize = 1450 //1450 is the max data space in an TCP segment over ent
-        , kTCPCoalesceDirectWriteSize = 0 // if > this # bytes bypass coalescing and make a direct write
+          kMaxTCPCoalesceBufferSize = 65536 // upper limit for rtsp_tcp_coalesce_buffer_size
         , kInteleaveHeaderSize = 4  // '$ '+ 1 byte ch ID + 2 bytes length
+        , kNumZeroCopyBuffers = 8   // buffers to fill in turn while the kernel sends from the others
+        , kMinZeroCopyWriteSize = 16384 // the kernel docs put the break even point around 10 KB
     };
+    QTSS_Error  WriteCoalesceBuffer();
+    Bool16      CoalesceBufferAvailable();
+    void        ScheduleBlockedWrite();
+    QTSS_Error  DirectInterleavedWrite(void* inBuffer, UInt32 inLen, UInt32* outLenWritten, unsigned char channel);
+
+    OSMutex     fTCPCoalesceMutex;
     char*       fTCPCoalesceBuffer;
-    SInt32      fNumInCoalesceBuffer;
+    UInt32      fTCPCoalesceBufferSize;
+    UInt32      fNumInCoalesceBuffer;
+    SInt64      fTCPCoalesceStartTime;  // when the oldest byte in the buffer was queued
+
+    // With enable_rtsp_tcp_zerocopy full buffers are sent with MSG_ZEROCOPY, and the
+    // kernel holds on to each until the client has acked it. fTCPCoalesceBuffer is
+    // then one of fZeroCopyBuffers, which are NULL otherwise. Whether this saves CPU
+    // depends on the NIC and the kernel: measure with TCPSocket::BenchmarkZeroCopy
+    // against a remote sink before turning it on.
+    char*       fZeroCopyBuffers[kNumZeroCopyBuffers];
+    UInt32      fZeroCopySendIDs[kNumZeroCopyBuffers];
+    Bool16      fZeroCopyPinned[kNumZeroCopyBuffers];
+    UInt32      fCurZeroCopyBuffer;
 
 
     //+rt  socket we get from "accept()"
@@ -55,6 +55,8 @@
 #endif
 #include "QTSServerInterface.h"
 #include "QTSServer.h"
+#include "RTCPTask.h"
+#include "RTPPacer.h"
 
 #include <stdlib.h>
 #include <sys/stat.h>
@@ -88,9 +90,7 @@ QTSS_ServerState StartServer(XMLPrefsParser* inPrefsSource, PrefsSource* inMessa
 
 #if !MACOSXEVENTQUEUE
 
-	#ifndef __Win32__    
-    ::epollInit();
-    #else
+	#ifdef __Win32__    
     ::select_startevents();//initialize the select() implementation of the event queue        
     #endif
 
@@ -159,6 +159,7 @@ QTSS_ServerState StartServer(XMLPrefsParser* inPrefsSource, PrefsSource* inMessa
         //qtss_printf("Add threads shortask=%lu blocking=%lu\n",numShortTaskThreads, numBlockingThreads);
         TaskThreadPool::SetNumShortTaskThreads(numShortTaskThreads);
         TaskThreadPool::SetNumBlockingTaskThreads(numBlockingThreads);
+        TaskThreadPool::SetWorkStealing(sServer->GetPrefs()->GetTaskWorkStealingEnabled());
         TaskThreadPool::AddThreads(numThreads);
 		sServer->InitNumThreads(numThreads);
 		
@@ -166,6 +167,14 @@ QTSS_ServerState StartServer(XMLPrefsParser* inPrefsSource, PrefsSource* inMessa
         qtss_printf("Number of task threads: %"_U32BITARG_"\n",numThreads);
     #endif
     
+        // Each event thread owns its own epoll instance; the first one was created
+        // by Socket::Initialize, so add the rest before they get started.
+        UInt32 numEventThreads = sServer->GetPrefs()->GetNumEventThreads();
+        if (numEventThreads == 0)
+            numEventThreads = OS::GetNumProcessors();
+        if (numEventThreads > 1)
+            Socket::AddEventThreads(numEventThreads - 1);
+    
         // Start up the server's global tasks, and start listening
         TimeoutTask::Initialize();     // The TimeoutTask mechanism is task based,
                                     // we therefore must do this after adding task threads
@@ -178,6 +187,7 @@ QTSS_ServerState StartServer(XMLPrefsParser* inPrefsSource, PrefsSource* inMessa
     if (sServer->GetServerState() != qtssFatalErrorState)
     {
         IdleTask::Initialize();
+        RTPPacer::Initialize();
         Socket::StartThread();
         OSThread::Sleep(1000);
         
@@ -512,6 +522,56 @@ FILE* DisplayDebugEnabled()
 }
 
 
+void DebugLevel_2(FILE*   statusFile, FILE*   stdOut)
+{
+    // per task thread scheduler counters, to check how well work is spread over the threads
+    char theLine[128] = "";
+    UInt32 numThreads = TaskThreadPool::GetNumThreads();
+    for (UInt32 x = 0; x < numThreads; x++)
+    {
+        TaskThread* theThread = TaskThreadPool::GetThread(x);
+        qtss_snprintf(theLine, sizeof(theLine) -1, "TaskThread %2"_U32BITARG_": runs=%"_64BITARG_"u steals=%"_64BITARG_"u queue=%"_U32BITARG_"\n",
+            x, theThread->GetNumRuns(), theThread->GetNumSteals(), theThread->GetQueueDepth());
+        print_status(statusFile, stdOut, "%s", theLine);
+    }
+
+    // average allocations per RTSP request, on the heap and in the request arena
+    UInt32 numRequests = sServer->GetNumRTSPRequestsCounted();
+    if (numRequests > 0)
+    {
+        qtss_snprintf(theLine, sizeof(theLine) -1, "RTSP requests=%"_U32BITARG_" heap allocs/request=%.2f arena allocs/request=%.2f\n",
+            numRequests, (Float32)sServer->GetRTSPRequestHeapAllocs() / numRequests, (Float32)sServer->GetRTSPRequestArenaAllocs() / numRequests);
+        print_status(statusFile, stdOut, "%s", theLine);
+    }
+
+    // RTCP sockets and packets read per RTCPTask wakeup since the last status line
+    UInt32 numWakeups = 0, numSockets = 0, numPackets = 0;
+    RTCPTask::GetWakeupStats(&numWakeups, &numSockets, &numPackets);
+    if (numWakeups > 0)
+    {
+        qtss_snprintf(theLine, sizeof(theLine) -1, "RTCP wakeups=%"_U32BITARG_" sockets/wakeup=%.2f packets/wakeup=%.2f\n",
+            numWakeups, (Float32)numSockets / numWakeups, (Float32)numPackets / numWakeups);
+        print_status(statusFile, stdOut, "%s", theLine);
+    }
+
+    // RTCP generic NACK totals since startup
+    if (sServer->GetNumNackedPackets() > 0)
+    {
+        qtss_snprintf(theLine, sizeof(theLine) -1, "RTCP NACKed packets=%"_U32BITARG_" repaired=%"_U32BITARG_" late=%"_U32BITARG_" rate limited=%"_U32BITARG_"\n",
+            sServer->GetNumNackedPackets(), sServer->GetNumNackRepairs(), sServer->GetNumNackLateRepairs(), sServer->GetNumNackRateLimited());
+        print_status(statusFile, stdOut, "%s", theLine);
+    }
+
+    // RTP packets that had to wait in a pacer queue since startup, and how many wait now
+    UInt32 numPaced = sServer->GetNumPacedPackets();
+    if (numPaced > 0)
+    {
+        qtss_snprintf(theLine, sizeof(theLine) -1, "RTP paced packets=%"_U32BITARG_" avg delay=%.2f ms queued=%"_U32BITARG_" max queued=%"_U32BITARG_"\n",
+            numPaced, (Float32)sServer->GetTotalPacingDelayInUSec() / 1000 / numPaced, sServer->GetPacingQueueDepth(), sServer->GetMaxPacingQueueDepth());
+        print_status(statusFile, stdOut, "%s", theLine);
+    }
+}
+
 void DebugStatus(UInt32 debugLevel, Bool16 printHeader)
 {
         
@@ -521,6 +581,9 @@ void DebugStatus(UInt32 debugLevel, Bool16 printHeader)
     if (debugLevel > 0)
         DebugLevel_1(statusFile, stdOut, printHeader);
 
+    if (debugLevel > 1)
+        DebugLevel_2(statusFile, stdOut);
+
     if (statusFile) 
         ::fclose(statusFile);
 }
@@ -102,6 +102,7 @@ OBJECTFILES= \
 	${OBJECTDIR}/RTCPTask.o \
 	${OBJECTDIR}/RTPBandwidthTracker.o \
 	${OBJECTDIR}/RTPOverbufferWindow.o \
+	${OBJECTDIR}/RTPPacer.o \
 	${OBJECTDIR}/RTPPacketResender.o \
 	${OBJECTDIR}/RTPSession.o \
 	${OBJECTDIR}/RTPSession3GPP.o \
@@ -480,6 +481,11 @@ ${OBJECTDIR}/RTPOverbufferWindow.o: RTPOverbufferWindow.cpp
 	${RM} "$@.d"
 	$(COMPILE.cc) -g -D_REENTRANT -D__USE_POSIX -D__linux__ -I. -I.. -I../QTFileLib -I../OSMemoryLib -I../RTSPClientLib -I../APIModules -I../APICommonCode -I../APIModules/OSMemory_Modules -I../APIModules/QTSSAccessLogModule -I../APIModules/QTSSFileModule -I../APIModules/QTSSFlowControlModule -I../APIModules/QTSSReflectorModule -I../APIModules/QTSSSvrControlModule -I../APIModules/QTSSWebDebugModule -I../APIModules/QTSSWebStatsModule -I../APIModules/QTSSAuthorizeModule -I../APIModules/QTSSPOSIXFileSysModule -I../APIModules/QTSSAdminModule -I../APIModules/QTSSMP3StreamingModule -I../APIModules/QTSSRTPFileModule -I../APIModules/QTSSAccessModule -I../APIModules/QTSSHttpFileModule -I../QTFileTools/RTPFileGen.tproj -I../APIStubLib -I../CommonUtilitiesLib -I../RTCPUtilitiesLib -I../HTTPUtilitiesLib -I../RTPMetaInfoLib -I../PrefsSourceLib -include ../PlatformHeader.h -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/RTPOverbufferWindow.o RTPOverbufferWindow.cpp
 
+${OBJECTDIR}/RTPPacer.o: RTPPacer.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -D_REENTRANT -D__USE_POSIX -D__linux__ -I. -I.. -I../QTFileLib -I../OSMemoryLib -I../RTSPClientLib -I../APIModules -I../APICommonCode -I../APIModules/OSMemory_Modules -I../APIModules/QTSSAccessLogModule -I../APIModules/QTSSFileModule -I../APIModules/QTSSFlowControlModule -I../APIModules/QTSSReflectorModule -I../APIModules/QTSSSvrControlModule -I../APIModules/QTSSWebDebugModule -I../APIModules/QTSSWebStatsModule -I../APIModules/QTSSAuthorizeModule -I../APIModules/QTSSPOSIXFileSysModule -I../APIModules/QTSSAdminModule -I../APIModules/QTSSMP3StreamingModule -I../APIModules/QTSSRTPFileModule -I../APIModules/QTSSAccessModule -I../APIModules/QTSSHttpFileModule -I../QTFileTools/RTPFileGen.tproj -I../APIStubLib -I../CommonUtilitiesLib -I../RTCPUtilitiesLib -I../HTTPUtilitiesLib -I../RTPMetaInfoLib -I../PrefsSourceLib -include ../PlatformHeader.h -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/RTPPacer.o RTPPacer.cpp
+
 ${OBJECTDIR}/RTPPacketResender.o: RTPPacketResender.cpp 
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
@@ -218,6 +218,10 @@ QTSS_Error HTTPRequest::ParseRequestLine(StringParser* parser)
     // Check the version
     if (versionStr.Len > 0)
             fVersion = HTTPProtocol::GetVersion(&versionStr);
+
+    // HTTP/1.1 connections are persistent unless the client sends Connection: close,
+    // HTTP/1.0 ones only if it sends Connection: keep-alive. See ParseHeaders.
+    fRequestKeepAlive = (fVersion == http11Version);
   
     // Go past the end of line
     if (!parser->ExpectEOL())
@@ -365,13 +369,12 @@ QTSS_Error HTTPRequest::ParseHeaders(StringParser* parser)
 
 void HTTPRequest::SetKeepAlive(StrPtrLen *keepAliveValue)
 {
-    if ( sCloseString.EqualIgnoreCase(keepAliveValue->Ptr, keepAliveValue->Len) )
-            fRequestKeepAlive = sFalse;
-    else
-        {
-            Assert( sKeepAliveString.EqualIgnoreCase(keepAliveValue->Ptr, keepAliveValue->Len) );
-            fRequestKeepAlive = sTrue;
-        }
+    // The value is a list of tokens, such as "keep-alive, Upgrade". Anything
+    // without close or keep-alive in it leaves the version's default alone.
+    if ( keepAliveValue->FindStringIgnoreCase(sCloseString) != NULL )
+        fRequestKeepAlive = sFalse;
+    else if ( keepAliveValue->FindStringIgnoreCase(sKeepAliveString) != NULL )
+        fRequestKeepAlive = sTrue;
 }
 
 void HTTPRequest::PutStatusLine(StringFormatter* putStream, HTTPStatusCode status,
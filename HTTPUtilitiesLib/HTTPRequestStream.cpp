@@ -28,6 +28,8 @@ HTTPRequestStream::HTTPRequestStream(ClientSocket* sock)
     fEncodedBytesRemaining(0),
     fRequest(fRequestBuffer, 0),
     fRequestPtr(NULL),
+    fHeaderScanOffset(0),
+    fHeaderScanLines(0),
     fDecode(false),
     fPrintMsg(false)
 {}
@@ -40,6 +42,7 @@ void HTTPRequestStream::SnarfRetreat( HTTPRequestStream &fromRequest )
     Assert(fRetreatBytes < QTSS_MAX_REQUEST_BUFFER_SIZE);
     fRetreatBytes = fromRequest.fRetreatBytes;
     fEncodedBytesRemaining = fCurOffset = fRequest.Len = 0;
+    fHeaderScanOffset = fHeaderScanLines = 0;
     ::memcpy(&fRequestBuffer[0], fromRequest.fRequest.Ptr + fromRequest.fRequest.Len, fromRequest.fRetreatBytes);
 }
 
@@ -85,6 +88,7 @@ QTSS_Error HTTPRequestStream::ReadRequest()
                 
             newOffset = fRequest.Len = fRetreatBytes;
             fRetreatBytes = fRetreatBytesRead = 0;
+            fHeaderScanOffset = fHeaderScanLines = 0;
         }
 
         // We don't have any new data, so try and get some
@@ -190,9 +194,16 @@ QTSS_Error HTTPRequestStream::ReadRequest()
         Bool16 weAreDone = false;
         StringParser headerParser(&fRequest);
         
-        UInt16 lcount = 0;
+        //lines that were complete on an earlier read don't need to be looked at again,
+        //except for the last one, whose EOL may have been cut in half by that read
+        headerParser.ConsumeLength(NULL, fHeaderScanOffset);
+        UInt32 theLineStart = fHeaderScanOffset;
+        UInt16 theLinesBefore = fHeaderScanLines;
+        UInt16 lcount = fHeaderScanLines;
         while (headerParser.GetThruEOL(NULL))
         {
+            fHeaderScanOffset = theLineStart;
+            fHeaderScanLines = theLinesBefore;
             lcount++;
             if (headerParser.ExpectEOL())
             {
@@ -223,6 +234,8 @@ QTSS_Error HTTPRequestStream::ReadRequest()
                     break;
                 }
             }
+            theLineStart = headerParser.GetDataParsedLen();
+            theLinesBefore = lcount;
         }
         
         //weAreDone means we have gotten a full request
@@ -85,6 +85,11 @@ private:
     
     StrPtrLen               fRequest;
     StrPtrLen*              fRequestPtr;    // pointer to a request header
+
+    // Where the search for the end of the header picks up after a partial read:
+    // the start of the last complete line, and the number of lines before it
+    UInt32                  fHeaderScanOffset;
+    UInt16                  fHeaderScanLines;
     Bool16                  fDecode;        // should we base 64 decode?
     Bool16                  fIsDataPacket;  // is this a data packet? Like for a record?
     Bool16                  fPrintMsg;     // debugging printfs
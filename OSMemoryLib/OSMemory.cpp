@@ -45,6 +45,16 @@ OSMutex  OSMemory::sMutex;
 
 static SInt32   sMemoryErr = 0;
 
+#if __GNUC__
+#define THREAD_NUM_ALLOCS 1
+static __thread UInt32 sThreadNumAllocs = 0;
+#elif _MSC_VER
+#define THREAD_NUM_ALLOCS 1
+static __declspec(thread) UInt32 sThreadNumAllocs = 0;
+#else
+#define THREAD_NUM_ALLOCS 0
+#endif
+
 
 //
 // OPERATORS
@@ -90,8 +100,20 @@ void OSMemory::SetMemoryError(SInt32 inErr)
     sMemoryErr = inErr;
 }
 
+UInt32  OSMemory::GetThreadNumAllocs()
+{
+#if THREAD_NUM_ALLOCS
+    return sThreadNumAllocs;
+#else
+    return 0;
+#endif
+}
+
 void*   OSMemory::New(size_t inSize)
 {
+#if THREAD_NUM_ALLOCS
+    sThreadNumAllocs++;
+#endif
 #if MEMORY_DEBUGGING
     return OSMemory::DebugNew(inSize, __FILE__, __LINE__, false);
 #else